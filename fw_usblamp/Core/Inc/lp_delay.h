@@ -9,5 +9,7 @@
 
 #include <stdint.h>
 
-void LP_DELAY(uint32_t ms);
+/* Returns the part of the delay spent in STOP2 (ms), during which HAL_GetTick() stood
+ * still. A B1 long press ends the delay early. */
+uint32_t LP_DELAY(uint32_t ms);
 
@@ -13,8 +13,75 @@ uint8_t USB_CLI_IsConnected(void);
 /* Force CLI to treat USB as disconnected (safe to call from IRQ). */
 void USB_CLI_NotifyDetach(void);
 
-/* CDC write function for use by MiniPascal and other modules. */
+/*
+ * Console output for MiniPascal and other modules. Bytes are copied into a TX ring
+ * (string literals in flash are queued by reference) and handed to the non-blocking CDC
+ * TX queue by USB_CLI_TxFlush() from the main loop. Writers never wait for the host:
+ * cdc_write() returns how many bytes it took and the rest is dropped (see
+ * usb_cli_tx_stats_t). Output larger than USB_CLI_TxRoom() has to be paced by its producer.
+ */
 void cdc_write_str(const char *s);
+uint32_t cdc_write(const char *s, uint32_t len);
+void cdc_write_char(char c);
+/* Bytes the TX ring can take right now. */
+uint32_t USB_CLI_TxRoom(void);
+
+/* Hand buffered output to the CDC TX queue (USB main loop; never waits). */
+void USB_CLI_TxFlush(void);
+
+typedef struct
+{
+    uint32_t queued;        /* bytes accepted into the ring */
+    uint32_t sent;          /* bytes acknowledged by the CDC class */
+    uint32_t dropped;       /* bytes lost (ring full, or host detached) */
+    uint32_t zero_copy;     /* bytes queued by reference (flash strings) */
+    uint32_t usb_writes;    /* buffers submitted to the CDC TX queue */
+    uint32_t short_writes;  /* cdc_write() calls cut short by a full ring */
+    uint32_t max_fill;      /* ring high-water mark */
+} usb_cli_tx_stats_t;
+
+void USB_CLI_GetTxStats(usb_cli_tx_stats_t *out);
+
+/*
+ * STREAM <mask> <hz> telemetry frame (all fields little-endian):
+ *   0xA5 0x5A | len u8 | mask u8 | seq u16 | t_ms u32 | fields | crc u16
+ * len counts the bytes from mask through the last field; crc is the low 16 bits of
+ * CRC-32 (zlib) over len..last field. Fields follow in bit order for each set mask bit:
+ *   MIC   level dBFS*100 i16
+ *   FFT   LF, MF, HF dBFS*100 i16 x3
+ *   LIGHT lux u16 (saturating)
+ *   BAT   battery mV u16, VCC mV u16
+ * Values that are not available yet read USB_STREAM_NO_DATA. seq counts every frame
+ * slot, so a gap on the host side is a frame lost to a full TX ring.
+ */
+#define USB_STREAM_SYNC0        0xA5u
+#define USB_STREAM_SYNC1        0x5Au
+#define USB_STREAM_MIC          0x01u
+#define USB_STREAM_FFT          0x02u
+#define USB_STREAM_LIGHT        0x04u
+#define USB_STREAM_BAT          0x08u
+#define USB_STREAM_ALL          0x0Fu
+#define USB_STREAM_NO_DATA      ((int16_t)-32768)
+#define USB_STREAM_MAX_HZ       50u
+#define USB_STREAM_FRAME_MAX    (3u + 7u + 2u + 6u + 2u + 4u + 2u)
+
+/*
+ * BENCH - CDC throughput / latency baseline. Each run starts after its command line is
+ * echoed back as "BENCH <mode> ...\r\n" and ends with one "BENCH <mode> ..." result line.
+ *   BENCH TX <n>   the device sends n raw bytes, byte i = (i & 0xFF), then
+ *                  "BENCH TX bytes= ms= rate=B/s full=" (full = writes refused by a full
+ *                  CDC queue and retried). Any input aborts the run.
+ *   BENCH RX <n>   after "BENCH RX <n> ready" the host sends n bytes of the same
+ *                  pattern; the device reports rate and pattern errors (timing starts at
+ *                  the first byte). USB_CLI_BENCH_TIMEOUT_MS of silence ends the run.
+ *   BENCH ECHO [count] [size]
+ *                  the device sends count frames of size bytes
+ *                  {USB_BENCH_ECHO_SYNC, seq, seq+2, seq+3, ...}, one at a time; the host
+ *                  writes every frame back unchanged. Round trips (device submit to last
+ *                  echoed byte) are reported as min/p50/p90/p99/max in microseconds.
+ */
+#define USB_BENCH_ECHO_SYNC     0xECu
+#define USB_BENCH_ECHO_MAX      64u
 
 #ifdef __cplusplus
 }
@@ -36,6 +36,7 @@
 #include "lp_delay.h"
 #include "rtc.h"
 #include "memmon.h"
+#include "settings.h"
 #include "stm32u0xx_hal_pwr_ex.h"
 /* USER CODE END Includes */
 
@@ -114,6 +115,7 @@ static void Power_MinimizeLoads(void);
 static void EnterShutdown(void);
 static void B2_Hold_Service_NoSleep(uint32_t now_ms);
 static void B2_Hold_Service_Blocking(void);
+static uint8_t Buttons_Dispatch(void);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -196,6 +198,14 @@ int main(void)
   /* If battery is critically low (and no USB), park MCU in standby and retry every 1 s. */
   LowBattery_EarlyGate();
 
+  /* Load persistent settings (one indexed pass), then apply the ones owned by board code. */
+  SETTINGS_Init();
+  {
+    int32_t bright = SETTINGS_GetOr(SET_BRIGHTNESS, 255);
+    led_set_brightness((bright >= 1 && bright <= 255) ? (uint8_t)bright : 255u);
+  }
+  (void)RTC_RestoreDailyAlarm();
+
   /* Initialize PDM microphone driver (SPI1+DMA). MIC_Task() updates 50 ms windows. */
   MIC_Init();
   /* MIC_Start() is handled by the driver automatically if needed (interval/continuous). */
@@ -262,23 +272,13 @@ int main(void)
       if (usb_pin)
       {
         ux_device_stack_tasks_run();
+        USBD_CDC_ACM_TxTask();
         USB_CLI_Task();
+        USB_CLI_TxFlush();
       }
 
-      /* Debounced buttons: feed short/long events into MiniPascal (USB + battery). */
-      MP_Buttons_Poll(HAL_GetTick());
-      while (1)
-      {
-        mp_btn_id_t e = MP_Buttons_PopShort();
-        if (e == MP_BTN_NONE) break;
-        mp_notify_button_short((uint8_t)e);
-      }
-      while (1)
-      {
-        mp_btn_id_t e = MP_Buttons_PopLong();
-        if (e == MP_BTN_NONE) break;
-        mp_notify_button_long((uint8_t)e);
-      }
+      /* Button events (debounced in SysTick) into MiniPascal (USB + battery). */
+      (void)Buttons_Dispatch();
 
       /* USB mode is controlled by USB detect pin. */
       uint8_t usb_mode = usb_pin;
@@ -301,6 +301,7 @@ int main(void)
       LowBattery_Task();
       BEEP_Task();
       MIC_Task();
+      mp_flash_task();
       BL_Task();
       /* Battery safety: B2 hold >=2s forces shutdown even if program is running. */
       B2_Hold_Service_NoSleep(HAL_GetTick());
@@ -941,6 +942,12 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_Init(BL_GPIO_Port, &GPIO_InitStruct);
 
   /* USER CODE BEGIN MX_GPIO_Init_2 */
+  /* Buttons interrupt on both edges: mp_buttons times presses from the EXTI edges. */
+  GPIO_InitStruct.Pin = B1_Pin|B2_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
   /* Clear any stale pending EXTI flags before enabling IRQ. */
   __HAL_GPIO_EXTI_CLEAR_IT(B1_Pin);
   __HAL_GPIO_EXTI_CLEAR_IT(B2_Pin);
@@ -972,8 +979,12 @@ int mp_hal_getchar(void)
 
 void mp_hal_putchar(char c)
 {
-  char b[2] = {c, 0};
-  cdc_write_str(b);
+  cdc_write_char(c);
+}
+
+uint32_t mp_hal_tx_room(void)
+{
+  return USB_CLI_TxRoom();
 }
 
 uint32_t mp_hal_millis(void)
@@ -1076,35 +1087,66 @@ static void lp_delay_sleep_ms(uint32_t ms)
   }
 }
 
+/* Feed queued button events to MiniPascal; returns 1 if one of them was a B1 long press. */
+static uint8_t Buttons_Dispatch(void)
+{
+  uint8_t b1_long = 0u;
+  mp_btn_event_t ev;
+  while (MP_Buttons_Pop(&ev))
+  {
+    mp_notify_button(ev.id, ev.kind);
+    if ((ev.id == MP_BTN_B1) && (ev.kind == MP_BTN_EV_LONG)) b1_long = 1u;
+  }
+  return b1_long;
+}
+
 static uint8_t lp_delay_rtc_ready(void)
 {
   return (hrtc.Instance == RTC) ? 1u : 0u;
 }
 
-void LP_DELAY(uint32_t ms)
+/* RTC time of day in ms (1/256 s steps). The shadow registers are not updated in STOP2,
+ * so resynchronize them first. */
+static uint32_t lp_delay_rtc_ms(void)
 {
-  if (ms == 0u) return;
+  RTC_TimeTypeDef t;
+  RTC_DateTypeDef d;
+  __HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+  (void)HAL_RTC_WaitForSynchro(&hrtc);
+  __HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+  if (HAL_RTC_GetTime(&hrtc, &t, RTC_FORMAT_BIN) != HAL_OK) return 0u;
+  (void)HAL_RTC_GetDate(&hrtc, &d, RTC_FORMAT_BIN);   /* unlocks the shadow registers */
+  uint32_t sec = (uint32_t)t.Hours * 3600u + (uint32_t)t.Minutes * 60u + (uint32_t)t.Seconds;
+  uint32_t frac = t.SecondFraction + 1u;
+  return sec * 1000u + ((t.SecondFraction - t.SubSeconds) * 1000u) / frac;
+}
+
+uint32_t LP_DELAY(uint32_t ms)
+{
+  if (ms == 0u) return 0u;
 
   if (USB_IsPresent() != 0u)
   {
     HAL_Delay(ms);
-    return;
+    return 0u;
   }
 
   if ((ms < 20u) || (lp_delay_rtc_ready() == 0u))
   {
     lp_delay_sleep_ms(ms);
-    return;
+    return 0u;
   }
 
+  uint32_t stop_ms = 0u;
+
   /* RTC WUT @ RTCCLK/16 = 32768/16 = 2048 Hz (0.488 ms resolution), max ~32 s per shot. */
-  /* NOTE: On battery we also watch B1 long-hold during STOP2 delays so program switching works even inside delay(). */
-  static uint32_t s_b1_hold_ms = 0u;
+  /* NOTE: Button edges wake STOP2; a B1 long press ends the delay so program switching works inside delay(). */
   while (ms)
   {
     uint32_t chunk_ms = ms;
-    /* Keep chunks short so we can observe button release while mostly sleeping. */
-    if (chunk_ms > 50u) chunk_ms = 50u;
+    uint8_t b1_long = 0u;
+    /* One WUT shot; buttons no longer need short chunks. */
+    if (chunk_ms > 32000u) chunk_ms = 32000u;
 
     /* While beeping (LPTIM2 from HSI), avoid STOP2 so PWM stays stable. */
     if (BEEP_IsActive() != 0u)
@@ -1118,6 +1160,9 @@ void LP_DELAY(uint32_t ms)
       if (ticks < 1u) ticks = 1u;
       if (ticks > 65536u) ticks = 65536u;
 
+      uint32_t rtc0 = lp_delay_rtc_ms();
+      uint32_t tick0 = HAL_GetTick();
+      uint8_t stopped = 0u;
       s_mp_wut_fired = 0u;
       (void)HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
       __HAL_RTC_WAKEUPTIMER_CLEAR_FLAG(&hrtc, RTC_FLAG_WUTF);
@@ -1132,38 +1177,41 @@ void LP_DELAY(uint32_t ms)
         while (!s_mp_wut_fired)
         {
           B2_Hold_Service_Blocking();
-          __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
-          HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
-          SystemClock_Config();
-
-          /* If we woke because of B2, stay awake in light sleep so HAL_GetTick() can count the 2s hold. */
-          B2_Hold_Service_Blocking();
+          if (MP_Buttons_Busy() != 0u)
+          {
+            /* A press is being timed: light sleep keeps SysTick (debounce/clicks) running. */
+            HAL_PWR_EnterSLEEPMode(PWR_LOWPOWERREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+          }
+          else
+          {
+            __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
+            HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+            SystemClock_Config();
+            stopped = 1u;
+
+            /* If we woke because of B2, stay awake in light sleep so HAL_GetTick() can count the 2s hold. */
+            B2_Hold_Service_Blocking();
+          }
+          b1_long = Buttons_Dispatch();
+          if (b1_long) break;
         }
         (void)HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
       }
-    }
 
-    ms -= chunk_ms;
-
-    /* B1 long-hold (2s) triggers "next program" even if we're inside LP_DELAY (e.g., delay() in Pascal). */
-    uint8_t b1 = (HAL_GPIO_ReadPin(B1_GPIO_Port, B1_Pin) == GPIO_PIN_SET) ? 1u : 0u;
-    if (b1)
-    {
-      if (s_b1_hold_ms < (0xFFFFFFFFu - chunk_ms)) s_b1_hold_ms += chunk_ms;
-      else s_b1_hold_ms = 0xFFFFFFFFu;
-    }
-    else if (s_b1_hold_ms != 0u)
-    {
-      if (s_b1_hold_ms >= MP_BTN_LONG_MS)
+      /* Wall time the tick did not see = time spent in STOP2 (RTC wraps at midnight). */
+      if (stopped)
       {
-        s_b1_hold_ms = 0u;
-        mp_notify_button_long(1u);
-        (void)HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
-        return;
+        uint32_t wall = (lp_delay_rtc_ms() + 86400000u - rtc0) % 86400000u;
+        uint32_t ticked = HAL_GetTick() - tick0;
+        if (wall > ticked) stop_ms += wall - ticked;
       }
-      s_b1_hold_ms = 0u;
     }
+
+    /* B1 long-hold (2s) triggers "next program" even if we're inside LP_DELAY (e.g., delay() in Pascal). */
+    if (b1_long || (Buttons_Dispatch() != 0u)) return stop_ms;
+    ms -= chunk_ms;
   }
+  return stop_ms;
 }
 
 void mp_hal_lowpower_delay_ms(uint32_t ms)
@@ -1327,6 +1375,8 @@ static void EnterStop(void)
         /* If B1 is already held (e.g., wake from shutdown), accept it without entering STOP2. */
         if (B1_WaitHeld(B1_WAKE_HOLD_MS))
         {
+            /* The wake hold is handled here; programs must not see it as a long press. */
+            MP_Buttons_Discard();
             float vbat = vbat_read_blocking(50);
             if (vbat < CHARGER_VBAT_CRITICAL)
             {
@@ -1372,7 +1422,9 @@ static void EnterStop(void)
         if (woke_by_b1)
         {
             s_stop2_woke_by_b1 = 0u;
-            if (B1_WaitHeld(B1_WAKE_HOLD_MS))
+            uint8_t held = B1_WaitHeld(B1_WAKE_HOLD_MS);
+            MP_Buttons_Discard();
+            if (held)
             {
                 float vbat = vbat_read_blocking(50);
                 if (vbat < CHARGER_VBAT_CRITICAL)
@@ -1518,19 +1570,30 @@ void HAL_SYSTICK_Callback(void)
     MemMon_TickHook();
 }
 
+/*
+ * The U0 HAL reports EXTI through the rising/falling callbacks. Button edges go to
+ * mp_buttons from both; the B1 press also marks a STOP2 wake.
+ */
+void HAL_GPIO_EXTI_Rising_Callback(uint16_t GPIO_Pin)
+{
+    MP_Buttons_OnEdge(GPIO_Pin);
+    if ((GPIO_Pin == B1_Pin) && s_stop2_armed) s_stop2_woke_by_b1 = 1u;
+}
+
+void HAL_GPIO_EXTI_Falling_Callback(uint16_t GPIO_Pin)
+{
+    MP_Buttons_OnEdge(GPIO_Pin);
+}
+
+/*
+ * Known dead code: the U0 HAL never calls this callback, so the USB_Pin attach reset and
+ * detach handling below do not run. The main loop's USB_IsPresent() polling does the
+ * detach switch; it is kept until the attach reset is reviewed for the edge callbacks.
+ */
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
     static uint8_t usb_reset_done = 0;
 
-    if (GPIO_Pin == B1_Pin)
-    {
-        if (s_stop2_armed)
-        {
-            /* Short BT1 press should start lamp after STOP2 wake. */
-            s_stop2_woke_by_b1 = 1u;
-        }
-    }
-
     if (GPIO_Pin == USB_Pin)
     {
         if (USB_IsPresent() != 0u)
@@ -23,6 +23,7 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include <stdbool.h>
+#include "mp_buttons.h"
 extern LPTIM_HandleTypeDef hlptim2;
 /* USER CODE END Includes */
 
@@ -138,6 +139,7 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  MP_Buttons_Tick(HAL_GetTick());
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -8,9 +8,13 @@
 #include "alarm.h"
 #include <MiniPascal.h>
 #include "memmon.h"
+#include "settings.h"
+#include "led.h"
+#include "analog.h"
+#include "crc32.h"
+#include "fmt.h"
 
 #include <string.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -18,6 +22,8 @@
 
 #include "stm32u0xx_hal.h"
 
+extern const uint32_t __flash_data_start__;
+
 #ifndef USB_CLI_RX_CHUNK
 #define USB_CLI_RX_CHUNK 64
 #endif
@@ -26,9 +32,54 @@
 #define USB_CLI_LINE_MAX 128
 #endif
 
+/* TX ring (power of two). All console output is queued here and sent by USB_CLI_TxFlush(). */
+#ifndef USB_CLI_TX_RING
+#define USB_CLI_TX_RING 512u
+#endif
+
+/* Largest single CDC write (multiple of the 64-byte FS bulk packet). */
+#ifndef USB_CLI_TX_CHUNK
+#define USB_CLI_TX_CHUNK 256u
+#endif
+
+/* Strings in flash at least this long are queued by reference instead of copied. */
+#ifndef USB_CLI_TX_ZC_MIN
+#define USB_CLI_TX_ZC_MIN 16u
+#endif
+
+/* Input is only taken with this much ring free, so an echo or a short reply always fits. */
+#ifndef USB_CLI_TX_IN_ROOM
+#define USB_CLI_TX_IN_ROOM (USB_CLI_TX_RING / 2u)
+#endif
+
+/* BENCH: no input for this long ends an RX run or loses an ECHO ping. */
+#ifndef USB_CLI_BENCH_TIMEOUT_MS
+#define USB_CLI_BENCH_TIMEOUT_MS 3000u
+#endif
+
+#ifndef USB_CLI_BENCH_ECHO_TIMEOUT_MS
+#define USB_CLI_BENCH_ECHO_TIMEOUT_MS 500u
+#endif
+
+/* BENCH ECHO: round-trip samples kept for the percentiles (= max ping count). */
+#ifndef USB_CLI_BENCH_SAMPLES
+#define USB_CLI_BENCH_SAMPLES 64u
+#endif
+
 static char s_line[USB_CLI_LINE_MAX];
 static uint32_t s_line_len;
 
+static uint8_t  s_tx_ring[USB_CLI_TX_RING];
+static uint32_t s_tx_head;          /* free-running write index */
+static uint32_t s_tx_sub;           /* bytes handed to the CDC TX queue */
+static uint32_t s_tx_tail;          /* bytes released by the queue (sent or dropped) */
+static usb_cli_tx_stats_t s_tx_stats;
+
+/* A reply longer than the ring is written one part per pass once it has room (USB_CLI_Task). */
+typedef bool (*cli_more_fn_t)(uint8_t part);
+static cli_more_fn_t s_more_fn;
+static uint8_t s_more_part;
+
 static void cdc_writef(const char *fmt, ...);
 
 static int cli_stricmp(const char *a, const char *b)
@@ -42,79 +93,6 @@ static int cli_stricmp(const char *a, const char *b)
     return (int)(unsigned char)*a - (int)(unsigned char)*b;
 }
 
-static bool cli_is_time0_call(const char *line)
-{
-    const char *p = line;
-    while (*p == ' ' || *p == '\t') p++;
-    if (!isalpha((unsigned char)*p) && *p != '_') return false;
-    char name[16];
-    uint8_t i = 0;
-    while ((*p == '_' || isalnum((unsigned char)*p)) && i < (sizeof(name) - 1))
-        name[i++] = *p++;
-    name[i] = 0;
-    if (cli_stricmp(name, "time") != 0) return false;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != '(') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != ')') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    return (*p == 0);
-}
-
-static bool cli_is_call0(const char *line, const char *fname)
-{
-    const char *p = line;
-    while (*p == ' ' || *p == '\t') p++;
-    if (!isalpha((unsigned char)*p) && *p != '_') return false;
-    char name[16];
-    uint8_t i = 0;
-    while ((*p == '_' || isalnum((unsigned char)*p)) && i < (sizeof(name) - 1))
-        name[i++] = *p++;
-    name[i] = 0;
-    if (cli_stricmp(name, fname) != 0) return false;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != '(') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != ')') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    return (*p == 0);
-}
-
-static bool cli_is_call1_float(const char *line, const char *fname, float *out_arg)
-{
-    const char *p = line;
-    while (*p == ' ' || *p == '\t') p++;
-    if (!isalpha((unsigned char)*p) && *p != '_') return false;
-    char name[16];
-    uint8_t i = 0;
-    while ((*p == '_' || isalnum((unsigned char)*p)) && i < (sizeof(name) - 1))
-        name[i++] = *p++;
-    name[i] = 0;
-    if (cli_stricmp(name, fname) != 0) return false;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != '(') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-
-    char *end = NULL;
-    float v = strtof(p, &end);
-    if (end == NULL || end == p) return false;
-    p = end;
-
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != ')') return false;
-    p++;
-    while (*p == ' ' || *p == '\t') p++;
-    if (*p != 0) return false;
-
-    if (out_arg) *out_arg = v;
-    return true;
-}
-
 static void dbg_led_blink(uint8_t times)
 {
     /*
@@ -136,29 +114,143 @@ static void dbg_led_blink(uint8_t times)
     }
 }
 
+/* Ring segments complete in order, so the tail just follows. */
+static void cdc_tx_ring_done(const uint8_t *buf, uint32_t len, uint32_t status)
+{
+    (void)buf;
+    s_tx_tail += len;
+    if (status == 0u) s_tx_stats.sent += len;
+    else s_tx_stats.dropped += len;
+}
+
+static void cdc_tx_const_done(const uint8_t *buf, uint32_t len, uint32_t status)
+{
+    (void)buf;
+    if (status == 0u) s_tx_stats.sent += len;
+    else s_tx_stats.dropped += len;
+}
+
+/* Code flash never changes at run time (FLASH_DATA and the settings area above it do), so
+ * such strings can be sent in place. */
+static bool cdc_is_const(const char *s)
+{
+    uintptr_t a = (uintptr_t)s;
+    return (a >= FLASH_BASE) && (a < (uintptr_t)&__flash_data_start__);
+}
+
+void USB_CLI_TxFlush(void)
+{
+    while (s_tx_head != s_tx_sub)
+    {
+        uint32_t off = s_tx_sub & (USB_CLI_TX_RING - 1u);
+        uint32_t n = s_tx_head - s_tx_sub;
+        if (n > (USB_CLI_TX_RING - off)) n = USB_CLI_TX_RING - off;
+        if (n > USB_CLI_TX_CHUNK) n = USB_CLI_TX_CHUNK;
+
+        uint32_t ret = USBD_CDC_ACM_TxSubmit(&s_tx_ring[off], n, cdc_tx_ring_done);
+        if (ret == 1u)
+        {
+            /* Not connected: the queue has released everything in flight (tail == sub). */
+            s_tx_stats.dropped += s_tx_head - s_tx_sub;
+            s_tx_sub = s_tx_head;
+            s_tx_tail = s_tx_head;
+            return;
+        }
+        if (ret != 0u)
+            return;     /* queue full; retried on the next pass */
+
+        s_tx_sub += n;
+        s_tx_stats.usb_writes++;
+    }
+}
+
+uint32_t USB_CLI_TxRoom(void)
+{
+    return USB_CLI_TX_RING - (s_tx_head - s_tx_tail);
+}
+
+uint32_t cdc_write(const char *s, uint32_t len)
+{
+    if (s == NULL || len == 0u) return 0u;
+
+    if (len >= USB_CLI_TX_ZC_MIN && cdc_is_const(s))
+    {
+        /* Only if nothing copied earlier is still waiting, to keep the byte order. */
+        USB_CLI_TxFlush();
+        if (s_tx_sub == s_tx_head &&
+            USBD_CDC_ACM_TxSubmit((const uint8_t *)s, len, cdc_tx_const_done) == 0u)
+        {
+            s_tx_stats.queued += len;
+            s_tx_stats.zero_copy += len;
+            s_tx_stats.usb_writes++;
+            return len;
+        }
+    }
+
+    /* Never waits for the host: what does not fit is dropped and the caller told so. */
+    uint32_t room = USB_CLI_TxRoom();
+    uint32_t n = (len < room) ? len : room;
+    uint32_t off = s_tx_head & (USB_CLI_TX_RING - 1u);
+    uint32_t n1 = USB_CLI_TX_RING - off;
+    if (n1 > n) n1 = n;
+    memcpy(&s_tx_ring[off], s, n1);
+    memcpy(&s_tx_ring[0], s + n1, n - n1);
+    s_tx_head += n;
+    s_tx_stats.queued += n;
+    if (n != len)
+    {
+        s_tx_stats.dropped += len - n;
+        s_tx_stats.short_writes++;
+    }
+
+    uint32_t fill = s_tx_head - s_tx_tail;
+    if (fill > s_tx_stats.max_fill) s_tx_stats.max_fill = fill;
+    return n;
+}
+
+/* All-or-nothing, never waits: for output that is useless if late (telemetry). */
+static bool cdc_write_try(const void *buf, uint32_t len)
+{
+    if (USB_CLI_TxRoom() < len)
+        return false;
+    (void)cdc_write((const char *)buf, len);
+    return true;
+}
+
+void cdc_write_char(char c)
+{
+    (void)cdc_write(&c, 1u);
+}
+
 void cdc_write_str(const char *s)
 {
     if (s == NULL) return;
-    uint32_t sent = 0;
+    (void)cdc_write(s, (uint32_t)strlen(s));
+}
 
-    /* Non-blocking: if TX not ready (return=2) or not connected, just drop. */
-    (void)USBD_CDC_ACM_Transmit((uint8_t*)s, (uint32_t)strlen(s), &sent);
+void USB_CLI_GetTxStats(usb_cli_tx_stats_t *out)
+{
+    if (out) *out = s_tx_stats;
+}
+
+static void cdc_fmt_out(void *ctx, const char *s, uint32_t len)
+{
+    (void)ctx;
+    (void)cdc_write(s, len);
 }
 
+/* Formatted straight into the TX ring; literal runs of fmt may go out zero-copy. */
 static void cdc_writef(const char *fmt, ...)
 {
-    char buf[200];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    (void)FMT_VFormat(cdc_fmt_out, NULL, fmt, ap);
     va_end(ap);
-    cdc_write_str(buf);
 }
 
 static void cdc_echo_char(char c)
 {
-    uint32_t sent = 0;
-    (void)USBD_CDC_ACM_Transmit((uint8_t*)&c, 1, &sent);
+    cdc_write_char(c);
 }
 
 static void cdc_prompt(void)
@@ -176,6 +268,9 @@ static uint8_t cli_wait_enter(uint32_t timeout_ms)
         if ((timeout_ms != 0u) && ((HAL_GetTick() - t0) >= timeout_ms))
             return 0u;
 
+        USB_CLI_TxFlush();
+        USBD_CDC_ACM_TxTask();
+
         uint32_t got = 0;
         uint32_t ret = USBD_CDC_ACM_Receive(rx, sizeof(rx), &got);
         if (ret != 0)
@@ -202,6 +297,7 @@ static uint8_t s_usb_connected = 0;
 void USB_CLI_NotifyDetach(void)
 {
     s_usb_connected = 0;
+    s_more_fn = NULL;
     if (s_pascal_mode)
     {
         s_pascal_mode = 0;
@@ -209,187 +305,1026 @@ void USB_CLI_NotifyDetach(void)
     }
 }
 
-static void print_help(void)
-{
-    cdc_write_str(
-        "COMMANDS:\r\n"
-        "  HELP\r\n"
-        "  PING\r\n"
-        "  MEM         (RAM total/free/minfree)\r\n"
-        "  PASCAL      (enter interpreter; QUIT to exit)\r\n"
-        "  MICDIAG     (mic SPI/DMA diagnostics)\r\n"
-        "  MICCAL()    (interactive: quiet->ENTER, buzzer->ENTER; auto SPL estimate; saves offset)\r\n"
-        "  MICCAL(x)   (interactive: quiet->ENTER, ext audio->ENTER; x=dB SPL @ mic; saves offset)\r\n"
-        "  CHARGER     (battery %, state, VBAT)\r\n"
-        "  CHGRST      (reset charger)\r\n"
-        "  LOBATT_ENABLE (allow charging <1.7V once)\r\n"
-        "\r\n"
-        "PASCAL CALLS (same as interpreter):\r\n"
-        "  LED(i,r,g,b,w)\r\n"
-        "  LEDON(r,g,b,w)\r\n"
-        "  LEDOFF()\r\n"
-        "  DELAY(ms)\r\n"
-        "  BATTERY()\r\n"
-        "  LIGHT()\r\n"
-        "  BTN()       (0=none, 1=B1, 2=B2, 3=BL)\r\n"
-        "  RNG()\r\n"
-        "  TEMP()\r\n"
-        "  HUM()\r\n"
-        "  PRESS()\r\n"
-        "  MIC()\r\n"
-        "  MICFFT()    (prints LF,MF,HF dBFS*100)\r\n"
-        "            bands: LF=100-400 MF=400-2000 HF=2000-8000 Hz\r\n"
-        "  TIME()      (prints YY,MO,DD,HH,MM)\r\n"
-        "  TIME(sel)   (return part: 0=YY 1=MO 2=DD 3=HH 4=MM 5=SS)\r\n"
-        "  SETTIME(yy,mo,dd,hh,mm)   (set date+time, sec=0)\r\n"
-        "  SETTIME(hh,mm,ss)         (set time only, keep date)\r\n"
-        "            yy=0..99 mo=1..12 dd=1..31 hh=0..23 mm=0..59 ss=0..59\r\n"
-        "  ALARM()     (1 while alarm is running, else 0)\r\n"
-        "  SETALARM(hh,mm[,dur])     (daily alarm, dur seconds, 0 disables)\r\n"
-        "            hh=0..23 mm=0..59 dur=1..255 (default 30)\r\n"
-        "  BEEP(freq,vol,ms)\r\n"
-        "\r\n"
-        "NOTES:\r\n"
-        "  Use parentheses and commas in calls.\r\n"
-        "\r\n");
+/*
+ * STREAM: binary telemetry frames from cached driver values (layout in usb_cli.h).
+ * A frame that does not fit in the TX ring is skipped, not waited for; its sequence
+ * number is still used, so the host sees the gap.
+ */
+typedef struct
+{
+    uint8_t  mask;
+    uint16_t period_ms;
+    uint16_t seq;
+    uint32_t next_ms;
+    uint32_t frames;
+    uint32_t lost;
+} cli_stream_t;
+
+static cli_stream_t s_stream;
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p = put_u16(p, (uint16_t)v);
+    return put_u16(p, (uint16_t)(v >> 16));
 }
 
+static uint16_t volts_to_mv(float v)
+{
+    if (v <= 0.0f) return 0u;
+    if (v >= 65.535f) return 0xFFFFu;
+    return (uint16_t)(v * 1000.0f + 0.5f);
+}
 
+static void stream_send_frame(uint32_t now)
+{
+    uint8_t f[USB_STREAM_FRAME_MAX];
+    uint8_t *p = &f[3];
+    *p++ = s_stream.mask;
+    p = put_u16(p, s_stream.seq);
+    p = put_u32(p, now);
 
+    if (s_stream.mask & USB_STREAM_MIC)
+    {
+        float dbfs = 0.0f;
+        int16_t v = USB_STREAM_NO_DATA;
+        if (MIC_GetLast50msEx(&dbfs, NULL, NULL) == MIC_ERR_OK)
+            v = (int16_t)(dbfs * 100.0f);
+        p = put_u16(p, (uint16_t)v);
+    }
+    if (s_stream.mask & USB_STREAM_FFT)
+    {
+        int16_t lf = USB_STREAM_NO_DATA, mf = USB_STREAM_NO_DATA, hf = USB_STREAM_NO_DATA;
+        if (MIC_FFT_GetLastBinsDbX100(&lf, &mf, &hf) != MIC_ERR_OK)
+            lf = mf = hf = USB_STREAM_NO_DATA;
+        p = put_u16(p, (uint16_t)lf);
+        p = put_u16(p, (uint16_t)mf);
+        p = put_u16(p, (uint16_t)hf);
+    }
+    if (s_stream.mask & USB_STREAM_LIGHT)
+    {
+        float lux = ANALOG_GetLight();
+        p = put_u16(p, (lux <= 0.0f) ? 0u : ((lux >= 65535.0f) ? 0xFFFFu : (uint16_t)lux));
+    }
+    if (s_stream.mask & USB_STREAM_BAT)
+    {
+        p = put_u16(p, volts_to_mv(ANALOG_GetBat()));
+        p = put_u16(p, volts_to_mv(ANALOG_GetVcc()));
+    }
 
+    f[0] = USB_STREAM_SYNC0;
+    f[1] = USB_STREAM_SYNC1;
+    f[2] = (uint8_t)(p - &f[3]);
+    p = put_u16(p, (uint16_t)CRC32_Calc(&f[2], (uint32_t)(p - &f[2])));
 
+    if (cdc_write_try(f, (uint32_t)(p - f))) s_stream.frames++;
+    else s_stream.lost++;
+    s_stream.seq++;
+}
 
-static void handle_line(char *line)
+static void stream_task(void)
 {
-    while (*line == ' ' || *line == '\t') line++;
-    if (*line == '\0') return;
+    if (s_stream.mask == 0u) return;
+    uint32_t now = HAL_GetTick();
+    if ((int32_t)(now - s_stream.next_ms) < 0) return;
 
-    /* normalize CRLF */
-    size_t n = strlen(line);
-    while (n && (line[n-1] == '\r' || line[n-1] == '\n'))
-        line[--n] = '\0';
+    s_stream.next_ms += s_stream.period_ms;
+    /* Fell behind by more than a period (e.g. blocking command): resync instead of bursting.
+     * The skipped slots use up their sequence numbers too, so the host sees them as lost. */
+    if ((int32_t)(now - s_stream.next_ms) >= 0)
+    {
+        uint32_t skipped = (now - s_stream.next_ms) / s_stream.period_ms + 1u;
+        s_stream.lost += skipped;
+        s_stream.seq = (uint16_t)(s_stream.seq + skipped);
+        s_stream.next_ms = now + s_stream.period_ms;
+    }
+    stream_send_frame(now);
+}
+
+static void stream_stop(void)
+{
+    if (s_stream.mask == 0u) return;
+    s_stream.mask = 0u;
+    cdc_writef("\r\nSTREAM OFF frames=%lu lost=%lu\r\n",
+               (unsigned long)s_stream.frames, (unsigned long)s_stream.lost);
+}
 
-    if (strcmp(line, "help") == 0)
+static void cli_stream(const char *args)
+{
+    char *end = NULL;
+    unsigned long mask = strtoul(args, &end, 0);
+    unsigned long hz = (end && end != args) ? strtoul(end, NULL, 10) : 0ul;
+    mask &= USB_STREAM_ALL;
+    if (mask == 0ul || hz < 1ul || hz > USB_STREAM_MAX_HZ)
     {
-        print_help();
+        cdc_writef("ERR use: stream <mask 1-%u> <hz 1-%u>\r\n",
+                   (unsigned)USB_STREAM_ALL, (unsigned)USB_STREAM_MAX_HZ);
         return;
     }
 
-    if (strcmp(line, "ping") == 0)
+    memset(&s_stream, 0, sizeof(s_stream));
+    s_stream.period_ms = (uint16_t)(1000ul / hz);
+    s_stream.next_ms = HAL_GetTick() + s_stream.period_ms;
+    cdc_writef("STREAM mask=0x%02lX %luHz (any key stops)\r\n", mask, hz);
+    s_stream.mask = (uint8_t)mask;
+}
+
+/*
+ * BENCH: CDC throughput and latency baseline (protocol in usb_cli.h).
+ * TX data goes straight to USBD_CDC_ACM_Transmit() from a flash pattern, after the
+ * console ring has drained, so the numbers are those of the CDC path itself.
+ */
+typedef enum
+{
+    BENCH_IDLE = 0,
+    BENCH_TX,
+    BENCH_RX,
+    BENCH_ECHO,
+} bench_mode_t;
+
+typedef struct
+{
+    uint8_t  mode;
+    uint8_t  size;          /* ECHO frame size */
+    uint8_t  pending;       /* ECHO: frame sent, echo not complete */
+    uint8_t  refused;       /* the current write was refused at least once */
+    uint16_t count;         /* ECHO pings requested */
+    uint16_t pings;         /* ECHO pings sent */
+    uint16_t n;             /* ECHO samples */
+    uint32_t total;         /* TX/RX bytes requested */
+    uint32_t done;          /* TX bytes queued / RX bytes received / ECHO bytes of this ping */
+    uint32_t t0_ms;
+    uint32_t t_last_ms;
+    uint32_t t0_us;
+    uint32_t full;          /* writes refused by a full queue (once each, not per retry) */
+    uint32_t errors;        /* RX/ECHO bytes that broke the pattern */
+    uint32_t lost;          /* ECHO pings without a complete echo */
+    uint8_t  buf[USB_BENCH_ECHO_MAX];
+    uint16_t us[USB_CLI_BENCH_SAMPLES];
+} cli_bench_t;
+
+static cli_bench_t s_bench;
+
+#define BENCH_P4(n)     (n), (n) + 1, (n) + 2, (n) + 3
+#define BENCH_P16(n)    BENCH_P4(n), BENCH_P4((n) + 4), BENCH_P4((n) + 8), BENCH_P4((n) + 12)
+#define BENCH_P64(n)    BENCH_P16(n), BENCH_P16((n) + 16), BENCH_P16((n) + 32), BENCH_P16((n) + 48)
+
+/* Byte i of a TX/RX run is (i & 0xFF); in flash so Transmit() can send it in place. */
+static const uint8_t s_bench_pattern[256] =
+{
+    BENCH_P64(0), BENCH_P64(64), BENCH_P64(128), BENCH_P64(192)
+};
+
+/* Microseconds from HAL tick + SysTick down-counter (1 kHz tick). */
+static uint32_t bench_us(void)
+{
+    uint32_t ms, val;
+    do
     {
-        cdc_write_str("pong\r\n");
+        ms = HAL_GetTick();
+        val = SysTick->VAL;
+    } while (ms != HAL_GetTick());
+    uint32_t load = SysTick->LOAD + 1u;
+    return ms * 1000u + ((load - val) * 1000u) / load;
+}
+
+static uint32_t bench_rate(uint32_t bytes, uint32_t ms)
+{
+    if (ms == 0u) ms = 1u;
+    return (bytes / ms) * 1000u + ((bytes % ms) * 1000u) / ms;
+}
+
+/* Console output queued before the run must go first (same CDC queue). */
+static bool bench_console_idle(void)
+{
+    USB_CLI_TxFlush();
+    return (s_tx_sub == s_tx_head);
+}
+
+static void bench_report(const char *why)
+{
+    uint32_t ms = s_bench.t_last_ms - s_bench.t0_ms;
+    if (s_bench.mode == BENCH_TX)
+    {
+        cdc_writef("\r\nBENCH TX%s bytes=%lu ms=%lu rate=%luB/s full=%lu\r\n", why,
+                   (unsigned long)s_bench.done, (unsigned long)ms,
+                   (unsigned long)bench_rate(s_bench.done, ms), (unsigned long)s_bench.full);
+    }
+    else if (s_bench.mode == BENCH_RX)
+    {
+        cdc_writef("BENCH RX%s bytes=%lu/%lu ms=%lu rate=%luB/s errors=%lu\r\n", why,
+                   (unsigned long)s_bench.done, (unsigned long)s_bench.total, (unsigned long)ms,
+                   (unsigned long)bench_rate(s_bench.done, ms), (unsigned long)s_bench.errors);
+    }
+    else if (s_bench.mode == BENCH_ECHO)
+    {
+        uint16_t *v = s_bench.us;
+        uint16_t n = s_bench.n;
+        for (uint16_t i = 1; i < n; i++)
+        {
+            uint16_t x = v[i];
+            uint16_t j = i;
+            for (; j > 0u && v[j - 1u] > x; j--) v[j] = v[j - 1u];
+            v[j] = x;
+        }
+        uint16_t p50 = 0, p90 = 0, p99 = 0, max = 0;
+        if (n)
+        {
+            p50 = v[(n * 50u) / 100u];
+            p90 = v[(n * 90u) / 100u];
+            p99 = v[(n * 99u) / 100u];
+            max = v[n - 1u];
+        }
+        cdc_writef("\r\nBENCH ECHO%s n=%u size=%u lost=%lu errors=%lu full=%lu "
+                   "min=%uus p50=%uus p90=%uus p99=%uus max=%uus\r\n", why,
+                   (unsigned)n, (unsigned)s_bench.size, (unsigned long)s_bench.lost,
+                   (unsigned long)s_bench.errors, (unsigned long)s_bench.full,
+                   (unsigned)(n ? v[0] : 0u), (unsigned)p50, (unsigned)p90, (unsigned)p99, (unsigned)max);
+    }
+    s_bench.mode = BENCH_IDLE;
+    cdc_prompt();
+}
+
+static void bench_tx_task(void)
+{
+    if (!bench_console_idle()) return;
+    if (s_bench.t0_ms == 0u) s_bench.t0_ms = HAL_GetTick();
+
+    while (s_bench.done < s_bench.total)
+    {
+        uint32_t off = s_bench.done & 0xFFu;
+        uint32_t n = 256u - off;
+        if (n > (s_bench.total - s_bench.done)) n = s_bench.total - s_bench.done;
+
+        uint32_t sent = 0;
+        uint32_t ret = USBD_CDC_ACM_Transmit((uint8_t *)&s_bench_pattern[off], n, &sent);
+        if (ret == 1u)
+        {
+            s_bench.mode = BENCH_IDLE;     /* host gone; nothing to report to */
+            return;
+        }
+        if (ret == 2u)
+        {
+            if (!s_bench.refused) s_bench.full++;
+            s_bench.refused = 1u;
+            return;
+        }
+        s_bench.refused = 0u;
+        s_bench.done += n;
+    }
+
+    if (USBD_CDC_ACM_TxPending() == 0u)
+    {
+        s_bench.t_last_ms = HAL_GetTick();
+        bench_report("");
+    }
+}
+
+static void bench_echo_task(void)
+{
+    uint32_t now = HAL_GetTick();
+    if (s_bench.pending)
+    {
+        if ((now - s_bench.t_last_ms) < USB_CLI_BENCH_ECHO_TIMEOUT_MS) return;
+        s_bench.pending = 0u;
+        s_bench.lost++;
+    }
+    if (s_bench.pings >= s_bench.count)
+    {
+        bench_report("");
         return;
     }
+    if (!bench_console_idle()) return;
+
+    uint8_t seq = (uint8_t)s_bench.pings;
+    s_bench.buf[0] = USB_BENCH_ECHO_SYNC;
+    s_bench.buf[1] = seq;
+    for (uint8_t i = 2; i < s_bench.size; i++) s_bench.buf[i] = (uint8_t)(seq + i);
 
-    if (cli_stricmp(line, "mem") == 0)
+    uint32_t sent = 0;
+    uint32_t ret = USBD_CDC_ACM_Transmit(s_bench.buf, s_bench.size, &sent);
+    if (ret == 1u)
+    {
+        s_bench.mode = BENCH_IDLE;
+        return;
+    }
+    if (ret == 2u)
     {
-        uint32_t total = 0, free = 0, min_free = 0, min_tick_ms = 0;
-        char min_dt[RTC_DATETIME_STRING_SIZE];
-        memset(min_dt, 0, sizeof(min_dt));
-        MemMon_Get(&total, &free, &min_free, &min_tick_ms, min_dt, sizeof(min_dt));
-        cdc_writef("RAM: total=%luB free=%luB minfree=%luB\r\n",
-                   (unsigned long)total, (unsigned long)free, (unsigned long)min_free);
-        cdc_writef("RAM: uptime_ms=%lu minfree_at=%s minfree_uptime_ms=%lu\r\n",
-                   (unsigned long)HAL_GetTick(),
-                   min_dt[0] ? min_dt : "N/A",
-                   (unsigned long)min_tick_ms);
+        if (!s_bench.refused) s_bench.full++;
+        s_bench.refused = 1u;
         return;
     }
+    s_bench.refused = 0u;
+    s_bench.t0_us = bench_us();
+    s_bench.t_last_ms = now;
+    s_bench.done = 0u;
+    s_bench.pending = 1u;
+    s_bench.pings++;
+}
+
+static void bench_input(const uint8_t *rx, uint32_t got)
+{
+    if (got == 0u) return;
 
-    if (cli_stricmp(line, "micdiag") == 0)
+    if (s_bench.mode == BENCH_TX)
     {
-        MIC_WriteDiag(cdc_write_str);
+        s_bench.t_last_ms = HAL_GetTick();
+        bench_report(" aborted");
         return;
     }
 
-    if (cli_stricmp(line, "miccal") == 0 || cli_is_call0(line, "miccal"))
+    if (s_bench.mode == BENCH_RX)
     {
-        mic_err_t st = MIC_CalibrateInteractiveAuto(cdc_write_str, cli_wait_enter, BEEP);
-        if (st != MIC_ERR_OK)
+        uint32_t now = HAL_GetTick();
+        if (s_bench.done == 0u) s_bench.t0_ms = now;
+        for (uint32_t i = 0; i < got && s_bench.done < s_bench.total; i++, s_bench.done++)
         {
-            const char *msg = MIC_LastErrorMsg();
-            cdc_writef("ERR miccal %s(%ld) msg=%s\r\n",
-                       MIC_ErrName(st), (long)st, msg ? msg : "");
+            if (rx[i] != (uint8_t)s_bench.done) s_bench.errors++;
         }
+        s_bench.t_last_ms = now;
+        if (s_bench.done >= s_bench.total) bench_report("");
         return;
     }
 
-    float manual_spl_db = 0.0f;
-    if (cli_is_call1_float(line, "miccal", &manual_spl_db))
+    /* ECHO */
+    for (uint32_t i = 0; i < got; i++)
     {
-        mic_err_t st = MIC_CalibrateInteractiveManualSpl(manual_spl_db, cdc_write_str, cli_wait_enter);
-        if (st != MIC_ERR_OK)
+        if (!s_bench.pending || rx[i] != s_bench.buf[s_bench.done])
         {
-            const char *msg = MIC_LastErrorMsg();
-            cdc_writef("ERR miccal %s(%ld) msg=%s\r\n",
-                       MIC_ErrName(st), (long)st, msg ? msg : "");
+            s_bench.errors++;
+            continue;
         }
+        if (++s_bench.done < s_bench.size) continue;
+
+        uint32_t us = bench_us() - s_bench.t0_us;
+        if (s_bench.n < USB_CLI_BENCH_SAMPLES)
+            s_bench.us[s_bench.n++] = (us > 0xFFFFu) ? 0xFFFFu : (uint16_t)us;
+        s_bench.pending = 0u;
+    }
+}
+
+static void bench_task(void)
+{
+    if (s_bench.mode == BENCH_TX)
+    {
+        bench_tx_task();
+    }
+    else if (s_bench.mode == BENCH_RX)
+    {
+        uint32_t now = HAL_GetTick();
+        if ((now - s_bench.t_last_ms) >= USB_CLI_BENCH_TIMEOUT_MS)
+            bench_report(" timeout");
+    }
+    else if (s_bench.mode == BENCH_ECHO)
+    {
+        bench_echo_task();
+    }
+}
+
+static void cli_bench(const char *args)
+{
+    char mode[6];
+    uint8_t i = 0;
+    while (*args && *args != ' ' && *args != '\t' && i < (sizeof(mode) - 1))
+        mode[i++] = (char)tolower((unsigned char)*args++);
+    mode[i] = 0;
+
+    char *end = NULL;
+    unsigned long a = strtoul(args, &end, 10);
+    unsigned long b = (end && end != args) ? strtoul(end, NULL, 10) : 0ul;
+
+    memset(&s_bench, 0, sizeof(s_bench));
+    s_bench.t_last_ms = HAL_GetTick();
+    if (strcmp(mode, "tx") == 0 && a > 0ul)
+    {
+        s_bench.total = (uint32_t)a;
+        cdc_writef("BENCH TX %lu\r\n", a);
+        s_bench.mode = BENCH_TX;
+    }
+    else if (strcmp(mode, "rx") == 0 && a > 0ul)
+    {
+        s_bench.total = (uint32_t)a;
+        cdc_writef("BENCH RX %lu ready\r\n", a);
+        s_bench.mode = BENCH_RX;
+    }
+    else if (strcmp(mode, "echo") == 0)
+    {
+        if (a == 0ul) a = 32ul;
+        if (b == 0ul) b = 16ul;
+        if (a > USB_CLI_BENCH_SAMPLES || b < 2ul || b > USB_BENCH_ECHO_MAX)
+        {
+            cdc_writef("ERR use: bench echo [n 1-%u] [size 2-%u]\r\n",
+                       (unsigned)USB_CLI_BENCH_SAMPLES, (unsigned)USB_BENCH_ECHO_MAX);
+            return;
+        }
+        s_bench.count = (uint16_t)a;
+        s_bench.size = (uint8_t)b;
+        cdc_writef("BENCH ECHO %lu %lu\r\n", a, b);
+        s_bench.mode = BENCH_ECHO;
+    }
+    else
+    {
+        cdc_write_str("ERR use: bench tx <bytes> | bench rx <bytes> | bench echo [n] [size]\r\n");
+    }
+}
+
+/* CONFIG [key [value]] | CONFIG ERASE - persistent settings (settings.h). */
+static void cli_config(const char *args)
+{
+    char key[12];
+    uint8_t i = 0;
+    while (*args == ' ' || *args == '\t') args++;
+    while (*args && *args != ' ' && *args != '\t' && i < (sizeof(key) - 1))
+        key[i++] = (char)tolower((unsigned char)*args++);
+    key[i] = 0;
+    while (*args == ' ' || *args == '\t') args++;
+
+    if (key[0] == 0)
+    {
+        SETTINGS_WriteAll(cdc_write_str);
+        return;
+    }
+    if (strcmp(key, "erase") == 0)
+    {
+        cdc_write_str(SETTINGS_Erase() ? "OK (defaults after reset)\r\n" : "ERR flash\r\n");
         return;
     }
 
-    if (strcmp(line, "pascal") == 0 || strcmp(line, "PASCAL") == 0)
+    settings_key_t k = SETTINGS_KeyByName(key);
+    if (k == SET_NONE)
     {
-        s_pascal_mode = 1;
-        mp_start_session();
+        cdc_write_str("ERR key (miccal, alarm, bright, slot)\r\n");
+        return;
+    }
+    if (*args == 0)
+    {
+        int32_t v = 0;
+        if (SETTINGS_Get(k, &v)) cdc_writef("%s=%ld\r\n", key, (long)v);
+        else cdc_writef("%s=(default)\r\n", key);
+        return;
+    }
+    if (k == SET_ALARM)
+    {
+        cdc_write_str("ERR use SETALARM(hh,mm[,dur])\r\n");
         return;
     }
 
-    if (cli_is_time0_call(line))
+    char *end = NULL;
+    long v = strtol(args, &end, 10);
+    if (end == args)
+    {
+        cdc_write_str("ERR value\r\n");
+        return;
+    }
+    if ((k == SET_BRIGHTNESS && (v < 1 || v > 255)) ||
+        (k == SET_DEFAULT_SLOT && (v < 0 || v > (long)MP_FLASH_SLOT_COUNT)) ||
+        (k == SET_MIC_CAL_X100 && (v < -32768 || v > 32767)))
     {
-        RTC_WriteTimeYMDHM(cdc_write_str);
+        cdc_write_str("ERR range\r\n");
+        return;
+    }
+    if (!SETTINGS_Set(k, (int32_t)v))
+    {
+        cdc_write_str("ERR flash\r\n");
         return;
     }
 
-    if (cli_is_call0(line, "micfft"))
+    /* Apply right away where the owner keeps a RAM copy. */
+    if (k == SET_BRIGHTNESS)
     {
-        int16_t lf = 0, mf = 0, hf = 0;
-        mic_err_t st = MIC_FFT_WaitBinsDbX100(1000u, &lf, &mf, &hf);
-        if (st != MIC_ERR_OK)
+        led_set_brightness((uint8_t)v);
+    }
+    else if (k == SET_MIC_CAL_X100)
+    {
+        float gain = 1.0f;
+        MIC_CalGet(&gain, NULL);
+        MIC_CalSet(gain, (float)v / 100.0f);
+    }
+    cdc_write_str("OK\r\n");
+}
+
+/* HELP is longer than the TX ring: USB_CLI_Task() writes it a line per pass (help_more). */
+static const char *const s_help_lines[] =
+{
+    "COMMANDS:\r\n",
+    "  HELP\r\n",
+    "  PING\r\n",
+    "  MEM         (RAM total/free/minfree)\r\n",
+    "  PASCAL      (enter interpreter; QUIT to exit)\r\n",
+    "  MICDIAG     (mic SPI/DMA diagnostics)\r\n",
+    "  MICCONF [d [w [n [p [a]]]]]  (mic decim 4..32, window ms, DMA words, powersave ms,\r\n",
+    "              adaptive max gap ms (0=off); no args shows config and mic duty)\r\n",
+    "  MICCAL()    (interactive: quiet->ENTER, buzzer->ENTER; auto SPL estimate; saves offset)\r\n",
+    "  MICCAL(x)   (interactive: quiet->ENTER, ext audio->ENTER; x=dB SPL @ mic; saves offset)\r\n",
+    "  CHARGER     (battery %, state, VBAT)\r\n",
+    "  CHGRST      (reset charger)\r\n",
+    "  LOBATT_ENABLE (allow charging <1.7V once)\r\n",
+    "  CONFIG      (list settings; CONFIG key value; CONFIG ERASE)\r\n",
+    "            keys: miccal (cdB) bright (1-255) slot (0=first) alarm (read-only)\r\n",
+    "  TXSTAT      (console TX counters; TXSTAT RESET clears)\r\n",
+    "  STREAM m hz (binary telemetry frames; m: 1=MIC 2=FFT 4=LIGHT 8=BAT; any key stops)\r\n",
+    "  BENCH TX n  (send n pattern bytes, report B/s; any key aborts)\r\n",
+    "  BENCH RX n  (receive n pattern bytes, report B/s and errors)\r\n",
+    "  BENCH ECHO [n] [size]  (n pings the host echoes back; RTT percentiles in us)\r\n",
+    "\r\n",
+    "PASCAL CALLS (same as interpreter):\r\n",
+    "  LED(i,r,g,b,w)\r\n",
+    "  LEDON(r,g,b,w)\r\n",
+    "  LEDOFF()\r\n",
+    "  DELAY(ms)\r\n",
+    "  BATTERY()\r\n",
+    "  LIGHT()\r\n",
+    "  BTN()       next button event (0=none, 1=B1, 2=B2, 3=BL;\r\n",
+    "              +10 double, +20 triple, +30 hold repeat, +40 long)\r\n",
+    "  RNG()\r\n",
+    "  TEMP()\r\n",
+    "  HUM()\r\n",
+    "  PRESS()\r\n",
+    "  MIC()\r\n",
+    "  MICFFT()    (prints LF,MF,HF dBFS*100)\r\n",
+    "            bands: LF=100-400 MF=400-2000 HF=2000-8000 Hz\r\n",
+    "  MICBANDS(n) (prints n log-spaced bands 100-8000 Hz, dBFS*100)\r\n",
+    "  MICCONF(d[,w[,n[,p[,a]]]])  (same as MICCONF d w n p a, returns 0 or error)\r\n",
+    "  BEAT()      (prints beats,onsets,BPM*10,phase 0..255; starts the mic)\r\n",
+    "  TIME()      (prints YY,MO,DD,HH,MM)\r\n",
+    "  TIME(sel)   (return part: 0=YY 1=MO 2=DD 3=HH 4=MM 5=SS)\r\n",
+    "  SETTIME(yy,mo,dd,hh,mm)   (set date+time, sec=0)\r\n",
+    "  SETTIME(hh,mm,ss)         (set time only, keep date)\r\n",
+    "            yy=0..99 mo=1..12 dd=1..31 hh=0..23 mm=0..59 ss=0..59\r\n",
+    "  ALARM()     (1 while alarm is running, else 0)\r\n",
+    "  SETALARM(hh,mm[,dur])     (daily alarm, dur seconds, 0 disables)\r\n",
+    "            hh=0..23 mm=0..59 dur=1..255 (default 30)\r\n",
+    "  BEEP(freq,vol,ms)\r\n",
+    "\r\n",
+    "NOTES:\r\n",
+    "  Use parentheses and commas in calls.\r\n",
+    "\r\n",
+};
+
+#define HELP_LINES (sizeof(s_help_lines) / sizeof(s_help_lines[0]))
+
+static bool help_more(uint8_t part)
+{
+    if (part < HELP_LINES)
+        cdc_write_str(s_help_lines[part]);
+    return (part + 1u) < HELP_LINES;
+}
+
+
+
+
+
+
+/*
+ * Command dispatch.
+ * A line is tokenized once into a name plus arguments, either
+ *   WORD form:  name [arg ...]      (rest = text after the name)
+ *   CALL form:  name(arg, ...)      (argv = trimmed argument strings)
+ * and looked up by hash in s_cmds[]; CALL-form names not in the table go to the
+ * MiniPascal builtin table (same hash, mp_builtin_find_hash()).
+ */
+#define CLI_FORM_WORD   0x01u
+#define CLI_FORM_CALL   0x02u
+#define CLI_MAX_ARGS    8u
+#define CLI_NAME_MAX    16u
+
+typedef struct
+{
+    char        name[CLI_NAME_MAX];     /* lower case */
+    uint16_t    hash;                   /* mp_name_hash(name) */
+    uint8_t     form;
+    uint8_t     argc;
+    const char *rest;
+    char       *argv[CLI_MAX_ARGS];
+} cli_tok_t;
+
+typedef struct
+{
+    const char *name;
+    uint16_t    hash;
+    uint8_t     forms;
+    uint8_t     min_args;
+    uint8_t     max_args;
+    void      (*fn)(const cli_tok_t *t);
+} cli_cmd_t;
+
+static bool cli_tokenize(char *line, cli_tok_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (!isalpha((unsigned char)*p) && *p != '_') return false;
+
+    uint8_t i = 0;
+    while (*p == '_' || isalnum((unsigned char)*p))
+    {
+        if (i >= (CLI_NAME_MAX - 1u)) return false;
+        t->name[i++] = (char)tolower((unsigned char)*p++);
+    }
+    t->name[i] = 0;
+    t->hash = mp_name_hash(t->name);
+    while (*p == ' ' || *p == '\t') p++;
+
+    if (*p != '(')
+    {
+        if (p[0] != 0 && p[-1] != ' ' && p[-1] != '\t') return false;
+        t->form = CLI_FORM_WORD;
+        t->rest = p;
+        while (*p)
         {
-            const char *msg = MIC_LastErrorMsg();
-            cdc_writef("ERR micfft %s(%ld) msg=%s\r\n",
-                       MIC_ErrName(st), (long)st, msg ? msg : "");
+            if (t->argc < 0xFFu) t->argc++;
+            while (*p && *p != ' ' && *p != '\t') p++;
+            while (*p == ' ' || *p == '\t') p++;
         }
-        else
+        return true;
+    }
+
+    t->form = CLI_FORM_CALL;
+    p++;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == ')')
+    {
+        p++;
+    }
+    else
+    {
+        while (1)
         {
-            cdc_writef("%d,%d,%d\r\n", (int)lf, (int)mf, (int)hf);
+            while (*p == ' ' || *p == '\t') p++;
+            char *a = p;
+            while (*p && *p != ',' && *p != ')') p++;
+            if (*p == 0 || t->argc >= CLI_MAX_ARGS) return false;
+            char sep = *p;
+            char *e = p;
+            while (e > a && (e[-1] == ' ' || e[-1] == '\t')) e--;
+            *e = 0;
+            t->argv[t->argc++] = a;
+            p++;
+            if (sep == ')') break;
         }
-        return;
     }
+    while (*p == ' ' || *p == '\t') p++;
+    return (*p == 0);
+}
 
-    if (cli_stricmp(line, "charger") == 0)
+static bool cli_arg_int(const char *s, int32_t *out)
+{
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != 0) return false;
+    *out = (int32_t)v;
+    return true;
+}
+
+static void cmd_help(const cli_tok_t *t)
+{
+    (void)t;
+    s_more_fn = help_more;
+    s_more_part = 0u;
+}
+
+static void cmd_ping(const cli_tok_t *t)
+{
+    (void)t;
+    cdc_write_str("pong\r\n");
+}
+
+static void cmd_txstat(const cli_tok_t *t)
+{
+    if (t->argc == 1u)
     {
-        CHARGER_WriteStatus(cdc_write_str);
+        if (cli_stricmp(t->rest, "reset") != 0)
+        {
+            cdc_write_str("ERR use: txstat [reset]\r\n");
+            return;
+        }
+        memset(&s_tx_stats, 0, sizeof(s_tx_stats));
+        cdc_write_str("OK\r\n");
         return;
     }
+    usb_cli_tx_stats_t st = s_tx_stats;
+    cdc_writef("TX queued=%lu sent=%lu dropped=%lu zc=%lu writes=%lu short=%lu fill=%lu max=%lu/%u\r\n",
+               (unsigned long)st.queued, (unsigned long)st.sent, (unsigned long)st.dropped,
+               (unsigned long)st.zero_copy, (unsigned long)st.usb_writes, (unsigned long)st.short_writes,
+               (unsigned long)(s_tx_head - s_tx_tail), (unsigned long)st.max_fill,
+               (unsigned)USB_CLI_TX_RING);
+}
+
+static void cmd_mem(const cli_tok_t *t)
+{
+    (void)t;
+    uint32_t total = 0, free = 0, min_free = 0, min_tick_ms = 0;
+    char min_dt[RTC_DATETIME_STRING_SIZE];
+    memset(min_dt, 0, sizeof(min_dt));
+    MemMon_Get(&total, &free, &min_free, &min_tick_ms, min_dt, sizeof(min_dt));
+    cdc_writef("RAM: total=%luB free=%luB minfree=%luB\r\n",
+               (unsigned long)total, (unsigned long)free, (unsigned long)min_free);
+    cdc_writef("RAM: uptime_ms=%lu minfree_at=%s minfree_uptime_ms=%lu\r\n",
+               (unsigned long)HAL_GetTick(),
+               min_dt[0] ? min_dt : "N/A",
+               (unsigned long)min_tick_ms);
+}
+
+static bool micdiag_more(uint8_t part)
+{
+    return MIC_WriteDiag(part, cdc_write_str);
+}
 
-    if (cli_stricmp(line, "chgrst") == 0)
+/* Longer than the TX ring: printed a line per pass. */
+static void cmd_micdiag(const cli_tok_t *t)
+{
+    (void)t;
+    s_more_fn = micdiag_more;
+    s_more_part = 0u;
+}
+
+/* miccal / miccal() = auto (buzzer); miccal(x) / miccal x = external source at x dB SPL. */
+static void cmd_miccal(const cli_tok_t *t)
+{
+    mic_err_t st;
+    if (t->argc == 0u)
     {
-        CHARGER_Reset();
-        cdc_write_str("OK\r\n");
+        st = MIC_CalibrateInteractiveAuto(cdc_write_str, cli_wait_enter, BEEP);
+    }
+    else
+    {
+        const char *a = (t->form == CLI_FORM_CALL) ? t->argv[0] : t->rest;
+        char *end = NULL;
+        float spl_db = strtof(a, &end);
+        while (end && (*end == ' ' || *end == '\t')) end++;
+        if (end == a || end == NULL || *end != 0)
+        {
+            cdc_write_str("ERR use: MICCAL() or MICCAL(dB_SPL)\r\n");
+            return;
+        }
+        st = MIC_CalibrateInteractiveManualSpl(spl_db, cdc_write_str, cli_wait_enter);
+    }
+    if (st != MIC_ERR_OK)
+    {
+        const char *msg = MIC_LastErrorMsg();
+        cdc_writef("ERR miccal %s(%ld) msg=%s\r\n",
+                   MIC_ErrName(st), (long)st, msg ? msg : "");
+    }
+}
+
+static void cmd_pascal(const cli_tok_t *t)
+{
+    (void)t;
+    s_pascal_mode = 1;
+    mp_start_session();
+}
+
+static void cmd_time(const cli_tok_t *t)
+{
+    (void)t;
+    RTC_WriteTimeYMDHM(cdc_write_str);
+}
+
+static void cmd_micfft(const cli_tok_t *t)
+{
+    (void)t;
+    int16_t lf = 0, mf = 0, hf = 0;
+    mic_err_t st = MIC_FFT_WaitBinsDbX100(1000u, &lf, &mf, &hf);
+    if (st != MIC_ERR_OK)
+    {
+        const char *msg = MIC_LastErrorMsg();
+        cdc_writef("ERR micfft %s(%ld) msg=%s\r\n",
+                   MIC_ErrName(st), (long)st, msg ? msg : "");
+    }
+    else
+    {
+        cdc_writef("%d,%d,%d\r\n", (int)lf, (int)mf, (int)hf);
+    }
+}
+
+static void cmd_micbands(const cli_tok_t *t)
+{
+    int16_t db[MIC_BANDS_MAX];
+    long n = MIC_BANDS_MAX;
+    if (t->argc != 0u)
+    {
+        char *end = NULL;
+        n = strtol(t->argv[0], &end, 10);
+        if (end == t->argv[0] || *end != 0 || n < 1 || n > (long)MIC_BANDS_MAX)
+        {
+            cdc_writef("ERR use: MICBANDS(1..%u)\r\n", (unsigned)MIC_BANDS_MAX);
+            return;
+        }
+    }
+
+    mic_err_t st = MIC_FFT_WaitBandsDbX100(1000u, (uint8_t)n, db);
+    if (st != MIC_ERR_OK)
+    {
+        const char *msg = MIC_LastErrorMsg();
+        cdc_writef("ERR micbands %s(%ld) msg=%s\r\n",
+                   MIC_ErrName(st), (long)st, msg ? msg : "");
         return;
     }
+    for (long i = 0; i < n; i++)
+        cdc_writef((i + 1 < n) ? "%d," : "%d\r\n", (int)db[i]);
+}
 
-    if (cli_stricmp(line, "lobatt_enable") == 0)
+static void cmd_beat(const cli_tok_t *t)
+{
+    (void)t;
+    mic_beat_t b;
+    mic_err_t st = MIC_BeatPoll(&b);
+    if (st != MIC_ERR_OK && st != MIC_ERR_NO_DATA_YET)
     {
-        CHARGER_LowBattEnableOnce();
-        cdc_write_str("OK\r\n");
+        const char *msg = MIC_LastErrorMsg();
+        cdc_writef("ERR beat %s(%ld) msg=%s\r\n",
+                   MIC_ErrName(st), (long)st, msg ? msg : "");
         return;
     }
+    cdc_writef("%lu,%lu,%u,%u\r\n", (unsigned long)b.beats, (unsigned long)b.onsets,
+               (unsigned)b.bpm_x10, (unsigned)b.phase);
+}
+
+static void cmd_micconf(const cli_tok_t *t)
+{
+    mic_config_t c;
+    MIC_GetConfig(&c);
+    if (t->argc != 0u)
+    {
+        /* Positional: decim [window_ms [dma_words [powersave_ms [adaptive_max_ms]]]], the rest is kept. */
+        long v[5] = { c.decim, c.window_ms, c.dma_words, (long)c.powersave_ms, (long)c.adaptive_max_ms };
+        const char *p = t->rest;
+        for (uint8_t i = 0; i < t->argc; i++)
+        {
+            char *end = NULL;
+            v[i] = strtol(p, &end, 10);
+            if (end == p || (*end != 0 && *end != ' ' && *end != '\t') || v[i] < 0 || (i < 3u && v[i] > 0xFFFF))
+            {
+                cdc_write_str("ERR use: MICCONF [decim [window_ms [dma_words [powersave_ms [adaptive_max_ms]]]]]\r\n");
+                return;
+            }
+            p = end;
+            while (*p == ' ' || *p == '\t') p++;
+        }
+        c.decim = (uint16_t)v[0];
+        c.window_ms = (uint16_t)v[1];
+        c.dma_words = (uint16_t)v[2];
+        c.powersave_ms = (uint32_t)v[3];
+        c.adaptive_max_ms = (uint32_t)v[4];
+
+        mic_err_t st = MIC_Configure(&c);
+        if (st != MIC_ERR_OK)
+        {
+            cdc_writef("ERR micconf %s(%ld) decim=%u..%u window=%u..%u dma=%u..%u even\r\n",
+                       MIC_ErrName(st), (long)st,
+                       (unsigned)MIC_DECIM_MIN, (unsigned)MIC_DECIM_MAX,
+                       (unsigned)MIC_WINDOW_MS_MIN, (unsigned)MIC_WINDOW_MS_MAX,
+                       (unsigned)MIC_DMA_WORDS_MIN, (unsigned)MIC_DMA_WORDS);
+            return;
+        }
+    }
+    uint32_t on_ms = 0u, total_ms = 0u;
+    MIC_GetDuty(&on_ms, &total_ms);
+    uint32_t duty_x10 = (total_ms != 0u) ? (uint32_t)(((uint64_t)on_ms * 1000u) / total_ms) : 0u;
+    cdc_writef("MICCONF decim=%u window=%ums dma=%u powersave=%lums adaptive=%lums duty=%.1q%%\r\n",
+               (unsigned)c.decim, (unsigned)c.window_ms, (unsigned)c.dma_words,
+               (unsigned long)c.powersave_ms, (unsigned long)c.adaptive_max_ms, (int32_t)duty_x10);
+}
+
+static void cmd_charger(const cli_tok_t *t)
+{
+    (void)t;
+    CHARGER_WriteStatus(cdc_write_str);
+}
+
+static void cmd_chgrst(const cli_tok_t *t)
+{
+    (void)t;
+    CHARGER_Reset();
+    cdc_write_str("OK\r\n");
+}
+
+static void cmd_stream(const cli_tok_t *t)
+{
+    cli_stream(t->rest);
+}
+
+static void cmd_config(const cli_tok_t *t)
+{
+    cli_config(t->rest);
+}
+
+static void cmd_bench(const cli_tok_t *t)
+{
+    cli_bench(t->rest);
+}
+
+static void cmd_lobatt_enable(const cli_tok_t *t)
+{
+    (void)t;
+    CHARGER_LowBattEnableOnce();
+    cdc_write_str("OK\r\n");
+}
+
+/* Sorted by hash (PASCAL monitor: ID <name>); a new entry goes at its hash position.
+ * tools/name_tables_test.py (make test) checks hashes and order. */
+static const cli_cmd_t s_cmds[] =
+{
+    { "txstat",        0x03C6u, CLI_FORM_WORD,                 0, 1, cmd_txstat },
+    { "micconf",       0x09E5u, CLI_FORM_WORD,                 0, 5, cmd_micconf },
+    { "stream",        0x320Au, CLI_FORM_WORD,                 0, 2, cmd_stream },
+    { "chgrst",        0x38FBu, CLI_FORM_WORD,                 0, 0, cmd_chgrst },
+    { "micfft",        0x4043u, CLI_FORM_CALL,                 0, 0, cmd_micfft },
+    { "config",        0x4538u, CLI_FORM_WORD,                 0, 2, cmd_config },
+    { "lobatt_enable", 0x8902u, CLI_FORM_WORD,                 0, 0, cmd_lobatt_enable },
+    { "miccal",        0x9032u, CLI_FORM_WORD | CLI_FORM_CALL, 0, 1, cmd_miccal },
+    { "mem",           0x9153u, CLI_FORM_WORD,                 0, 0, cmd_mem },
+    { "help",          0x9B8Bu, CLI_FORM_WORD,                 0, 0, cmd_help },
+    { "charger",       0x9C8Cu, CLI_FORM_WORD,                 0, 0, cmd_charger },
+    { "micdiag",       0xA5EEu, CLI_FORM_WORD,                 0, 0, cmd_micdiag },
+    { "pascal",        0xB1C4u, CLI_FORM_WORD,                 0, 0, cmd_pascal },
+    { "micbands",      0xBA87u, CLI_FORM_CALL,                 0, 1, cmd_micbands },
+    { "beat",          0xC597u, CLI_FORM_CALL,                 0, 0, cmd_beat },
+    { "time",          0xC6D8u, CLI_FORM_CALL,                 0, 0, cmd_time },
+    { "bench",         0xDCD7u, CLI_FORM_WORD,                 1, 3, cmd_bench },
+    { "ping",          0xE6D4u, CLI_FORM_WORD,                 0, 0, cmd_ping },
+};
+
+#define CLI_CMD_COUNT   (sizeof(s_cmds) / sizeof(s_cmds[0]))
+
+static const cli_cmd_t *cli_find(const cli_tok_t *t)
+{
+    uint8_t lo = 0, hi = (uint8_t)CLI_CMD_COUNT;
+    while (lo < hi)
+    {
+        uint8_t mid = (uint8_t)((lo + hi) / 2u);
+        if (s_cmds[mid].hash < t->hash) lo = (uint8_t)(mid + 1u);
+        else hi = mid;
+    }
+    for (; lo < CLI_CMD_COUNT && s_cmds[lo].hash == t->hash; lo++)
+    {
+        if (strcmp(s_cmds[lo].name, t->name) == 0) return &s_cmds[lo];
+    }
+    return NULL;
+}
+
+/* NAME(args) through the MiniPascal builtin table. Returns false if the name is unknown. */
+static bool cli_call_builtin(const cli_tok_t *t)
+{
+    const mp_builtin_t *b = mp_builtin_find_hash(t->name, t->hash);
+    if (b == NULL) return false;
+
+    int32_t argv[CLI_MAX_ARGS];
+    bool ok = (t->argc >= b->min_args) && (t->argc <= b->max_args);
+    for (uint8_t i = 0; ok && i < t->argc; i++)
+        ok = cli_arg_int(t->argv[i], &argv[i]);
 
     int32_t ret = 0;
     bool has_ret = false;
-    if (mp_exec_builtin_line(line, &ret, &has_ret))
+    if (!ok || !mp_exec_builtin(b, t->argc, argv, &ret, &has_ret))
     {
-        if (has_ret)
+        cdc_writef("ERR args %s(%u..%u)\r\n", b->name, (unsigned)b->min_args, (unsigned)b->max_args);
+        return true;
+    }
+    if (has_ret)
+    {
+        cdc_writef("%ld\r\n", (long)ret);
+    }
+    else
+    {
+        cdc_write_str("OK\r\n");
+    }
+    return true;
+}
+
+static void handle_line(char *line)
+{
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0') return;
+
+    /* normalize CRLF */
+    size_t n = strlen(line);
+    while (n && (line[n-1] == '\r' || line[n-1] == '\n'))
+        line[--n] = '\0';
+
+    cli_tok_t t;
+    if (cli_tokenize(line, &t))
+    {
+        const cli_cmd_t *c = cli_find(&t);
+        if (c != NULL && (c->forms & t.form) && t.argc >= c->min_args && t.argc <= c->max_args)
         {
-            cdc_writef("%ld\r\n", (long)ret);
+            c->fn(&t);
+            return;
         }
-        else
+        /* e.g. time(sel): same name as a CLI command, different schema -> builtin. */
+        if (t.form == CLI_FORM_CALL && cli_call_builtin(&t))
+            return;
+        if (c != NULL)
         {
-            cdc_write_str("OK\r\n");
+            cdc_writef("ERR args %s, type: help\r\n", c->name);
+            return;
         }
-        return;
     }
 
     dbg_led_blink(1);
@@ -430,6 +1365,10 @@ void USB_CLI_Task(void)
             return;
         }
 
+        /* Output still being paced out: leave the input with the host until it is done. */
+        if (mp_output_pending() || USB_CLI_TxRoom() < USB_CLI_TX_IN_ROOM)
+            return;
+
          /* Route incoming chars to Pascal */
         uint32_t ret = USBD_CDC_ACM_Receive(rx, sizeof(rx), &got);
         s_usb_connected = (ret == 0) ? 1u : 0u;
@@ -443,9 +1382,49 @@ void USB_CLI_Task(void)
         return;
     }
 
+    if (s_more_fn != NULL)
+    {
+        if (USB_CLI_TxRoom() >= USB_CLI_TX_IN_ROOM && !s_more_fn(s_more_part++))
+        {
+            s_more_fn = NULL;
+            cdc_prompt();
+        }
+        return;
+    }
+    if (s_stream.mask == 0u && s_bench.mode == BENCH_IDLE && USB_CLI_TxRoom() < USB_CLI_TX_IN_ROOM)
+        return;     /* earlier output still draining */
+
     uint32_t ret = USBD_CDC_ACM_Receive(rx, sizeof(rx), &got);
     s_usb_connected = (ret == 0) ? 1u : 0u;
-    if (ret != 0 || got == 0)
+    if (ret != 0)
+    {
+        s_stream.mask = 0u;
+        s_bench.mode = BENCH_IDLE;
+        return;
+    }
+    if (s_bench.mode != BENCH_IDLE)
+    {
+        /* Benchmark run: input is benchmark data (or aborts a TX run). */
+        bench_input(rx, got);
+        if (s_bench.mode != BENCH_IDLE)
+            bench_task();
+        return;
+    }
+    if (s_stream.mask != 0u)
+    {
+        /* Streaming: input only stops the stream (it is not a command). */
+        if (got > 0)
+        {
+            stream_stop();
+            cdc_prompt();
+        }
+        else
+        {
+            stream_task();
+        }
+        return;
+    }
+    if (got == 0)
         return;
 
     for (uint32_t i = 0; i < got; i++)
@@ -474,7 +1453,10 @@ void USB_CLI_Task(void)
                 handle_line(s_line);
                 s_line_len = 0;
             }
-            cdc_prompt();
+            if (s_bench.mode != BENCH_IDLE || s_stream.mask != 0u)
+                return;     /* raw run started: no prompt, rest of this chunk is not a command */
+            if (s_more_fn == NULL)
+                cdc_prompt();
             continue;
         }
 
@@ -10,10 +10,14 @@ C_SRCS += \
 ../Drivers/Project_drv/analog.c \
 ../Drivers/Project_drv/bme280.c \
 ../Drivers/Project_drv/charger.c \
+../Drivers/Project_drv/crc32.c \
+../Drivers/Project_drv/fmt.c \
 ../Drivers/Project_drv/led.c \
 ../Drivers/Project_drv/mic.c \
+../Drivers/Project_drv/mic_dsp.c \
 ../Drivers/Project_drv/mp_buttons.c \
-../Drivers/Project_drv/rtc.c 
+../Drivers/Project_drv/rtc.c \
+../Drivers/Project_drv/settings.c 
 
 OBJS += \
 ./Drivers/Project_drv/MiniPascal.o \
@@ -21,10 +25,14 @@ OBJS += \
 ./Drivers/Project_drv/analog.o \
 ./Drivers/Project_drv/bme280.o \
 ./Drivers/Project_drv/charger.o \
+./Drivers/Project_drv/crc32.o \
+./Drivers/Project_drv/fmt.o \
 ./Drivers/Project_drv/led.o \
 ./Drivers/Project_drv/mic.o \
+./Drivers/Project_drv/mic_dsp.o \
 ./Drivers/Project_drv/mp_buttons.o \
-./Drivers/Project_drv/rtc.o 
+./Drivers/Project_drv/rtc.o \
+./Drivers/Project_drv/settings.o 
 
 C_DEPS += \
 ./Drivers/Project_drv/MiniPascal.d \
@@ -32,10 +40,14 @@ C_DEPS += \
 ./Drivers/Project_drv/analog.d \
 ./Drivers/Project_drv/bme280.d \
 ./Drivers/Project_drv/charger.d \
+./Drivers/Project_drv/crc32.d \
+./Drivers/Project_drv/fmt.d \
 ./Drivers/Project_drv/led.d \
 ./Drivers/Project_drv/mic.d \
+./Drivers/Project_drv/mic_dsp.d \
 ./Drivers/Project_drv/mp_buttons.d \
-./Drivers/Project_drv/rtc.d 
+./Drivers/Project_drv/rtc.d \
+./Drivers/Project_drv/settings.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -45,7 +57,7 @@ Drivers/Project_drv/%.o Drivers/Project_drv/%.su Drivers/Project_drv/%.cyclo: ..
 clean: clean-Drivers-2f-Project_drv
 
 clean-Drivers-2f-Project_drv:
-	-$(RM) ./Drivers/Project_drv/MiniPascal.cyclo ./Drivers/Project_drv/MiniPascal.d ./Drivers/Project_drv/MiniPascal.o ./Drivers/Project_drv/MiniPascal.su ./Drivers/Project_drv/alarm.cyclo ./Drivers/Project_drv/alarm.d ./Drivers/Project_drv/alarm.o ./Drivers/Project_drv/alarm.su ./Drivers/Project_drv/analog.cyclo ./Drivers/Project_drv/analog.d ./Drivers/Project_drv/analog.o ./Drivers/Project_drv/analog.su ./Drivers/Project_drv/bme280.cyclo ./Drivers/Project_drv/bme280.d ./Drivers/Project_drv/bme280.o ./Drivers/Project_drv/bme280.su ./Drivers/Project_drv/charger.cyclo ./Drivers/Project_drv/charger.d ./Drivers/Project_drv/charger.o ./Drivers/Project_drv/charger.su ./Drivers/Project_drv/led.cyclo ./Drivers/Project_drv/led.d ./Drivers/Project_drv/led.o ./Drivers/Project_drv/led.su ./Drivers/Project_drv/mic.cyclo ./Drivers/Project_drv/mic.d ./Drivers/Project_drv/mic.o ./Drivers/Project_drv/mic.su ./Drivers/Project_drv/mp_buttons.cyclo ./Drivers/Project_drv/mp_buttons.d ./Drivers/Project_drv/mp_buttons.o ./Drivers/Project_drv/mp_buttons.su ./Drivers/Project_drv/rtc.cyclo ./Drivers/Project_drv/rtc.d ./Drivers/Project_drv/rtc.o ./Drivers/Project_drv/rtc.su
+	-$(RM) ./Drivers/Project_drv/MiniPascal.cyclo ./Drivers/Project_drv/MiniPascal.d ./Drivers/Project_drv/MiniPascal.o ./Drivers/Project_drv/MiniPascal.su ./Drivers/Project_drv/alarm.cyclo ./Drivers/Project_drv/alarm.d ./Drivers/Project_drv/alarm.o ./Drivers/Project_drv/alarm.su ./Drivers/Project_drv/analog.cyclo ./Drivers/Project_drv/analog.d ./Drivers/Project_drv/analog.o ./Drivers/Project_drv/analog.su ./Drivers/Project_drv/bme280.cyclo ./Drivers/Project_drv/bme280.d ./Drivers/Project_drv/bme280.o ./Drivers/Project_drv/bme280.su ./Drivers/Project_drv/charger.cyclo ./Drivers/Project_drv/charger.d ./Drivers/Project_drv/charger.o ./Drivers/Project_drv/charger.su ./Drivers/Project_drv/crc32.cyclo ./Drivers/Project_drv/crc32.d ./Drivers/Project_drv/crc32.o ./Drivers/Project_drv/crc32.su ./Drivers/Project_drv/fmt.cyclo ./Drivers/Project_drv/fmt.d ./Drivers/Project_drv/fmt.o ./Drivers/Project_drv/fmt.su ./Drivers/Project_drv/led.cyclo ./Drivers/Project_drv/led.d ./Drivers/Project_drv/led.o ./Drivers/Project_drv/led.su ./Drivers/Project_drv/mic.cyclo ./Drivers/Project_drv/mic.d ./Drivers/Project_drv/mic.o ./Drivers/Project_drv/mic.su ./Drivers/Project_drv/mic_dsp.cyclo ./Drivers/Project_drv/mic_dsp.d ./Drivers/Project_drv/mic_dsp.o ./Drivers/Project_drv/mic_dsp.su ./Drivers/Project_drv/mp_buttons.cyclo ./Drivers/Project_drv/mp_buttons.d ./Drivers/Project_drv/mp_buttons.o ./Drivers/Project_drv/mp_buttons.su ./Drivers/Project_drv/rtc.cyclo ./Drivers/Project_drv/rtc.d ./Drivers/Project_drv/rtc.o ./Drivers/Project_drv/rtc.su ./Drivers/Project_drv/settings.cyclo ./Drivers/Project_drv/settings.d ./Drivers/Project_drv/settings.o ./Drivers/Project_drv/settings.su
 
 .PHONY: clean-Drivers-2f-Project_drv
 
@@ -6,7 +6,6 @@
 
 #include <string.h>
 #include <ctype.h>
-#include <stdio.h>
 #include <MiniPascal.h>
 
 #include "stm32u0xx_hal.h"
@@ -19,6 +18,10 @@
 #include "alarm.h"
 #include "main.h"
 #include "lp_delay.h"
+#include "crc32.h"
+#include "settings.h"
+#include "fmt.h"
+#include "mp_buttons.h"
 
 /* External peripherals from main.c */
 extern RNG_HandleTypeDef hrng;
@@ -104,6 +107,21 @@ static bool parse_int(const char **p, int *out){
   return true;
 }
 
+static bool parse_hex32(const char **p, uint32_t *out){
+  while (**p==' '||**p=='\t') (*p)++;
+  if ((*p)[0]=='0' && ((*p)[1]=='x' || (*p)[1]=='X')) (*p)+=2;
+  uint32_t v=0;
+  uint8_t n=0;
+  while (isxdigit((unsigned char)**p) && n < 8u){
+    char c=(char)tolower((unsigned char)**p);
+    v = (v<<4) | (uint32_t)((c<='9') ? (c-'0') : (c-'a'+10));
+    (*p)++; n++;
+  }
+  if (n == 0u || isxdigit((unsigned char)**p)) return false;
+  *out = v;
+  return true;
+}
+
 bool mp_exec_builtin_line(const char *line, int32_t *ret_out, bool *has_ret){
   if (!line) return false;
   const char *p = line;
@@ -137,23 +155,24 @@ bool mp_exec_builtin_line(const char *line, int32_t *ret_out, bool *has_ret){
   while (*p==' '||*p=='\t') p++;
   if (*p) return false;
 
-  int id = builtin_id(name);
-  if (id < 0) return false;
+  const mp_builtin_t *b = mp_builtin_find(name);
+  if (!b) return false;
+  return mp_exec_builtin(b, argc, argv, ret_out, has_ret);
+}
 
-  bool ret = false;
-  if (id==3 || id==4 || id==5 || id==6 || id==7 || id==9 || id==12 || id==16) ret = true;
-  if (id==10 && argc==1) ret = true; /* time(sel) */
-  if (id==11 && argc==0) ret = true; /* alarm() */
+bool mp_exec_builtin(const mp_builtin_t *b, uint8_t argc, const int32_t *argv, int32_t *ret_out, bool *has_ret){
+  if (!b) return false;
+  bool ret = (b->ret_argc & MP_BI_RET_ARGC(argc > 7u ? 7u : argc)) != 0u;
   if (has_ret) *has_ret = ret;
 
   int32_t r = 0;
-  if (id==2){
+  if (b->id==2){
     if (argc!=1 || argv[0] < 0) return false;
     uint32_t ms = (uint32_t)argv[0];
     LP_DELAY(ms);
     r = 0;
   } else {
-    r = mp_user_builtin((uint8_t)id, argc, argv);
+    r = mp_user_builtin(b->id, argc, argv);
     /* Negative values are valid (e.g. MIC() dBFS, TEMP() below zero).
        Treat them as normal results; for "void" calls, print the error code. */
     if (!ret && r < 0){
@@ -231,12 +250,10 @@ static bool ed_set(mp_editor_t *ed, int line_no, const char *text){
   return true;
 }
 
-static void ed_list(const mp_editor_t *ed){
+static void list_line(int line_no, const char *text){
   char num[16];
-  for (uint8_t i=0;i<ed->count;i++){
-    mp_itoa(ed->lines[i].line_no, num);
-    mp_puts(num); mp_puts(" "); mp_puts(ed->lines[i].text); mp_putcrlf();
-  }
+  mp_itoa(line_no, num);
+  mp_puts(num); mp_puts(" "); mp_puts(text); mp_putcrlf();
 }
 
 /*
@@ -253,9 +270,12 @@ enum {
   SV_TIMEH = 15, SV_TIMEM, SV_TIMES,                             /* 15..17 */
   SV_ALH   = 18, SV_ALM, SV_ALS,                                 /* 18..20 */
   SV_TIMEY = 21, SV_TIMEMO, SV_TIMED,                            /* 21..23 */
-  SV_MICLF = 24, SV_MICMF, SV_MICHF                              /* 24..26 (dBFS*100) */
+  SV_MICLF = 24, SV_MICMF, SV_MICHF,                             /* 24..26 (dBFS*100) */
+  SV_MICB1 = 27,                                                 /* 27..34 (dBFS*100) */
+  SV_BPM   = 35, SV_BEATPH, SV_ONSETS                            /* 35..37 (beat()) */
 };
-#define SYSVAR_COUNT 27
+#define MP_MICBANDS  8u      /* MICB1..MICB8 */
+#define SYSVAR_COUNT (SV_ONSETS + 1)
 
 static const sysvar_t g_sysvars[] = {
   {"CMDID", SV_CMDID}, {"NARG", SV_NARG},
@@ -266,6 +286,9 @@ static const sysvar_t g_sysvars[] = {
   {"ALH", SV_ALH}, {"ALM", SV_ALM}, {"ALS", SV_ALS},
   {"TIMEY", SV_TIMEY}, {"TIMEMO", SV_TIMEMO}, {"TIMED", SV_TIMED},
   {"MICLF", SV_MICLF}, {"MICMF", SV_MICMF}, {"MICHF", SV_MICHF},
+  {"MICB1", SV_MICB1}, {"MICB2", SV_MICB1+1}, {"MICB3", SV_MICB1+2}, {"MICB4", SV_MICB1+3},
+  {"MICB5", SV_MICB1+4}, {"MICB6", SV_MICB1+5}, {"MICB7", SV_MICB1+6}, {"MICB8", SV_MICB1+7},
+  {"BPM", SV_BPM}, {"BEATPH", SV_BEATPH}, {"ONSETS", SV_ONSETS},
 };
 
 static int sysvar_find(const char *name){
@@ -561,47 +584,58 @@ static int sym_get_or_add(program_t *p, symtab_t *st, const char *name){
 }
 
 /*
- * Builtin name -> id table (compiler side).
+ * Builtin name -> id table, shared by the compiler, immediate calls and the USB CLI.
  * Pascal calls like `led(1,255)` are mapped to small numeric IDs used by the VM.
+ * Sorted by hash = fnv1a16 of the lower-case name (PASCAL monitor: ID <name>);
+ * a new entry goes at its hash position (checked by tools/name_tables_test.py).
  */
+static const mp_builtin_t g_builtins[] = {
+  { "micconf",  0x09E5u, 21, 1, 5, MP_BI_RET_ANY },  /* micconf(decim[,win_ms[,dma[,ps_ms[,adapt_ms]]]]) */
+  { "rng",      0x0DA2u,  4, 0, 0, MP_BI_RET_ANY },  /* RNG peripheral (main.c hrng) */
+  { "btne",     0x244Au, 16, 0, 0, MP_BI_RET_ANY },  /* backward compatible alias of btn */
+  { "ledon",    0x38F5u, 13, 0, 4, 0u },             /* LED control (led.*) */
+  { "micfft",   0x4043u, 19, 0, 0, 0u },             /* microphone bands (mic.*) */
+  { "temp",     0x7FDCu,  5, 0, 0, MP_BI_RET_ANY },  /* BME280 sensor (bme280.*) */
+  { "ledoff",   0x83A4u, 14, 0, 0, 0u },
+  { "hum",      0x847Cu,  6, 0, 0, MP_BI_RET_ANY },
+  { "mic",      0x8C6Fu,  9, 0, 0, MP_BI_RET_ANY },
+  { "led",      0xAAA0u,  1, 2, 5, 0u },
+  { "micbands", 0xBA87u, 20, 1, 1, 0u },             /* micbands(n) -> MICB1..MICBn */
+  { "delay",    0xBF09u,  2, 1, 1, 0u },             /* executed by the VM (sleeps without blocking the CLI) */
+  { "beat",     0xC597u, 22, 0, 0, MP_BI_RET_ANY },  /* beat() -> beat count, BPM/BEATPH/ONSETS; never waits */
+  { "time",     0xC6D8u, 10, 0, 1, MP_BI_RET_ARGC(1) }, /* time() or time(sel) (rtc.*) */
+  { "beep",     0xCBC6u, 15, 3, 3, 0u },             /* beeper (alarm.*) */
+  { "settime",  0xE3E2u, 17, 3, 5, 0u },             /* settime(yy,mo,dd,hh,mm) or settime(hh,mm,ss) */
+  { "setalarm", 0xEAE6u, 18, 2, 3, 0u },             /* setalarm(hh,mm[,duration_sec]) daily */
+  { "battery",  0xF1E4u,  3, 0, 0, MP_BI_RET_ANY },  /* analog measurements (analog.*) */
+  { "alarm",    0xF531u, 11, 0, 0, MP_BI_RET_ARGC(0) }, /* alarm() -> active? */
+  { "press",    0xF848u,  7, 0, 0, MP_BI_RET_ANY },
+  { "btn",      0xFB00u, 16, 0, 0, MP_BI_RET_ANY },  /* button events queued by mp_notify_button */
+  { "light",    0xFCB2u, 12, 0, 0, MP_BI_RET_ANY },
+};
+
+uint16_t mp_name_hash(const char *s){ return fnv1a16_ci(s); }
+
+const mp_builtin_t *mp_builtin_find_hash(const char *name, uint16_t hash){
+  uint8_t lo = 0, hi = (uint8_t)(sizeof(g_builtins)/sizeof(g_builtins[0]));
+  while (lo < hi){
+    uint8_t mid = (uint8_t)((lo + hi) / 2u);
+    if (g_builtins[mid].hash < hash) lo = (uint8_t)(mid + 1u);
+    else hi = mid;
+  }
+  for (; lo < sizeof(g_builtins)/sizeof(g_builtins[0]) && g_builtins[lo].hash == hash; lo++){
+    if (!mp_stricmp(name, g_builtins[lo].name)) return &g_builtins[lo];
+  }
+  return NULL;
+}
+
+const mp_builtin_t *mp_builtin_find(const char *name){
+  return mp_builtin_find_hash(name, fnv1a16_ci(name));
+}
+
 static int builtin_id(const char *name){
-  /* LED control (Drivers/Project_drv/led.*). */
-  if (!mp_stricmp(name,"led"))   return 1;
-  if (!mp_stricmp(name,"ledon")) return 13;
-  if (!mp_stricmp(name,"ledoff")) return 14;
-
-  /* Timing/power: delay is executed by the VM so programs sleep without blocking the CLI. */
-  if (!mp_stricmp(name,"delay")) return 2;
-
-  /* Analog measurements (Drivers/Project_drv/analog.*). */
-  if (!mp_stricmp(name,"battery")) return 3;
-  if (!mp_stricmp(name,"light")) return 12;
-
-  /* RNG peripheral (main.c hrng). */
-  if (!mp_stricmp(name,"rng"))   return 4;
-
-  /* BME280 sensor (Drivers/Project_drv/bme280.*). */
-  if (!mp_stricmp(name,"temp"))  return 5;
-  if (!mp_stricmp(name,"hum"))   return 6;
-  if (!mp_stricmp(name,"press")) return 7;
-
-  /* Button events (short presses queued by mp_buttons_poll). */
-  if (!mp_stricmp(name,"btn"))   return 16;
-  if (!mp_stricmp(name,"btne"))  return 16; /* Backward compatible alias. */
-
-  /* Microphone processing (Drivers/Project_drv/mic.*). */
-  if (!mp_stricmp(name,"mic"))   return 9;
-  if (!mp_stricmp(name,"micfft")) return 19;
-
-  /* RTC clock/alarm (Drivers/Project_drv/rtc.*). */
-  if (!mp_stricmp(name,"time")) return 10;      /* time() or time(sel) */
-  if (!mp_stricmp(name,"settime")) return 17;   /* settime(yy,mo,dd,hh,mm) or settime(hh,mm,ss) */
-  if (!mp_stricmp(name,"alarm")) return 11;     /* alarm() -> active? */
-  if (!mp_stricmp(name,"setalarm"))return 18;   /* setalarm(hh,mm[,duration_sec]) daily */
-
-  /* Beeper (Drivers/Project_drv/alarm.*). */
-  if (!mp_stricmp(name,"beep")) return 15;
-  return -1;
+  const mp_builtin_t *b = mp_builtin_find(name);
+  return b ? (int)b->id : -1;
 }
 
 /* Expression parser: turns tokens into bytecode for arithmetic/logic and function calls. */
@@ -1003,6 +1037,12 @@ typedef struct {
   bool stop_req;
   bool sleeping;
   uint32_t wake_ms;
+  uint8_t wait_id;      /* builtin id of a pending mic()/micfft()/micbands(), 0 = none */
+  uint8_t wait_arg;     /* micbands(n): n */
+  uint32_t wait_seq;    /* MIC_GetSeq() at the last poll */
+  uint32_t wait_t0;
+  bool tx_wait;         /* a print is waiting for console room since tx_t0 */
+  uint32_t tx_t0;
 } vm_t;
 
 static void vm_reset(vm_t *vm){
@@ -1017,10 +1057,63 @@ static int32_t rd_i32(const uint8_t *bc, uint16_t *ip){
   *ip+=4; return (int32_t)v;
 }
 
+/*
+ * mic()/micfft()/micbands() suspend only the VM, not the main loop: the call stays pending in
+ * vm->wait_id and is polled again whenever the mic driver publishes a new window
+ * (MIC_GetSeq() moves) or the wait times out; then its result is pushed.
+ */
+#define MP_MIC_WAIT_MS 1000u
+
+static int32_t mp_mic_result(mic_err_t st, int16_t dbfs_x100);
+static int32_t mp_micfft_result(mic_err_t st, int16_t lf, int16_t mf, int16_t hf);
+static int32_t mp_micbands_result(mic_err_t st, uint8_t n, const int16_t *db);
+static bool mp_micbands_n_ok(int32_t n){ return n>=1 && n<=(int32_t)MP_MICBANDS && (uint32_t)n<=MIC_BANDS_MAX; }
+
+/*
+ * Console output never blocks, so a print waits here (the VM yields its slice) until the
+ * console has room for it plus MP_TX_RESERVE. A host that stops reading gets MP_TX_STALL_MS,
+ * then prints go out (and are dropped) without waiting until the console drains again.
+ */
+static bool vm_tx_hold(vm_t *vm, uint32_t need, uint32_t now_ms){
+  if (!mp_hal_usb_connected() || mp_hal_tx_room() >= need + MP_TX_RESERVE){ vm->tx_wait=false; return false; }
+  if (!vm->tx_wait){ vm->tx_wait=true; vm->tx_t0=now_ms; return true; }
+  return (uint32_t)(now_ms - vm->tx_t0) < MP_TX_STALL_MS;
+}
+
+static bool vm_mic_poll(vm_t *vm, int32_t *r){
+  mic_err_t st;
+  vm->wait_seq = MIC_GetSeq();
+  if (vm->wait_id == 9){
+    int16_t v = 0;
+    st = MIC_ReadDbfsX100_Poll(vm->wait_t0, MP_MIC_WAIT_MS, &v);
+    if (st == MIC_ERR_NO_DATA_YET) return false;
+    *r = mp_mic_result(st, v);
+  } else if (vm->wait_id == 20){
+    int16_t db[MP_MICBANDS];
+    st = MIC_FFT_PollBandsDbX100(vm->wait_t0, MP_MIC_WAIT_MS, vm->wait_arg, db);
+    if (st == MIC_ERR_NO_DATA_YET) return false;
+    *r = mp_micbands_result(st, vm->wait_arg, db);
+  } else {
+    int16_t lf = 0, mf = 0, hf = 0;
+    st = MIC_FFT_PollBinsDbX100(vm->wait_t0, MP_MIC_WAIT_MS, &lf, &mf, &hf);
+    if (st == MIC_ERR_NO_DATA_YET) return false;
+    *r = mp_micfft_result(st, lf, mf, hf);
+  }
+  vm->wait_id = 0;
+  return true;
+}
+
 static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_ops){
   if (!vm->running) return false;
   if (vm->stop_req){ vm->running=false; return false; }
 
+  if (vm->wait_id){
+    if (MIC_GetSeq() == vm->wait_seq && (uint32_t)(now_ms - vm->wait_t0) < MP_MIC_WAIT_MS) return true;
+    int32_t r;
+    if (!vm_mic_poll(vm, &r)) return true;
+    if (!push(vm, r)){ vm->running=false; return false; }
+  }
+
   if (vm->sleeping){
     if ((int32_t)(now_ms - vm->wake_ms) < 0) return true;
     vm->sleeping=false;
@@ -1072,9 +1165,11 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
           if (argc!=1){ vm->running=false; break; }
           int32_t ms = argv[0];
           if (ms < 0) ms = 0;
-          if ((mp_hal_usb_connected() == 0) && !g_session_active && ((uint32_t)ms >= MP_DELAY_STOP2_THRESHOLD_MS))
+          /* STOP2 unless the mic scheduler is capturing sound or BEAT() holds the capture (then MIC_Task must keep running). */
+          if ((mp_hal_usb_connected() == 0) && !g_session_active && ((uint32_t)ms >= MP_DELAY_STOP2_THRESHOLD_MS)
+              && MIC_PrepareStop())
           {
-            LP_DELAY((uint32_t)ms);
+            MIC_AccountStop(LP_DELAY((uint32_t)ms));
             if(!push(vm,0)) vm->running=false;
             break;
           }
@@ -1084,6 +1179,16 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
           return vm->running;
         }
 
+        if (((id==9 || id==19) && argc==0) || (id==20 && argc==1 && mp_micbands_n_ok(argv[0]))){
+          int32_t r;
+          vm->wait_id = id;
+          vm->wait_arg = (uint8_t)argv[0];
+          vm->wait_t0 = now_ms;
+          if (!vm_mic_poll(vm, &r)) return vm->running;
+          if(!push(vm,r)) vm->running=false;
+          break;
+        }
+
         int32_t r = mp_user_builtin(id, argc, argv);
         if(!push(vm,r)) vm->running=false;
       } break;
@@ -1095,6 +1200,7 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
         return true;
       } break;
       case OP_PRINTI: {
+        if (vm_tx_hold(vm, 12u, now_ms)) { vm->ip--; return true; }
         if(!pop(vm,&a)) { vm->running=false; break; }
         if (mp_hal_usb_connected()){
           char b[16];
@@ -1103,6 +1209,7 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
         }
       } break;
       case OP_PRINTS: {
+        if (vm_tx_hold(vm, p->bc[vm->ip], now_ms)) { vm->ip--; return true; }
         uint8_t len = p->bc[vm->ip++];
         if (mp_hal_usb_connected()){
           for (uint8_t i=0;i<len;i++){
@@ -1113,6 +1220,7 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
         }
       } break;
       case OP_PRINTNL: {
+        if (vm_tx_hold(vm, 2u, now_ms)) { vm->ip--; return true; }
         if (mp_hal_usb_connected()){
           mp_putcrlf();
         }
@@ -1130,9 +1238,12 @@ static bool vm_step(vm_t *vm, const program_t *p, uint32_t now_ms, uint16_t max_
  * Each slot stores the compiled program in the linker FLASH_DATA region (save/load/autorun).
  */
 #define MP_MAGIC 0x4D505033u /* 'MPP3' */
+#define MP_HDR_VER_FNV 2u     /* legacy slots: FNV-1a checksum, raw records (read only) */
+#define MP_HDR_VER_CRC 3u     /* CRC-32, raw records (read only) */
+#define MP_HDR_VER_TOK 4u     /* current: CRC-32, token-compressed records */
 typedef struct __attribute__((packed)) {
   uint32_t magic;
-  uint16_t version;   /* 2 */
+  uint16_t version;   /* MP_HDR_VER_* */
   uint16_t count;
   uint8_t  autorun;
   uint8_t  reserved[3];
@@ -1146,6 +1257,181 @@ static uint32_t fnv1a32_update(uint32_t h, const void *data, uint32_t len){
   return h;
 }
 
+/* Slot checksum, selected by header version (v2 images from older firmware still load). */
+typedef struct {
+  uint16_t version;
+  uint32_t fnv;
+  crc32_ctx_t crc;
+} mp_sum_t;
+
+static void mp_sum_begin(mp_sum_t *s, uint16_t version){
+  s->version = version;
+  if (version == MP_HDR_VER_FNV) s->fnv = 2166136261u;
+  else CRC32_Begin(&s->crc);
+}
+
+static void mp_sum_update(mp_sum_t *s, const void *data, uint32_t len){
+  if (s->version == MP_HDR_VER_FNV) s->fnv = fnv1a32_update(s->fnv, data, len);
+  else CRC32_Update(&s->crc, data, len);
+}
+
+static uint32_t mp_sum_end(mp_sum_t *s){
+  return (s->version == MP_HDR_VER_FNV) ? s->fnv : CRC32_End(&s->crc);
+}
+
+static bool mp_hdr_version_ok(uint16_t version){
+  return (version == MP_HDR_VER_FNV) || (version == MP_HDR_VER_CRC) || (version == MP_HDR_VER_TOK);
+}
+
+/*
+ * Token-compressed line records (v4).
+ * Record: zigzag varint line-number delta (vs. previous record), u8 length, encoded text.
+ * Encoded text is plain ASCII except:
+ *   0x80+i / 0xC0+i  whole identifier equal to g_tok_words[i] in lower / UPPER case
+ *   0xBF n           run of n spaces (n >= 3)
+ *   0xFF b           literal byte b >= 0x80
+ * Only exact-case matches are tokenized, so decoding gives back the text byte for byte
+ * (string literals included). The table is part of the flash format: append only, max 63.
+ */
+#define MP_TOK_LOWER  0x80u
+#define MP_TOK_UPPER  0xC0u
+#define MP_TOK_SPACES 0xBFu
+#define MP_TOK_ESC    0xFFu
+#define MP_REC_MAX    (5u + 1u + 2u*(MP_LINE_LEN-1u))
+
+static const char *const g_tok_words[] = {
+  /* keywords */
+  "if", "then", "else", "while", "do", "begin", "end", "repeat", "until", "goto",
+  "and", "or", "not", "writeln",
+  /* builtins */
+  "led", "ledon", "ledoff", "delay", "battery", "light", "rng", "temp", "hum", "press",
+  "btn", "btne", "mic", "micfft", "time", "settime", "alarm", "setalarm", "beep",
+  /* system variables */
+  "cmdid", "narg", "ledi", "ledr", "ledg", "ledb", "ledw", "timeh", "timem", "times",
+  "alh", "alm", "als", "timey", "timemo", "timed", "miclf", "micmf", "michf",
+  "micbands", "micconf", "beat", "bpm", "beatph", "onsets",
+};
+#define MP_TOK_COUNT ((uint8_t)(sizeof(g_tok_words)/sizeof(g_tok_words[0])))
+
+/* Token byte for an identifier, or 0 if it is not in the table (in this exact case). */
+static uint8_t tok_word_find(const char *id, uint8_t n){
+  for (uint8_t i=0;i<MP_TOK_COUNT;i++){
+    const char *w = g_tok_words[i];
+    if (strlen(w) != n) continue;
+    if (memcmp(id, w, n) == 0) return (uint8_t)(MP_TOK_LOWER + i);
+    uint8_t k=0;
+    while (k<n && id[k] == (char)toupper((unsigned char)w[k])) k++;
+    if (k == n) return (uint8_t)(MP_TOK_UPPER + i);
+  }
+  return 0;
+}
+
+/* Encode one line; out must hold 2*(MP_LINE_LEN-1) bytes. Returns the encoded length. */
+static uint8_t tok_encode_line(const char *s, uint8_t *out){
+  uint8_t len = (uint8_t)strnlen(s, MP_LINE_LEN-1);
+  uint8_t n=0, i=0;
+  while (i < len){
+    char c = s[i];
+    if (is_id0(c) && (i == 0 || !is_idn(s[i-1]))){
+      uint8_t j=i;
+      while (j < len && is_idn(s[j])) j++;
+      uint8_t t = tok_word_find(s + i, (uint8_t)(j - i));
+      if (t){ out[n++] = t; }
+      else { memcpy(out + n, s + i, j - i); n = (uint8_t)(n + (j - i)); }
+      i = j;
+      continue;
+    }
+    if (c == ' ' && (i + 2u) < len && s[i+1] == ' ' && s[i+2] == ' '){
+      uint8_t j=i;
+      while (j < len && s[j] == ' ') j++;
+      out[n++] = MP_TOK_SPACES;
+      out[n++] = (uint8_t)(j - i);
+      i = j;
+      continue;
+    }
+    if ((uint8_t)c >= 0x80u) out[n++] = MP_TOK_ESC;
+    out[n++] = (uint8_t)c;
+    i++;
+  }
+  return n;
+}
+
+/* Decode n encoded bytes into a NUL-terminated line (truncated to cap-1 chars). */
+static void tok_decode_line(const uint8_t *in, uint8_t n, char *out, uint8_t cap){
+  uint8_t o=0;
+  for (uint8_t i=0; i<n && (o+1u) < cap; i++){
+    uint8_t b = in[i];
+    if (b < 0x80u){ out[o++] = (char)b; continue; }
+    if (b == MP_TOK_ESC){ if (++i < n) out[o++] = (char)in[i]; continue; }
+    if (b == MP_TOK_SPACES){
+      if (++i < n){ uint8_t k = in[i]; while (k-- && (o+1u) < cap) out[o++] = ' '; }
+      continue;
+    }
+    bool up = (b >= MP_TOK_UPPER);
+    uint8_t t = (uint8_t)(b - (up ? MP_TOK_UPPER : MP_TOK_LOWER));
+    if (t >= MP_TOK_COUNT) continue;
+    for (const char *w = g_tok_words[t]; *w && (o+1u) < cap; w++){
+      out[o++] = up ? (char)toupper((unsigned char)*w) : *w;
+    }
+  }
+  out[o] = 0;
+}
+
+/* v4 record for editor line i into out[MP_REC_MAX]. Returns the record length. */
+static uint8_t storage_encode_record(const mp_editor_t *ed, uint8_t i, uint8_t *out){
+  int32_t prev = i ? (int32_t)ed->lines[i-1].line_no : 0;
+  int32_t d = (int32_t)ed->lines[i].line_no - prev;
+  uint32_t zz = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+  uint8_t n=0;
+  do {
+    uint8_t b = (uint8_t)(zz & 0x7Fu);
+    zz >>= 7;
+    if (zz) b |= 0x80u;
+    out[n++] = b;
+  } while (zz);
+  uint8_t tl = tok_encode_line(ed->lines[i].text, out + n + 1);
+  out[n] = tl;
+  return (uint8_t)(n + 1u + tl);
+}
+
+/*
+ * Read one record of a stored image (any version) and advance *pp / *remain.
+ * *ln holds the previous line number on entry (v4 records are delta coded).
+ */
+static bool storage_rec_next(uint16_t version, const uint8_t **pp, uint32_t *remain, int *ln, char *text){
+  const uint8_t *p = *pp;
+  uint32_t r = *remain;
+  uint8_t n;
+  if (version == MP_HDR_VER_TOK){
+    uint32_t zz=0;
+    uint8_t sh=0, b;
+    do {
+      if (r == 0 || sh > 28u) return false;
+      b = *p++; r--;
+      zz |= (uint32_t)(b & 0x7Fu) << sh;
+      sh += 7u;
+    } while (b & 0x80u);
+    *ln += (int)((int32_t)(zz >> 1) ^ -(int32_t)(zz & 1u));
+    if (r == 0) return false;
+    n = *p++; r--;
+    if (r < n) return false;
+    tok_decode_line(p, n, text, MP_LINE_LEN);
+  } else {
+    if (r < 3) return false;
+    *ln = (int)((uint16_t)p[0] | ((uint16_t)p[1]<<8));
+    n = p[2];
+    p += 3; r -= 3;
+    if (r < n) return false;
+    uint8_t cpy = n;
+    if (cpy > (MP_LINE_LEN-1)) cpy = (uint8_t)(MP_LINE_LEN-1);
+    memcpy(text, p, cpy);
+    text[cpy]=0;
+  }
+  *pp = p + n;
+  *remain = r - n;
+  return true;
+}
+
 static uint32_t flash_data_start(void){
   return (uint32_t)&__flash_data_start__;
 }
@@ -1173,7 +1459,7 @@ static void flash_err_set(const char *msg){
   g_flash_hal_err = HAL_FLASH_GetError();
 }
 
-static void flash_clear_errors(void){
+void mp_flash_clear_errors(void){
   __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP);
   __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_OPERR);
   __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_PROGERR);
@@ -1186,47 +1472,65 @@ static void flash_clear_errors(void){
   __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_OPTVERR);
 }
 
-static uint32_t slot_size_bytes(void){
+/* Distance between slot bases (whole pages, rounded up: the last slot gets what is left). */
+static uint32_t slot_stride_bytes(void){
   uint32_t total = flash_data_size();
   if (total == 0) return 0u;
-  uint32_t slot = total / (uint32_t)MP_FLASH_SLOT_COUNT;
-  slot = (slot / (uint32_t)MP_FLASH_PAGE_SIZE) * (uint32_t)MP_FLASH_PAGE_SIZE;
-  return slot;
+  uint32_t pages = (total + MP_FLASH_PAGE_SIZE - 1u) / (uint32_t)MP_FLASH_PAGE_SIZE;
+  uint32_t slot = (pages + MP_FLASH_SLOT_COUNT - 1u) / (uint32_t)MP_FLASH_SLOT_COUNT;
+  return slot * (uint32_t)MP_FLASH_PAGE_SIZE;
 }
 
 static uint32_t slot_base_addr(uint8_t slot){
-  uint32_t ss = slot_size_bytes();
+  uint32_t ss = slot_stride_bytes();
   uint32_t start = flash_data_start();
   if (slot < 1) slot = 1;
   if (slot > MP_FLASH_SLOT_COUNT) slot = MP_FLASH_SLOT_COUNT;
   return start + ss * (uint32_t)(slot - 1);
 }
 
+/* Usable bytes of a slot: the whole stride, up to the end of FLASH_DATA. */
+static uint32_t slot_size_bytes(uint8_t slot){
+  uint32_t ss = slot_stride_bytes();
+  uint32_t base = slot_base_addr(slot);
+  uint32_t end = flash_data_end();
+  if (base >= end) return 0u;
+  if ((base + ss) > end) ss = end - base;
+  return ss;
+}
+
 static bool flash_unlock(void){ return (HAL_FLASH_Unlock()==HAL_OK); }
 static void flash_lock(void){ (void)HAL_FLASH_Lock(); }
 
-static bool flash_erase_region(uint32_t addr, uint32_t size){
-  if (size==0) return true;
-  uint32_t start=addr;
-  uint32_t end=addr + size - 1;
-  uint32_t page = (start - FLASH_BASE) / MP_FLASH_PAGE_SIZE;
-  uint32_t page_end = (end - FLASH_BASE) / MP_FLASH_PAGE_SIZE;
-
-  if (page_end < page) return false;
+static bool flash_page_is_blank(uint32_t addr){
+  const uint32_t *w = (const uint32_t*)addr;
+  for (uint32_t i=0;i<MP_FLASH_PAGE_SIZE/4u;i++){
+    if (w[i] != 0xFFFFFFFFu) return false;
+  }
+  return true;
+}
 
+static bool flash_erase_page(uint32_t addr){
   FLASH_EraseInitTypeDef ei; memset(&ei,0,sizeof(ei));
   uint32_t page_error=0;
   ei.TypeErase = FLASH_TYPEERASE_PAGES;
-  ei.Page = page;
-  ei.NbPages = (page_end - page) + 1;
+  ei.Page = (addr - FLASH_BASE) / MP_FLASH_PAGE_SIZE;
+  ei.NbPages = 1;
   return (HAL_FLASHEx_Erase(&ei, &page_error) == HAL_OK);
 }
 
+/* Statistics of the last save job (printed when SAVE completes). */
 typedef struct {
-  uint32_t addr;
-  uint8_t buf[8];
-  uint8_t fill;
-} flash_stream_t;
+  uint32_t ms;
+  uint32_t bytes;
+  uint16_t dw_prog;       /* double words programmed one by one */
+  uint8_t  rows_fast;     /* rows written with fast programming */
+  uint8_t  pages_used;
+  uint8_t  pages_erased;  /* blank pages are not erased again */
+  bool     unchanged;     /* slot already held this image, nothing written */
+} mp_save_stats_t;
+
+static mp_save_stats_t g_save_stats;
 
 static bool flash_prog_dw(uint32_t addr, const uint8_t *buf){
   uint64_t dw = 0xFFFFFFFFFFFFFFFFull;
@@ -1235,174 +1539,345 @@ static bool flash_prog_dw(uint32_t addr, const uint8_t *buf){
   return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, dw) == HAL_OK);
 }
 
-static bool flash_stream_init(flash_stream_t *s, uint32_t base){
-  if (!s || (base & 0x7u)) return false;
-  s->addr = base;
-  s->fill = 0;
-  memset(s->buf, 0xFF, sizeof(s->buf));
+/*
+ * Program len bytes (multiple of 8) from a word-aligned RAM buffer into blank flash.
+ * A full, row-aligned row goes out with FLASH_TYPEPROGRAM_FAST, anything else as double words.
+ */
+static bool flash_prog_block(uint32_t addr, const uint32_t *buf, uint32_t len){
+#if MP_FLASH_FAST_PROG
+  if (len == MP_FLASH_ROW_SIZE && (addr % MP_FLASH_ROW_SIZE) == 0u){
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_FAST, addr, (uint64_t)(uint32_t)buf) != HAL_OK) return false;
+    g_save_stats.rows_fast++;
+    return true;
+  }
+#endif
+  const uint8_t *b = (const uint8_t*)buf;
+  for (uint32_t off=0; off<len; off+=8u){
+    if (!flash_prog_dw(addr + off, b + off)) return false;
+    g_save_stats.dw_prog++;
+  }
   return true;
 }
 
-static bool flash_stream_write(flash_stream_t *s, const uint8_t *data, uint32_t len){
-  if (!s || !data) return false;
-  for (uint32_t i=0;i<len;i++){
-    s->buf[s->fill++] = data[i];
-    if (s->fill == 8){
-      if (!flash_prog_dw(s->addr, s->buf)) return false;
-      s->addr += 8;
-      s->fill = 0;
-      memset(s->buf, 0xFF, sizeof(s->buf));
-    }
+/* Build the slot header (data_len + checksum) for the editor contents. */
+static void storage_build_hdr(const mp_editor_t *ed, bool autorun, mp_hdr_t *hdr){
+  memset(hdr,0,sizeof(*hdr));
+  hdr->magic = MP_MAGIC;
+  hdr->version = MP_HDR_VER_TOK;
+  hdr->count = ed->count;
+  hdr->autorun = autorun ? 1 : 0;
+
+  uint8_t rec[MP_REC_MAX];
+  uint32_t data_len=0;
+  for (uint8_t i=0;i<ed->count;i++) data_len += storage_encode_record(ed, i, rec);
+  hdr->data_len = data_len;
+  hdr->checksum = 0;
+
+  mp_sum_t sum;
+  mp_sum_begin(&sum, hdr->version);
+  mp_sum_update(&sum, hdr, sizeof(*hdr));
+  for (uint8_t i=0;i<ed->count;i++){
+    uint8_t n = storage_encode_record(ed, i, rec);
+    mp_sum_update(&sum, rec, n);
   }
-  return true;
+  hdr->checksum = mp_sum_end(&sum);
 }
 
-static bool flash_stream_flush(flash_stream_t *s){
-  if (!s) return false;
-  if (s->fill == 0) return true;
-  if (!flash_prog_dw(s->addr, s->buf)) return false;
-  s->addr += 8;
-  s->fill = 0;
-  memset(s->buf, 0xFF, sizeof(s->buf));
+/* True if the slot already holds exactly this header + record stream. */
+static bool storage_slot_equals(uint32_t base, const mp_hdr_t *hdr, const mp_editor_t *ed){
+  const uint8_t *p = (const uint8_t*)base;
+  if (memcmp(p, hdr, sizeof(*hdr)) != 0) return false;
+  p += sizeof(*hdr);
+  uint8_t rec[MP_REC_MAX];
+  for (uint8_t i=0;i<ed->count;i++){
+    uint8_t n = storage_encode_record(ed, i, rec);
+    if (memcmp(p, rec, n) != 0) return false;
+    p += n;
+  }
   return true;
 }
 
-static bool storage_save_slot(uint8_t slot, const mp_editor_t *ed, bool autorun){
-  flash_err_clear();
-  mp_hdr_t hdr; memset(&hdr,0,sizeof(hdr));
-  hdr.magic = MP_MAGIC;
-  hdr.version = 2;
-  hdr.count = ed->count;
-  hdr.autorun = autorun ? 1 : 0;
+/* Header + checksum check of a stored image (no copy). */
+static bool storage_image_valid(uint32_t base, uint32_t slot_size, bool need_lines){
+  const mp_hdr_t *hdr = (const mp_hdr_t*)base;
+  if (hdr->magic != MP_MAGIC || !mp_hdr_version_ok(hdr->version)) return false;
+  if (hdr->count > MP_MAX_LINES) return false;
+  if (need_lines && hdr->count == 0) return false;
 
-  uint32_t data_len=0;
-  for (uint8_t i=0;i<ed->count;i++){
-    uint8_t slen = (uint8_t)strnlen(ed->lines[i].text, MP_LINE_LEN-1);
-    data_len += 2 + 1 + slen;
-  }
-  hdr.data_len = data_len;
-  hdr.checksum = 0;
+  uint32_t total = sizeof(*hdr) + hdr->data_len;
+  if (total > slot_size) return false;
 
-  uint32_t h = 2166136261u;
-  h = fnv1a32_update(h, &hdr, sizeof(hdr));
-  for (uint8_t i=0;i<ed->count;i++){
-    uint16_t ln = (uint16_t)ed->lines[i].line_no;
-    uint8_t slen = (uint8_t)strnlen(ed->lines[i].text, MP_LINE_LEN-1);
-    h = fnv1a32_update(h, &ln, 2);
-    h = fnv1a32_update(h, &slen, 1);
-    h = fnv1a32_update(h, ed->lines[i].text, slen);
+  mp_hdr_t h0 = *hdr;
+  uint32_t stored = h0.checksum;
+  h0.checksum = 0;
+
+  mp_sum_t sum;
+  mp_sum_begin(&sum, h0.version);
+  mp_sum_update(&sum, &h0, sizeof(h0));
+  const uint8_t *p = (const uint8_t*)base + sizeof(*hdr);
+  mp_sum_update(&sum, p, hdr->data_len);
+  return (mp_sum_end(&sum) == stored);
+}
+
+/*
+ * Background save.
+ * SAVE only queues a job; mp_flash_task() then does one step per main-loop pass
+ * (erase one page, program one page, commit), so USB, MIC DMA and LEDs keep running.
+ * Only the pages covered by the new image are touched, blank pages are not erased
+ * again, and an identical image is not rewritten at all.
+ *
+ * The first MP_HDR_HOLD bytes (the header) are programmed last: after a power loss
+ * mid-save the header is blank and the slot reads as empty, never as a torn program.
+ * While a job is pending the editor buffer is its data source (edits are refused)
+ * and the target slot is hidden from LOAD/autorun.
+ */
+#define MP_HDR_HOLD ((uint32_t)((sizeof(mp_hdr_t) + 7u) & ~7u))
+
+typedef enum { FJ_IDLE = 0, FJ_ERASE, FJ_PROG, FJ_COMMIT } fj_state_t;
+
+typedef struct {
+  const mp_editor_t *ed;
+  uint8_t slot;
+  bool    autorun;
+} fj_req_t;
+
+typedef struct {
+  fj_req_t   q[MP_FLASH_JOB_QUEUE];
+  uint8_t    q_head;
+  uint8_t    q_count;
+  fj_state_t state;
+  fj_req_t   cur;
+  mp_hdr_t   hdr;
+  uint32_t   base;
+  uint32_t   total;
+  uint32_t   pages;
+  uint32_t   page;      /* next page to erase / program */
+  uint32_t   pos;       /* image bytes produced so far */
+  uint8_t    rd_line;   /* image reader: record index */
+  uint8_t    rd_off;    /* image reader: byte offset inside the record */
+  uint8_t    rec_len;
+  uint8_t    rec[MP_REC_MAX];  /* image reader: current encoded record */
+  uint32_t   row[MP_FLASH_ROW_SIZE/4u];  /* word aligned: HAL reads it as the fast-row source */
+  uint32_t   head[MP_HDR_HOLD/4u];       /* held-back header bytes */
+  mp_flash_status_t last;
+  const char *err;
+  uint32_t   hal_err;
+  uint32_t   t0;
+} fj_t;
+
+static fj_t g_fj;
+
+static bool storage_busy(void){
+  return (g_fj.state != FJ_IDLE) || (g_fj.q_count != 0);
+}
+
+static bool storage_slot_busy(uint8_t slot){
+  if (g_fj.state != FJ_IDLE && g_fj.cur.slot == slot) return true;
+  for (uint8_t i=0;i<g_fj.q_count;i++){
+    if (g_fj.q[(g_fj.q_head + i) % MP_FLASH_JOB_QUEUE].slot == slot) return true;
   }
-  hdr.checksum = h;
+  return false;
+}
 
-  uint32_t total = sizeof(hdr) + data_len;
-  uint32_t slot_size = slot_size_bytes();
+static bool storage_save_queue(uint8_t slot, const mp_editor_t *ed, bool autorun){
+  flash_err_clear();
+  uint8_t rec[MP_REC_MAX];
+  uint32_t total = sizeof(mp_hdr_t);
+  for (uint8_t i=0;i<ed->count;i++) total += storage_encode_record(ed, i, rec);
+  uint32_t slot_size = slot_size_bytes(slot);
   if (slot_size == 0){ flash_err_set("slot size"); return false; }
   if (total > slot_size){ flash_err_set("too big"); return false; }
+  if ((slot_base_addr(slot) + slot_size) > flash_data_end()){ flash_err_set("slot range"); return false; }
+  if (g_fj.q_count >= MP_FLASH_JOB_QUEUE){ flash_err_set("queue full"); return false; }
+
+  fj_req_t *r = &g_fj.q[(g_fj.q_head + g_fj.q_count) % MP_FLASH_JOB_QUEUE];
+  r->ed = ed;
+  r->slot = slot;
+  r->autorun = autorun;
+  g_fj.q_count++;
+  return true;
+}
 
-  uint32_t base = slot_base_addr(slot);
-  if ((base + slot_size) > flash_data_end()){ flash_err_set("slot range"); return false; }
+/* Next n bytes of the image (header, then v4 records encoded one at a time). */
+static uint32_t fj_read(uint8_t *dst, uint32_t n){
+  uint32_t got = 0;
+  while (got < n && g_fj.pos < g_fj.total){
+    if (g_fj.pos < sizeof(mp_hdr_t)){
+      dst[got++] = ((const uint8_t*)&g_fj.hdr)[g_fj.pos++];
+      continue;
+    }
+    if (g_fj.rd_off == 0) g_fj.rec_len = storage_encode_record(g_fj.cur.ed, g_fj.rd_line, g_fj.rec);
+    dst[got++] = g_fj.rec[g_fj.rd_off++];
+    g_fj.pos++;
+    if (g_fj.rd_off >= g_fj.rec_len){ g_fj.rd_off = 0; g_fj.rd_line++; }
+  }
+  return got;
+}
+
+static bool fj_end(bool ok){
+  g_fj.state = FJ_IDLE;
+  g_fj.last = ok ? MP_FLASH_DONE : MP_FLASH_FAILED;
+  g_fj.err = ok ? 0 : g_flash_err;
+  g_fj.hal_err = ok ? 0u : g_flash_hal_err;
+  g_save_stats.ms = mp_hal_millis() - g_fj.t0;
+  return true;
+}
+
+static bool fj_begin(void){
+  g_fj.cur = g_fj.q[g_fj.q_head];
+  g_fj.q_head = (uint8_t)((g_fj.q_head + 1u) % MP_FLASH_JOB_QUEUE);
+  g_fj.q_count--;
 
-  flash_clear_errors();
-  if(!flash_unlock()){ flash_err_set("unlock"); return false; }
-  bool ok = flash_erase_region(base, slot_size);
-  if (!ok){ flash_err_set("erase"); }
+  g_fj.t0 = mp_hal_millis();
+  memset(&g_save_stats, 0, sizeof(g_save_stats));
+  flash_err_clear();
+  storage_build_hdr(g_fj.cur.ed, g_fj.cur.autorun, &g_fj.hdr);
+  g_fj.base = slot_base_addr(g_fj.cur.slot);
+  g_fj.total = sizeof(mp_hdr_t) + g_fj.hdr.data_len;
+  g_fj.pages = (g_fj.total + MP_FLASH_PAGE_SIZE - 1u) / MP_FLASH_PAGE_SIZE;
+  g_fj.page = 0;
+  g_fj.pos = 0;
+  g_fj.rd_line = 0;
+  g_fj.rd_off = 0;
+  g_save_stats.bytes = g_fj.total;
+  g_save_stats.pages_used = (uint8_t)g_fj.pages;
+
+  if (storage_slot_equals(g_fj.base, &g_fj.hdr, g_fj.cur.ed)){
+    g_save_stats.unchanged = true;
+    return fj_end(true);
+  }
+  g_fj.state = FJ_ERASE;
+  return false;
+}
 
-  flash_stream_t fs;
-  if (ok && !flash_stream_init(&fs, base)){
-    flash_err_set("align");
-    ok = false;
+/* One step of the save queue; returns true when a job has just finished (see g_fj.last). */
+static bool fj_step(void){
+  if (g_fj.state == FJ_IDLE){
+    if (g_fj.q_count == 0) return false;
+    return fj_begin();
   }
-  if (ok){
-    ok = flash_stream_write(&fs, (const uint8_t*)&hdr, sizeof(hdr));
+
+  fj_state_t st = g_fj.state;
+  mp_flash_clear_errors();
+  if (!flash_unlock()){ flash_err_set("unlock"); return fj_end(false); }
+  bool ok = true;
+
+  if (st == FJ_ERASE){
+    uint32_t pa = g_fj.base + g_fj.page * MP_FLASH_PAGE_SIZE;
+    if (!flash_page_is_blank(pa)){
+      ok = flash_erase_page(pa);
+      if (ok) g_save_stats.pages_erased++;
+      else flash_err_set("erase");
+    }
+    if (++g_fj.page >= g_fj.pages){ g_fj.page = 0; g_fj.state = FJ_PROG; }
+  } else if (st == FJ_PROG){
+    uint32_t pa = g_fj.base + g_fj.page * MP_FLASH_PAGE_SIZE;
+    for (uint32_t r=0; r<MP_FLASH_PAGE_SIZE/MP_FLASH_ROW_SIZE && ok && g_fj.pos < g_fj.total; r++){
+      uint32_t addr = pa + r * MP_FLASH_ROW_SIZE;
+      memset(g_fj.row, 0xFF, sizeof(g_fj.row));
+      uint32_t len = (fj_read((uint8_t*)g_fj.row, MP_FLASH_ROW_SIZE) + 7u) & ~7u;
+      if (addr == g_fj.base){
+        memcpy(g_fj.head, g_fj.row, MP_HDR_HOLD);
+        ok = flash_prog_block(addr + MP_HDR_HOLD, g_fj.row + MP_HDR_HOLD/4u, len - MP_HDR_HOLD);
+      } else {
+        ok = flash_prog_block(addr, g_fj.row, len);
+      }
+      if (!ok) flash_err_set("prog data");
+    }
+    g_fj.page++;
+    if (g_fj.pos >= g_fj.total) g_fj.state = FJ_COMMIT;
+  } else {
+    ok = flash_prog_block(g_fj.base, g_fj.head, MP_HDR_HOLD);
     if (!ok) flash_err_set("prog hdr");
   }
 
-  for (uint8_t i=0;i<ed->count && ok;i++){
-    uint16_t ln = (uint16_t)ed->lines[i].line_no;
-    uint8_t slen = (uint8_t)strnlen(ed->lines[i].text, MP_LINE_LEN-1);
-    uint8_t rec_hdr[3] = { (uint8_t)(ln&0xFF), (uint8_t)((ln>>8)&0xFF), slen };
-    ok = flash_stream_write(&fs, rec_hdr, 3);
-    if (ok){ ok = flash_stream_write(&fs, (const uint8_t*)ed->lines[i].text, slen); }
-    if (!ok){ flash_err_set("prog data"); }
-  }
-  if (ok && !flash_stream_flush(&fs)){
-    flash_err_set("prog data");
-    ok = false;
+  flash_lock();
+  if (!ok) return fj_end(false);
+  if (st == FJ_COMMIT){
+    if (!storage_image_valid(g_fj.base, slot_size_bytes(g_fj.cur.slot), false)){
+      flash_err_set("verify");
+      return fj_end(false);
+    }
+    return fj_end(true);
   }
+  return false;
+}
 
-  flash_lock();
-  return ok;
+mp_flash_status_t mp_flash_status(void){
+  if (storage_busy()) return MP_FLASH_BUSY;
+  return g_fj.last;
 }
 
 static bool storage_load_slot(uint8_t slot, mp_editor_t *ed, bool *autorun_out){
+  /* A pending save streams from the editor buffer; do not overwrite it. */
+  if (storage_busy()) return false;
   flash_err_clear();
   uint32_t base = slot_base_addr(slot);
-  uint32_t slot_size = slot_size_bytes();
+  uint32_t slot_size = slot_size_bytes(slot);
   if (slot_size == 0){ flash_err_set("slot size"); return false; }
   if ((base + slot_size) > flash_data_end()){ flash_err_set("slot range"); return false; }
+  /* Verify the whole image first so a bad slot never clobbers the editor. */
+  if (!storage_image_valid(base, slot_size, false)) return false;
   const mp_hdr_t *hdr = (const mp_hdr_t*)base;
-  if (hdr->magic != MP_MAGIC || hdr->version != 2) return false;
-  if (hdr->count > MP_MAX_LINES) return false;
-
-  uint32_t total = sizeof(*hdr) + hdr->data_len;
-  if (total > slot_size) return false;
-
-  mp_hdr_t h0 = *hdr;
-  uint32_t stored = h0.checksum;
-  h0.checksum = 0;
-
-  uint32_t h = 2166136261u;
-  h = fnv1a32_update(h, &h0, sizeof(h0));
 
   const uint8_t *p = (const uint8_t*)base + sizeof(*hdr);
   uint32_t remain = hdr->data_len;
+  int ln = 0;
 
   ed_init(ed);
   for (uint16_t i=0;i<hdr->count;i++){
-    if (remain < 3) return false;
-    uint16_t ln = (uint16_t)p[0] | ((uint16_t)p[1]<<8);
-    uint8_t slen = p[2];
-    h = fnv1a32_update(h, p, 3);
-    p += 3; remain -= 3;
-    if (remain < slen) return false;
-    h = fnv1a32_update(h, p, slen);
-
-    ed->lines[i].line_no = (int)ln;
-    uint8_t cpy = slen;
-    if (cpy > (MP_LINE_LEN-1)) cpy = (uint8_t)(MP_LINE_LEN-1);
-    memcpy(ed->lines[i].text, p, cpy);
-    ed->lines[i].text[cpy]=0;
-    p += slen; remain -= slen;
+    if (!storage_rec_next(hdr->version, &p, &remain, &ln, ed->lines[i].text)){ ed_init(ed); return false; }
+    ed->lines[i].line_no = ln;
     ed->count++;
   }
 
-  if (h != stored) return false;
   if (autorun_out) *autorun_out = (hdr->autorun != 0);
   return true;
 }
 
-static bool storage_slot_has_program(uint8_t slot){
+/*
+ * Monitor output longer than the console buffer (HELP, LIST) is printed a line per
+ * mp_task() pass (out_poll); input waits meanwhile (mp_output_pending).
+ */
+enum { MP_OUT_NONE = 0, MP_OUT_TEXT, MP_OUT_LIST, MP_OUT_SLOT };
+static struct {
+  uint8_t kind;
+  uint8_t slot;
+  uint16_t i;             /* next line (LIST) / records left (LIST slot) */
+  uint16_t version;
+  int ln;
+  uint32_t remain;
+  const uint8_t *p;
+  const char *text;
+} g_out;
+
+/* LIST <slot>: print a stored program straight from flash (editor untouched). */
+static bool storage_list_slot(uint8_t slot){
+  if (storage_slot_busy(slot)) return false;
   uint32_t base = slot_base_addr(slot);
-  uint32_t slot_size = slot_size_bytes();
+  uint32_t slot_size = slot_size_bytes(slot);
   if (slot_size == 0) return false;
   if ((base + slot_size) > flash_data_end()) return false;
+  if (!storage_image_valid(base, slot_size, false)) return false;
 
   const mp_hdr_t *hdr = (const mp_hdr_t*)base;
-  if (hdr->magic != MP_MAGIC || hdr->version != 2) return false;
-  if (hdr->count == 0 || hdr->count > MP_MAX_LINES) return false;
-
-  uint32_t total = sizeof(*hdr) + hdr->data_len;
-  if (total > slot_size) return false;
-
-  mp_hdr_t h0 = *hdr;
-  uint32_t stored = h0.checksum;
-  h0.checksum = 0;
+  g_out.kind = MP_OUT_SLOT;
+  g_out.slot = slot;
+  g_out.i = hdr->count;
+  g_out.version = hdr->version;
+  g_out.p = (const uint8_t*)base + sizeof(*hdr);
+  g_out.remain = hdr->data_len;
+  g_out.ln = 0;
+  return true;
+}
 
-  uint32_t h = 2166136261u;
-  h = fnv1a32_update(h, &h0, sizeof(h0));
-  const uint8_t *p = (const uint8_t*)base + sizeof(*hdr);
-  h = fnv1a32_update(h, p, hdr->data_len);
-  return (h == stored);
+static bool storage_slot_has_program(uint8_t slot){
+  if (storage_slot_busy(slot)) return false;
+  uint32_t base = slot_base_addr(slot);
+  uint32_t slot_size = slot_size_bytes(slot);
+  if (slot_size == 0) return false;
+  if ((base + slot_size) > flash_data_end()) return false;
+  return storage_image_valid(base, slot_size, true);
 }
 
 static uint8_t slot_step(uint8_t slot, int dir){
@@ -1426,6 +1901,13 @@ static uint8_t slot_find_first_program(void){
   return 0;
 }
 
+/* Boot/autorun slot: CONFIG slot if it holds a program, else the first non-empty one. */
+static uint8_t slot_find_default_program(void){
+  int32_t def = SETTINGS_GetOr(SET_DEFAULT_SLOT, 0);
+  if (def >= 1 && def <= (int32_t)MP_FLASH_SLOT_COUNT && storage_slot_has_program((uint8_t)def)) return (uint8_t)def;
+  return slot_find_first_program();
+}
+
 static uint8_t g_first_program_slot = 0;
 
 static void refresh_program_slot_cache(void){
@@ -1470,94 +1952,165 @@ typedef struct {
 } mp_edit_t;
 static mp_edit_t g_edit_state;
 
+/*
+ * What the terminal shows, so edit_render() only sends the difference.
+ * Rows are identified by a 16-bit hash of line number + text (0 = blank row);
+ * the active row also keeps its text for column-level updates.
+ */
+#define MP_EDIT_TOP_ROW 3u    /* screen row of program line 0 (1-based) */
+
+typedef struct {
+  uint8_t  valid;             /* 0 = next render repaints the whole screen */
+  uint8_t  count;             /* program rows on screen */
+  uint8_t  marker;            /* row carrying "> ", 0xFF = none */
+  uint8_t  text_idx;          /* row whose text is in text[], 0xFF = none */
+  int      text_no;
+  uint16_t hash[MP_MAX_LINES];
+  char     text[MP_LINE_LEN];
+} mp_screen_t;
+static mp_screen_t g_scr;
+
+/* EDSTAT: terminal output of the editor. */
+typedef struct {
+  uint32_t renders;
+  uint32_t bytes;
+  uint32_t full;
+  uint16_t last;
+  uint16_t max;
+} mp_edit_stats_t;
+static mp_edit_stats_t g_edit_stats;
+static uint16_t g_edit_out;
+static uint8_t g_edit_more;     /* rows left undrawn for lack of console room (out_poll) */
+
 static void mp_prompt(void){
   if (g_edit) return;
   mp_puts("> ");
 }
 
-static void help(void){
-  mp_puts("MiniPascal monitor\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== COMMANDS ===\r\n");
-  mp_puts("  EDIT         edit current buffer\r\n");
-  mp_puts("  EDIT 1       edit program from slot 1 (1-6)\r\n");
-  mp_puts("  NEW          clear program\r\n");
-  mp_puts("  CLR          clear program (alias of NEW)\r\n");
-  mp_puts("  LIST         show program\r\n");
-  mp_puts("  RUN          compile and run\r\n");
-  mp_puts("  STOP         stop running\r\n");
-  mp_puts("  QUIT         exit Pascal mode (alias: EXIT)\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== EDIT MODE ===\r\n");
-  mp_puts("  Arrow keys move, DEL/BKSP delete, ENTER splits line.\r\n");
-  mp_puts("  Ctrl+Q exits edit mode (or type QUIT on its own line).\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== FLASH STORAGE ===\r\n");
-  mp_puts("  SAVE 1       save to slot 1 (1-6)\r\n");
-  mp_puts("  LOAD 1       load from slot\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== PASCAL FUNCTIONS ===\r\n");
-  mp_puts("  LED(idx,r,g,b,w)    set LED color (idx 1-12)\r\n");
-  mp_puts("  LEDON(r,g,b,w)      set all LEDs on\r\n");
-  mp_puts("  LEDOFF()            turn all LEDs off\r\n");
-  mp_puts("  // comment          ignore rest of line\r\n");
-  mp_puts("  DELAY(ms)           delay milliseconds (battery: low power sleep)\r\n");
-  mp_puts("  BEEP(freq,vol,ms)   beep tone (vol 0-50)\r\n");
-  mp_puts("  GOTO n              jump to line n\r\n");
-  mp_puts("  TIME()              read RTC into TIMEY/TIMEMO/TIMED/TIMEH/TIMEM/TIMES\r\n");
-  mp_puts("  TIME(sel)           return part: 0=YY 1=MO 2=DD 3=HH 4=MM 5=SS (also: TIME(yy|mo|dd|hh|mm|ss))\r\n");
-  mp_puts("  SETTIME(yy,mo,dd,hh,mm) set RTC date+time (sec=0) yy=0..99 mo=1..12 dd=1..31 hh=0..23 mm=0..59\r\n");
-  mp_puts("  SETTIME(hh,mm,ss)   set RTC time only (keeps date) hh=0..23 mm=0..59 ss=0..59\r\n");
-  mp_puts("  WRITELN(...)        print text/numbers + newline (only when USB connected)\r\n");
-  mp_puts("  SETALARM(hh,mm[,dur]) set daily alarm at HH:MM (dur seconds, dur=0 disables, default dur=30)\r\n");
-  mp_puts("  ALARM()             alarm active flag (1 while alarm is running, else 0)\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== READ FUNCTIONS (return value) ===\r\n");
-  mp_puts("  BATTERY()    battery mV\r\n");
-  mp_puts("  LIGHT()      light lux\r\n");
-  mp_puts("  RNG()        random number\r\n");
-  mp_puts("  TEMP()       temperature (x100)\r\n");
-  mp_puts("  HUM()        humidity (x100)\r\n");
-  mp_puts("  PRESS()      pressure (x100)\r\n");
-  mp_puts("  BTN()        next short-press event (0=none, 1=B1, 2=B2, 3=BL)\r\n");
-  mp_puts("  MIC()        microphone level\r\n");
-  mp_puts("  MICFFT()     3-band mic bins -> MICLF/MICMF/MICHF (dBFS*100)\r\n");
-  mp_puts("              LF=100-400Hz MF=400-1600Hz HF=1600-4000Hz (avg window ~250ms)\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== FLOW CONTROL ===\r\n");
-  mp_puts("  10 x:=1\r\n");
-  mp_puts("  20 if (x>0) then led(1,255,0,0,0)\r\n");
-  mp_puts("  30 end\r\n");
-  mp_puts("\r\n");
-  mp_puts("  10 x:=1\r\n");
-  mp_puts("  20 if (x>0) then begin\r\n");
-  mp_puts("  30 led(1,255,0,0,0)\r\n");
-  mp_puts("  40 end\r\n");
-  mp_puts("  50 end\r\n");
-  mp_puts("\r\n");
-  mp_puts("  10 x:=3\r\n");
-  mp_puts("  20 while (x>0) do begin\r\n");
-  mp_puts("  30 led(x,255,0,0,0)\r\n");
-  mp_puts("  40 x:=x-1\r\n");
-  mp_puts("  50 end\r\n");
-  mp_puts("  60 end\r\n");
-  mp_puts("\r\n");
-  mp_puts("  10 x:=3\r\n");
-  mp_puts("  20 repeat\r\n");
-  mp_puts("  30 x:=x-1\r\n");
-  mp_puts("  40 until (x<1)\r\n");
-  mp_puts("  50 end\r\n");
-  mp_puts("\r\n");
-  mp_puts("=== VARIABLES ===\r\n");
-  mp_puts("  x := 5       assign\r\n");
-  mp_puts("  x := x + 1   expression\r\n");
-  mp_puts("  IF x>5 THEN GOTO 100\r\n");
-  mp_puts("  IF x>5 THEN x:=1 ELSE x:=0\r\n");
-  mp_puts("  TIME() then TIMEY/TIMEMO/TIMED/TIMEH/TIMEM\r\n");
-  mp_puts("  x := time(MM)  minutes\r\n");
-  mp_puts("  WRITELN('x=', x)\r\n");
-  mp_puts("\r\n");
-  mp_puts("Tip: hold BL to enter stop, wake with B1\r\n");
+static const char g_help_text[] =
+  "MiniPascal monitor\r\n"
+  "\r\n"
+  "=== COMMANDS ===\r\n"
+  "  EDIT         edit current buffer\r\n"
+  "  EDIT 1       edit program from slot 1 (1-6)\r\n"
+  "  NEW          clear program\r\n"
+  "  CLR          clear program (alias of NEW)\r\n"
+  "  LIST         show program\r\n"
+  "  LIST 1       show program stored in slot 1\r\n"
+  "  RUN          compile and run\r\n"
+  "  STOP         stop running\r\n"
+  "  QUIT         exit Pascal mode (alias: EXIT)\r\n"
+  "\r\n"
+  "=== EDIT MODE ===\r\n"
+  "  Arrow keys move, DEL/BKSP delete, ENTER splits line.\r\n"
+  "  Ctrl+Q exits edit mode (or type QUIT on its own line), Ctrl+L redraws.\r\n"
+  "\r\n"
+  "=== FLASH STORAGE ===\r\n"
+  "  SAVE 1       save to slot 1 (1-6)\r\n"
+  "  LOAD 1       load from slot\r\n"
+  "  FSTAT        background flash write status\r\n"
+  "  EDSTAT       editor terminal output (bytes per redraw), EDSTAT 0 resets\r\n"
+  "  UPLOAD s n c binary upload: n bytes of numbered lines, CRC-32 c (hex), no echo\r\n"
+  "               s=0 editor only, s=1-6 also compile + save to slot\r\n"
+  "\r\n"
+  "=== PASCAL FUNCTIONS ===\r\n"
+  "  LED(idx,r,g,b,w)    set LED color (idx 1-12)\r\n"
+  "  LEDON(r,g,b,w)      set all LEDs on\r\n"
+  "  LEDOFF()            turn all LEDs off\r\n"
+  "  // comment          ignore rest of line\r\n"
+  "  DELAY(ms)           delay milliseconds (battery: low power sleep)\r\n"
+  "  BEEP(freq,vol,ms)   beep tone (vol 0-50)\r\n"
+  "  GOTO n              jump to line n\r\n"
+  "  TIME()              read RTC into TIMEY/TIMEMO/TIMED/TIMEH/TIMEM/TIMES\r\n"
+  "  TIME(sel)           return part: 0=YY 1=MO 2=DD 3=HH 4=MM 5=SS (also: TIME(yy|mo|dd|hh|mm|ss))\r\n"
+  "  SETTIME(yy,mo,dd,hh,mm) set RTC date+time (sec=0) yy=0..99 mo=1..12 dd=1..31 hh=0..23 mm=0..59\r\n"
+  "  SETTIME(hh,mm,ss)   set RTC time only (keeps date) hh=0..23 mm=0..59 ss=0..59\r\n"
+  "  WRITELN(...)        print text/numbers + newline (only when USB connected)\r\n"
+  "  SETALARM(hh,mm[,dur]) set daily alarm at HH:MM (dur seconds, dur=0 disables, default dur=30)\r\n"
+  "  ALARM()             alarm active flag (1 while alarm is running, else 0)\r\n"
+  "\r\n"
+  "=== READ FUNCTIONS (return value) ===\r\n"
+  "  BATTERY()    battery mV\r\n"
+  "  LIGHT()      light lux\r\n"
+  "  RNG()        random number\r\n"
+  "  TEMP()       temperature (x100)\r\n"
+  "  HUM()        humidity (x100)\r\n"
+  "  PRESS()      pressure (x100)\r\n"
+  "  BTN()        next button event (0=none, 1=B1, 2=B2, 3=BL;\r\n"
+  "               +10 double, +20 triple, +30 hold repeat, +40 long)\r\n"
+  "  MIC()        microphone level\r\n"
+  "  MICFFT()     3-band mic bins -> MICLF/MICMF/MICHF (dBFS*100)\r\n"
+  "              LF=100-400Hz MF=400-2000Hz HF=2000-8000Hz (avg window 100ms)\r\n"
+  "  MICBANDS(n)  n=1..8 log-spaced bands 100-8000Hz -> MICB1..MICBn (dBFS*100)\r\n"
+  "  MICCONF(d[,w[,n[,p[,a]]]])  mic decim 4..32, window ms, DMA words, powersave ms,\r\n"
+  "              adaptive max gap ms (0=off; omitted args keep their value) -> 0 or error\r\n"
+  "  BEAT()       beat count (does not wait; keeps the mic running while polled)\r\n"
+  "              -> BPM (0=no tempo yet), BEATPH 0..255 since the beat, ONSETS\r\n"
+  "\r\n"
+  "=== FLOW CONTROL ===\r\n"
+  "  10 x:=1\r\n"
+  "  20 if (x>0) then led(1,255,0,0,0)\r\n"
+  "  30 end\r\n"
+  "\r\n"
+  "  10 x:=1\r\n"
+  "  20 if (x>0) then begin\r\n"
+  "  30 led(1,255,0,0,0)\r\n"
+  "  40 end\r\n"
+  "  50 end\r\n"
+  "\r\n"
+  "  10 x:=3\r\n"
+  "  20 while (x>0) do begin\r\n"
+  "  30 led(x,255,0,0,0)\r\n"
+  "  40 x:=x-1\r\n"
+  "  50 end\r\n"
+  "  60 end\r\n"
+  "\r\n"
+  "  10 x:=3\r\n"
+  "  20 repeat\r\n"
+  "  30 x:=x-1\r\n"
+  "  40 until (x<1)\r\n"
+  "  50 end\r\n"
+  "\r\n"
+  "=== VARIABLES ===\r\n"
+  "  x := 5       assign\r\n"
+  "  x := x + 1   expression\r\n"
+  "  IF x>5 THEN GOTO 100\r\n"
+  "  IF x>5 THEN x:=1 ELSE x:=0\r\n"
+  "  TIME() then TIMEY/TIMEMO/TIMED/TIMEH/TIMEM\r\n"
+  "  x := time(MM)  minutes\r\n"
+  "  WRITELN('x=', x)\r\n"
+  "\r\n"
+  "Tip: hold BL to enter stop, wake with B1\r\n";
+
+/* One line of g_out; false when it is finished. */
+static bool out_step(void){
+  switch (g_out.kind){
+    case MP_OUT_TEXT: {
+      const char *t = g_out.text;
+      while (*t && *t != '\n') mp_hal_putchar(*t++);
+      if (*t) mp_hal_putchar(*t++);
+      g_out.text = t;
+      return *t != 0;
+    }
+    case MP_OUT_LIST:
+      if (g_out.i >= g_ed.count) return false;
+      list_line(g_ed.lines[g_out.i].line_no, g_ed.lines[g_out.i].text);
+      return ++g_out.i < g_ed.count;
+    case MP_OUT_SLOT: {
+      char text[MP_LINE_LEN];
+      if (g_out.i == 0) return false;
+      /* A SAVE to this slot may have started since the last line. */
+      if (storage_slot_busy(g_out.slot) ||
+          !storage_rec_next(g_out.version, &g_out.p, &g_out.remain, &g_out.ln, text)){
+        mp_puts("LIST FAIL\r\n");
+        return false;
+      }
+      list_line(g_out.ln, text);
+      return --g_out.i != 0;
+    }
+    default:
+      return false;
+  }
 }
 
 static void edit_load_from_ed(uint8_t idx)
@@ -1719,30 +2272,168 @@ static void edit_insert_line_after(uint8_t after_idx, const char *text)
   g_ed.count++;
 }
 
+static void edit_puts(const char *s)
+{
+  while (*s) { mp_hal_putchar(*s++); g_edit_out++; }
+}
+
+static void edit_goto(uint8_t row, uint8_t col)
+{
+  FMT_Write(edit_puts, "\x1b[%u;%uH", (unsigned)row, (unsigned)col);
+}
+
+static const char *edit_row_text(uint8_t i)
+{
+  return (i == g_edit_state.line_idx) ? g_edit_state.buf : g_ed.lines[i].text;
+}
+
+static uint8_t edit_text_col(uint8_t i)
+{
+  char ln[16];
+  mp_itoa(g_ed.lines[i].line_no, ln);
+  return (uint8_t)(3u + (uint8_t)strlen(ln) + 1u);
+}
+
+static uint16_t edit_row_hash(uint8_t i)
+{
+  uint32_t h = 2166136261u ^ (uint32_t)g_ed.lines[i].line_no;
+  for (const char *p = edit_row_text(i); *p; p++)
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  uint16_t r = (uint16_t)(h ^ (h >> 16));
+  return r ? r : 1u;
+}
+
+static void edit_draw_row(uint8_t i)
+{
+  char ln[16];
+  mp_itoa(g_ed.lines[i].line_no, ln);
+  edit_goto((uint8_t)(MP_EDIT_TOP_ROW + i), 1u);
+  edit_puts(i == g_edit_state.line_idx ? "> " : "  ");
+  edit_puts(ln); edit_puts(" ");
+  edit_puts(edit_row_text(i));
+  edit_puts("\x1b[K");
+}
+
+/* Active row with an unchanged line number: rewrite from the first differing column. */
+static void edit_update_text(uint8_t i)
+{
+  const char *t = edit_row_text(i);
+  uint8_t c = 0;
+  while (t[c] && t[c] == g_scr.text[c]) c++;
+  edit_goto((uint8_t)(MP_EDIT_TOP_ROW + i), (uint8_t)(edit_text_col(i) + c));
+  edit_puts(&t[c]);
+  if (g_scr.text[c] && strlen(&t[c]) < strlen(&g_scr.text[c])) edit_puts("\x1b[K");
+}
+
+/* Clear the screen and mark every row blank; edit_render() then draws them as room allows. */
+static void edit_render_full(void)
+{
+  edit_puts("\x1b[2J\x1b[H"); /* clear + home */
+  edit_puts("MINIPASCAL EDIT  (Ctrl+Q exits, QUIT on empty line also exits)\r\n\r\n");
+
+  memset(g_scr.hash, 0, sizeof(g_scr.hash));
+  g_scr.count = g_ed.count;
+  g_scr.marker = 0xFFu;
+  g_scr.text_idx = 0xFFu;
+  g_scr.valid = 1u;
+  g_edit_stats.full++;
+}
+
+/* One line inserted (dir > 0) or removed (dir < 0) at row k: scroll the rows below. */
+static void edit_scroll_rows(uint8_t k, int dir)
+{
+  edit_goto((uint8_t)(MP_EDIT_TOP_ROW + k), 1u);
+  if (dir > 0)
+  {
+    edit_puts("\x1b[L");
+    memmove(&g_scr.hash[k + 1u], &g_scr.hash[k], (size_t)(g_scr.count - k) * sizeof(g_scr.hash[0]));
+    g_scr.hash[k] = 0u;
+    g_scr.count++;
+    if (g_scr.marker != 0xFFu && g_scr.marker >= k) g_scr.marker++;
+    if (g_scr.text_idx != 0xFFu && g_scr.text_idx >= k) g_scr.text_idx++;
+  }
+  else
+  {
+    edit_puts("\x1b[M");
+    memmove(&g_scr.hash[k], &g_scr.hash[k + 1u], (size_t)(g_scr.count - k - 1u) * sizeof(g_scr.hash[0]));
+    g_scr.count--;
+    g_scr.hash[g_scr.count] = 0u;
+    if (g_scr.marker == k) g_scr.marker = 0xFFu;
+    else if (g_scr.marker != 0xFFu && g_scr.marker > k) g_scr.marker--;
+    if (g_scr.text_idx == k) g_scr.text_idx = 0xFFu;
+    else if (g_scr.text_idx != 0xFFu && g_scr.text_idx > k) g_scr.text_idx--;
+  }
+}
+
 static void edit_render(void)
 {
-  mp_puts("\x1b[2J\x1b[H"); /* clear + home */
-  mp_puts("MINIPASCAL EDIT  (Ctrl+Q exits, QUIT on empty line also exits)\r\n\r\n");
+  g_edit_out = 0u;
+  g_edit_more = 0u;
+  uint8_t n = g_ed.count;
+  uint8_t cur_row = g_edit_state.line_idx;
 
-  for (uint8_t i = 0; i < g_ed.count; i++)
+  if (!g_scr.valid)
+    edit_render_full();
+
+  if (n == (uint8_t)(g_scr.count + 1u) || (uint8_t)(n + 1u) == g_scr.count)
   {
-    char ln[16];
-    mp_itoa(g_ed.lines[i].line_no, ln);
-    if (i == g_edit_state.line_idx) mp_puts("> "); else mp_puts("  ");
-    mp_puts(ln); mp_puts(" ");
-    if (i == g_edit_state.line_idx) mp_puts(g_edit_state.buf);
-    else mp_puts(g_ed.lines[i].text);
-    mp_putcrlf();
+    uint8_t k = 0;
+    uint8_t lim = (n < g_scr.count) ? n : g_scr.count;
+    while (k < lim && edit_row_hash(k) == g_scr.hash[k]) k++;
+    edit_scroll_rows(k, (n > g_scr.count) ? +1 : -1);
+  }
+  if (n < g_scr.count)
+  {
+    edit_goto((uint8_t)(MP_EDIT_TOP_ROW + n), 1u);
+    edit_puts("\x1b[J");
+    memset(&g_scr.hash[n], 0, (size_t)(g_scr.count - n) * sizeof(g_scr.hash[0]));
+    if (g_scr.marker != 0xFFu && g_scr.marker >= n) g_scr.marker = 0xFFu;
+  }
+  g_scr.count = n;
+
+  if (g_scr.marker != cur_row)
+  {
+    if (g_scr.marker != 0xFFu && g_scr.hash[g_scr.marker] != 0u)
+    {
+      edit_goto((uint8_t)(MP_EDIT_TOP_ROW + g_scr.marker), 1u);
+      edit_puts("  ");
+    }
+    edit_goto((uint8_t)(MP_EDIT_TOP_ROW + cur_row), 1u);
+    edit_puts("> ");
+    g_scr.marker = cur_row;
+  }
+
+  for (uint8_t i = 0; i < n; i++)
+  {
+    uint16_t h = edit_row_hash(i);
+    if (h == g_scr.hash[i]) continue;
+    if (mp_hal_tx_room() < MP_OUT_ROOM) { g_edit_more = 1u; break; }
+    if (i == cur_row && i == g_scr.text_idx && g_ed.lines[i].line_no == g_scr.text_no)
+      edit_update_text(i);
+    else
+      edit_draw_row(i);
+    g_scr.hash[i] = h;
+  }
+
+  /* edit_update_text() may only diff against a row that is really on screen. */
+  if (g_scr.hash[cur_row] == edit_row_hash(cur_row))
+  {
+    g_scr.text_idx = cur_row;
+    g_scr.text_no = g_ed.lines[cur_row].line_no;
+    memcpy(g_scr.text, g_edit_state.buf, MP_LINE_LEN);
+  }
+  else
+  {
+    g_scr.text_idx = 0xFFu;
   }
 
   /* Place cursor on the active line at the correct column. */
-  uint8_t row = (uint8_t)(3u + g_edit_state.line_idx);
-  char ln[16];
-  mp_itoa(g_ed.lines[g_edit_state.line_idx].line_no, ln);
-  uint8_t col = (uint8_t)(3u + (uint8_t)strlen(ln) + 1u + g_edit_state.cur);
-  char esc[32];
-  snprintf(esc, sizeof(esc), "\x1b[%u;%uH", (unsigned)row, (unsigned)col);
-  mp_puts(esc);
+  edit_goto((uint8_t)(MP_EDIT_TOP_ROW + cur_row), (uint8_t)(edit_text_col(cur_row) + g_edit_state.cur));
+
+  g_edit_stats.renders++;
+  g_edit_stats.bytes += g_edit_out;
+  g_edit_stats.last = g_edit_out;
+  if (g_edit_out > g_edit_stats.max) g_edit_stats.max = g_edit_out;
 }
 
 static void edit_exit(void)
@@ -1759,6 +2450,8 @@ static void edit_exit(void)
 
   g_edit = false;
   g_edit_state = (mp_edit_t){0};
+  g_scr.valid = 0u;
+  g_edit_more = 0u;
   mp_puts("\r\nEDIT OFF\r\n");
   mp_prompt();
 }
@@ -1777,6 +2470,7 @@ static void edit_enter_new(void)
   g_edit_state.added_tail = 1u;
   g_edit_state.line_idx = 0u;
   edit_load_from_ed(0u);
+  g_scr.valid = 0u;
   edit_render();
 }
 
@@ -1809,6 +2503,7 @@ static void edit_enter_resume(void)
   g_edit_state.line_idx = 0u;
   g_edit_state.cur = 0u;
   edit_load_from_ed(0u);
+  g_scr.valid = 0u;
   edit_render();
 }
 
@@ -1849,6 +2544,7 @@ static bool edit_enter_slot(uint8_t slot)
   g_edit_state.line_idx = 0u;
   g_edit_state.cur = 0u;
   edit_load_from_ed(0u);
+  g_scr.valid = 0u;
   edit_render();
   return true;
 }
@@ -2052,6 +2748,49 @@ static void print_compile_ok_stats(void)
   mp_puts(")\r\n");
 }
 
+static void print_save_stats(void)
+{
+  const mp_save_stats_t *st = &g_save_stats;
+  char b[16];
+  mp_puts("SAVED (");
+  if (st->unchanged){
+    mp_puts("unchanged");
+  } else {
+    mp_itoa((int)st->bytes, b); mp_puts(b);
+    mp_puts(" B, erased "); mp_itoa(st->pages_erased, b); mp_puts(b);
+    mp_puts("/"); mp_itoa(st->pages_used, b); mp_puts(b);
+    mp_puts(" pages, rows="); mp_itoa(st->rows_fast, b); mp_puts(b);
+    mp_puts(" dw="); mp_itoa(st->dw_prog, b); mp_puts(b);
+  }
+  mp_puts(", "); mp_itoa((int)st->ms, b); mp_puts(b);
+  mp_puts(" ms)\r\n");
+}
+
+static void print_save_result(void)
+{
+  if (g_fj.last == MP_FLASH_DONE){ print_save_stats(); return; }
+  mp_puts("SAVE FAIL");
+  if (g_fj.err){
+    mp_puts(": ");
+    mp_puts(g_fj.err);
+    if (g_fj.hal_err){
+      mp_puts(" err=0x");
+      char b[12];
+      mp_utoa_hex(g_fj.hal_err, b);
+      mp_puts(b);
+    }
+  }
+  mp_putcrlf();
+}
+
+/* Editor buffer is the source of a queued/running save: refuse changes until it is done. */
+static bool ed_locked(void)
+{
+  if (!storage_busy()) return false;
+  mp_puts("BUSY: flash write in progress\r\n");
+  return true;
+}
+
 static void cmd_run(void){
   compile_or_report();
   if (!g_have_prog) return;
@@ -2080,6 +2819,143 @@ static bool parse_slot_opt(const char *args, uint8_t *slot_out){
 
 
 
+/*
+ * UPLOAD <slot> <len> <crc32hex>: program transfer without echo or redraw.
+ * After "READY" the host sends exactly <len> bytes of "<no> <text>" lines (LF or CRLF;
+ * one LF right after the command line is ignored). The editor is cleared first and
+ * lines go straight into it; a CRC mismatch, bad line or timeout clears it again.
+ * Slot 0 = editor only, 1..6 = also compile and queue a SAVE to that slot.
+ */
+#ifndef MP_UPLOAD_TIMEOUT_MS
+#define MP_UPLOAD_TIMEOUT_MS 2000u
+#endif
+#define MP_UPLOAD_MAX ((uint32_t)MP_MAX_LINES * (MP_LINE_LEN + 6u))
+
+typedef struct {
+  bool        active;
+  bool        skip_lf;
+  uint8_t     slot;
+  uint8_t     n;          /* chars in line[] */
+  uint16_t    lines;
+  uint16_t    bad_line;   /* first rejected line (1-based), 0 = none */
+  uint32_t    len;
+  uint32_t    got;
+  uint32_t    crc;
+  uint32_t    t0;
+  uint32_t    t_last;
+  crc32_ctx_t sum;
+  char        line[MP_LINE_LEN];
+} mp_upload_t;
+
+static mp_upload_t g_up;
+
+static void upload_line(void){
+  g_up.line[g_up.n] = 0;
+  uint8_t n = g_up.n;
+  g_up.n = 0;
+  if (n == 0u || g_up.bad_line) return;
+  g_up.lines++;
+
+  const char *p = g_up.line;
+  int ln = 0;
+  if (!parse_int(&p, &ln) || ln <= 0){ g_up.bad_line = g_up.lines; return; }
+  while (*p==' '||*p=='\t') p++;
+  if (!ed_set(&g_ed, ln, p)) g_up.bad_line = g_up.lines;
+}
+
+static void upload_finish(const char *err){
+  g_up.active = false;
+  uint32_t crc = CRC32_End(&g_up.sum);
+  if (!err){
+    if (g_up.n) upload_line();
+    if (g_up.bad_line) err = "line";
+    else if (crc != g_up.crc) err = "crc";
+  }
+
+  char b[16];
+  if (err){
+    ed_init(&g_ed);
+    mp_puts("UPLOAD FAIL ");
+    mp_puts(err);
+    if (g_up.bad_line){ mp_puts(" "); mp_itoa(g_up.bad_line, b); mp_puts(b); }
+    mp_putcrlf();
+    mp_prompt();
+    return;
+  }
+
+  uint32_t ms = mp_hal_millis() - g_up.t0;
+  mp_puts("UPLOAD OK "); mp_itoa(g_ed.count, b); mp_puts(b);
+  mp_puts(" lines, "); mp_itoa((int)g_up.len, b); mp_puts(b);
+  mp_puts(" B, "); mp_itoa((int)ms, b); mp_puts(b);
+  mp_puts(" ms");
+  if (ms){ mp_puts(", "); mp_itoa((int)((g_up.len * 1000u) / ms), b); mp_puts(b); mp_puts(" B/s"); }
+  mp_putcrlf();
+
+  if (g_up.slot){
+    compile_or_report();
+    if (g_have_prog){
+      print_compile_ok_stats();
+      if (storage_save_queue(g_up.slot, &g_ed, false)){
+        mp_puts("SAVING slot "); mp_itoa(g_up.slot, b); mp_puts(b); mp_putcrlf();
+      } else {
+        mp_puts("SAVE FAIL: ");
+        mp_puts(g_flash_err ? g_flash_err : "?");
+        mp_putcrlf();
+      }
+    }
+  }
+  mp_prompt();
+}
+
+static void upload_begin(const char *args){
+  const char *p = args;
+  int slot = -1, len = 0;
+  uint32_t crc = 0;
+  if (!parse_int(&p, &slot) || !parse_int(&p, &len) || !parse_hex32(&p, &crc) ||
+      slot < 0 || slot > (int)MP_FLASH_SLOT_COUNT || len <= 0 || (uint32_t)len > MP_UPLOAD_MAX){
+    mp_puts("Use: UPLOAD <slot 0-6> <len> <crc32 hex>\r\n");
+    return;
+  }
+  if (ed_locked()) return;
+
+  memset(&g_up, 0, sizeof(g_up));
+  g_up.slot = (uint8_t)slot;
+  g_up.len = (uint32_t)len;
+  g_up.crc = crc;
+  g_up.skip_lf = true;
+  g_up.t0 = g_up.t_last = mp_hal_millis();
+  CRC32_Begin(&g_up.sum);
+  ed_init(&g_ed);
+  g_up.active = true;
+  mp_puts("READY\r\n");
+}
+
+static void upload_feed(char c){
+  if (g_up.skip_lf){
+    g_up.skip_lf = false;
+    if (c == '\n' && g_up.got == 0u) return;
+  }
+  uint8_t b = (uint8_t)c;
+  CRC32_Update(&g_up.sum, &b, 1u);
+  g_up.got++;
+  g_up.t_last = mp_hal_millis();
+
+  if (c == '\n') upload_line();
+  else if (c != '\r'){
+    if (g_up.n < (MP_LINE_LEN-1)) g_up.line[g_up.n++] = c;
+    else if (!g_up.bad_line) g_up.bad_line = (uint16_t)(g_up.lines + 1u);
+  }
+  if (g_up.got >= g_up.len) upload_finish(NULL);
+}
+
+static void upload_poll(void){
+  if (!g_up.active) return;
+  if ((mp_hal_millis() - g_up.t_last) >= MP_UPLOAD_TIMEOUT_MS){
+    mp_putcrlf();
+    upload_finish("timeout");
+  }
+}
+
 static void handle_line(char *line){
   while (*line==' '||*line=='\t') line++;
   if (!*line && !g_edit) return;  /* Empty line in normal mode - skip */
@@ -2091,6 +2967,7 @@ static void handle_line(char *line){
     int ln=0;
     if (!parse_int(&p,&ln)){ mp_puts("Bad line\r\n"); return; }
     while (*p==' '||*p=='\t') p++;
+    if (ed_locked()) return;
     if (!ed_set(&g_ed, ln, p)) mp_puts("Line store failed\r\n");
     return;
   }
@@ -2101,11 +2978,19 @@ static void handle_line(char *line){
   cmd[i]=0;
   char *args=line+i; while (*args==' '||*args=='\t') args++;
 
-  if (!mp_stricmp(cmd,"HELP")) { help(); return; }
-  if (!mp_stricmp(cmd,"NEW"))  { ed_init(&g_ed); mp_puts("OK\r\n"); return; }
-  if (!mp_stricmp(cmd,"CLR"))  { ed_init(&g_ed); g_have_prog=false; g_vm.running=false; mp_puts("OK\r\n"); return; }
-  if (!mp_stricmp(cmd,"LIST")) { ed_list(&g_ed); return; }
-  if (!mp_stricmp(cmd,"DEL"))  { int ln=0; const char *p=args; if(parse_int(&p,&ln) && ed_delete(&g_ed,ln)) mp_puts("OK\r\n"); else mp_puts("Not found\r\n"); return; }
+  if (!mp_stricmp(cmd,"HELP")) { g_out.kind = MP_OUT_TEXT; g_out.text = g_help_text; return; }
+  if (!mp_stricmp(cmd,"NEW"))  { if (ed_locked()) return; ed_init(&g_ed); mp_puts("OK\r\n"); return; }
+  if (!mp_stricmp(cmd,"CLR"))  { if (ed_locked()) return; ed_init(&g_ed); g_have_prog=false; g_vm.running=false; mp_puts("OK\r\n"); return; }
+  if (!mp_stricmp(cmd,"LIST")) {
+    uint8_t s=0;
+    if (*args && parse_slot_opt(args,&s)){
+      if (!storage_list_slot(s)) mp_puts("LIST FAIL\r\n");
+      return;
+    }
+    if (g_ed.count) { g_out.kind = MP_OUT_LIST; g_out.i = 0; }
+    return;
+  }
+  if (!mp_stricmp(cmd,"DEL"))  { if (ed_locked()) return; int ln=0; const char *p=args; if(parse_int(&p,&ln) && ed_delete(&g_ed,ln)) mp_puts("OK\r\n"); else mp_puts("Not found\r\n"); return; }
   if (!mp_stricmp(cmd,"RUN"))  { cmd_run(); return; }
   if (!mp_stricmp(cmd,"STOP")) { cmd_stop(); return; }
   if (!mp_stricmp(cmd,"QUIT") || !mp_stricmp(cmd,"EXIT")) { g_exit_pending=true; return; }
@@ -2130,27 +3015,47 @@ static void handle_line(char *line){
     if (!g_have_prog) return;
     print_compile_ok_stats();
 
-    if (storage_save_slot(s, &g_ed, false)){
-      g_slot = s;
-      refresh_program_slot_cache();
-      mp_puts("SAVED\r\n");
+    /* Written in the background by mp_flash_task(); result is printed when done. */
+    if (storage_save_queue(s, &g_ed, false)){
+      char b[16];
+      mp_puts("SAVING slot "); mp_itoa(s, b); mp_puts(b); mp_putcrlf();
     } else {
-      mp_puts("SAVE FAIL");
-      if (g_flash_err){
-        mp_puts(": ");
-        mp_puts(g_flash_err);
-        if (g_flash_hal_err){
-          mp_puts(" err=0x");
-          char b[12];
-          mp_utoa_hex(g_flash_hal_err, b);
-          mp_puts(b);
-        }
-      }
+      mp_puts("SAVE FAIL: ");
+      mp_puts(g_flash_err ? g_flash_err : "?");
+      mp_putcrlf();
+    }
+    return;
+  }
+  if (!mp_stricmp(cmd,"UPLOAD")) { upload_begin(args); return; }
+  if (!mp_stricmp(cmd,"FSTAT")) {
+    mp_flash_status_t st = mp_flash_status();
+    if (st == MP_FLASH_BUSY){
+      char b[16];
+      mp_puts("FLASH BUSY slot "); mp_itoa(g_fj.cur.slot, b); mp_puts(b);
+      mp_puts(" queued="); mp_itoa(g_fj.q_count, b); mp_puts(b);
       mp_putcrlf();
+    } else if (st == MP_FLASH_IDLE){
+      mp_puts("FLASH IDLE\r\n");
+    } else {
+      print_save_result();
+    }
+    return;
+  }
+  if (!mp_stricmp(cmd,"EDSTAT")) {
+    if (*args == '0'){
+      memset(&g_edit_stats, 0, sizeof(g_edit_stats));
+      mp_puts("OK\r\n");
+      return;
     }
+    mp_edit_stats_t st = g_edit_stats;
+    FMT_Write(mp_puts, "EDIT renders=%lu bytes=%lu avg=%lu last=%u max=%u full=%lu\r\n",
+              (unsigned long)st.renders, (unsigned long)st.bytes,
+              (unsigned long)(st.renders ? st.bytes / st.renders : 0u),
+              (unsigned)st.last, (unsigned)st.max, (unsigned long)st.full);
     return;
   }
   if (!mp_stricmp(cmd,"LOAD")) {
+    if (ed_locked()) return;
     uint8_t s=g_slot;
     if (*args){
       (void)parse_slot_opt(args,&s);
@@ -2171,6 +3076,7 @@ static void handle_line(char *line){
     return;
   }
   if (!mp_stricmp(cmd,"EDIT")) {
+    if (ed_locked()) return;
     uint8_t s = 0;
     if (*args && parse_slot_opt(args, &s))
     {
@@ -2237,7 +3143,7 @@ void mp_init(void){
   g_slot=1;
 
   refresh_program_slot_cache();
-  uint8_t slot = g_first_program_slot;
+  uint8_t slot = slot_find_default_program();
   if (slot != 0)
   {
     bool ar = false;
@@ -2268,6 +3174,9 @@ void mp_start_session(void){
   g_session_active = true;
   g_exit_pending = false;
   g_edit = false;
+  g_up.active = false;
+  g_out.kind = MP_OUT_NONE;
+  g_edit_more = 0u;
   
   mp_putcrlf();
   mp_puts("PASCAL READY (HELP for commands, EDIT to program, QUIT to quit)\r\n");
@@ -2295,10 +3204,18 @@ static void edit_feed_char(char c)
     return;
   }
 
+  /* Ctrl+L repaints the whole screen. */
+  if ((uint8_t)c == 0x0Cu)
+  {
+    g_scr.valid = 0u;
+    edit_render();
+    return;
+  }
+
   if (g_edit_state.esc_state != 0u)
   {
     edit_handle_escape(c);
-    edit_render();
+    if (g_edit_state.esc_state == 0u) edit_render();
     return;
   }
 
@@ -2324,6 +3241,11 @@ static void edit_feed_char(char c)
 }
 
 void mp_feed_char(char c){
+  if (g_up.active)
+  {
+    upload_feed(c);
+    return;
+  }
   if (g_edit)
   {
     edit_feed_char(c);
@@ -2338,7 +3260,8 @@ void mp_feed_char(char c){
     mp_puts("\r\n");  /* Echo newline */
     line[n]=0; n=0;
     handle_line(line);  /* Always call - even empty line needs g_edit prompt */
-    mp_prompt();
+    /* upload and paced output print their own prompt when done */
+    if (!g_up.active && g_out.kind == MP_OUT_NONE) mp_prompt();
     return;
   }
   
@@ -2359,7 +3282,29 @@ void mp_feed_char(char c){
   }
 }
 
-void mp_task(void){ mp_poll(); if (g_exit_pending) g_session_active=false; }
+static void out_poll(void){
+  while (g_out.kind != MP_OUT_NONE && mp_hal_tx_room() >= MP_OUT_ROOM){
+    if (!out_step()){ g_out.kind = MP_OUT_NONE; mp_prompt(); }
+  }
+  if (g_edit_more && mp_hal_tx_room() >= MP_OUT_ROOM) edit_render();
+}
+
+bool mp_output_pending(void){ return g_out.kind != MP_OUT_NONE || g_edit_more != 0u; }
+
+void mp_task(void){ upload_poll(); out_poll(); mp_poll(); if (g_exit_pending) g_session_active=false; }
+
+void mp_flash_task(void){
+  if (!fj_step()) return;
+  if (g_fj.last == MP_FLASH_DONE){
+    g_slot = g_fj.cur.slot;
+    refresh_program_slot_cache();
+  }
+  if (g_session_active){
+    mp_putcrlf();
+    print_save_result();
+    mp_prompt();
+  }
+}
 
 void mp_autorun_poll(void){
   static uint8_t autorun_done = 0;
@@ -2376,7 +3321,7 @@ void mp_autorun_poll(void){
   }
 
   bool ar = false;
-  uint8_t slot = slot_find_first_program();
+  uint8_t slot = slot_find_default_program();
   if (slot != 0 && storage_load_slot(slot, &g_ed, &ar)){
     g_slot = slot;
     compile_or_report();
@@ -2520,41 +3465,43 @@ void mp_poll(void){
   }
 }
 
-/* Short press events latched for BTN() (0 none, 1=B1, 2=B2, 3=BL). */
-static uint8_t g_btn_short_events = 0;
-void mp_notify_button_short(uint8_t btn_id)
+/*
+ * Button events for BTN(), oldest first: id + 10*kind, i.e. 1..3 click, 11..13 double,
+ * 21..23 triple, 31..33 hold repeat, 41..43 long press (ids 1=B1, 2=B2, 3=BL).
+ */
+#define MP_BTN_QLEN 8u
+static uint8_t g_btn_q[MP_BTN_QLEN];
+static uint8_t g_btn_head = 0, g_btn_tail = 0;
+
+static uint8_t btn_pop(void)
 {
-  if (btn_id == 1u)
+  if (g_btn_tail == g_btn_head) return 0;
+  return g_btn_q[g_btn_tail++ % MP_BTN_QLEN];
+}
+
+void mp_notify_button(uint8_t btn_id, uint8_t kind)
+{
+  if (btn_id < MP_BTN_B1 || btn_id > MP_BTN_BL || kind > MP_BTN_EV_LONG) return;
+
+  if (mp_hal_usb_connected() == 0 && btn_id == MP_BTN_B1)
   {
-    /* On battery, B1 short press starts the program when idle (do not enqueue as event). */
-    if ((mp_hal_usb_connected() == 0) && (!g_vm.running || !g_have_prog))
+    /* On battery, B1 clicks start the program when idle and a long press selects the next one
+       (neither is queued as an event). */
+    if (kind <= MP_BTN_EV_TRIPLE && (!g_vm.running || !g_have_prog))
     {
       mp_request_run_loaded();
       return;
     }
-
-    g_btn_short_events |= (1u << 0);
-    return;
-  }
-
-  if (btn_id == 2u)
-  {
-    g_btn_short_events |= (1u << 1);
-    return;
-  }
-
-  if (btn_id == 3u)
-  {
-    g_btn_short_events |= (1u << 2);
-    return;
+    if (kind == MP_BTN_EV_LONG)
+    {
+      g_run_next_req = 1u;
+      return;
+    }
   }
-}
 
-void mp_notify_button_long(uint8_t btn_id)
-{
-  /* Only battery mode uses long-press actions. */
-  if (mp_hal_usb_connected() != 0) return;
-  if (btn_id == 1u) g_run_next_req = 1u;
+  /* Full queue: keep the older events, a program that stopped reading loses the newest. */
+  if ((uint8_t)(g_btn_head - g_btn_tail) >= MP_BTN_QLEN) return;
+  g_btn_q[g_btn_head++ % MP_BTN_QLEN] = (uint8_t)(btn_id + 10u * kind);
 }
 
 static bool time_read_ymdhms(int *yy, int *mo, int *dd, int *hh, int *mm, int *ss){
@@ -2639,6 +3586,45 @@ static bool is_time0_call(const char *line){
  * Builtin functions (runtime side).
  * Each ID below matches builtin_id() and calls into the corresponding driver/library.
  */
+static int32_t mp_mic_result(mic_err_t st, int16_t dbfs_x100){
+  const int32_t fault = -99900;
+  if (st != MIC_ERR_OK){
+    if (mp_hal_usb_connected()){
+      const char *msg = MIC_LastErrorMsg();
+      FMT_Write(mp_puts, "[mic] st=%s(%ld) msg=%s\r\n",
+                MIC_ErrName(st), (long)st, msg ? msg : "");
+    }
+    return fault;
+  }
+  return (int32_t)dbfs_x100;
+}
+
+static int32_t mp_micfft_result(mic_err_t st, int16_t lf, int16_t mf, int16_t hf){
+  if (st != MIC_ERR_OK){
+    if (mp_hal_usb_connected()){
+      const char *msg = MIC_LastErrorMsg();
+      FMT_Write(mp_puts, "[micfft] st=%s(%ld) msg=%s\r\n",
+                MIC_ErrName(st), (long)st, msg ? msg : "");
+    }
+    lf = mf = hf = 0;
+  }
+  sysvar_set(SV_MICLF, (int32_t)lf);
+  sysvar_set(SV_MICMF, (int32_t)mf);
+  sysvar_set(SV_MICHF, (int32_t)hf);
+  return (st != MIC_ERR_OK) ? (int32_t)st : 0;
+}
+
+static int32_t mp_micbands_result(mic_err_t st, uint8_t n, const int16_t *db){
+  if (st != MIC_ERR_OK && mp_hal_usb_connected()){
+    const char *msg = MIC_LastErrorMsg();
+    FMT_Write(mp_puts, "[micbands] st=%s(%ld) msg=%s\r\n",
+              MIC_ErrName(st), (long)st, msg ? msg : "");
+  }
+  for (uint8_t i=0;i<MP_MICBANDS;i++)
+    sysvar_set((uint8_t)(SV_MICB1+i), (st == MIC_ERR_OK && i < n) ? (int32_t)db[i] : 0);
+  return (st != MIC_ERR_OK) ? (int32_t)st : 0;
+}
+
 int32_t mp_user_builtin(uint8_t id, uint8_t argc, const int32_t *argv){
   switch(id){
     /* ---------------- LED control (led.c, CTL_LEN power) ---------------- */
@@ -2698,59 +3684,68 @@ int32_t mp_user_builtin(uint8_t id, uint8_t argc, const int32_t *argv){
       }
 
     /* ---------------- Buttons ---------------- */
-    case 16: /* btn() -> next short-press event (0 none, 1=B1, 2=B2, 3=BL) */
-      if (argc==0){
-        uint8_t e = g_btn_short_events;
-        if (e & (1u<<0)) { g_btn_short_events = (uint8_t)(e & (uint8_t)~(1u<<0)); return 1; }
-        if (e & (1u<<1)) { g_btn_short_events = (uint8_t)(e & (uint8_t)~(1u<<1)); return 2; }
-        if (e & (1u<<2)) { g_btn_short_events = (uint8_t)(e & (uint8_t)~(1u<<2)); return 3; }
-        return 0;
-      }
+    case 16: /* btn() -> next button event in order (0 none, see mp_notify_button) */
+      if (argc==0) return btn_pop();
       return -1;
 
     /* ---------------- Microphone ---------------- */
+    /* Blocking here (CLI calls); the VM runs both through vm_mic_poll() instead. */
     case 9: /* mic() -> dbfs*100 (fault=-99900) */
       {
-        const int32_t fault = -99900;
-
         int16_t dbfs_x100 = 0;
-        mic_err_t st = MIC_ReadDbfsX100_Blocking(1000u, &dbfs_x100);
-        if (st != MIC_ERR_OK){
-          if (mp_hal_usb_connected()){
-            char b[160];
-            const char *msg = MIC_LastErrorMsg();
-            snprintf(b, sizeof(b), "[mic] st=%s(%ld) msg=%s\r\n",
-                     MIC_ErrName(st), (long)st, msg ? msg : "");
-            mp_puts(b);
-          }
-          return fault;
-        }
-
-        return (int32_t)dbfs_x100;
+        mic_err_t st = MIC_ReadDbfsX100_Blocking(MP_MIC_WAIT_MS, &dbfs_x100);
+        return mp_mic_result(st, dbfs_x100);
       }
 
     case 19: /* micfft() -> updates MICLF/MICMF/MICHF (dBFS*100). Returns 0 or negative mic_err_t. */
       if (argc==0){
         int16_t lf=0, mf=0, hf=0;
-        mic_err_t st = MIC_FFT_WaitBinsDbX100(1000u, &lf, &mf, &hf);
-        if (st != MIC_ERR_OK){
+        mic_err_t st = MIC_FFT_WaitBinsDbX100(MP_MIC_WAIT_MS, &lf, &mf, &hf);
+        return mp_micfft_result(st, lf, mf, hf);
+      }
+      return -1;
+
+    case 20: /* micbands(n) -> updates MICB1..MICBn (dBFS*100), n log-spaced bands. Returns 0 or negative mic_err_t. */
+      if (argc==1 && mp_micbands_n_ok(argv[0])){
+        int16_t db[MP_MICBANDS];
+        mic_err_t st = MIC_FFT_WaitBandsDbX100(MP_MIC_WAIT_MS, (uint8_t)argv[0], db);
+        return mp_micbands_result(st, (uint8_t)argv[0], db);
+      }
+      return -1;
+
+    case 22: /* beat() -> beat count (or negative mic_err_t), updates BPM/BEATPH/ONSETS. Never waits. */
+      if (argc==0){
+        mic_beat_t b;
+        mic_err_t st = MIC_BeatPoll(&b);
+        if (st != MIC_ERR_OK && st != MIC_ERR_NO_DATA_YET){
           if (mp_hal_usb_connected()){
-            char b[160];
             const char *msg = MIC_LastErrorMsg();
-            snprintf(b, sizeof(b), "[micfft] st=%s(%ld) msg=%s\r\n",
-                     MIC_ErrName(st), (long)st, msg ? msg : "");
-            mp_puts(b);
+            FMT_Write(mp_puts, "[beat] st=%s(%ld) msg=%s\r\n",
+                      MIC_ErrName(st), (long)st, msg ? msg : "");
           }
-          sysvar_set(SV_MICLF, 0);
-          sysvar_set(SV_MICMF, 0);
-          sysvar_set(SV_MICHF, 0);
-          return (int32_t)st;
+          b.bpm_x10 = 0u;
+          b.phase = 255u;
         }
+        sysvar_set(SV_BPM, ((int32_t)b.bpm_x10 + 5) / 10);
+        sysvar_set(SV_BEATPH, (int32_t)b.phase);
+        sysvar_set(SV_ONSETS, (int32_t)(b.onsets & 0x7FFFFFFFu));
+        if (st != MIC_ERR_OK && st != MIC_ERR_NO_DATA_YET) return (int32_t)st;
+        return (int32_t)(b.beats & 0x7FFFFFFFu);
+      }
+      return -1;
 
-        sysvar_set(SV_MICLF, (int32_t)lf);
-        sysvar_set(SV_MICMF, (int32_t)mf);
-        sysvar_set(SV_MICHF, (int32_t)hf);
-        return 0;
+    case 21: /* micconf(decim[,window_ms[,dma_words[,powersave_ms[,adaptive_max_ms]]]]) -> 0 or negative mic_err_t */
+      if (argc>=1){
+        mic_config_t c;
+        MIC_GetConfig(&c);
+        for (uint8_t i=0;i<argc;i++)
+          if (argv[i]<0 || (i<3u && argv[i]>0xFFFF)) return (int32_t)MIC_ERR_BAD_CONFIG;
+        c.decim = (uint16_t)argv[0];
+        if (argc>=2) c.window_ms = (uint16_t)argv[1];
+        if (argc>=3) c.dma_words = (uint16_t)argv[2];
+        if (argc>=4) c.powersave_ms = (uint32_t)argv[3];
+        if (argc>=5) c.adaptive_max_ms = (uint32_t)argv[4];
+        return (int32_t)MIC_Configure(&c);
       }
       return -1;
 
@@ -2784,7 +3779,7 @@ int32_t mp_user_builtin(uint8_t id, uint8_t argc, const int32_t *argv){
         uint8_t hh = (argv[3]<0)?0:(argv[3]>23?23:(uint8_t)argv[3]);
         uint8_t mm = (argv[4]<0)?0:(argv[4]>59?59:(uint8_t)argv[4]);
         char buf[RTC_DATETIME_STRING_SIZE];
-        snprintf(buf,sizeof(buf), "%02u:%02u:%02u_%02u.%02u.%02u", hh, mm, 0u, yy, mo, dd);
+        FMT_SNPrintf(buf,sizeof(buf), "%02u:%02u:%02u_%02u.%02u.%02u", hh, mm, 0u, yy, mo, dd);
         if (RTC_SetClock(buf)==HAL_OK){
           time_update_sysvars();
           return 0;
@@ -2795,7 +3790,7 @@ int32_t mp_user_builtin(uint8_t id, uint8_t argc, const int32_t *argv){
         int yy=0,mo=0,dd=0,hh=0,mm=0,ss=0;
         if (!time_read_ymdhms(&yy,&mo,&dd,&hh,&mm,&ss)) return -1;
         char buf[RTC_DATETIME_STRING_SIZE];
-        snprintf(buf,sizeof(buf), "%02ld:%02ld:%02ld_%02d.%02d.%02d",
+        FMT_SNPrintf(buf,sizeof(buf), "%02ld:%02ld:%02ld_%02d.%02d.%02d",
                  (long)argv[0], (long)argv[1], (long)argv[2], yy, mo, dd);
         if (RTC_SetClock(buf)==HAL_OK){
           time_update_sysvars();
@@ -46,6 +46,8 @@
 /*
  * Flash program storage (3 slots).
  * Slots live inside the linker FLASH_DATA region: __flash_data_start__ .. __flash_data_end__.
+ * The settings store (settings.h) has a linker region of its own above it, so the last
+ * slot is what remains after the full-size ones (4 KB with the 44 KB FLASH_DATA).
  */
 #ifndef MP_FLASH_TOTAL_SIZE
 #define MP_FLASH_TOTAL_SIZE (256u * 1024u)   /* bytes */
@@ -55,6 +57,18 @@
 #define MP_FLASH_PAGE_SIZE  (2048u)          /* bytes per page */
 #endif
 
+#ifndef MP_FLASH_ROW_SIZE
+#define MP_FLASH_ROW_SIZE   (256u)           /* fast-programming row (32 double words) */
+#endif
+
+#ifndef MP_FLASH_FAST_PROG
+#define MP_FLASH_FAST_PROG  1                /* 1 = write full rows with FLASH_TYPEPROGRAM_FAST */
+#endif
+
+#ifndef MP_FLASH_JOB_QUEUE
+#define MP_FLASH_JOB_QUEUE  (2u)             /* pending SAVE jobs */
+#endif
+
 #ifndef MP_FLASH_SLOT_PAGES
 #define MP_FLASH_SLOT_PAGES (4u)             /* pages per slot (4 pages => 8KB per program) */
 #endif
@@ -68,11 +82,31 @@
 #define MP_ABORT_HOLD_MS    (2000u)
 #endif
 
+/*
+ * Console pacing. Output never waits for the host: the VM holds a print until the console
+ * has room for it plus MP_TX_RESERVE (left for input echo; keep it above the USB CLI's
+ * input threshold), at most MP_TX_STALL_MS. Monitor output longer than the console buffer
+ * goes out a line per mp_task() pass whenever MP_OUT_ROOM bytes are free.
+ */
+#ifndef MP_TX_RESERVE
+#define MP_TX_RESERVE       (288u)
+#endif
+
+#ifndef MP_TX_STALL_MS
+#define MP_TX_STALL_MS      (50u)
+#endif
+
+#ifndef MP_OUT_ROOM
+#define MP_OUT_ROOM         (128u)   /* longest HELP line / editor row */
+#endif
+
 /* HAL glue provided by the firmware/board layer. */
 /* Return -1 if no char available, else 0..255. Non-blocking recommended. */
 int  mp_hal_getchar(void);
-/* Send one char to terminal. */
+/* Send one char to terminal (dropped if the terminal buffer is full). */
 void mp_hal_putchar(char c);
+/* Chars mp_hal_putchar() can take right now. */
+uint32_t mp_hal_tx_room(void);
 /* Milliseconds tick (HAL_GetTick). */
 uint32_t mp_hal_millis(void);
 
@@ -101,6 +135,29 @@ int32_t mp_user_builtin(uint8_t id, uint8_t argc, const int32_t *argv);
 /* Execute a single builtin call line: NAME(arg,...) -> returns true if handled. */
 bool mp_exec_builtin_line(const char *line, int32_t *ret_out, bool *has_ret);
 
+/*
+ * Builtin table entry (also used by the USB CLI to dispatch NAME(args) without re-parsing).
+ * min_args/max_args is the accepted argument count; ret_argc bit n = returns a value
+ * when called with n args.
+ */
+#define MP_BI_RET_ARGC(n)   ((uint8_t)(1u << (n)))
+#define MP_BI_RET_ANY       0xFFu
+typedef struct {
+  const char *name;     /* lower case */
+  uint16_t    hash;     /* mp_name_hash(name) */
+  uint8_t     id;       /* mp_user_builtin() id */
+  uint8_t     min_args;
+  uint8_t     max_args;
+  uint8_t     ret_argc;
+} mp_builtin_t;
+
+/* Case-insensitive 16-bit name hash (same value as the monitor's ID command). */
+uint16_t mp_name_hash(const char *s);
+const mp_builtin_t *mp_builtin_find(const char *name);
+const mp_builtin_t *mp_builtin_find_hash(const char *name, uint16_t hash);
+/* Run a builtin with already parsed arguments (same result rules as mp_exec_builtin_line). */
+bool mp_exec_builtin(const mp_builtin_t *b, uint8_t argc, const int32_t *argv, int32_t *ret_out, bool *has_ret);
+
 /* ---------------- Public API ---------------- */
 void mp_init(void);
 /* Call often from main loop; handles terminal input and runs the program time-sliced. */
@@ -121,10 +178,24 @@ void mp_feed_char(char c);
 void mp_task(void);
 bool mp_is_active(void);
 bool mp_exit_pending(void);
+/* Monitor output still being paced out: do not feed input until false. */
+bool mp_output_pending(void);
 void mp_autorun_poll(void);
 /* Returns first non-empty slot (1..3) or 0 if all empty. */
 uint8_t mp_first_program_slot(void);
 
+/* Background flash writer (SAVE): call every main-loop pass, one page per call. */
+typedef enum {
+  MP_FLASH_IDLE = 0,    /* nothing written since boot */
+  MP_FLASH_BUSY,        /* job queued or running */
+  MP_FLASH_DONE,        /* last job committed */
+  MP_FLASH_FAILED       /* last job failed (slot reads as empty) */
+} mp_flash_status_t;
+void mp_flash_task(void);
+mp_flash_status_t mp_flash_status(void);
+/* Clear stale FLASH SR error flags before an erase/program sequence (also used by settings.c). */
+void mp_flash_clear_errors(void);
+
 /* Button events from the board layer (used on battery, outside USB session). */
-void mp_notify_button_short(uint8_t btn_id);
-void mp_notify_button_long(uint8_t btn_id);
+/* btn_id: mp_btn_id_t, kind: mp_btn_kind_t (mp_buttons.h). */
+void mp_notify_button(uint8_t btn_id, uint8_t kind);
@@ -7,7 +7,7 @@
 #include "main.h"
 #include "analog.h"
 #include "lp_delay.h"
-#include <stdio.h>
+#include "fmt.h"
 #include <stdarg.h>
 
 /* State machine states */
@@ -255,12 +255,10 @@ void CHARGER_LowBattEnableOnce(void)
 static void charger_writef(charger_write_fn_t write, const char *fmt, ...)
 {
     if (!write || !fmt) return;
-    char buf[220];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    FMT_VWrite(write, fmt, ap);
     va_end(ap);
-    write(buf);
 }
 
 static float charger_battery_percent_from_v(float vbat)
@@ -308,10 +306,10 @@ void CHARGER_WriteStatus(charger_write_fn_t write)
 
     charger_writef(
         write,
-        "BAT=%.1f%% VBAT=%.2fV STATE=%s USB=%s MCU_requests_charging=%s (%s) Policy=%s\r\n"
+        "BAT=%.1q%% VBAT=%.2qV STATE=%s USB=%s MCU_requests_charging=%s (%s) Policy=%s\r\n"
         "CHARGER_STATUS_PIN=%s\r\n",
-        (double)pct,
-        (double)vbat,
+        (int32_t)(pct * 10.0f + 0.5f),
+        (int32_t)(vbat * 100.0f + 0.5f),
         charger_state_str(st),
         usb ? "YES" : "NO",
         mcu_wants ? "YES" : "NO",
@@ -0,0 +1,136 @@
+/*
+ * crc32.c - CRC-32 checksums (STM32U0 CRC peripheral or software fallback).
+ */
+
+#include "crc32.h"
+
+#if CRC32_USE_HW
+#include "stm32u0xx_hal.h"
+
+/* Word input is bit-reversed as a whole word, which equals per-byte reflection of a
+ * little-endian load. Tail bytes are written with byte reversal instead. */
+#define CRC32_CR_WORD   (CRC_CR_REV_IN_0 | CRC_CR_REV_IN_1 | CRC_CR_REV_OUT_0)
+#define CRC32_CR_BYTE   (CRC_CR_REV_IN_0 | CRC_CR_REV_OUT_0)
+
+/* Stream currently loaded in the peripheral (NULL = none / anonymous). */
+static const crc32_ctx_t *s_owner;
+
+/*
+ * Make ctx the stream in the peripheral. ctx->crc holds the value as read from DR
+ * (output bit-reversed), so the raw register is its bit reversal; it is reloaded
+ * through INIT + RESET.
+ */
+static void crc32_select(crc32_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx == s_owner) return;
+    CRC->INIT = __RBIT(ctx->crc);
+    CRC->CR   = CRC32_CR_WORD | CRC_CR_RESET;
+    s_owner = ctx;
+}
+
+void CRC32_Begin(crc32_ctx_t *ctx)
+{
+    __HAL_RCC_CRC_CLK_ENABLE();
+    CRC->POL  = 0x04C11DB7u;
+    CRC->INIT = 0xFFFFFFFFu;
+    CRC->CR   = CRC32_CR_WORD | CRC_CR_RESET;
+    s_owner = ctx;
+    if (ctx) ctx->crc = 0xFFFFFFFFu;
+}
+
+void CRC32_Update(crc32_ctx_t *ctx, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    if (!p || len == 0u) return;
+    crc32_select(ctx);
+
+    if (((uint32_t)p & 3u) == 0u)
+    {
+        const uint32_t *w = (const uint32_t *)p;
+        while (len >= 4u)
+        {
+            CRC->DR = *w++;
+            len -= 4u;
+        }
+        p = (const uint8_t *)w;
+    }
+    else
+    {
+        /* Cortex-M0+ has no unaligned loads; assemble the LE word by hand. */
+        while (len >= 4u)
+        {
+            CRC->DR = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                      ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+            p += 4;
+            len -= 4u;
+        }
+    }
+
+    if (len)
+    {
+        CRC->CR = CRC32_CR_BYTE;
+        while (len--)
+        {
+            *(__IO uint8_t *)&CRC->DR = *p++;
+        }
+        CRC->CR = CRC32_CR_WORD;
+    }
+    if (ctx) ctx->crc = CRC->DR;
+}
+
+uint32_t CRC32_End(crc32_ctx_t *ctx)
+{
+    uint32_t crc = (ctx ? ctx->crc : CRC->DR) ^ 0xFFFFFFFFu;
+    if (ctx)
+    {
+        ctx->crc = crc;
+        if (s_owner == ctx) s_owner = NULL;
+    }
+    return crc;
+}
+
+#else /* software */
+
+/* Nibble table: 64 bytes of const data, ~2x slower than a 1 kB byte table. */
+static const uint32_t s_crc32_nib[16] = {
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu,
+    0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu,
+    0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu,
+};
+
+void CRC32_Begin(crc32_ctx_t *ctx)
+{
+    if (ctx) ctx->crc = 0xFFFFFFFFu;
+}
+
+void CRC32_Update(crc32_ctx_t *ctx, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    if (!ctx || !p) return;
+    uint32_t c = ctx->crc;
+    while (len--)
+    {
+        c ^= *p++;
+        c = (c >> 4) ^ s_crc32_nib[c & 0x0Fu];
+        c = (c >> 4) ^ s_crc32_nib[c & 0x0Fu];
+    }
+    ctx->crc = c;
+}
+
+uint32_t CRC32_End(crc32_ctx_t *ctx)
+{
+    if (!ctx) return 0u;
+    ctx->crc ^= 0xFFFFFFFFu;
+    return ctx->crc;
+}
+
+#endif /* CRC32_USE_HW */
+
+uint32_t CRC32_Calc(const void *data, uint32_t len)
+{
+    crc32_ctx_t c;
+    CRC32_Begin(&c);
+    CRC32_Update(&c, data, len);
+    return CRC32_End(&c);
+}
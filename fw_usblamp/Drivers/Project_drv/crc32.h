@@ -0,0 +1,44 @@
+/*
+ * crc32.h - CRC-32 (IEEE 802.3) checksums for flash records.
+ *
+ * On target the STM32U0 CRC peripheral is used (word feeding, byte tail).
+ * Host builds (no USE_HAL_DRIVER) fall back to a bit-exact software implementation,
+ * so images and settings written on one side verify on the other.
+ *
+ * Result matches the common zlib/Ethernet crc32(): poly 0x04C11DB7, reflected in/out,
+ * init 0xFFFFFFFF, final xor 0xFFFFFFFF. crc32("123456789") == 0xCBF43926.
+ */
+
+#ifndef PROJECT_DRV_CRC32_H_
+#define PROJECT_DRV_CRC32_H_
+
+#include <stdint.h>
+
+/* 1 = use the CRC peripheral, 0 = software table (host tools / bring-up). */
+#ifndef CRC32_USE_HW
+#if defined(USE_HAL_DRIVER)
+#define CRC32_USE_HW 1
+#else
+#define CRC32_USE_HW 0
+#endif
+#endif
+
+/*
+ * Streaming context.
+ * With CRC32_USE_HW the running value is also kept in the context, and an Update() on a
+ * stream that is not loaded in the peripheral reloads it first. Several streams may be
+ * open at once (e.g. an upload spanning many loop passes while a slot is verified);
+ * main loop only, not from ISRs.
+ */
+typedef struct {
+    uint32_t crc;
+} crc32_ctx_t;
+
+void     CRC32_Begin(crc32_ctx_t *ctx);
+void     CRC32_Update(crc32_ctx_t *ctx, const void *data, uint32_t len);
+uint32_t CRC32_End(crc32_ctx_t *ctx);
+
+/* One-shot helper. */
+uint32_t CRC32_Calc(const void *data, uint32_t len);
+
+#endif /* PROJECT_DRV_CRC32_H_ */
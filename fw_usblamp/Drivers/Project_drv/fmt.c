@@ -0,0 +1,274 @@
+/*
+ * fmt.c - small printf-style formatter (see fmt.h for the supported subset).
+ */
+
+#include "fmt.h"
+
+#include <string.h>
+
+/* Sign + 10 digits + '.' + leading "0." padding of %.9q. */
+#define FMT_NUM_BUF     24u
+#define FMT_PAD_RUN     8u
+
+static const char s_pad_space[FMT_PAD_RUN] = { ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+static const char s_pad_zero[FMT_PAD_RUN]  = { '0', '0', '0', '0', '0', '0', '0', '0' };
+static const char s_digits_lc[] = "0123456789abcdef";
+static const char s_digits_uc[] = "0123456789ABCDEF";
+
+static void fmt_pad(fmt_out_fn_t out, void *ctx, char c, uint32_t n)
+{
+    const char *run = (c == '0') ? s_pad_zero : s_pad_space;
+    while (n)
+    {
+        uint32_t k = (n > FMT_PAD_RUN) ? FMT_PAD_RUN : n;
+        out(ctx, run, k);
+        n -= k;
+    }
+}
+
+/* Digits of v written backwards ending at end; returns the first digit. */
+static char *fmt_utoa(char *end, uint32_t v, uint32_t base, const char *digits)
+{
+    do
+    {
+        *--end = digits[v % base];
+        v /= base;
+    } while (v);
+    return end;
+}
+
+/* |v| as "i.ddd" with dec decimals, written backwards ending at end. */
+static char *fmt_fixed(char *end, uint32_t v, uint32_t dec)
+{
+    char *p = fmt_utoa(end, v, 10u, s_digits_lc);
+    while ((uint32_t)(end - p) <= dec) *--p = '0';
+    if (dec == 0u) return p;
+
+    /* Shift the integer part one left to open the decimal point. */
+    char *dot = end - dec;
+    memmove(p - 1, p, (size_t)(dot - p));
+    dot[-1] = '.';
+    return p - 1;
+}
+
+uint32_t FMT_VFormat(fmt_out_fn_t out, void *ctx, const char *fmt, va_list ap)
+{
+    uint32_t total = 0;
+    const char *p = fmt;
+    if (out == NULL || fmt == NULL) return 0u;
+
+    while (*p)
+    {
+        const char *lit = p;
+        while (*p && *p != '%') p++;
+        if (p != lit)
+        {
+            out(ctx, lit, (uint32_t)(p - lit));
+            total += (uint32_t)(p - lit);
+        }
+        if (*p == 0) break;
+
+        const char *spec = p++;
+        uint8_t left = 0u, is_long = 0u;
+        char pad = ' ';
+        for (;; p++)
+        {
+            if (*p == '-') left = 1u;
+            else if (*p == '0') pad = '0';
+            else break;
+        }
+        uint32_t width = 0;
+        while (*p >= '0' && *p <= '9') width = width * 10u + (uint32_t)(*p++ - '0');
+        int32_t prec = -1;
+        if (*p == '.')
+        {
+            p++;
+            prec = 0;
+            if (*p == '*')
+            {
+                prec = (int32_t)va_arg(ap, int);
+                p++;
+            }
+            else
+            {
+                while (*p >= '0' && *p <= '9') prec = prec * 10 + (*p++ - '0');
+            }
+        }
+        while (*p == 'l' || *p == 'h')
+        {
+            if (*p == 'l') is_long = 1u;
+            p++;
+        }
+
+        char nb[FMT_NUM_BUF];
+        char *end = nb + sizeof(nb);
+        const char *s = NULL;
+        uint32_t n = 0;
+        char sign = 0;
+
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'q':
+        {
+            long v = is_long ? va_arg(ap, long) : (long)va_arg(ap, int);
+            uint32_t u = (uint32_t)v;
+            if (v < 0)
+            {
+                sign = '-';
+                u = 0u - u;
+            }
+            if (*p == 'q')
+            {
+                uint32_t dec = (prec < 0) ? 0u : (uint32_t)prec;
+                if (dec > 9u) dec = 9u;
+                s = fmt_fixed(end, u, dec);
+            }
+            else
+            {
+                s = fmt_utoa(end, u, 10u, s_digits_lc);
+            }
+            n = (uint32_t)(end - s);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        {
+            uint32_t u = is_long ? (uint32_t)va_arg(ap, unsigned long) : (uint32_t)va_arg(ap, unsigned int);
+            if (*p == 'u') s = fmt_utoa(end, u, 10u, s_digits_lc);
+            else s = fmt_utoa(end, u, 16u, (*p == 'X') ? s_digits_uc : s_digits_lc);
+            n = (uint32_t)(end - s);
+            break;
+        }
+        case 'c':
+            nb[0] = (char)va_arg(ap, int);
+            s = nb;
+            n = 1u;
+            break;
+        case 's':
+            s = va_arg(ap, const char *);
+            if (s == NULL) s = "(null)";
+            n = (uint32_t)strlen(s);
+            if (prec >= 0 && n > (uint32_t)prec) n = (uint32_t)prec;
+            pad = ' ';
+            break;
+        case '%':
+            s = "%";
+            n = 1u;
+            break;
+        default:
+            /* Unknown conversion: print it verbatim. */
+            if (*p == 0) p--;
+            out(ctx, spec, (uint32_t)(p + 1 - spec));
+            total += (uint32_t)(p + 1 - spec);
+            p++;
+            continue;
+        }
+        p++;
+
+        uint32_t len = n + (sign ? 1u : 0u);
+        uint32_t fill = (width > len) ? (width - len) : 0u;
+        if (left) pad = ' ';
+        if (!left && pad == ' ') fmt_pad(out, ctx, ' ', fill);
+        if (sign) out(ctx, &sign, 1u);
+        if (!left && pad == '0') fmt_pad(out, ctx, '0', fill);
+        if (n) out(ctx, s, n);
+        if (left) fmt_pad(out, ctx, ' ', fill);
+        total += len + fill;
+    }
+    return total;
+}
+
+uint32_t FMT_Format(fmt_out_fn_t out, void *ctx, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    uint32_t n = FMT_VFormat(out, ctx, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+typedef struct
+{
+    char    *p;
+    uint32_t room;      /* bytes left before the terminating NUL */
+} fmt_buf_t;
+
+static void fmt_buf_out(void *ctx, const char *s, uint32_t len)
+{
+    fmt_buf_t *b = (fmt_buf_t *)ctx;
+    if (len > b->room) len = b->room;
+    memcpy(b->p, s, len);
+    b->p += len;
+    b->room -= len;
+}
+
+uint32_t FMT_VSNPrintf(char *buf, uint32_t size, const char *fmt, va_list ap)
+{
+    fmt_buf_t b;
+    b.p = buf;
+    b.room = (buf != NULL && size) ? (size - 1u) : 0u;
+    uint32_t n = FMT_VFormat(fmt_buf_out, &b, fmt, ap);
+    if (buf != NULL && size) *b.p = 0;
+    return n;
+}
+
+uint32_t FMT_SNPrintf(char *buf, uint32_t size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    uint32_t n = FMT_VSNPrintf(buf, size, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+typedef struct
+{
+    fmt_write_fn_t write;
+    uint32_t       n;
+    char           buf[FMT_WRITE_CHUNK + 1u];
+} fmt_chunk_t;
+
+static void fmt_chunk_out(void *ctx, const char *s, uint32_t len)
+{
+    fmt_chunk_t *c = (fmt_chunk_t *)ctx;
+    while (len)
+    {
+        uint32_t k = FMT_WRITE_CHUNK - c->n;
+        if (k > len) k = len;
+        memcpy(&c->buf[c->n], s, k);
+        c->n += k;
+        s += k;
+        len -= k;
+        if (c->n == FMT_WRITE_CHUNK)
+        {
+            c->buf[c->n] = 0;
+            c->write(c->buf);
+            c->n = 0;
+        }
+    }
+}
+
+void FMT_VWrite(fmt_write_fn_t write, const char *fmt, va_list ap)
+{
+    if (write == NULL || fmt == NULL) return;
+    fmt_chunk_t c;
+    c.write = write;
+    c.n = 0;
+    (void)FMT_VFormat(fmt_chunk_out, &c, fmt, ap);
+    if (c.n)
+    {
+        c.buf[c.n] = 0;
+        write(c.buf);
+    }
+}
+
+void FMT_Write(fmt_write_fn_t write, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    FMT_VWrite(write, fmt, ap);
+    va_end(ap);
+}
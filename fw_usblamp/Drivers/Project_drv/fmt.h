@@ -0,0 +1,40 @@
+/*
+ * fmt.h - small printf-style formatter for console output (replaces newlib vsnprintf).
+ *
+ * Conversions: %d %i %u %x %X %c %s %% with flags '-' and '0', a field width,
+ * precision on %s (%.Ns, %.*s) and the 'l'/'h' length modifiers.
+ * Fixed point: %.Nq prints an integer holding value * 10^N with N decimals,
+ * e.g. ("%.2q", 1234) -> "12.34", ("%.1q", -5) -> "-0.5". No floating point.
+ *
+ * FMT_VFormat() streams pieces straight to a sink (literal runs of the format string
+ * are passed through unchanged, so a TX path can send them without copying); the
+ * other calls are sinks for a char buffer or a NUL-terminated write callback.
+ */
+
+#ifndef PROJECT_DRV_FMT_H_
+#define PROJECT_DRV_FMT_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+
+/* Bytes buffered by FMT_Write() between calls of the write callback. */
+#ifndef FMT_WRITE_CHUNK
+#define FMT_WRITE_CHUNK     48u
+#endif
+
+typedef void (*fmt_out_fn_t)(void *ctx, const char *s, uint32_t len);
+typedef void (*fmt_write_fn_t)(const char *s);
+
+/* Returns the number of characters produced. */
+uint32_t FMT_VFormat(fmt_out_fn_t out, void *ctx, const char *fmt, va_list ap);
+uint32_t FMT_Format(fmt_out_fn_t out, void *ctx, const char *fmt, ...);
+
+/* snprintf semantics: always NUL-terminated (size > 0), returns the untruncated length. */
+uint32_t FMT_VSNPrintf(char *buf, uint32_t size, const char *fmt, va_list ap);
+uint32_t FMT_SNPrintf(char *buf, uint32_t size, const char *fmt, ...);
+
+/* Format into a FMT_WRITE_CHUNK stack buffer and hand it to write() as it fills. */
+void FMT_VWrite(fmt_write_fn_t write, const char *fmt, va_list ap);
+void FMT_Write(fmt_write_fn_t write, const char *fmt, ...);
+
+#endif /* PROJECT_DRV_FMT_H_ */
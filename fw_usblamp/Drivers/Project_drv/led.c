@@ -41,6 +41,24 @@ static uint8_t rgbw_arr[numberofpixels * bytesperpixel] = {0};
 /* DMA buffer must match CubeMX DMA width (use 32-bit words for CCR values). */
 static uint32_t pwm_buffer[total_slots] = {0};
 
+/* Global brightness (255 = unscaled). */
+static uint8_t s_brightness = 255u;
+
+static inline uint8_t scale_byte(uint8_t v)
+{
+    return (uint8_t)(((uint16_t)v * (uint16_t)s_brightness + 127u) / 255u);
+}
+
+void led_set_brightness(uint8_t scale)
+{
+    s_brightness = scale;
+}
+
+uint8_t led_get_brightness(void)
+{
+    return s_brightness;
+}
+
 static inline void put_byte_msb(uint32_t *dst, uint8_t v)
 {
     for (int i = 7; i >= 0; i--)
@@ -92,10 +110,10 @@ void led_render(void)
     /* Encode pixels (GRBW, MSB first). */
     for (uint32_t i = 0; i < numberofpixels; i++)
     {
-        uint8_t r = rgbw_arr[i * 4u + 0u];
-        uint8_t g = rgbw_arr[i * 4u + 1u];
-        uint8_t b = rgbw_arr[i * 4u + 2u];
-        uint8_t w = rgbw_arr[i * 4u + 3u];
+        uint8_t r = scale_byte(rgbw_arr[i * 4u + 0u]);
+        uint8_t g = scale_byte(rgbw_arr[i * 4u + 1u]);
+        uint8_t b = scale_byte(rgbw_arr[i * 4u + 2u]);
+        uint8_t w = scale_byte(rgbw_arr[i * 4u + 3u]);
 
         put_byte_msb(&pwm_buffer[p], g); p += 8u;
         put_byte_msb(&pwm_buffer[p], r); p += 8u;
@@ -14,4 +14,8 @@ void led_set_all_RGB(uint8_t r, uint8_t g, uint8_t b);
 void led_set_all_RGBW(uint8_t r, uint8_t g, uint8_t b, uint8_t w);
 void led_render(void);
 
+/* Global brightness scale applied in led_render() (255 = full, default). */
+void led_set_brightness(uint8_t scale);
+uint8_t led_get_brightness(void);
+
 #endif
@@ -5,10 +5,12 @@
 
 #include "main.h"
 #include "mic.h"
+#include "mic_dsp.h"
+#include "settings.h"
+#include "fmt.h"
 #include "stm32u0xx_hal.h"
 
 #include <stdint.h>
-#include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <math.h>
@@ -18,21 +20,36 @@ extern SPI_HandleTypeDef hspi1;
 extern RTC_HandleTypeDef hrtc;
 
 /* DSP config: decimation + 50 ms windows for RMS/dBFS measurement. */
-/* DMA strategy:
- *  - Normal DMA: start -> wait -> process -> restart (small gaps between blocks).
- *  - Circular DMA (CubeMX): continuous clock, process half/full buffers without restart.
- */
+/* DMA strategy: one circular transfer per capture (forced even if CubeMX changes the
+ * channel mode), so the SPI clock never stops between blocks. The half/full callbacks
+ * only advance s_dma_seq; MIC_Task processes the half-buffers it has not seen yet. */
 
-/* DMA RX buffer for one block. */
+/* DMA RX ring: two halves of s_cfg.dma_words/2 (at most MIC_DMA_WORDS). */
 static uint16_t s_rx_buf[MIC_DMA_WORDS];
 
+#if (MIC_DECIM_N < MIC_DECIM_MIN) || (MIC_DECIM_N > MIC_DECIM_MAX)
+#error "MIC_DECIM_N must be MIC_DECIM_MIN..MIC_DECIM_MAX"
+#endif
+#if (MIC_WINDOW_MS < MIC_WINDOW_MS_MIN) || (MIC_WINDOW_MS > MIC_WINDOW_MS_MAX)
+#error "MIC_WINDOW_MS must be MIC_WINDOW_MS_MIN..MIC_WINDOW_MS_MAX"
+#endif
+#if (MIC_DMA_WORDS < MIC_DMA_WORDS_MIN) || (MIC_DMA_WORDS > 0xFFFEu) || ((MIC_DMA_WORDS & 1u) != 0u)
+#error "MIC_DMA_WORDS must be even and >= MIC_DMA_WORDS_MIN"
+#endif
+
+/* Runtime configuration (MIC_Configure); a pending one is applied by MIC_Task. */
+static mic_config_t s_cfg = { MIC_DECIM_N, MIC_WINDOW_MS, MIC_DMA_WORDS, MIC_POWERSAVE, MIC_ADAPTIVE_MAX_MS };
+static mic_config_t s_cfg_pending;
+static uint8_t s_cfg_dirty;
+static void mic_cfg_apply(void);
+
 /* DMA transfer state. */
-static volatile uint8_t s_spi_done;
-static volatile uint8_t s_spi_half;
 static volatile uint8_t s_spi_err;
-static uint32_t s_dma_t0_ms;
+static volatile uint32_t s_dma_seq;     /* completed half-buffers since start */
+static uint32_t s_dma_seq_done;         /* half-buffers consumed by MIC_Task */
+static uint32_t s_dma_overruns;         /* MIC_Task fell behind: halves skipped or torn */
+static uint32_t s_dma_dropped_words;    /* PDM words lost to overruns */
 static uint32_t s_dma_last_evt_ms;
-static uint8_t  s_dma_circular;
 static uint32_t s_capture_t0_ms;
 
 /* Diagnostics (no-scope). */
@@ -57,11 +74,41 @@ static float s_last_dbfs = -1.0f;
 static float s_last_rms  = 0.0f;
 static uint32_t s_last_seq = 0u;
 
+/* Bumped on every result MIC_Task() publishes (window, bins or error); never reset. */
+static uint32_t s_pub_seq;
+
 /* Runtime calibration (defaults from mic.h macros, may be overridden via MIC_CalLoad()). */
 static float s_cal_rms_gain      = (float)MIC_CAL_RMS_GAIN;
 static float s_cal_db_offset_db  = (float)MIC_CAL_DB_OFFSET_DB;
 
-#define MIC_CAL_BKP_MAGIC 0x4D43u /* 'MC' */
+/* Integer form of the calibration, applied to window levels in dBFS*100. */
+static int32_t s_cal_gain_db_x100;
+static int32_t s_cal_off_db_x100;
+
+static int32_t mic_round_x100(float v)
+{
+    float x = v * 100.0f;
+    return (x >= 0.0f) ? (int32_t)(x + 0.5f) : (int32_t)(x - 0.5f);
+}
+
+static void mic_cal_update(void)
+{
+    s_cal_off_db_x100 = mic_round_x100(s_cal_db_offset_db);
+    if (s_cal_rms_gain <= 0.0f)
+        s_cal_gain_db_x100 = 2 * MIC_DSP_DB_FLOOR_X100;
+    else
+        s_cal_gain_db_x100 = mic_round_x100(20.0f * log10f(s_cal_rms_gain));
+}
+
+/* Same order as before: gain on the RMS (floored at -120 dB), then the dB offset. */
+static int32_t mic_cal_db_x100(int32_t db_x100)
+{
+    int32_t v = db_x100 + s_cal_gain_db_x100;
+    if (v < MIC_DSP_DB_FLOOR_X100) v = MIC_DSP_DB_FLOOR_X100;
+    return v + s_cal_off_db_x100;
+}
+
+#define MIC_CAL_BKP_MAGIC 0x4D43u /* 'MC' (legacy RTC BKP format, read for migration only) */
 
 static uint8_t mic_cal_bkp_load(void)
 {
@@ -74,63 +121,60 @@ static uint8_t mic_cal_bkp_load(void)
 
     int16_t off_x100 = (int16_t)(v & 0xFFFFu);
     s_cal_db_offset_db = (float)off_x100 / 100.0f;
+    mic_cal_update();
     return 1u;
 }
 
-static uint8_t mic_cal_bkp_save(void)
-{
-    if (hrtc.Instance == NULL)
-        return 0u;
-
-    int32_t off_x100 = (int32_t)(s_cal_db_offset_db * 100.0f + ((s_cal_db_offset_db >= 0.0f) ? 0.5f : -0.5f));
-    if (off_x100 > 32767) off_x100 = 32767;
-    if (off_x100 < -32768) off_x100 = -32768;
+/* Accumulators for one 50 ms RMS/dBFS window. */
+static mic_energy_t s_win;        /* sum(sample^2), peak and sample count */
 
-    uint32_t v = ((uint32_t)MIC_CAL_BKP_MAGIC << 16) | (uint16_t)(int16_t)off_x100;
-    HAL_RTCEx_BKUPWrite(&hrtc, MIC_CAL_PERSIST_BKP_REG, v);
-    return 1u;
-}
+/* 3rd-order CIC decimator (sinc^3) at the "word rate": a much stronger low-pass than a
+ * single boxcar, reducing noise-folding from the PDM noise-shaped spectrum into the
+ * audio band. */
+static mic_cic_t s_cic;
 
-/* Accumulators for one 50 ms RMS/dBFS window. */
-static uint32_t s_win_count;      /* number of PCM samples collected */
-static double   s_win_sum_sq;     /* sum(sample^2) for RMS */
-static double   s_win_peak;       /* peak amplitude (debug) */
-static uint32_t s_decim_phase;    /* decimation phase counter */
+/* PCM of one DMA half-buffer. */
+static mic_sample_t s_pcm_blk[MIC_DMA_WORDS / 2u / MIC_DECIM_MIN + 1u];
 static uint32_t s_pcm_fs_hz;      /* estimated PCM sample rate after decimation */
+static uint32_t s_band_lp_hz;     /* MIC_BAND_LP_HZ, lowered below Nyquist if needed */
 static uint32_t s_win_target_samples;
 static uint8_t  s_win_skip;       /* discard first N windows after warm-up */
 
 /* Audio band (applied to both MIC() and MICFFT()). */
-typedef struct
-{
-    float b0, b1, b2;
-    float a1, a2; /* a0 assumed 1.0 (already normalized) */
-    float z1, z2; /* DF2T state */
-} biquad_df2t_t;
-
-static biquad_df2t_t s_band_hp[2];
-static biquad_df2t_t s_band_lp[2];
+static mic_biquad_t s_band_hp[2];
+static mic_biquad_t s_band_lp[2];
 
 /* Smart warm-up: start measuring only after DATA is active. */
 static uint8_t  s_meas_started;
 static uint32_t s_stuck_t0_ms;
 
 /* =====================================================================================
- * MICFFT (3-band "FFT-like" analysis state)
+ * MICFFT / MICBANDS (MICFFT_N-point spectrum, Hann window, 50% overlap)
  * ===================================================================================== */
 
+#if (MICFFT_N > MIC_DSP_FFT_MAX) || (MICFFT_N < 16u) || ((MICFFT_N & (MICFFT_N - 1u)) != 0u)
+#error "MICFFT_N must be a power of two, 16..MIC_DSP_FFT_MAX"
+#endif
+#if (MIC_BANDS_MAX < 3u) || (MIC_BANDS_MAX > 16u)
+#error "MIC_BANDS_MAX must be 3..16"
+#endif
+
+#define MICFFT_HOP  (MICFFT_N / 2u)
+
 static uint32_t s_fft_fs_hz;
-static float    s_fft_a_lf;    /* low-pass alpha for MICFFT_LF_MAX_HZ */
-static float    s_fft_a_mf;    /* low-pass alpha for MICFFT_MF_MAX_HZ */
+static uint32_t s_fft_win_frames;   /* frames (hops) per MICFFT window */
 
-static float    s_fft_lp_lf;
-static float    s_fft_lp_mf;
+static int16_t  s_spec_ring[MICFFT_N];      /* last MICFFT_N band-limited samples, Q15 */
+static uint32_t s_spec_pos;                 /* next write = oldest sample */
+static uint32_t s_spec_fill;                /* samples in the ring, up to MICFFT_N */
+static uint32_t s_spec_new;                 /* samples since the last frame */
+static int16_t  s_spec_work[MICFFT_N];
+static uint32_t s_spec_pow[MICFFT_N / 2u];
+static uint32_t s_spec_frames;              /* frames in the current window */
 
-static uint32_t s_fft_t0_ms;
-static uint32_t s_fft_n;
-static double   s_fft_sum_sq_lf;
-static double   s_fft_sum_sq_mf;
-static double   s_fft_sum_sq_hf;
+/* LF/MF/HF bin ranges and window sums. */
+static uint16_t s_fft_edges[4];
+static uint64_t s_fft_acc[3];
 
 static uint8_t  s_fft_have_bins;
 static mic_err_t s_fft_last_err;
@@ -139,21 +183,47 @@ static int16_t  s_fft_last_mf_db_x100;
 static int16_t  s_fft_last_hf_db_x100;
 static uint8_t  s_fft_skip; /* discard first completed MICFFT window after warm-up */
 
-/* Compile-time power-save settings (MIC_POWERSAVE in mic.h). */
+/* MICBANDS: s_bands_n log-spaced bands; results of another count are never published. */
+static uint8_t  s_bands_n = MIC_BANDS_MAX;
+static uint16_t s_bands_edges[MIC_BANDS_MAX + 1u];
+static uint64_t s_bands_acc[MIC_BANDS_MAX];
+static uint8_t  s_bands_skip;               /* window started before the last re-layout */
+static uint8_t  s_bands_have;
+static int16_t  s_bands_last_db_x100[MIC_BANDS_MAX];
+
+/* BEAT tracker (runs on every frame) and its published state. Readers may interrupt
+ * the writer: it fills the slot they are not pointed at, then flips the index. */
+typedef struct
+{
+    uint32_t beats;
+    uint32_t onsets;
+    uint32_t beat_tick;         /* HAL tick of the last beat */
+    uint32_t period_ms;
+} mic_beat_pub_t;
+
+static mic_beat_det_t s_beat;
+static mic_beat_pub_t s_beat_pub[2];
+static volatile uint8_t s_beat_pub_idx;
+static uint32_t s_beat_poll_ms;
+static uint8_t  s_beat_polled;
+static uint8_t  s_beat_err_told;    /* BEAT() reported the error of result s_beat_err_seq */
+static uint32_t s_beat_err_seq;
+
+/* Power-save settings (s_cfg.powersave_ms, default MIC_POWERSAVE in mic.h). */
 static inline uint32_t mic_get_target_ms(void)
 {
     /* 0 = continuous */
-    if (MIC_POWERSAVE == 0u) return 0u;
+    if (s_cfg.powersave_ms == 0u) return 0u;
 
     /*
-     * MIC_POWERSAVE is the requested "useful" capture time.
+     * powersave_ms is the requested "useful" capture time.
      * If the clock was OFF before start, add MIC_WAKEUP_MS on top.
      */
-    uint32_t measure_ms = (uint32_t)MIC_POWERSAVE;
+    uint32_t measure_ms = s_cfg.powersave_ms;
 
     /* Ensure we can produce at least one RMS window after warm-up. */
-    if (measure_ms < (uint32_t)MIC_WINDOW_MS)
-        measure_ms = (uint32_t)MIC_WINDOW_MS;
+    if (measure_ms < (uint32_t)s_cfg.window_ms)
+        measure_ms = (uint32_t)s_cfg.window_ms;
 
     uint32_t total_ms = measure_ms + (uint32_t)MIC_WAKEUP_MS;
     if (total_ms < measure_ms)
@@ -161,6 +231,41 @@ static inline uint32_t mic_get_target_ms(void)
     return total_ms;
 }
 
+/* Adaptive duty-cycle scheduler (see mic.h). */
+static uint32_t s_sched_gap_ms;         /* stop -> next start while quiet */
+static uint32_t s_sched_next_ms;        /* tick of the next scheduled start */
+static uint8_t  s_sched_loud;           /* sound heard: capture runs continuously */
+static uint32_t s_sched_loud_ms;        /* last loud window */
+static uint8_t  s_sched_have_floor;
+static int32_t  s_sched_floor_x100;     /* noise floor estimate, dB*100 */
+static uint8_t  s_sched_win_new;        /* a MIC window was published (MIC_Task evaluates) */
+static int32_t  s_sched_win_x100;
+static uint8_t  s_keep_last;            /* keep the previous result until the next window */
+
+/* Mic clock duty: on-time and total time (tick time + STOP2 time reported by the VM). */
+static uint32_t s_duty_t0_ms;
+static uint32_t s_duty_sleep_ms;
+static uint32_t s_duty_on_ms;
+static uint32_t s_run_t0_ms;
+
+static inline uint8_t mic_sched_enabled(void)
+{
+    return (s_cfg.powersave_ms != 0u && s_cfg.adaptive_max_ms != 0u) ? 1u : 0u;
+}
+
+static void mic_sched_reset(void)
+{
+    uint32_t now = HAL_GetTick();
+    s_sched_gap_ms = MIC_SCHED_MIN_GAP_MS;
+    s_sched_next_ms = now;
+    s_sched_loud = 0u;
+    s_sched_win_new = 0u;
+    s_duty_t0_ms = now;
+    s_duty_sleep_ms = 0u;
+    s_duty_on_ms = 0u;
+    s_run_t0_ms = now;
+}
+
 /* last DMA snapshot for CLI dump */
 static uint8_t  s_have_last_dma;
 static uint32_t s_last_dma_words;
@@ -186,8 +291,16 @@ const uint16_t* MIC_DebugLastDmaBuf(uint32_t *out_words)
 static uint8_t  s_interval_active;
 static uint32_t s_interval_t0_ms;
 
-/* Debug logging helper. */
-#define MIC_DBG(...) do { if (s_debug) printf(__VA_ARGS__); } while (0)
+/* Debug logging helper (same destination printf had: _write() in syscalls.c). */
+extern int _write(int file, char *ptr, int len);
+
+static void mic_dbg_out(void *ctx, const char *s, uint32_t len)
+{
+    (void)ctx;
+    (void)_write(1, (char *)s, (int)len);
+}
+
+#define MIC_DBG(...) do { if (s_debug) (void)FMT_Format(mic_dbg_out, NULL, __VA_ARGS__); } while (0)
 
 /* Error handling + dBFS conversion helpers. */
 static float safe_dbfs_from_rms(float rms)
@@ -197,110 +310,16 @@ static float safe_dbfs_from_rms(float rms)
     return 20.0f * log10f(rms);
 }
 
-static float mic_rms_apply_cal(float rms)
-{
-    float r = rms;
-    if (r < 0.0f) r = 0.0f;
-    r *= s_cal_rms_gain;
-    if (r < 0.0f) r = 0.0f;
-    return r;
-}
-
-static float mic_dbfs_apply_cal(float dbfs)
-{
-    return dbfs + s_cal_db_offset_db;
-}
-
 static void set_error(mic_err_t e, const char *msg)
 {
     s_last_err = e;
     s_last_err_msg = msg;
-    if (msg && s_debug)
-        printf("[MIC] %s\r\n", msg);
+    s_pub_seq++;
+    if (msg)
+        MIC_DBG("[MIC] %s\r\n", msg);
 }
 
 static uint32_t mic_pcm_fs_hz(void);
-static float mic_lp_alpha_from_fc(uint32_t fc_hz, uint32_t fs_hz);
-
-static inline void biquad_reset(biquad_df2t_t *s)
-{
-    if (s == NULL) return;
-    s->z1 = 0.0f;
-    s->z2 = 0.0f;
-}
-
-static inline float biquad_step(biquad_df2t_t *s, float x)
-{
-    /* Direct Form II Transposed */
-    float y = s->b0 * x + s->z1;
-    s->z1 = s->b1 * x - s->a1 * y + s->z2;
-    s->z2 = s->b2 * x - s->a2 * y;
-    return y;
-}
-
-static void biquad_design_lp(biquad_df2t_t *s, uint32_t fc_hz, uint32_t fs_hz, float q)
-{
-    if (s == NULL || fs_hz == 0u) return;
-
-    float fs = (float)fs_hz;
-    float fc = (float)fc_hz;
-    if (fc < 1.0f) fc = 1.0f;
-    float fc_max = 0.45f * fs;
-    if (fc > fc_max) fc = fc_max;
-
-    if (q < 0.1f) q = 0.1f;
-
-    float w0 = 6.28318530718f * (fc / fs);
-    float cs = cosf(w0);
-    float sn = sinf(w0);
-    float alpha = sn / (2.0f * q);
-
-    float b0 = (1.0f - cs) * 0.5f;
-    float b1 = (1.0f - cs);
-    float b2 = (1.0f - cs) * 0.5f;
-    float a0 = 1.0f + alpha;
-    float a1 = -2.0f * cs;
-    float a2 = 1.0f - alpha;
-
-    s->b0 = b0 / a0;
-    s->b1 = b1 / a0;
-    s->b2 = b2 / a0;
-    s->a1 = a1 / a0;
-    s->a2 = a2 / a0;
-    biquad_reset(s);
-}
-
-static void biquad_design_hp(biquad_df2t_t *s, uint32_t fc_hz, uint32_t fs_hz, float q)
-{
-    if (s == NULL || fs_hz == 0u) return;
-
-    float fs = (float)fs_hz;
-    float fc = (float)fc_hz;
-    if (fc < 1.0f) fc = 1.0f;
-    float fc_max = 0.45f * fs;
-    if (fc > fc_max) fc = fc_max;
-
-    if (q < 0.1f) q = 0.1f;
-
-    float w0 = 6.28318530718f * (fc / fs);
-    float cs = cosf(w0);
-    float sn = sinf(w0);
-    float alpha = sn / (2.0f * q);
-
-    float b0 = (1.0f + cs) * 0.5f;
-    float b1 = -(1.0f + cs);
-    float b2 = (1.0f + cs) * 0.5f;
-    float a0 = 1.0f + alpha;
-    float a1 = -2.0f * cs;
-    float a2 = 1.0f - alpha;
-
-    s->b0 = b0 / a0;
-    s->b1 = b1 / a0;
-    s->b2 = b2 / a0;
-    s->a1 = a1 / a0;
-    s->a2 = a2 / a0;
-    biquad_reset(s);
-}
 
 static void mic_update_rates(void)
 {
@@ -310,13 +329,25 @@ static void mic_update_rates(void)
     uint32_t fs_for_filters = s_pcm_fs_hz;
     if (fs_for_filters == 0u) fs_for_filters = 6000u; /* defensive fallback */
 
+    /* Large decimation factors put MIC_BAND_LP_HZ above Nyquist. */
+    s_band_lp_hz = MIC_BAND_LP_HZ;
+    if (s_band_lp_hz > fs_for_filters * 45u / 100u)
+        s_band_lp_hz = fs_for_filters * 45u / 100u;
+
     /* 4th-order Butterworth = cascade two biquads with these Q values. */
     const float q1 = 0.54119610f;
     const float q2 = 1.30656296f;
-    biquad_design_hp(&s_band_hp[0], MIC_BAND_HP_HZ, fs_for_filters, q1);
-    biquad_design_hp(&s_band_hp[1], MIC_BAND_HP_HZ, fs_for_filters, q2);
-    biquad_design_lp(&s_band_lp[0], MIC_BAND_LP_HZ, fs_for_filters, q1);
-    biquad_design_lp(&s_band_lp[1], MIC_BAND_LP_HZ, fs_for_filters, q2);
+    mic_biquad_coef_t c;
+    MIC_DSP_DesignHP(&c, MIC_BAND_HP_HZ, fs_for_filters, q1);
+    MIC_DSP_BiquadInit(&s_band_hp[0], &c);
+    MIC_DSP_DesignHP(&c, MIC_BAND_HP_HZ, fs_for_filters, q2);
+    MIC_DSP_BiquadInit(&s_band_hp[1], &c);
+    MIC_DSP_DesignLP(&c, s_band_lp_hz, fs_for_filters, q1);
+    MIC_DSP_BiquadInit(&s_band_lp[0], &c);
+    MIC_DSP_DesignLP(&c, s_band_lp_hz, fs_for_filters, q2);
+    MIC_DSP_BiquadInit(&s_band_lp[1], &c);
+
+    MIC_DSP_CicInit(&s_cic, s_cfg.decim, MIC_FIR_TAPS);
 
     if (s_pcm_fs_hz == 0u)
     {
@@ -325,7 +356,7 @@ static void mic_update_rates(void)
         return;
     }
 
-    uint32_t target = (s_pcm_fs_hz * (uint32_t)MIC_WINDOW_MS + 500u) / 1000u;
+    uint32_t target = (s_pcm_fs_hz * (uint32_t)s_cfg.window_ms + 500u) / 1000u;
     if (target == 0u) target = 1u;
     s_win_target_samples = target;
 }
@@ -357,9 +388,9 @@ static uint32_t mic_spi_bits_per_word(void)
 static uint32_t mic_pcm_fs_hz(void)
 {
     /*
-     * We treat each received SPI word as one CIC input sample (it represents 16 PDM bits via popcount).
+     * We treat each received SPI word as one CIC input sample (it represents 16 PDM bits, see MIC_PDM_LUT).
      * Therefore the CIC input sample rate is: fs_in = SPI_SCK / bits_per_word.
-     * After MIC_DECIM_N, PCM fs is: fs = fs_in / MIC_DECIM_N.
+     * After decimation by s_cfg.decim, PCM fs is: fs = fs_in / decim.
      */
     uint32_t pclk = HAL_RCC_GetPCLK1Freq();
     if (pclk == 0u) pclk = HAL_RCC_GetHCLKFreq();
@@ -371,59 +402,37 @@ static uint32_t mic_pcm_fs_hz(void)
     if (bits == 0u) return 0u;
 
     uint32_t fs_in = sck / bits;
-    if (MIC_DECIM_N == 0u) return 0u;
-    return fs_in / MIC_DECIM_N;
-}
-
-static float mic_lp_alpha_from_fc(uint32_t fc_hz, uint32_t fs_hz)
-{
-    if (fs_hz == 0u || fc_hz == 0u) return 0.0f;
-
-    float fs = (float)fs_hz;
-    float fc = (float)fc_hz;
-
-    /* Clamp for stability if configuration/sample-rate makes fc too high. */
-    float fc_max = 0.45f * fs;
-    if (fc > fc_max) fc = fc_max;
-    if (fc < 1.0f) fc = 1.0f;
-
-    /* alpha = 2*pi*fc / (2*pi*fc + fs) */
-    const float two_pi = 6.28318530718f;
-    float w = two_pi * fc;
-    float a = w / (w + fs);
-    if (a < 0.0f) a = 0.0f;
-    if (a > 1.0f) a = 1.0f;
-    return a;
-}
-
-static inline float mic_lp_step(float x, float *state, float alpha)
-{
-    *state += alpha * (x - *state);
-    return *state;
+    if (s_cfg.decim == 0u) return 0u;
+    return fs_in / s_cfg.decim;
 }
 
 static void mic_band_reset(void)
 {
-    biquad_reset(&s_band_hp[0]);
-    biquad_reset(&s_band_hp[1]);
-    biquad_reset(&s_band_lp[0]);
-    biquad_reset(&s_band_lp[1]);
+    MIC_DSP_BiquadReset(&s_band_hp[0]);
+    MIC_DSP_BiquadReset(&s_band_hp[1]);
+    MIC_DSP_BiquadReset(&s_band_lp[0]);
+    MIC_DSP_BiquadReset(&s_band_lp[1]);
 }
 
-static inline float mic_band_step(float x)
+static void mic_band_block(mic_sample_t *buf, uint32_t n)
 {
-    float y = x;
     if (MIC_BAND_HP_HZ != 0u)
     {
-        y = biquad_step(&s_band_hp[0], y);
-        y = biquad_step(&s_band_hp[1], y);
+        MIC_DSP_BiquadBlock(&s_band_hp[0], buf, n);
+        MIC_DSP_BiquadBlock(&s_band_hp[1], buf, n);
     }
     if (MIC_BAND_LP_HZ != 0u)
     {
-        y = biquad_step(&s_band_lp[0], y);
-        y = biquad_step(&s_band_lp[1], y);
+        MIC_DSP_BiquadBlock(&s_band_lp[0], buf, n);
+        MIC_DSP_BiquadBlock(&s_band_lp[1], buf, n);
     }
-    return y;
+}
+
+static int16_t mic_clamp_i16(int32_t v)
+{
+    if (v > 32767) v = 32767;
+    if (v < -32768) v = -32768;
+    return (int16_t)v;
 }
 
 static int16_t mic_dbfs_to_x100_i16(float dbfs)
@@ -440,65 +449,131 @@ static void micfft_invalidate(mic_err_t e)
 {
     s_fft_have_bins = 0u;
     s_fft_last_err = e;
-    s_fft_t0_ms = 0u;
-    s_fft_n = 0u;
-    s_fft_sum_sq_lf = 0.0;
-    s_fft_sum_sq_mf = 0.0;
-    s_fft_sum_sq_hf = 0.0;
+    s_spec_frames = 0u;
+    memset(s_fft_acc, 0, sizeof(s_fft_acc));
+    memset(s_bands_acc, 0, sizeof(s_bands_acc));
+    s_bands_have = 0u;
+    s_bands_skip = 0u;
 }
 
-static void micfft_reset(void)
+static uint16_t micfft_bin(float f_hz)
 {
-    s_fft_fs_hz = mic_pcm_fs_hz();
-    s_fft_a_lf = mic_lp_alpha_from_fc(MICFFT_LF_MAX_HZ, s_fft_fs_hz);
-    s_fft_a_mf = mic_lp_alpha_from_fc(MICFFT_MF_MAX_HZ, s_fft_fs_hz);
+    if (s_fft_fs_hz == 0u || f_hz <= 0.0f) return 1u;
+    return (uint16_t)(f_hz * (float)MICFFT_N / (float)s_fft_fs_hz + 0.5f);
+}
 
-    s_fft_lp_lf = 0.0f;
-    s_fft_lp_mf = 0.0f;
+/* Edges must rise (each band gets at least one bin while bins last) and skip DC. */
+static void micfft_fix_edges(uint16_t *edges, uint32_t nb)
+{
+    for (uint32_t b = 0; b <= nb; b++)
+    {
+        uint32_t k = edges[b];
+        if (k < 1u) k = 1u;
+        if (b > 0u && k <= edges[b - 1u]) k = edges[b - 1u] + 1u;
+        if (k > MICFFT_N / 2u) k = MICFFT_N / 2u;
+        edges[b] = (uint16_t)k;
+    }
+}
 
-    s_fft_last_lf_db_x100 = -12000;
-    s_fft_last_mf_db_x100 = -12000;
-    s_fft_last_hf_db_x100 = -12000;
+/* nb log-spaced bands from f_lo to f_hi. */
+static void micfft_layout(uint16_t *edges, uint32_t nb, uint32_t f_lo, uint32_t f_hi)
+{
+    if (f_lo < 1u) f_lo = 1u;
+    if (f_hi <= f_lo) f_hi = f_lo + 1u;
+    float ratio = (float)f_hi / (float)f_lo;
+    for (uint32_t b = 0; b <= nb; b++)
+        edges[b] = micfft_bin((float)f_lo * powf(ratio, (float)b / (float)nb));
+    micfft_fix_edges(edges, nb);
+}
 
-    s_fft_skip = 1u;
-    micfft_invalidate(MIC_ERR_NO_DATA_YET);
+static void micfft_bands_layout(void)
+{
+    micfft_layout(s_bands_edges, s_bands_n, MIC_BAND_HP_HZ, s_band_lp_hz);
+    memset(s_bands_acc, 0, sizeof(s_bands_acc));
+    s_bands_have = 0u;
+    s_bands_skip = (s_spec_frames != 0u) ? 1u : 0u;
 }
 
-static void micfft_feed_sample(float x)
+static void mic_beat_publish(void)
 {
-    if (MICFFT_WINDOW_MS == 0u) return;
-    if (s_fft_fs_hz == 0u) return;
+    uint8_t i = (uint8_t)(s_beat_pub_idx ^ 1u);
+    s_beat_pub[i].beats = s_beat.beats;
+    s_beat_pub[i].onsets = s_beat.onsets;
+    s_beat_pub[i].beat_tick = HAL_GetTick() - (s_beat.t_ms - s_beat.beat_ms);
+    s_beat_pub[i].period_ms = s_beat.period_ms;
+    __DMB();
+    s_beat_pub_idx = i;
+}
 
-    /* Input is already band-limited by MIC_BAND_HP_HZ..MIC_BAND_LP_HZ. */
-    float x_band = x;
+/* A BEAT() reader polled recently: keep capturing. */
+static uint8_t mic_beat_hold(void)
+{
+    return (s_beat_polled && (HAL_GetTick() - s_beat_poll_ms) < MIC_BEAT_HOLD_MS) ? 1u : 0u;
+}
 
-    /* Two low-pass splits: LF cutoff and MF cutoff (3 bins total). */
-    float lp_lf = mic_lp_step(x_band, &s_fft_lp_lf, s_fft_a_lf);
-    float lp_mf = mic_lp_step(x_band, &s_fft_lp_mf, s_fft_a_mf);
+static void micfft_reset(void)
+{
+    s_fft_fs_hz = mic_pcm_fs_hz();
+    (void)MIC_DSP_FftInit(MICFFT_N);
 
-    float lf = lp_lf;
-    float mf = lp_mf - lp_lf;
-    float hf = x_band - lp_mf;
+    /* Hard band edges: HP..LF_MAX..MF_MAX..LP. */
+    s_fft_edges[0] = micfft_bin((float)MIC_BAND_HP_HZ);
+    s_fft_edges[1] = micfft_bin((float)MICFFT_LF_MAX_HZ);
+    s_fft_edges[2] = micfft_bin((float)MICFFT_MF_MAX_HZ);
+    s_fft_edges[3] = micfft_bin((float)s_band_lp_hz);
+    micfft_fix_edges(s_fft_edges, 3u);
 
-    double dlf = (double)lf;
-    double dmf = (double)mf;
-    double dhf = (double)hf;
+    /* MICFFT_WINDOW_MS in samples, rounded to whole hops: windows are sample-aligned. */
+    uint32_t win = (s_fft_fs_hz * (uint32_t)MICFFT_WINDOW_MS + 500u) / 1000u;
+    s_fft_win_frames = (win + MICFFT_HOP / 2u) / MICFFT_HOP;
+    if (s_fft_win_frames == 0u) s_fft_win_frames = 1u;
 
-    if (s_fft_n == 0u)
-        s_fft_t0_ms = HAL_GetTick();
+    s_spec_pos = 0u;
+    s_spec_fill = 0u;
+    s_spec_new = 0u;
+    s_spec_frames = 0u;
 
-    s_fft_sum_sq_lf += dlf * dlf;
-    s_fft_sum_sq_mf += dmf * dmf;
-    s_fft_sum_sq_hf += dhf * dhf;
-    s_fft_n++;
+    s_fft_last_lf_db_x100 = -12000;
+    s_fft_last_mf_db_x100 = -12000;
+    s_fft_last_hf_db_x100 = -12000;
 
-    uint32_t now = HAL_GetTick();
-    if ((now - s_fft_t0_ms) < (uint32_t)MICFFT_WINDOW_MS)
-        return;
+    s_fft_skip = 1u;
+    micfft_invalidate(MIC_ERR_NO_DATA_YET);
+    micfft_bands_layout();
 
-    if (s_fft_n == 0u)
-        return;
+    /* Frame step in ms, Q16; the counts carry on across restarts. */
+    uint32_t frame_q16 = (s_fft_fs_hz != 0u)
+        ? (uint32_t)((((uint64_t)MICFFT_HOP * 1000u) << 16) / s_fft_fs_hz) : 0u;
+    MIC_DSP_BeatReset(&s_beat, frame_q16);
+}
 
+static void micfft_frame(void)
+{
+    /* Oldest sample first. */
+    uint32_t tail = MICFFT_N - s_spec_pos;
+    memcpy(&s_spec_work[0], &s_spec_ring[s_spec_pos], tail * sizeof(int16_t));
+    memcpy(&s_spec_work[tail], &s_spec_ring[0], s_spec_pos * sizeof(int16_t));
+
+    int32_t shift = MIC_DSP_RealFftPower(s_spec_work, s_spec_pow);
+    uint64_t fr[3] = { 0u, 0u, 0u };
+    MIC_DSP_BandsAccumulate(fr, s_fft_edges, 3u, s_spec_pow, shift);
+    MIC_DSP_BandsAccumulate(s_bands_acc, s_bands_edges, s_bands_n, s_spec_pow, shift);
+    s_spec_frames++;
+
+    /* LF/MF/HF of this frame: into the window and through the beat tracker. */
+    int32_t lvl[3];
+    for (uint32_t b = 0; b < 3u; b++)
+    {
+        s_fft_acc[b] += fr[b];
+        lvl[b] = MIC_DSP_BandDbX100(fr[b], 1u);
+    }
+    uint32_t period_ms = s_beat.period_ms;
+    if (MIC_DSP_BeatFrame(&s_beat, lvl) != 0u || s_beat.period_ms != period_ms)
+        mic_beat_publish();
+}
+
+static void micfft_close_window(void)
+{
     /* Discard the very first FFT window after warm-up to let filters settle. */
     if (s_fft_skip)
     {
@@ -507,119 +582,62 @@ static void micfft_feed_sample(float x)
         return;
     }
 
-    float rms_lf = (float)sqrt(s_fft_sum_sq_lf / (double)s_fft_n);
-    float rms_mf = (float)sqrt(s_fft_sum_sq_mf / (double)s_fft_n);
-    float rms_hf = (float)sqrt(s_fft_sum_sq_hf / (double)s_fft_n);
-
-    float db_lf = mic_dbfs_apply_cal(safe_dbfs_from_rms(mic_rms_apply_cal(rms_lf)));
-    float db_mf = mic_dbfs_apply_cal(safe_dbfs_from_rms(mic_rms_apply_cal(rms_mf)));
-    float db_hf = mic_dbfs_apply_cal(safe_dbfs_from_rms(mic_rms_apply_cal(rms_hf)));
-
-    s_fft_last_lf_db_x100 = mic_dbfs_to_x100_i16(db_lf);
-    s_fft_last_mf_db_x100 = mic_dbfs_to_x100_i16(db_mf);
-    s_fft_last_hf_db_x100 = mic_dbfs_to_x100_i16(db_hf);
-
+    s_fft_last_lf_db_x100 = mic_clamp_i16(mic_cal_db_x100(MIC_DSP_BandDbX100(s_fft_acc[0], s_spec_frames)));
+    s_fft_last_mf_db_x100 = mic_clamp_i16(mic_cal_db_x100(MIC_DSP_BandDbX100(s_fft_acc[1], s_spec_frames)));
+    s_fft_last_hf_db_x100 = mic_clamp_i16(mic_cal_db_x100(MIC_DSP_BandDbX100(s_fft_acc[2], s_spec_frames)));
     s_fft_have_bins = 1u;
     s_fft_last_err = MIC_ERR_OK;
 
+    if (s_bands_skip)
+    {
+        s_bands_skip = 0u;
+    }
+    else
+    {
+        for (uint32_t b = 0; b < s_bands_n; b++)
+            s_bands_last_db_x100[b] = mic_clamp_i16(mic_cal_db_x100(MIC_DSP_BandDbX100(s_bands_acc[b], s_spec_frames)));
+        s_bands_have = 1u;
+    }
+    s_pub_seq++;
+
     /* Reset for next window. */
-    s_fft_t0_ms = now;
-    s_fft_n = 0u;
-    s_fft_sum_sq_lf = 0.0;
-    s_fft_sum_sq_mf = 0.0;
-    s_fft_sum_sq_hf = 0.0;
+    s_spec_frames = 0u;
+    memset(s_fft_acc, 0, sizeof(s_fft_acc));
+    memset(s_bands_acc, 0, sizeof(s_bands_acc));
 }
 
-/* PDM->PCM pipeline: CIC + decimation + short FIR smoothing (feeds RMS accumulator). */
-
-/* CIC state (single channel), 3rd-order CIC decimator (sinc^3) at the "word rate".
- * This provides a much stronger low-pass than a single boxcar, reducing noise-folding
- * from the PDM noise-shaped spectrum into the audio band.
- *
- * NOTE: Integrators run continuously and would overflow in signed arithmetic; we
- * intentionally keep them modulo 2^32 using uint32_t (defined wrap-around).
- */
-typedef struct
-{
-    uint32_t i1, i2, i3; /* integrators */
-    uint32_t d1, d2, d3; /* comb delays (at decimated rate) */
-} cic3_u32_t;
-
-static cic3_u32_t s_cic3;
-
-/* FIR moving average (simple low-pass). */
-static int32_t s_fir_hist[MIC_FIR_TAPS];
-static uint32_t s_fir_pos;
-
-static void pdm2pcm_reset(void)
+static void micfft_feed_block(const mic_sample_t *buf, uint32_t n)
 {
-    memset(&s_cic3, 0, sizeof(s_cic3));
-    s_decim_phase = 0u;
-    memset(s_fir_hist, 0, sizeof(s_fir_hist));
-    s_fir_pos = 0u;
-}
+    if (MICFFT_WINDOW_MS == 0u) return;
+    if (s_fft_fs_hz == 0u) return;
 
-static inline uint8_t popcount16_inline(uint16_t x)
-{
-    uint8_t c = 0;
-    while (x)
+    /* Input is already band-limited by MIC_BAND_HP_HZ..MIC_BAND_LP_HZ. */
+    for (uint32_t i = 0; i < n; i++)
     {
-        x &= (uint16_t)(x - 1u);
-        c++;
+#if MIC_FIXED_POINT
+        int32_t v = (buf[i] + (1 << 7)) >> 8;
+#else
+        float f = buf[i] * 32768.0f;
+        int32_t v = (int32_t)((f >= 0.0f) ? (f + 0.5f) : (f - 0.5f));
+#endif
+        if (v > 32767) v = 32767;
+        if (v < -32768) v = -32768;
+        s_spec_ring[s_spec_pos] = (int16_t)v;
+        if (++s_spec_pos >= MICFFT_N) s_spec_pos = 0u;
+        if (s_spec_fill < MICFFT_N) s_spec_fill++;
+        if (++s_spec_new < MICFFT_HOP || s_spec_fill < MICFFT_N) continue;
+
+        s_spec_new = 0u;
+        micfft_frame();
+        if (s_spec_frames >= s_fft_win_frames)
+            micfft_close_window();
     }
-    return c;
 }
 
-/* Convert 16 PDM bits into a signed CIC input in range [-16..+16]. */
-static inline int32_t pdm_word_to_cic_input(uint16_t w)
-{
-    int32_t ones = (int32_t)popcount16_inline(w);
-    return (2 * ones) - 16;
-}
-
-static inline int32_t cic_u32_to_s32(uint32_t u)
-{
-    /* Convert modulo 2^32 value to signed int32 (two's complement) without UB. */
-    if (u <= 0x7FFFFFFFu) return (int32_t)u;
-    return (int32_t)((int64_t)u - 0x100000000LL);
-}
-
-static inline uint8_t pdm2pcm_push(int32_t cic_in, float *out_pcm)
+/* PDM->PCM pipeline: CIC + decimation + short FIR smoothing (feeds RMS accumulator). */
+static void pdm2pcm_reset(void)
 {
-    /* 3-stage CIC integrators (modulo arithmetic). */
-    s_cic3.i1 += (uint32_t)cic_in;
-    s_cic3.i2 += s_cic3.i1;
-    s_cic3.i3 += s_cic3.i2;
-
-    s_decim_phase++;
-    if (s_decim_phase < MIC_DECIM_N)
-        return 0u;
-
-    s_decim_phase = 0u;
-
-    /* 3-stage combs at the decimated rate. */
-    uint32_t c1u = s_cic3.i3 - s_cic3.d1; s_cic3.d1 = s_cic3.i3;
-    uint32_t c2u = c1u      - s_cic3.d2; s_cic3.d2 = c1u;
-    uint32_t c3u = c2u      - s_cic3.d3; s_cic3.d3 = c2u;
-    int32_t comb = cic_u32_to_s32(c3u);
-
-    /* FIR moving average on the decimated stream. */
-    s_fir_hist[s_fir_pos] = comb;
-    s_fir_pos = (s_fir_pos + 1u) % MIC_FIR_TAPS;
-
-    int64_t acc = 0;
-    for (uint32_t i = 0; i < MIC_FIR_TAPS; i++)
-        acc += (int64_t)s_fir_hist[i];
-
-    /* Normalize to roughly [-1..1] (not calibrated) and clamp for stability. */
-    uint32_t r = (uint32_t)MIC_DECIM_N;
-    uint32_t r3 = r * r * r;
-    if (r3 == 0u) r3 = 1u;
-    float y = (float)acc / (float)(MIC_FIR_TAPS * 16u * r3);
-    if (y > 1.0f) y = 1.0f;
-    if (y < -1.0f) y = -1.0f;
-    if (out_pcm) *out_pcm = y;
-    return 1u;
+    MIC_DSP_CicReset(&s_cic);
 }
 
 /* HAL callbacks (DMA completion / error). */
@@ -627,7 +645,7 @@ void HAL_SPI_RxHalfCpltCallback(SPI_HandleTypeDef *hspi)
 {
     if (hspi == &hspi1)
     {
-        s_spi_half = 1u;
+        s_dma_seq++;
         s_dma_last_evt_ms = HAL_GetTick();
         s_cb_half_count++;
         s_cb_half_last_ms = s_dma_last_evt_ms;
@@ -638,7 +656,7 @@ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
 {
     if (hspi == &hspi1)
     {
-        s_spi_done = 1u;
+        s_dma_seq++;
         s_dma_last_evt_ms = HAL_GetTick();
         s_cb_full_count++;
         s_cb_full_last_ms = s_dma_last_evt_ms;
@@ -656,18 +674,14 @@ void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
     }
 }
 
-/* Start one SPI RX DMA block (non-circular, processed in software). */
-static mic_err_t start_dma_block(void)
+/* Start the circular SPI RX DMA; it runs until MIC_Stop. */
+static mic_err_t start_dma_ring(void)
 {
-    /* Fill with 0xAA so we can detect "DMA wrote nothing" cases. */
-    memset(s_rx_buf, 0xAA, sizeof(s_rx_buf));
-
     s_have_last_dma = 0u;
-    s_last_dma_words = MIC_DMA_WORDS;
+    s_last_dma_words = s_cfg.dma_words;
 
-    s_dma_circular = 0u;
-    s_spi_done = 0u;
-    s_spi_half = 0u;
+    s_dma_seq = 0u;
+    s_dma_seq_done = 0u;
     s_spi_err  = 0u;
 
     /* Basic sanity checks before starting DMA. */
@@ -683,61 +697,120 @@ static mic_err_t start_dma_block(void)
         return MIC_ERR_SPI_NOT_READY;
     }
 
+    if (hspi1.hdmarx == NULL || hspi1.hdmarx->Instance == NULL)
+    {
+        set_error(MIC_ERR_NOT_INIT, "ERROR: SPI1 RX DMA not linked");
+        return MIC_ERR_NOT_INIT;
+    }
+
+    /* The processing relies on the ring; re-init the channel if it was generated as normal. */
+    if (hspi1.hdmarx->Init.Mode != DMA_CIRCULAR)
+    {
+        hspi1.hdmarx->Init.Mode = DMA_CIRCULAR;
+        if (HAL_DMA_Init(hspi1.hdmarx) != HAL_OK)
+        {
+            set_error(MIC_ERR_START_DMA, "ERROR: cannot switch SPI1 RX DMA to circular");
+            return MIC_ERR_START_DMA;
+        }
+    }
+
     /* Start RX DMA (count is in 16-bit elements with the current SPI/DMA config). */
-    HAL_StatusTypeDef st = HAL_SPI_Receive_DMA(&hspi1, (uint8_t*)s_rx_buf, MIC_DMA_WORDS);
+    HAL_StatusTypeDef st = HAL_SPI_Receive_DMA(&hspi1, (uint8_t*)s_rx_buf, s_cfg.dma_words);
     if (st != HAL_OK)
     {
         set_error(MIC_ERR_START_DMA, "ERROR: HAL_SPI_Receive_DMA failed");
-        if (s_debug)
-            printf("[MIC] HAL st=%d state=%d err=0x%08lX\r\n", (int)st, (int)HAL_SPI_GetState(&hspi1), (unsigned long)hspi1.ErrorCode);
+        MIC_DBG("[MIC] HAL st=%d state=%d err=0x%08lX\r\n", (int)st, (int)HAL_SPI_GetState(&hspi1), (unsigned long)hspi1.ErrorCode);
         return MIC_ERR_START_DMA;
     }
 
     /* For debug: BUSY means SPI is actively generating CLOCK on PA5. */
-    s_dma_t0_ms = HAL_GetTick();
-    s_dma_last_evt_ms = s_dma_t0_ms;
+    s_dma_last_evt_ms = HAL_GetTick();
+
+    MIC_DBG("[MIC] DMA started. SPI state=%d (2=BUSY => CLOCK on PA5)\r\n", (int)HAL_SPI_GetState(&hspi1));
+    return MIC_ERR_OK;
+}
 
-    /* Detect circular DMA configuration (CubeMX). */
-    if (hspi1.hdmarx && hspi1.hdmarx->Instance)
+/* Close a full RMS window: saturation check, warm-up skip, publish. */
+static mic_err_t mic_win_finalize(void)
+{
+    float rms = MIC_DSP_EnergyRms(&s_win);
+    int32_t dbfs_x100 = mic_cal_db_x100(MIC_DSP_EnergyDbX100(&s_win));
+
+    /* Guard against suspicious saturation (often wiring/clock/polarity issues). */
+    if (MIC_DSP_EnergySaturated(&s_win))
     {
-        if ((hspi1.hdmarx->Instance->CCR & DMA_CCR_CIRC) == DMA_CCR_CIRC)
-            s_dma_circular = 1u;
+        MIC_DBG("[MIC] WARNING: saturation suspected: rms=%.4q peak=%.4q\r\n",
+                (int32_t)(rms * 10000.0f), (int32_t)(MIC_DSP_EnergyPeak(&s_win) * 10000.0f));
+        set_error(MIC_ERR_SIGNAL_SATURATED, "ERROR: signal saturated (RMS/PEAK ~ 1.0) - likely DATA stuck or wrong clock/polarity");
+        micfft_invalidate(MIC_ERR_SIGNAL_SATURATED);
+
+        /* Reset window so we don't get stuck returning the same error forever. */
+        mic_energy_reset(&s_win);
+        return MIC_ERR_SIGNAL_SATURATED;
     }
 
-    MIC_DBG("[MIC] DMA started. SPI state=%d (2=BUSY => CLOCK on PA5)\r\n", (int)HAL_SPI_GetState(&hspi1));
+    /* Discard the very first full window after warm-up to let CIC/IIR settle. */
+    if (s_win_skip)
+    {
+        s_win_skip--;
+        if (!s_keep_last)
+        {
+            s_last_err = MIC_ERR_NO_DATA_YET;
+            s_last_err_msg = "no data yet";
+        }
+        mic_energy_reset(&s_win);
+        return MIC_ERR_OK;
+    }
+
+    s_last_rms  = rms;
+    s_last_dbfs = (float)dbfs_x100 / 100.0f;
+    s_last_err  = MIC_ERR_OK;
+    s_last_err_msg = NULL;
+    s_last_seq++;
+    s_pub_seq++;
+    s_keep_last = 0u;
+    s_sched_win_new = 1u;
+    s_sched_win_x100 = dbfs_x100;
+
+    MIC_DBG("[MIC] 50ms window ready: n=%lu rms=%.4q dbfs=%.2q peak=%.4q\r\n",
+            (unsigned long)s_win.n, (int32_t)(rms * 10000.0f), dbfs_x100,
+            (int32_t)(MIC_DSP_EnergyPeak(&s_win) * 10000.0f));
+
+    /* Reset window for the next measurement. */
+    mic_energy_reset(&s_win);
     return MIC_ERR_OK;
 }
 
-static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t words)
+/* Keep the block statistics for MICDIAG. */
+static void mic_rx_stats_store(const uint16_t *buf, const mic_word_stats_t *st, uint32_t now_ms)
 {
-    if (!buf || words == 0u)
-        return MIC_ERR_OK;
+    uint32_t first_n = (uint32_t)(sizeof(s_last_rx_first) / sizeof(s_last_rx_first[0]));
+    if (first_n > st->n) first_n = st->n;
+    memcpy(s_last_rx_first, buf, first_n * sizeof(s_last_rx_first[0]));
 
-    /* Quick RX quality stats (helps debug without an oscilloscope). */
-    uint32_t cnt_0000 = 0u;
-    uint32_t cnt_ffff = 0u;
-    uint32_t transitions = 0u;
-    uint16_t minw = 0xFFFFu;
-    uint16_t maxw = 0x0000u;
-    uint16_t prev = 0u;
-    uint8_t have_prev = 0u;
-    uint32_t first_n = 0u;
+    s_last_rx_ms = now_ms;
+    s_last_rx_words = st->n;
+    s_last_rx_cnt_0000 = st->cnt_0000;
+    s_last_rx_cnt_ffff = st->cnt_ffff;
+    s_last_rx_transitions = st->transitions;
+    s_last_rx_minw = st->minw;
+    s_last_rx_maxw = st->maxw;
+    s_last_rx_first_n = first_n;
+}
 
-    /* Detect "DMA wrote nothing" by checking the 0xAAAA fill pattern. */
-    uint32_t still_aa = 0;
-    for (uint32_t i = 0; i < words; i++)
-        if (buf[i] == 0xAAAAu) still_aa++;
+/* buf is the half completed by DMA event `seq`. */
+static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t words, uint32_t seq)
+{
+    if (!buf || words == 0u)
+        return MIC_ERR_OK;
 
-    if (still_aa == words)
-    {
-        set_error(MIC_ERR_DMA_NO_WRITE, "ERROR: DMA completed but buffer unchanged (0xAAAA) -> DMA not writing");
-        micfft_invalidate(MIC_ERR_DMA_NO_WRITE);
-        return MIC_ERR_DMA_NO_WRITE;
-    }
+    /* s_pcm_blk holds the output of one half-buffer at most. */
+    if (words > MIC_DMA_WORDS / 2u)
+        words = MIC_DMA_WORDS / 2u;
 
     /* Save last block for CLI debug dump. */
     s_have_last_dma = 1u;
-    s_last_dma_words = MIC_DMA_WORDS;
+    s_last_dma_words = s_cfg.dma_words;
 
     uint32_t now_ms = HAL_GetTick();
     uint32_t elapsed_ms = now_ms - s_capture_t0_ms;
@@ -748,45 +821,34 @@ static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t w
         if (elapsed_ms < (uint32_t)MIC_WAKEUP_MS) time_ready = 0u;
     }
 
-    /* Quick data-quality check: detect stuck DATA (all 0x0000/0xFFFF) -> RMS ~= 1.0. */
-    for (uint32_t i = 0; i < words; i++)
-    {
-        uint16_t w = buf[i];
-
-        if (first_n < (uint32_t)(sizeof(s_last_rx_first) / sizeof(s_last_rx_first[0])))
-            s_last_rx_first[first_n++] = w;
-
-        if (w == 0x0000u) cnt_0000++;
-        if (w == 0xFFFFu) cnt_ffff++;
-
-        if (w < minw) minw = w;
-        if (w > maxw) maxw = w;
+    /*
+     * RX quality stats (stuck DATA -> RMS ~= 1.0, plus MICDIAG). While measuring they
+     * come out of the decimation pass; during warm-up the block is only scanned.
+     */
+    mic_word_stats_t st;
+    uint32_t m = 0u;
+    if (s_meas_started)
+        m = MIC_DSP_CicBlock(&s_cic, buf, words, &s_pcm_blk[0], &st);
+    else
+        MIC_DSP_WordStats(&st, buf, words);
 
-        if (have_prev)
-        {
-            if (w != prev) transitions++;
-        }
-        else
-        {
-            have_prev = 1u;
-        }
-        prev = w;
+    /* Event seq+1 sends the DMA back into this half: the words just read may mix two laps.
+     * Drop the block (and what it left in the decimator) like any other overrun. */
+    if (s_dma_seq != seq)
+    {
+        s_dma_overruns++;
+        s_dma_dropped_words += words;
+        pdm2pcm_reset();
+        MIC_DBG("[MIC] DMA overrun: half-buffer overwritten while processed\r\n");
+        return MIC_ERR_OK;
     }
+    mic_rx_stats_store(buf, &st, now_ms);
 
-    s_last_rx_ms = now_ms;
-    s_last_rx_words = words;
-    s_last_rx_cnt_0000 = cnt_0000;
-    s_last_rx_cnt_ffff = cnt_ffff;
-    s_last_rx_transitions = transitions;
-    s_last_rx_minw = minw;
-    s_last_rx_maxw = maxw;
-    s_last_rx_first_n = first_n;
-
-    uint32_t bad_count = cnt_0000 + cnt_ffff;
+    uint32_t bad_count = st.cnt_0000 + st.cnt_ffff;
 
     uint8_t data_stuck = (bad_count == words) ? 1u : 0u;
     uint8_t data_active = 0u;
-    if ((bad_count < words) && (minw != maxw) && (transitions > 0u))
+    if ((bad_count < words) && (st.minw != st.maxw) && (st.transitions > 0u))
         data_active = 1u;
 
     /*
@@ -797,7 +859,7 @@ static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t w
      */
     if ((!s_meas_started) && time_ready && data_stuck)
     {
-        uint32_t startup_grace_ms = (uint32_t)MIC_WAKEUP_MS + (uint32_t)MIC_WINDOW_MS;
+        uint32_t startup_grace_ms = (uint32_t)MIC_WAKEUP_MS + (uint32_t)s_cfg.window_ms;
         if (startup_grace_ms < (uint32_t)MIC_WAKEUP_MS)
             startup_grace_ms = 0xFFFFFFFFu;
 
@@ -825,10 +887,7 @@ static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t w
         s_meas_started = 1u;
         s_stuck_t0_ms = 0u;
 
-        s_win_count  = 0u;
-        s_win_sum_sq = 0.0;
-        s_win_peak   = 0.0;
-        s_decim_phase = 0u;
+        mic_energy_reset(&s_win);
         s_win_skip   = 1u;
 
         mic_band_reset();
@@ -839,9 +898,13 @@ static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t w
         return MIC_ERR_OK;
     }
 
-    /* If data gets stuck during measurement, debounce briefly then report. */
+    /* If data gets stuck during measurement, debounce briefly then report. The stuck
+     * words already went through the decimator; drop them so they don't leak into the
+     * next block. */
     if (data_stuck)
     {
+        pdm2pcm_reset();
+
         if (s_stuck_t0_ms == 0u)
             s_stuck_t0_ms = now_ms;
 
@@ -855,73 +918,25 @@ static mic_err_t process_words_and_update_window(const uint16_t *buf, uint32_t w
     }
     s_stuck_t0_ms = 0u;
 
-    /* PDM->PCM + decimation + RMS accumulator update. */
-    for (uint32_t i = 0; i < words; i++)
-    {
-        /* CIC input derived from 16 PDM bits. */
-        int32_t cic_in = pdm_word_to_cic_input(buf[i]);
-
-        float s = 0.0f;
-        if (!pdm2pcm_push(cic_in, &s))
-            continue;
-
-        float x_band = mic_band_step(s);
-        micfft_feed_sample(x_band);
-
-        /* Accumulate RMS window. */
-        double sd = (double)x_band;
-        s_win_sum_sq += sd * sd;
+    /* Band filter, then the MICFFT split and RMS window. */
+    mic_band_block(s_pcm_blk, m);
+    micfft_feed_block(s_pcm_blk, m);
 
-        double a = (sd >= 0.0) ? sd : -sd;
-        if (a > s_win_peak) s_win_peak = a;
-
-        s_win_count++;
+    for (uint32_t n = 0u; n < m; )
+    {
+        /* Accumulate RMS window up to its boundary. */
+        uint32_t take = m - n;
+        uint32_t room = (s_win.n < s_win_target_samples) ? (s_win_target_samples - s_win.n) : 0u;
+        if (take > room) take = room;
+        MIC_DSP_EnergyBlock(&s_win, &s_pcm_blk[n], take);
+        n += take;
 
         /* When the window is full, finalize RMS/dBFS and store the result. */
-        if (s_win_count >= s_win_target_samples)
+        if (s_win.n >= s_win_target_samples)
         {
-            float rms = (float)sqrt(s_win_sum_sq / (double)s_win_count);
-            float dbfs = mic_dbfs_apply_cal(safe_dbfs_from_rms(mic_rms_apply_cal(rms)));
-
-            /* Guard against suspicious saturation (often wiring/clock/polarity issues). */
-            if (rms > 0.98f || s_win_peak > 0.98)
-            {
-                MIC_DBG("[MIC] WARNING: saturation suspected: rms=%.4f peak=%.4f\r\n", (double)rms, (double)s_win_peak);
-                set_error(MIC_ERR_SIGNAL_SATURATED, "ERROR: signal saturated (RMS/PEAK ~ 1.0) - likely DATA stuck or wrong clock/polarity");
-                micfft_invalidate(MIC_ERR_SIGNAL_SATURATED);
-
-                /* Reset window so we don't get stuck returning the same error forever. */
-                s_win_count  = 0u;
-                s_win_sum_sq = 0.0;
-                s_win_peak   = 0.0;
-                return MIC_ERR_SIGNAL_SATURATED;
-            }
-
-            /* Discard the very first full window after warm-up to let CIC/IIR settle. */
-            if (s_win_skip)
-            {
-                s_win_skip--;
-                s_last_err = MIC_ERR_NO_DATA_YET;
-                s_last_err_msg = "no data yet";
-                s_win_count  = 0u;
-                s_win_sum_sq = 0.0;
-                s_win_peak   = 0.0;
-                continue;
-            }
-
-            s_last_rms  = rms;
-            s_last_dbfs = dbfs;
-            s_last_err  = MIC_ERR_OK;
-            s_last_err_msg = NULL;
-            s_last_seq++;
-
-            MIC_DBG("[MIC] 50ms window ready: n=%lu rms=%.4f dbfs=%.2f peak=%.4f\r\n",
-                    (unsigned long)s_win_count, (double)rms, (double)dbfs, (double)s_win_peak);
-
-            /* Reset window for the next measurement. */
-            s_win_count  = 0u;
-            s_win_sum_sq = 0.0;
-            s_win_peak   = 0.0;
+            mic_err_t e = mic_win_finalize();
+            if (e != MIC_ERR_OK)
+                return e;
         }
     }
 
@@ -944,13 +959,11 @@ void MIC_Init(void)
     s_running = 0u;
     s_last_err = MIC_ERR_NOT_INIT;
     s_last_err_msg = "not started";
-    s_dma_t0_ms = 0u;
     s_capture_t0_ms = 0u;
+    s_dma_overruns = 0u;
+    s_dma_dropped_words = 0u;
 
-    s_win_count  = 0u;
-    s_win_sum_sq = 0.0;
-    s_win_peak   = 0.0;
-    s_decim_phase = 0u;
+    mic_energy_reset(&s_win);
     s_win_skip   = 0u;
     mic_band_reset();
     s_meas_started = 0u;
@@ -969,7 +982,7 @@ void MIC_Init(void)
     s_interval_active = 0u;
     s_interval_t0_ms  = 0u;
     s_have_last_dma   = 0u;
-    s_last_dma_words  = MIC_DMA_WORDS;
+    s_last_dma_words  = s_cfg.dma_words;
 
     s_cb_half_count = 0u;
     s_cb_full_count = 0u;
@@ -993,12 +1006,18 @@ void MIC_Init(void)
     s_capture_t0_ms = 0u;
     pdm2pcm_reset();
     mic_update_rates();
+    memset(&s_beat, 0, sizeof(s_beat));
+    s_beat_polled = 0u;
+    s_beat_err_told = 0u;
     micfft_reset();
+    mic_beat_publish();
+    mic_sched_reset();
+    s_keep_last = 0u;
 
     MIC_DBG("[MIC] Init done. Window=%ums, target_samples=%lu, decim=%u, fs=%luHz\r\n",
-            (unsigned)MIC_WINDOW_MS,
+            (unsigned)s_cfg.window_ms,
             (unsigned long)s_win_target_samples,
-            (unsigned)MIC_DECIM_N,
+            (unsigned)s_cfg.decim,
             (unsigned long)s_pcm_fs_hz);
 }
 
@@ -1013,13 +1032,16 @@ mic_err_t MIC_Start(void)
     if (s_running)
         return MIC_ERR_OK;
 
+    /* A configuration accepted during the last capture has not been applied yet. */
+    if (s_cfg_dirty)
+        mic_cfg_apply();
+
     s_capture_t0_ms = HAL_GetTick();
     s_cb_start_ms = s_capture_t0_ms;
     s_cb_full_start_count = s_cb_full_count;
     mic_update_rates();
 
-    /* Start the first DMA block. */
-    mic_err_t e = start_dma_block();
+    mic_err_t e = start_dma_ring();
     if (e != MIC_ERR_OK)
         return e;
 
@@ -1028,15 +1050,13 @@ mic_err_t MIC_Start(void)
     micfft_reset();
 
     s_running = 1u;
+    s_run_t0_ms = HAL_GetTick();
 
     /* Reset measurement state (warm-up + first valid block starts clean). */
     s_meas_started = 0u;
     s_stuck_t0_ms  = 0u;
     mic_band_reset();
-    s_win_count    = 0u;
-    s_win_sum_sq   = 0.0;
-    s_win_peak     = 0.0;
-    s_decim_phase  = 0u;
+    mic_energy_reset(&s_win);
     s_win_skip     = 0u;
     s_last_seq     = 0u;
 
@@ -1047,16 +1067,18 @@ mic_err_t MIC_Start(void)
         s_interval_t0_ms  = HAL_GetTick();
 
         /* Reset accumulators for one-shot interval measurement. */
-        s_win_count  = 0u;
-        s_win_sum_sq = 0.0;
-        s_win_peak   = 0.0;
-        s_decim_phase = 0u;
-
-        /* Placeholder result until the first window completes. */
-        s_last_rms  = 0.0f;
-        s_last_dbfs = -120.0f;
-        s_last_err  = MIC_ERR_NO_DATA_YET;
-        s_last_err_msg = "no data yet";
+        mic_energy_reset(&s_win);
+
+        /* Placeholder result until the first window completes; scheduled captures keep
+         * serving the previous one meanwhile. */
+        s_keep_last = (mic_sched_enabled() && s_last_err == MIC_ERR_OK) ? 1u : 0u;
+        if (!s_keep_last)
+        {
+            s_last_rms  = 0.0f;
+            s_last_dbfs = -120.0f;
+            s_last_err  = MIC_ERR_NO_DATA_YET;
+            s_last_err_msg = "no data yet";
+        }
 
         MIC_DBG("[MIC] PowerSave compile-time: capture %lu ms then stop\r\n", (unsigned long)mic_get_target_ms());
     }
@@ -1081,10 +1103,206 @@ void MIC_Stop(void)
     (void)HAL_SPI_Abort(&hspi1);
     s_running = 0u;
     s_interval_active = 0u;
-    s_dma_circular = 0u;
-    s_spi_done = 0u;
-    s_spi_half = 0u;
     s_spi_err = 0u;
+    s_duty_on_ms += HAL_GetTick() - s_run_t0_ms;
+}
+
+/* Switch to s_cfg_pending; runs between blocks (MIC_Task) or while stopped. */
+static void mic_cfg_apply(void)
+{
+    uint8_t rates = (s_cfg_pending.decim != s_cfg.decim) || (s_cfg_pending.window_ms != s_cfg.window_ms);
+    uint8_t ring  = (s_cfg_pending.dma_words != s_cfg.dma_words);
+    uint8_t duty  = (s_cfg_pending.powersave_ms != s_cfg.powersave_ms) ||
+                    (s_cfg_pending.adaptive_max_ms != s_cfg.adaptive_max_ms);
+    s_cfg = s_cfg_pending;
+    s_cfg_dirty = 0u;
+
+    if (duty)
+    {
+        mic_sched_reset();
+        s_keep_last = 0u;
+    }
+
+    if (rates)
+    {
+        /* New filters and window length: restart the DSP state, drop partial windows. */
+        mic_update_rates();
+        mic_band_reset();
+        micfft_reset();
+        mic_energy_reset(&s_win);
+        if (s_meas_started)
+            s_win_skip = 1u;
+    }
+
+    if (!s_running)
+        return;
+
+    if (ring)
+    {
+        (void)HAL_SPI_Abort(&hspi1);
+        pdm2pcm_reset();
+        if (start_dma_ring() != MIC_ERR_OK)
+        {
+            micfft_invalidate(s_last_err);
+            s_running = 0u;
+            s_interval_active = 0u;
+            return;
+        }
+    }
+
+    /* Duty cycle: a running capture either keeps going or becomes one interval. */
+    if (mic_get_target_ms() == 0u)
+    {
+        s_interval_active = 0u;
+    }
+    else if (!s_interval_active)
+    {
+        s_interval_active = 1u;
+        s_interval_t0_ms  = HAL_GetTick();
+    }
+}
+
+mic_err_t MIC_Configure(const mic_config_t *cfg)
+{
+    if (!cfg)
+        return MIC_ERR_BAD_CONFIG;
+    if (cfg->decim < MIC_DECIM_MIN || cfg->decim > MIC_DECIM_MAX)
+        return MIC_ERR_BAD_CONFIG;
+    if (cfg->window_ms < MIC_WINDOW_MS_MIN || cfg->window_ms > MIC_WINDOW_MS_MAX)
+        return MIC_ERR_BAD_CONFIG;
+    if (cfg->dma_words < MIC_DMA_WORDS_MIN || cfg->dma_words > MIC_DMA_WORDS || (cfg->dma_words & 1u) != 0u)
+        return MIC_ERR_BAD_CONFIG;
+    if (cfg->adaptive_max_ms != 0u && cfg->adaptive_max_ms < MIC_SCHED_MIN_GAP_MS)
+        return MIC_ERR_BAD_CONFIG;
+
+    s_cfg_pending = *cfg;
+    s_cfg_dirty = 1u;
+
+    /* MIC_Init picks it up; a stopped capture switches now, a running one in MIC_Task. */
+    if (!s_inited)
+    {
+        s_cfg = s_cfg_pending;
+        s_cfg_dirty = 0u;
+    }
+    else if (!s_running)
+    {
+        mic_cfg_apply();
+    }
+    return MIC_ERR_OK;
+}
+
+void MIC_GetConfig(mic_config_t *cfg)
+{
+    if (cfg)
+        *cfg = s_cfg_dirty ? s_cfg_pending : s_cfg;
+}
+
+/* Scheduler, capture stopped: start the next capture when it is due. */
+static void mic_sched_idle(void)
+{
+    if (!mic_sched_enabled())
+        return;
+    if ((int32_t)(HAL_GetTick() - s_sched_next_ms) < 0)
+        return;
+    if (MIC_Start() != MIC_ERR_OK)
+        s_sched_next_ms = HAL_GetTick() + s_sched_gap_ms;
+}
+
+/* Scheduler, new MIC window: classify it and switch between duty cycle and continuous.
+ * Returns 1 if the capture was stopped. */
+static uint8_t mic_sched_window(void)
+{
+    if (!s_sched_win_new)
+        return 0u;
+    s_sched_win_new = 0u;
+    if (!mic_sched_enabled())
+        return 0u;
+
+    uint32_t now = HAL_GetTick();
+    int32_t lvl = s_sched_win_x100;
+    if (!s_sched_have_floor)
+    {
+        s_sched_have_floor = 1u;
+        s_sched_floor_x100 = lvl;
+    }
+
+    if (lvl >= s_sched_floor_x100 + MIC_SCHED_RISE_DB_X100)
+    {
+        if (!s_sched_loud)
+            MIC_DBG("[MIC] sched: sound (%ld > floor %ld), continuous\r\n", (long)lvl, (long)s_sched_floor_x100);
+        s_sched_loud = 1u;
+        s_sched_loud_ms = now;
+        s_sched_gap_ms = MIC_SCHED_MIN_GAP_MS;
+        s_interval_active = 0u;
+        return 0u;
+    }
+
+    /* Quiet: the floor follows drops at once and rises slowly (0.1 dB per window). */
+    s_sched_floor_x100 = (lvl < s_sched_floor_x100 + 10) ? lvl : (s_sched_floor_x100 + 10);
+
+    if (s_sched_loud && (now - s_sched_loud_ms) >= MIC_SCHED_HOLD_MS && !mic_beat_hold())
+    {
+        MIC_DBG("[MIC] sched: quiet, back to duty cycle\r\n");
+        s_sched_loud = 0u;
+        MIC_Stop();
+        s_sched_next_ms = now + s_sched_gap_ms;
+        return 1u;
+    }
+    return 0u;
+}
+
+/* Scheduler, a quiet interval capture ended: back off. */
+static void mic_sched_capture_done(void)
+{
+    if (!mic_sched_enabled())
+        return;
+    s_sched_next_ms = HAL_GetTick() + s_sched_gap_ms;
+    s_sched_gap_ms *= 2u;
+    if (s_sched_gap_ms > s_cfg.adaptive_max_ms)
+        s_sched_gap_ms = s_cfg.adaptive_max_ms;
+}
+
+uint8_t MIC_PrepareStop(void)
+{
+    if (s_running && mic_beat_hold())
+        return 0u;
+
+    if (s_inited && mic_sched_enabled())
+    {
+        if (s_sched_loud && s_running)
+            return 0u;
+
+        /* An unfinished capture would only yield a timeout after STOP2: redo it at wake-up. */
+        if (s_running)
+        {
+            MIC_Stop();
+            s_sched_next_ms = HAL_GetTick();
+        }
+    }
+    return 1u;
+}
+
+void MIC_AccountStop(uint32_t stop_ms)
+{
+    if (stop_ms == 0u)
+        return;
+
+    if (s_inited && mic_sched_enabled())
+    {
+        /* The tick stood still in STOP2: count the sleep against the wait. */
+        uint32_t left = s_sched_next_ms - HAL_GetTick();
+        if ((int32_t)left > 0)
+            s_sched_next_ms -= (left < stop_ms) ? left : stop_ms;
+    }
+    s_duty_sleep_ms += stop_ms;
+}
+
+void MIC_GetDuty(uint32_t *out_on_ms, uint32_t *out_total_ms)
+{
+    uint32_t now = HAL_GetTick();
+    uint32_t on = s_duty_on_ms + (s_running ? (now - s_run_t0_ms) : 0u);
+    if (out_on_ms) *out_on_ms = on;
+    if (out_total_ms) *out_total_ms = (now - s_duty_t0_ms) + s_duty_sleep_ms;
 }
 
 void MIC_Task(void)
@@ -1094,7 +1312,10 @@ void MIC_Task(void)
         return;
 
     if (!s_running)
+    {
+        mic_sched_idle();
         return;
+    }
 
     /* Abort on SPI error. */
     if (s_spi_err)
@@ -1105,102 +1326,76 @@ void MIC_Task(void)
         return;
     }
 
-    /* Circular DMA mode: continuous clock, process half/full buffers without restart. */
-    if (s_dma_circular)
+    /* A new configuration takes effect between two half-buffers. */
+    if (s_cfg_dirty)
     {
-        /* Timeout if DMA callbacks stop arriving. */
-        if ((HAL_GetTick() - s_dma_last_evt_ms) > MIC_TIMEOUT_MS)
-        {
-            set_error(MIC_ERR_TIMEOUT, "ERROR: DMA timeout (no circular DMA events)");
-            micfft_invalidate(MIC_ERR_TIMEOUT);
-            MIC_Stop();
+        mic_cfg_apply();
+        if (!s_running)
             return;
-        }
-
-        uint32_t half_words = MIC_DMA_WORDS / 2u;
-        uint32_t rest_words = MIC_DMA_WORDS - half_words;
-        if (half_words == 0u)
-            return;
-
-        if (s_spi_half)
-        {
-            s_spi_half = 0u;
-            (void)process_words_and_update_window(&s_rx_buf[0], half_words);
-        }
+    }
 
-        if (s_spi_done)
-        {
-            s_spi_done = 0u;
-            (void)process_words_and_update_window(&s_rx_buf[half_words], rest_words);
-        }
+    uint32_t half_words = s_cfg.dma_words / 2u;
+    uint32_t seq = s_dma_seq;
+    uint32_t pending = seq - s_dma_seq_done;
 
-        /* Interval mode stop condition (if enabled at compile-time). */
-        if (s_interval_active)
+    if (pending == 0u)
+    {
+        /* Timeout if DMA callbacks stop arriving. A counter still at its reload value
+         * means the channel never moved a single word. */
+        if ((HAL_GetTick() - s_dma_last_evt_ms) > MIC_TIMEOUT_MS)
         {
-            uint32_t elapsed = HAL_GetTick() - s_interval_t0_ms;
-            uint32_t target  = mic_get_target_ms();
-            if (elapsed >= target)
+            if (seq == 0u && __HAL_DMA_GET_COUNTER(hspi1.hdmarx) == s_cfg.dma_words)
             {
-                if (s_last_err == MIC_ERR_NO_DATA_YET)
-                {
-                    set_error(MIC_ERR_TIMEOUT, "ERROR: interval finished but no valid window");
-                    micfft_invalidate(MIC_ERR_TIMEOUT);
-                }
-                MIC_Stop();
-                s_interval_active = 0u;
+                set_error(MIC_ERR_DMA_NO_WRITE, "ERROR: DMA counter not moving -> DMA not writing");
+                micfft_invalidate(MIC_ERR_DMA_NO_WRITE);
             }
+            else
+            {
+                set_error(MIC_ERR_TIMEOUT, "ERROR: DMA timeout (no circular DMA events)");
+                micfft_invalidate(MIC_ERR_TIMEOUT);
+            }
+            MIC_Stop();
         }
-
         return;
     }
 
-    /* If DMA is not done yet, only check for timeout. */
-    if (!s_spi_done)
+    /* Event k completes half (k-1)&1 while the DMA moves on to the other one, so with two
+     * or more pending the oldest halves have already been overwritten: keep the newest. */
+    if (pending > 1u)
     {
-        if ((HAL_GetTick() - s_dma_t0_ms) > MIC_TIMEOUT_MS)
-        {
-            set_error(MIC_ERR_TIMEOUT, "ERROR: DMA timeout waiting for RxCplt");
-            micfft_invalidate(MIC_ERR_TIMEOUT);
-            MIC_Stop();
-        }
-        return;
+        s_dma_overruns++;
+        s_dma_dropped_words += (pending - 1u) * half_words;
+        MIC_DBG("[MIC] DMA overrun: %lu half-buffers dropped\r\n", (unsigned long)(pending - 1u));
     }
-    s_spi_done = 0u;
+    s_dma_seq_done = seq;
+    (void)process_words_and_update_window(&s_rx_buf[((seq - 1u) & 1u) * half_words], half_words, seq);
 
-    /* DMA complete: process the received block. */
-    (void)process_words_and_update_window(s_rx_buf, MIC_DMA_WORDS);
+    if (mic_sched_window())
+        return;
 
+    /* Interval mode stop condition (if enabled at compile-time). */
     if (s_interval_active)
     {
         uint32_t elapsed = HAL_GetTick() - s_interval_t0_ms;
         uint32_t target  = mic_get_target_ms();
-
-        if (elapsed >= target)
+        if (elapsed >= target && !mic_beat_hold())
         {
             if (s_last_err == MIC_ERR_NO_DATA_YET)
             {
                 set_error(MIC_ERR_TIMEOUT, "ERROR: interval finished but no valid window");
-                mic_err_t e = MIC_ERR_TIMEOUT;
-                micfft_invalidate(e);
+                micfft_invalidate(MIC_ERR_TIMEOUT);
             }
             MIC_Stop();
             s_interval_active = 0u;
-            return;
+            mic_sched_capture_done();
         }
-
-        (void)start_dma_block();
-        return;
     }
-
-    /* Continuous mode: always restart DMA. */
-    if (mic_get_target_ms() == 0u)
-        (void)start_dma_block();
 }
 
 mic_err_t MIC_GetLast50ms(float *out_dbfs, float *out_rms)
 {
-    /* In interval mode, auto-start capture on first read. */
-    if (s_inited && (mic_get_target_ms() != 0u) && (!s_running) && (!s_interval_active))
+    /* In interval mode, auto-start capture on first read (the scheduler starts its own). */
+    if (s_inited && (mic_get_target_ms() != 0u) && (!s_running) && (!s_interval_active) && !mic_sched_enabled())
     {
         (void)MIC_Start();
     }
@@ -1221,6 +1416,7 @@ void MIC_CalResetToDefaults(void)
 {
     s_cal_rms_gain     = (float)MIC_CAL_RMS_GAIN;
     s_cal_db_offset_db = (float)MIC_CAL_DB_OFFSET_DB;
+    mic_cal_update();
 }
 
 void MIC_CalGet(float *out_rms_gain, float *out_db_offset_db)
@@ -1233,16 +1429,32 @@ void MIC_CalSet(float rms_gain, float db_offset_db)
 {
     s_cal_rms_gain = rms_gain;
     s_cal_db_offset_db = db_offset_db;
+    mic_cal_update();
 }
 
 uint8_t MIC_CalLoad(void)
 {
-    return mic_cal_bkp_load();
+    int32_t off_x100 = 0;
+    if (SETTINGS_Get(SET_MIC_CAL_X100, &off_x100))
+    {
+        s_cal_db_offset_db = (float)off_x100 / 100.0f;
+        mic_cal_update();
+        return 1u;
+    }
+
+    /* One-time migration from the RTC backup register used by older firmware. */
+    if (!mic_cal_bkp_load())
+        return 0u;
+    (void)MIC_CalSave();
+    return 1u;
 }
 
 uint8_t MIC_CalSave(void)
 {
-    return mic_cal_bkp_save();
+    int32_t off_x100 = (int32_t)(s_cal_db_offset_db * 100.0f + ((s_cal_db_offset_db >= 0.0f) ? 0.5f : -0.5f));
+    if (off_x100 > 32767) off_x100 = 32767;
+    if (off_x100 < -32768) off_x100 = -32768;
+    return SETTINGS_Set(SET_MIC_CAL_X100, off_x100) ? 1u : 0u;
 }
 
 static void mic_cal_writef(mic_write_fn_t write, const char *fmt, ...)
@@ -1250,12 +1462,10 @@ static void mic_cal_writef(mic_write_fn_t write, const char *fmt, ...)
     if (write == NULL || fmt == NULL)
         return;
 
-    char buf[200];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    FMT_VWrite(write, fmt, ap);
     va_end(ap);
-    write(buf);
 }
 
 static void mic_cal_task_delay_ms(uint32_t delay_ms)
@@ -1487,7 +1697,7 @@ static mic_err_t mic_calibrate_interactive(float spl_db,
         mic_cal_writef(write, "MICCAL: set in mic.h: #define MIC_CAL_DB_OFFSET_DB (%ld/100.0f)\r\n",
                        (long)off_x100);
         if (!saved)
-            write("MICCAL: WARN: persistent save failed (RTC BKP not ready?)\r\n");
+            write("MICCAL: WARN: persistent save failed (settings flash)\r\n");
     }
 
     if (was_running)
@@ -1591,6 +1801,7 @@ const char* MIC_ErrName(mic_err_t e)
         case MIC_ERR_DATA_STUCK: return "DATA_STUCK";
         case MIC_ERR_SIGNAL_SATURATED: return "SIGNAL_SATURATED";
         case MIC_ERR_NO_DATA_YET: return "NO_DATA_YET";
+        case MIC_ERR_BAD_CONFIG: return "BAD_CONFIG";
         default: return "UNKNOWN";
     }
 }
@@ -1606,27 +1817,39 @@ static mic_err_t mic_ensure_started(void)
     return st;
 }
 
-mic_err_t MIC_ReadDbfsX100_Blocking(uint32_t timeout_ms, int16_t *out_dbfs_x100)
+/* With the adaptive scheduler, readers take its latest result and only start a capture
+ * when there is none; the scheduler stops it again. */
+static mic_err_t mic_reader_start(uint8_t have_result)
+{
+    if (mic_sched_enabled() && s_inited && (have_result || s_running))
+        return MIC_ERR_OK;
+    return mic_ensure_started();
+}
+
+static uint8_t mic_reader_auto_stop(void)
+{
+    return (mic_get_target_ms() != 0u && !mic_sched_enabled()) ? 1u : 0u;
+}
+
+uint32_t MIC_GetSeq(void)
+{
+    return s_pub_seq;
+}
+
+mic_err_t MIC_ReadDbfsX100_Poll(uint32_t t0_ms, uint32_t timeout_ms, int16_t *out_dbfs_x100)
 {
     if (out_dbfs_x100) *out_dbfs_x100 = 0;
-    const uint8_t auto_stop = (mic_get_target_ms() != 0u) ? 1u : 0u;
+    const uint8_t auto_stop = mic_reader_auto_stop();
 
-    mic_err_t start = mic_ensure_started();
+    mic_err_t start = mic_reader_start(s_last_err == MIC_ERR_OK);
     if (start != MIC_ERR_OK)
         return start;
 
     float dbfs = 0.0f;
     float rms  = 0.0f;
     mic_err_t st = MIC_GetLast50ms(&dbfs, &rms);
-
-    uint32_t t0 = HAL_GetTick();
-    while ((st == MIC_ERR_NO_DATA_YET || st == MIC_ERR_DATA_STUCK) && ((HAL_GetTick() - t0) < timeout_ms))
-    {
-        MIC_Task();
-        /* Do not enter sleep here; some low-power configs can stall SPI/DMA progress. */
-        HAL_Delay(1);
-        st = MIC_GetLast50ms(&dbfs, &rms);
-    }
+    if ((st == MIC_ERR_NO_DATA_YET || st == MIC_ERR_DATA_STUCK) && ((HAL_GetTick() - t0_ms) < timeout_ms))
+        return MIC_ERR_NO_DATA_YET;
 
     if (st != MIC_ERR_OK)
     {
@@ -1646,6 +1869,19 @@ mic_err_t MIC_ReadDbfsX100_Blocking(uint32_t timeout_ms, int16_t *out_dbfs_x100)
     return MIC_ERR_OK;
 }
 
+mic_err_t MIC_ReadDbfsX100_Blocking(uint32_t timeout_ms, int16_t *out_dbfs_x100)
+{
+    uint32_t t0 = HAL_GetTick();
+    mic_err_t st;
+    while ((st = MIC_ReadDbfsX100_Poll(t0, timeout_ms, out_dbfs_x100)) == MIC_ERR_NO_DATA_YET)
+    {
+        MIC_Task();
+        /* Do not enter sleep here; some low-power configs can stall SPI/DMA progress. */
+        HAL_Delay(1);
+    }
+    return st;
+}
+
 mic_err_t MIC_FFT_GetLastBinsDbX100(int16_t *out_lf_db_x100,
                                    int16_t *out_mf_db_x100,
                                    int16_t *out_hf_db_x100)
@@ -1667,34 +1903,91 @@ mic_err_t MIC_FFT_GetLastBinsDbX100(int16_t *out_lf_db_x100,
     return MIC_ERR_OK;
 }
 
-mic_err_t MIC_FFT_WaitBinsDbX100(uint32_t timeout_ms,
+mic_err_t MIC_FFT_PollBinsDbX100(uint32_t t0_ms, uint32_t timeout_ms,
                                 int16_t *out_lf_db_x100,
                                 int16_t *out_mf_db_x100,
                                 int16_t *out_hf_db_x100)
 {
-    if (out_lf_db_x100) *out_lf_db_x100 = 0;
-    if (out_mf_db_x100) *out_mf_db_x100 = 0;
-    if (out_hf_db_x100) *out_hf_db_x100 = 0;
-    const uint8_t auto_stop = (mic_get_target_ms() != 0u) ? 1u : 0u;
+    const uint8_t auto_stop = mic_reader_auto_stop();
 
-    mic_err_t start = mic_ensure_started();
+    mic_err_t start = mic_reader_start(s_fft_have_bins);
     if (start != MIC_ERR_OK)
+    {
+        if (out_lf_db_x100) *out_lf_db_x100 = 0;
+        if (out_mf_db_x100) *out_mf_db_x100 = 0;
+        if (out_hf_db_x100) *out_hf_db_x100 = 0;
         return start;
+    }
 
     mic_err_t st = MIC_FFT_GetLastBinsDbX100(out_lf_db_x100, out_mf_db_x100, out_hf_db_x100);
+    if ((st == MIC_ERR_NO_DATA_YET || st == MIC_ERR_DATA_STUCK) && ((HAL_GetTick() - t0_ms) < timeout_ms))
+        return MIC_ERR_NO_DATA_YET;
+
+    if (st == MIC_ERR_NO_DATA_YET)
+    {
+        set_error(MIC_ERR_TIMEOUT, "ERROR: timeout waiting for micfft window");
+        micfft_invalidate(MIC_ERR_TIMEOUT);
+        st = MIC_ERR_TIMEOUT;
+    }
+
+    if (auto_stop) MIC_Stop();
+    return st;
+}
 
+mic_err_t MIC_FFT_WaitBinsDbX100(uint32_t timeout_ms,
+                                int16_t *out_lf_db_x100,
+                                int16_t *out_mf_db_x100,
+                                int16_t *out_hf_db_x100)
+{
     uint32_t t0 = HAL_GetTick();
-    while ((st == MIC_ERR_NO_DATA_YET || st == MIC_ERR_DATA_STUCK) && ((HAL_GetTick() - t0) < timeout_ms))
+    mic_err_t st;
+    while ((st = MIC_FFT_PollBinsDbX100(t0, timeout_ms, out_lf_db_x100, out_mf_db_x100, out_hf_db_x100))
+           == MIC_ERR_NO_DATA_YET)
     {
         MIC_Task();
         /* Do not enter sleep here; some low-power configs can stall SPI/DMA progress. */
         HAL_Delay(1);
-        st = MIC_FFT_GetLastBinsDbX100(out_lf_db_x100, out_mf_db_x100, out_hf_db_x100);
     }
+    return st;
+}
+
+static mic_err_t mic_bands_get_last(uint8_t n, int16_t *out_db_x100)
+{
+    if (s_last_err != MIC_ERR_OK && s_last_err != MIC_ERR_NO_DATA_YET)
+        return s_last_err;
+    if (!s_bands_have)
+        return (s_fft_last_err != MIC_ERR_OK) ? s_fft_last_err : MIC_ERR_NO_DATA_YET;
+
+    if (out_db_x100)
+        memcpy(out_db_x100, s_bands_last_db_x100, (uint32_t)n * sizeof(int16_t));
+    return MIC_ERR_OK;
+}
+
+mic_err_t MIC_FFT_PollBandsDbX100(uint32_t t0_ms, uint32_t timeout_ms, uint8_t n, int16_t *out_db_x100)
+{
+    const uint8_t auto_stop = mic_reader_auto_stop();
+
+    if (n < 1u) n = 1u;
+    if (n > MIC_BANDS_MAX) n = MIC_BANDS_MAX;
+    if (out_db_x100) memset(out_db_x100, 0, (uint32_t)n * sizeof(int16_t));
+
+    mic_err_t start = mic_reader_start(s_bands_have && n == s_bands_n);
+    if (start != MIC_ERR_OK)
+        return start;
+
+    if (n != s_bands_n)
+    {
+        s_bands_n = n;
+        micfft_bands_layout();
+    }
+
+    mic_err_t st = mic_bands_get_last(n, out_db_x100);
+    if ((st == MIC_ERR_NO_DATA_YET || st == MIC_ERR_DATA_STUCK) && ((HAL_GetTick() - t0_ms) < timeout_ms))
+        return MIC_ERR_NO_DATA_YET;
 
     if (st == MIC_ERR_NO_DATA_YET)
     {
-        set_error(MIC_ERR_TIMEOUT, "ERROR: timeout waiting for micfft window");
+        set_error(MIC_ERR_TIMEOUT, "ERROR: timeout waiting for micbands window");
         micfft_invalidate(MIC_ERR_TIMEOUT);
         st = MIC_ERR_TIMEOUT;
     }
@@ -1703,6 +1996,69 @@ mic_err_t MIC_FFT_WaitBinsDbX100(uint32_t timeout_ms,
     return st;
 }
 
+mic_err_t MIC_FFT_WaitBandsDbX100(uint32_t timeout_ms, uint8_t n, int16_t *out_db_x100)
+{
+    uint32_t t0 = HAL_GetTick();
+    mic_err_t st;
+    while ((st = MIC_FFT_PollBandsDbX100(t0, timeout_ms, n, out_db_x100)) == MIC_ERR_NO_DATA_YET)
+    {
+        MIC_Task();
+        /* Do not enter sleep here; some low-power configs can stall SPI/DMA progress. */
+        HAL_Delay(1);
+    }
+    return st;
+}
+
+void MIC_GetBeat(mic_beat_t *out)
+{
+    if (!out) return;
+
+    mic_beat_pub_t b;
+    uint8_t i;
+    do
+    {
+        i = s_beat_pub_idx;
+        __DMB();
+        b = s_beat_pub[i];
+        __DMB();
+    } while (i != s_beat_pub_idx);
+
+    uint32_t per = (b.period_ms != 0u) ? b.period_ms : (uint32_t)MIC_BEAT_IDLE_PERIOD_MS;
+    uint32_t age = HAL_GetTick() - b.beat_tick;
+    out->beats = b.beats;
+    out->onsets = b.onsets;
+    out->bpm_x10 = (b.period_ms != 0u) ? (uint16_t)((600000u + b.period_ms / 2u) / b.period_ms) : 0u;
+    out->phase = (b.beats == 0u || age >= per) ? 255u : (uint8_t)((age * 256u) / per);
+}
+
+mic_err_t MIC_BeatPoll(mic_beat_t *out)
+{
+    s_beat_poll_ms = HAL_GetTick();
+    s_beat_polled = 1u;
+
+    /* Report a capture error before anything restarts the capture (MIC_Start() clears it).
+     * Without the scheduler the next poll restarts; with it, the scheduler does. */
+    const mic_err_t last = s_last_err;
+    const uint8_t failed = (last != MIC_ERR_OK && last != MIC_ERR_NO_DATA_YET) ? 1u : 0u;
+    if (failed && !(s_beat_err_told && s_beat_err_seq == s_pub_seq))
+    {
+        s_beat_err_told = 1u;
+        s_beat_err_seq = s_pub_seq;
+        MIC_GetBeat(out);
+        return last;
+    }
+
+    mic_err_t st = mic_reader_start(failed);
+    MIC_GetBeat(out);
+    if (st != MIC_ERR_OK)
+        return st;
+    if (s_last_err != MIC_ERR_OK && s_last_err != MIC_ERR_NO_DATA_YET)
+        return s_last_err;
+    if (MICFFT_WINDOW_MS == 0u || !s_meas_started || s_beat.warm != 0u)
+        return MIC_ERR_NO_DATA_YET;
+    return MIC_ERR_OK;
+}
+
 /* =====================================================================================
  * USB CLI helper: MICDIAG (debug)
  * ===================================================================================== */
@@ -1710,89 +2066,124 @@ mic_err_t MIC_FFT_WaitBinsDbX100(uint32_t timeout_ms,
 static void micdiag_writef(mic_write_fn_t write, const char *fmt, ...)
 {
     if (!write || !fmt) return;
-    char buf[200];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    FMT_VWrite(write, fmt, ap);
     va_end(ap);
-    write(buf);
 }
 
-void MIC_WriteDiag(mic_write_fn_t write)
+/* One line per part, so a caller with a small output buffer can pace them. */
+bool MIC_WriteDiag(uint8_t part, mic_write_fn_t write)
 {
-    if (!write) return;
+    if (!write) return false;
 
     uint32_t now = HAL_GetTick();
 
-    mic_err_t last_err = s_last_err;
-    const char *last_msg = s_last_err_msg;
-
-    uint8_t inited   = s_inited;
-    uint8_t running  = s_running;
-    uint8_t interval = s_interval_active;
-    uint8_t dma_circ = s_dma_circular;
-
-    uint32_t spi_state = (uint32_t)HAL_SPI_GetState(&hspi1);
-    uint32_t spi_err   = (uint32_t)hspi1.ErrorCode;
-
-    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
-    if (pclk == 0u) pclk = HAL_RCC_GetHCLKFreq();
-    uint32_t div  = mic_spi_prescaler_div(hspi1.Init.BaudRatePrescaler);
-    uint32_t sck  = (div != 0u) ? (pclk / div) : 0u;
-    uint32_t bits = mic_spi_bits_per_word();
+    switch (part)
+    {
+        case 0:
+        {
+            uint32_t dma_ccr = 0u;
+            if (hspi1.hdmarx && hspi1.hdmarx->Instance)
+                dma_ccr = hspi1.hdmarx->Instance->CCR;
+            uint8_t dma_circ = ((dma_ccr & DMA_CCR_CIRC) == DMA_CCR_CIRC) ? 1u : 0u;
+            micdiag_writef(write, "MICDIAG: inited=%u running=%u interval=%u dma_circ=%u spi_state=%lu spi_err=0x%08lX\r\n",
+                           (unsigned)s_inited, (unsigned)s_running, (unsigned)s_interval_active, (unsigned)dma_circ,
+                           (unsigned long)HAL_SPI_GetState(&hspi1), (unsigned long)hspi1.ErrorCode);
+            return true;
+        }
+        case 1:
+        {
+            mic_err_t last_err = s_last_err;
+            const char *last_msg = s_last_err_msg;
+            micdiag_writef(write, "MICDIAG: last=%s(%ld) msg=%s\r\n",
+                           MIC_ErrName(last_err), (long)last_err, last_msg ? last_msg : "");
+            return true;
+        }
+        case 2:
+        case 3:
+        {
+            uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+            if (pclk == 0u) pclk = HAL_RCC_GetHCLKFreq();
+            uint32_t div  = mic_spi_prescaler_div(hspi1.Init.BaudRatePrescaler);
+            uint32_t bits = mic_spi_bits_per_word();
+            if (part == 2u)
+            {
+                uint32_t sck = (div != 0u) ? (pclk / div) : 0u;
+                micdiag_writef(write, "MICDIAG: PCLK1=%luHz presc=%lu => SCK~%luHz bits=%lu decim=%u fs~%luHz\r\n",
+                               (unsigned long)pclk, (unsigned long)div, (unsigned long)sck, (unsigned long)bits,
+                               (unsigned)s_cfg.decim, (unsigned long)s_pcm_fs_hz);
+                return true;
+            }
 
-    uint32_t cb_half = s_cb_half_count;
-    uint32_t cb_full = s_cb_full_count;
-    uint32_t cb_err  = s_cb_err_count;
-
-    uint32_t dma_ccr = 0u;
-    uint32_t dma_cndtr = 0u;
-    if (hspi1.hdmarx && hspi1.hdmarx->Instance)
-    {
-        dma_ccr = hspi1.hdmarx->Instance->CCR;
-        dma_cndtr = hspi1.hdmarx->Instance->CNDTR;
-    }
-
-    uint32_t last_evt_age = (s_dma_last_evt_ms != 0u) ? (now - s_dma_last_evt_ms) : 0xFFFFFFFFu;
-    uint32_t last_rx_age  = (s_last_rx_ms != 0u) ? (now - s_last_rx_ms) : 0xFFFFFFFFu;
-
-    uint32_t elapsed_ms = (s_cb_start_ms != 0u) ? (now - s_cb_start_ms) : 0u;
-    uint32_t delta_full = cb_full - s_cb_full_start_count;
-    uint64_t words_captured = (uint64_t)delta_full * (uint64_t)MIC_DMA_WORDS;
-    uint32_t words_per_s = 0u;
-    uint32_t sck_est_hz = 0u;
-    if (elapsed_ms != 0u)
-    {
-        words_per_s = (uint32_t)((words_captured * 1000ull) / (uint64_t)elapsed_ms);
-        sck_est_hz = words_per_s * bits;
-    }
-
-    micdiag_writef(write, "MICDIAG: inited=%u running=%u interval=%u dma_circ=%u spi_state=%lu spi_err=0x%08lX\r\n",
-                   (unsigned)inited, (unsigned)running, (unsigned)interval, (unsigned)dma_circ,
-                   (unsigned long)spi_state, (unsigned long)spi_err);
-    micdiag_writef(write, "MICDIAG: last=%s(%ld) msg=%s\r\n",
-                   MIC_ErrName(last_err), (long)last_err, last_msg ? last_msg : "");
-    micdiag_writef(write, "MICDIAG: PCLK1=%luHz presc=%lu => SCK~%luHz bits=%lu decim=%u fs~%luHz\r\n",
-                   (unsigned long)pclk, (unsigned long)div, (unsigned long)sck, (unsigned long)bits,
-                   (unsigned)MIC_DECIM_N, (unsigned long)s_pcm_fs_hz);
-    micdiag_writef(write, "MICDIAG: dma CCR=0x%08lX CNDTR=%lu last_evt_age=%lums cb_half=%lu cb_full=%lu cb_err=%lu sck_est~%luHz\r\n",
-                   (unsigned long)dma_ccr, (unsigned long)dma_cndtr, (unsigned long)last_evt_age,
-                   (unsigned long)cb_half, (unsigned long)cb_full, (unsigned long)cb_err,
-                   (unsigned long)sck_est_hz);
-    micdiag_writef(write, "MICDIAG: last_rx age=%lums words=%lu 0000=%lu ffff=%lu trans=%lu min=0x%04X max=0x%04X\r\n",
-                   (unsigned long)last_rx_age,
-                   (unsigned long)s_last_rx_words,
-                   (unsigned long)s_last_rx_cnt_0000,
-                   (unsigned long)s_last_rx_cnt_ffff,
-                   (unsigned long)s_last_rx_transitions,
-                   (unsigned)s_last_rx_minw,
-                   (unsigned)s_last_rx_maxw);
-
-    if (s_last_rx_first_n)
-    {
-        micdiag_writef(write, "MICDIAG: first:");
-        for (uint32_t i = 0; i < s_last_rx_first_n; i++)
-            micdiag_writef(write, " %04X", (unsigned)s_last_rx_first[i]);
-        micdiag_writef(write, "\r\n");
+            uint32_t dma_ccr = 0u;
+            uint32_t dma_cndtr = 0u;
+            if (hspi1.hdmarx && hspi1.hdmarx->Instance)
+            {
+                dma_ccr = hspi1.hdmarx->Instance->CCR;
+                dma_cndtr = hspi1.hdmarx->Instance->CNDTR;
+            }
+            uint32_t last_evt_age = (s_dma_last_evt_ms != 0u) ? (now - s_dma_last_evt_ms) : 0xFFFFFFFFu;
+            uint32_t elapsed_ms = (s_cb_start_ms != 0u) ? (now - s_cb_start_ms) : 0u;
+            uint32_t cb_full = s_cb_full_count;
+            uint64_t words_captured = (uint64_t)(cb_full - s_cb_full_start_count) * (uint64_t)s_cfg.dma_words;
+            uint32_t sck_est_hz = 0u;
+            if (elapsed_ms != 0u)
+                sck_est_hz = (uint32_t)((words_captured * 1000ull) / (uint64_t)elapsed_ms) * bits;
+            micdiag_writef(write, "MICDIAG: dma CCR=0x%08lX CNDTR=%lu last_evt_age=%lums cb_half=%lu cb_full=%lu cb_err=%lu sck_est~%luHz\r\n",
+                           (unsigned long)dma_ccr, (unsigned long)dma_cndtr, (unsigned long)last_evt_age,
+                           (unsigned long)s_cb_half_count, (unsigned long)cb_full, (unsigned long)s_cb_err_count,
+                           (unsigned long)sck_est_hz);
+            return true;
+        }
+        case 4:
+            micdiag_writef(write, "MICDIAG: dma seq=%lu done=%lu overruns=%lu dropped=%lu words (~%lu samples)\r\n",
+                           (unsigned long)s_dma_seq, (unsigned long)s_dma_seq_done,
+                           (unsigned long)s_dma_overruns, (unsigned long)s_dma_dropped_words,
+                           (unsigned long)(s_dma_dropped_words / s_cfg.decim));
+            return true;
+        case 5:
+        {
+            uint32_t duty_on = 0u, duty_total = 0u;
+            MIC_GetDuty(&duty_on, &duty_total);
+            uint32_t duty_x10 = (duty_total != 0u) ? (uint32_t)(((uint64_t)duty_on * 1000u) / duty_total) : 0u;
+            micdiag_writef(write, "MICDIAG: duty=%.1q%% on=%lums of %lums sched=%u loud=%u gap=%lums next_in=%ldms floor=%.2q\r\n",
+                           (int32_t)duty_x10, (unsigned long)duty_on, (unsigned long)duty_total,
+                           (unsigned)mic_sched_enabled(), (unsigned)s_sched_loud, (unsigned long)s_sched_gap_ms,
+                           (long)(int32_t)(s_sched_next_ms - now), (int32_t)s_sched_floor_x100);
+            return true;
+        }
+        case 6:
+        {
+            mic_beat_t beat;
+            MIC_GetBeat(&beat);
+            micdiag_writef(write, "MICDIAG: beat beats=%lu onsets=%lu bpm=%.1q phase=%u flux=%.2q mean=%.2q hold=%u\r\n",
+                           (unsigned long)beat.beats, (unsigned long)beat.onsets, (int32_t)beat.bpm_x10,
+                           (unsigned)beat.phase, (int32_t)s_beat.flux, (int32_t)(s_beat.mean_x16 >> 4),
+                           (unsigned)mic_beat_hold());
+            return true;
+        }
+        case 7:
+        {
+            uint32_t last_rx_age = (s_last_rx_ms != 0u) ? (now - s_last_rx_ms) : 0xFFFFFFFFu;
+            micdiag_writef(write, "MICDIAG: last_rx age=%lums words=%lu 0000=%lu ffff=%lu trans=%lu min=0x%04X max=0x%04X\r\n",
+                           (unsigned long)last_rx_age,
+                           (unsigned long)s_last_rx_words,
+                           (unsigned long)s_last_rx_cnt_0000,
+                           (unsigned long)s_last_rx_cnt_ffff,
+                           (unsigned long)s_last_rx_transitions,
+                           (unsigned)s_last_rx_minw,
+                           (unsigned)s_last_rx_maxw);
+            return true;
+        }
+        case 8:
+            if (!s_last_rx_first_n) return false;
+            micdiag_writef(write, "MICDIAG: first:");
+            for (uint32_t i = 0; i < s_last_rx_first_n; i++)
+                micdiag_writef(write, " %04X", (unsigned)s_last_rx_first[i]);
+            micdiag_writef(write, "\r\n");
+            return true;
+        default:
+            return false;
     }
 }
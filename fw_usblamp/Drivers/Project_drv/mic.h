@@ -1,6 +1,7 @@
 #pragma once
 #include "stm32u0xx_hal.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,23 +21,33 @@ typedef uint8_t (*mic_wait_enter_fn_t)(uint32_t timeout_ms);
 /* Optional helper: start a calibration tone (used by MICCAL()). */
 typedef void (*mic_beep_fn_t)(uint16_t freq_hz, uint8_t volume, float time_s);
 
-/* Microphone DSP/capture tunables. */
+/* Microphone DSP/capture tunables. MIC_DECIM_N, MIC_WINDOW_MS, MIC_DMA_WORDS and
+ * MIC_POWERSAVE are the power-on defaults of MIC_Configure(). */
 #ifndef MIC_DECIM_N
 #define MIC_DECIM_N      10u     /* 16-bit SPI words: bit-decimation = 16*MIC_DECIM_N (e.g. 128 @ MIC_DECIM_N=8) */
 #endif
 #ifndef MIC_WINDOW_MS
-#define MIC_WINDOW_MS    50u    /* RMS/dBFS window length */
+#define MIC_WINDOW_MS    50u    /* RMS/dBFS window length (counted in PCM samples) */
 #endif
 #ifndef MIC_DMA_WORDS
-#define MIC_DMA_WORDS    512u   /* DMA block size (words) */
+#define MIC_DMA_WORDS    512u   /* circular DMA ring (words), processed in halves; also the max at runtime */
 #endif
 #ifndef MIC_TIMEOUT_MS
-#define MIC_TIMEOUT_MS   200u   /* DMA timeout waiting for RxCplt */
+#define MIC_TIMEOUT_MS   200u   /* DMA timeout waiting for a half/full event */
 #endif
 #ifndef MIC_FIR_TAPS
-#define MIC_FIR_TAPS     2u     /* moving-average smoothing taps on the decimated stream (keep small to preserve HF band) */
+#define MIC_FIR_TAPS     2u     /* moving-average smoothing taps on the decimated stream (keep small to preserve HF band); unused with MIC_PDM_LUT */
 #endif
 
+/*
+ * MIC_FIXED_POINT (mic_dsp.h, default 1): run the decimator output, band filters and
+ * window energy in integer Q23/Q29 arithmetic. 0 selects the original float pipeline,
+ * kept as a reference; both report the same levels to within 0.01 dB.
+ *
+ * MIC_PDM_LUT (mic_dsp.h, default 1): table-driven sinc^3 first stage instead of the
+ * per-word popcount, MIC_DECIM_N <= 64.
+ */
+
 /*
  * dBFS calibration (optional)
  *
@@ -67,8 +78,8 @@ typedef void (*mic_beep_fn_t)(uint16_t freq_hz, uint8_t volume, float time_s);
 
 /*
  * Persistent calibration storage:
- * By default, mic calibration offset can be stored in an RTC backup register so it
- * survives reset and "off/on" while the backup domain is powered (battery).
+ * The offset is kept in the settings store (settings.h, key "miccal"). Older firmware kept it
+ * in this RTC backup register; MIC_CalLoad() migrates such a value once.
  */
 #ifndef MIC_CAL_PERSIST_BKP_REG
 #define MIC_CAL_PERSIST_BKP_REG RTC_BKP_DR2
@@ -143,6 +154,8 @@ typedef enum
     MIC_ERR_SIGNAL_SATURATED = -8, /* looks like saturation (RMS or peak ~ 1.0) */
     /* State: capture running but no data yet */
     MIC_ERR_NO_DATA_YET = -9,
+    /* MIC_Configure() value out of range */
+    MIC_ERR_BAD_CONFIG = -10,
 } mic_err_t;
 
 /* Call once after MX_SPI1_Init() (e.g., in main USER CODE BEGIN 2). */
@@ -159,7 +172,7 @@ void MIC_Stop(void);
 
 /*
  * Runtime calibration control (used by USB CLI MICCAL()).
- * NOTE: MIC_CalSave()/Load() persist only MIC_CAL_DB_OFFSET_DB (centi-dB) in RTC BKP.
+ * NOTE: MIC_CalSave()/Load() persist only MIC_CAL_DB_OFFSET_DB (centi-dB) in the settings store.
  */
 void MIC_CalResetToDefaults(void);
 void MIC_CalGet(float *out_rms_gain, float *out_db_offset_db);
@@ -188,7 +201,7 @@ mic_err_t MIC_GetLast50msEx(float *out_dbfs, float *out_rms, uint32_t *out_seq);
 void MIC_SetDebug(uint8_t enable);
 
 /*
- * MIC_POWERSAVE (compile-time):
+ * MIC_POWERSAVE (default, see mic_config_t.powersave_ms):
  *   0   = keep microphone clock running continuously (debug / lowest latency).
  *   >0  = power-save mode: do periodic measurements and stop the MIC clock afterwards.
  *
@@ -205,6 +218,81 @@ void MIC_SetDebug(uint8_t enable);
 #define MIC_POWERSAVE   0u
 #endif
 
+/*
+ * Runtime capture configuration (MIC_Configure / MiniPascal MICCONF / CLI MICCONF).
+ *   decim:        SPI words per PCM sample, fs = SCK/16/decim (~18.75 kHz at 10). A larger
+ *                 value saves CPU; the low-pass edge drops to 0.45*fs if MIC_BAND_LP_HZ no
+ *                 longer fits.
+ *   window_ms:    RMS window (MIC()).
+ *   dma_words:    DMA ring size (even); half of it is processed per MIC_Task pass.
+ *   powersave_ms: MIC_POWERSAVE semantics, 0 = continuous.
+ *   adaptive_max_ms: with powersave_ms, 0 = captures only when read; else the adaptive
+ *                 scheduler below, with this as the longest gap between quiet captures.
+ */
+#define MIC_DECIM_MIN       4u
+#define MIC_DECIM_MAX       32u
+#define MIC_WINDOW_MS_MIN   10u
+#define MIC_WINDOW_MS_MAX   1000u
+#define MIC_DMA_WORDS_MIN   64u
+
+#ifndef MIC_ADAPTIVE_MAX_MS
+#define MIC_ADAPTIVE_MAX_MS 0u
+#endif
+
+typedef struct
+{
+    uint16_t decim;
+    uint16_t window_ms;
+    uint16_t dma_words;
+    uint32_t powersave_ms;
+    uint32_t adaptive_max_ms;
+} mic_config_t;
+
+/*
+ * Validate and apply cfg. While capturing, the change takes effect between two DMA
+ * half-buffers in MIC_Task: the filters and windows restart (the first window after a
+ * rate change is discarded while the filters settle), a new ring size restarts the DMA,
+ * and a duty-cycle change applies to the running capture. Returns MIC_ERR_BAD_CONFIG
+ * for out-of-range values, without changing anything.
+ */
+mic_err_t MIC_Configure(const mic_config_t *cfg);
+
+/* Current configuration (a pending one once MIC_Configure() has accepted it). */
+void MIC_GetConfig(mic_config_t *cfg);
+
+/*
+ * Adaptive duty cycle (powersave_ms != 0 and adaptive_max_ms != 0).
+ * MIC_Task starts powersave_ms captures by itself. After each quiet capture the gap to the
+ * next one doubles, from MIC_SCHED_MIN_GAP_MS up to adaptive_max_ms. A window louder than
+ * the tracked noise floor by MIC_SCHED_RISE_DB_X100 keeps the capture running
+ * continuously until MIC_SCHED_HOLD_MS pass without one. MIC()/MICFFT()/MICBANDS()
+ * return the latest scheduled result instead of starting their own capture.
+ */
+#ifndef MIC_SCHED_MIN_GAP_MS
+#define MIC_SCHED_MIN_GAP_MS    250u
+#endif
+#ifndef MIC_SCHED_HOLD_MS
+#define MIC_SCHED_HOLD_MS       3000u
+#endif
+#ifndef MIC_SCHED_RISE_DB_X100
+#define MIC_SCHED_RISE_DB_X100  1000
+#endif
+
+/*
+ * Call before a STOP2 sleep (the tick stops there). Returns 0 if the mic must keep
+ * running (adaptive scheduler hearing sound): sleep without STOP2 and keep calling
+ * MIC_Task. Otherwise a scheduled capture in progress is dropped, so the mic never
+ * wakes the CPU on its own.
+ */
+uint8_t MIC_PrepareStop(void);
+
+/* Call after the sleep with the time actually spent in STOP2 (LP_DELAY's result): the
+ * scheduler's wait and the duty-cycle total move on by that much. */
+void MIC_AccountStop(uint32_t stop_ms);
+
+/* Mic clock on-time and total time (STOP2 included) since the last (re)configuration. */
+void MIC_GetDuty(uint32_t *out_on_ms, uint32_t *out_total_ms);
+
 /*
  * Microphone wake-up time after clock start (ignore samples during this time).
  */
@@ -232,11 +320,20 @@ void MIC_SetDebug(uint8_t enable);
 #endif
 
 /*
- * MICFFT (3-band "FFT-like" analysis) configuration.
- * Used for "color music" effects: computes LF/MF/HF levels as dBFS*100 (int16).
+ * MICFFT / MICBANDS spectrum configuration.
+ * Used for "color music" effects: a MICFFT_N-point fixed-point FFT (Hann window, 50%
+ * overlap) of the band-limited PCM, averaged over MICFFT_WINDOW_MS and summed into
+ * LF/MF/HF (MICFFT) or MIC_BANDS_MAX-or-fewer log-spaced bands (MICBANDS), all as
+ * dBFS*100 (int16). Bin width is fs/MICFFT_N (~73 Hz at 256).
  */
 #ifndef MICFFT_WINDOW_MS
-#define MICFFT_WINDOW_MS  100u   /* averaging window (ms), must be <= 1000ms */
+#define MICFFT_WINDOW_MS  100u   /* averaging window (ms, rounded to whole hops of N/2), <= 1000ms */
+#endif
+#ifndef MICFFT_N
+#define MICFFT_N          256u   /* FFT size: power of two, 64..256 (RAM ~ 7*N bytes) */
+#endif
+#ifndef MIC_BANDS_MAX
+#define MIC_BANDS_MAX     8u     /* most bands MICBANDS(n) can return, 3..16 */
 #endif
 
 /* Backward compatible names (driver uses MIC_BAND_*). */
@@ -273,8 +370,9 @@ const char* MIC_LastErrorMsg(void);
 /* Debug: get last DMA buffer for CLI inspection */
 const uint16_t* MIC_DebugLastDmaBuf(uint32_t *out_words);
 
-/* USB CLI helper: microphone diagnostics (debug). */
-void MIC_WriteDiag(mic_write_fn_t write);
+/* USB CLI helper: microphone diagnostics (debug), one line per part 0,1,2...;
+ * false once past the last line. */
+bool MIC_WriteDiag(uint8_t part, mic_write_fn_t write);
 
 /* Error name helper (for debug prints). */
 const char* MIC_ErrName(mic_err_t e);
@@ -286,8 +384,8 @@ const char* MIC_ErrName(mic_err_t e);
 mic_err_t MIC_ReadDbfsX100_Blocking(uint32_t timeout_ms, int16_t *out_dbfs_x100);
 
 /*
- * MICFFT bins (LF/MF/HF) as dBFS*100 (int16).
- * NOTE: internally this is a lightweight 3-band filterbank, not a full FFT.
+ * MICFFT bins (LF/MF/HF) as dBFS*100 (int16): FFT bins summed between MIC_BAND_HP_HZ,
+ * MICFFT_LF_MAX_HZ, MICFFT_MF_MAX_HZ and MIC_BAND_LP_HZ.
  */
 mic_err_t MIC_FFT_GetLastBinsDbX100(int16_t *out_lf_db_x100,
                                    int16_t *out_mf_db_x100,
@@ -297,6 +395,64 @@ mic_err_t MIC_FFT_WaitBinsDbX100(uint32_t timeout_ms,
                                 int16_t *out_mf_db_x100,
                                 int16_t *out_hf_db_x100);
 
+/*
+ * Non-blocking forms of the two waits above, for callers that must not stall the main
+ * loop (MiniPascal VM). Start capture if needed and return MIC_ERR_NO_DATA_YET while the
+ * result is still pending (t0_ms = time of the first call); anything else is the final
+ * result, identical to the blocking call. MIC_GetSeq() changes whenever MIC_Task()
+ * publishes a window, bins or an error, so a pending caller only needs to poll again
+ * after it moves (or on timeout).
+ */
+uint32_t  MIC_GetSeq(void);
+mic_err_t MIC_ReadDbfsX100_Poll(uint32_t t0_ms, uint32_t timeout_ms, int16_t *out_dbfs_x100);
+mic_err_t MIC_FFT_PollBinsDbX100(uint32_t t0_ms, uint32_t timeout_ms,
+                                int16_t *out_lf_db_x100,
+                                int16_t *out_mf_db_x100,
+                                int16_t *out_hf_db_x100);
+
+/*
+ * MICBANDS: n (1..MIC_BANDS_MAX, clamped) log-spaced bands from MIC_BAND_HP_HZ to
+ * MIC_BAND_LP_HZ, lowest first, dBFS*100 into out_db_x100[0..n). Asking for a different n
+ * than the previous call re-lays the bands, so its first result takes one more window.
+ */
+mic_err_t MIC_FFT_WaitBandsDbX100(uint32_t timeout_ms, uint8_t n, int16_t *out_db_x100);
+mic_err_t MIC_FFT_PollBandsDbX100(uint32_t t0_ms, uint32_t timeout_ms, uint8_t n, int16_t *out_db_x100);
+
+/*
+ * BEAT: onsets and tempo, tracked on every MICFFT frame (N/2 samples, ~7 ms at 18.75 kHz)
+ * from the LF/MF/HF levels; see MIC_DSP_BeatFrame() in mic_dsp.h. Needs MICFFT_WINDOW_MS
+ * != 0. A beat is reported in the frame of its onset, or on time from the tempo.
+ */
+#ifndef MIC_BEAT_HOLD_MS
+#define MIC_BEAT_HOLD_MS        2000u   /* MIC_BeatPoll() keeps the capture running this long */
+#endif
+#ifndef MIC_BEAT_IDLE_PERIOD_MS
+#define MIC_BEAT_IDLE_PERIOD_MS 500u    /* phase ramp after a beat while there is no tempo */
+#endif
+
+typedef struct
+{
+    uint32_t beats;         /* beat counter: tempo ticks, or every onset while there is no tempo */
+    uint32_t onsets;        /* onset counter */
+    uint16_t bpm_x10;       /* tempo, 0 = none */
+    uint8_t  phase;         /* 0 at a beat, rising to 255 one period later (held there) */
+} mic_beat_t;
+
+/* Latest beat state. Lock-free and never blocks, so it may also be called from interrupts;
+ * does not start the capture. */
+void MIC_GetBeat(mic_beat_t *out);
+
+/*
+ * BEAT() reader: starts the capture if needed and, while called at least every
+ * MIC_BEAT_HOLD_MS, keeps it running (power-save intervals, the adaptive scheduler and
+ * STOP2 delays wait). Never waits: returns MIC_ERR_NO_DATA_YET until the tracker gets
+ * frames, then MIC_ERR_OK, or the capture error. A capture error is returned by the first
+ * poll after it without restarting; the next poll restarts the capture, or, with the
+ * adaptive scheduler, keeps returning the error until the scheduler restarts it. *out is
+ * filled in every case.
+ */
+mic_err_t MIC_BeatPoll(mic_beat_t *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,914 @@
+/*
+ * mic_dsp.c - DSP primitives of the PDM microphone path (see mic_dsp.h).
+ */
+
+#include "mic_dsp.h"
+
+#include <math.h>
+#include <string.h>
+
+/* ---------------------------------------------------------------- filter design ---- */
+
+static float design_prewarp(uint32_t fc_hz, uint32_t fs_hz, float q, float *cs, float *alpha)
+{
+    float fs = (float)fs_hz;
+    float fc = (float)fc_hz;
+    if (fc < 1.0f) fc = 1.0f;
+    float fc_max = 0.45f * fs;
+    if (fc > fc_max) fc = fc_max;
+
+    if (q < 0.1f) q = 0.1f;
+
+    float w0 = 6.28318530718f * (fc / fs);
+    *cs = cosf(w0);
+    *alpha = sinf(w0) / (2.0f * q);
+    return 1.0f + *alpha;       /* a0 */
+}
+
+void MIC_DSP_DesignLP(mic_biquad_coef_t *c, uint32_t fc_hz, uint32_t fs_hz, float q)
+{
+    if (c == 0 || fs_hz == 0u) return;
+
+    float cs, alpha;
+    float a0 = design_prewarp(fc_hz, fs_hz, q, &cs, &alpha);
+    c->b0 = ((1.0f - cs) * 0.5f) / a0;
+    c->b1 = (1.0f - cs) / a0;
+    c->b2 = ((1.0f - cs) * 0.5f) / a0;
+    c->a1 = (-2.0f * cs) / a0;
+    c->a2 = (1.0f - alpha) / a0;
+}
+
+void MIC_DSP_DesignHP(mic_biquad_coef_t *c, uint32_t fc_hz, uint32_t fs_hz, float q)
+{
+    if (c == 0 || fs_hz == 0u) return;
+
+    float cs, alpha;
+    float a0 = design_prewarp(fc_hz, fs_hz, q, &cs, &alpha);
+    c->b0 = ((1.0f + cs) * 0.5f) / a0;
+    c->b1 = -(1.0f + cs) / a0;
+    c->b2 = ((1.0f + cs) * 0.5f) / a0;
+    c->a1 = (-2.0f * cs) / a0;
+    c->a2 = (1.0f - alpha) / a0;
+}
+
+/* ---------------------------------------------------------------- integer math ---- */
+
+/* log2(1 + i/64) in Q16, i = 0..63. */
+static const uint16_t s_log2_tab[64] = {
+        0,  1466,  2909,  4331,  5732,  7112,  8473,  9814,
+    11136, 12440, 13727, 14996, 16248, 17484, 18704, 19909,
+    21098, 22272, 23433, 24579, 25711, 26830, 27936, 29029,
+    30109, 31178, 32234, 33279, 34312, 35334, 36346, 37346,
+    38336, 39316, 40286, 41246, 42196, 43137, 44068, 44990,
+    45904, 46809, 47705, 48593, 49472, 50344, 51207, 52063,
+    52911, 53751, 54584, 55410, 56229, 57040, 57845, 58643,
+    59434, 60219, 60997, 61769, 62534, 63294, 64047, 64794,
+};
+
+int32_t MIC_DSP_Log2Q16(uint64_t v)
+{
+    if (v == 0u) return 0;
+
+    int32_t k = 0;
+    uint32_t hi = (uint32_t)(v >> 32);
+    uint32_t m;
+    if (hi)
+    {
+        k = 32;
+        m = hi;
+    }
+    else
+    {
+        m = (uint32_t)v;
+    }
+    if (m >= (1u << 16)) { k += 16; m >>= 16; }
+    if (m >= (1u << 8))  { k += 8;  m >>= 8; }
+    if (m >= (1u << 4))  { k += 4;  m >>= 4; }
+    if (m >= (1u << 2))  { k += 2;  m >>= 2; }
+    if (m >= (1u << 1))  { k += 1; }
+
+    /* Mantissa with the leading one at bit 31: 6 index bits, then 16 interpolation bits. */
+    if (k >= 31) m = (uint32_t)(v >> (k - 31));
+    else m = (uint32_t)v << (31 - k);
+
+    uint32_t idx  = (m >> 25) & 63u;
+    uint32_t frac = (m >> 9) & 0xFFFFu;
+    uint32_t y0 = s_log2_tab[idx];
+    uint32_t y1 = (idx < 63u) ? s_log2_tab[idx + 1u] : 65536u;
+    return (k << 16) + (int32_t)(y0 + (((y1 - y0) * frac) >> 16));
+}
+
+uint32_t MIC_DSP_ISqrt64(uint64_t v)
+{
+    uint64_t r = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit)
+    {
+        if (v >= r + bit)
+        {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)r;
+}
+
+/* dB*100 per log2 unit: 1000*log10(2) = 301.03, applied as *30103/100. */
+#define DB_X100_PER_LOG2_NUM    30103
+#define DB_X100_PER_LOG2_DEN    100
+
+int32_t MIC_DSP_PowerDbX100(uint64_t sum, uint32_t n, int32_t frac_bits)
+{
+    if (n == 0u || sum == 0u) return MIC_DSP_DB_FLOOR_X100;
+
+    /* Without the 64-bit division. */
+    int64_t lg = (int64_t)MIC_DSP_Log2Q16(sum) - MIC_DSP_Log2Q16(n) - ((int64_t)frac_bits << 16);
+    int64_t db = lg * DB_X100_PER_LOG2_NUM;
+    int64_t den = (int64_t)DB_X100_PER_LOG2_DEN << 16;
+    db = (db >= 0) ? ((db + den / 2) / den) : -((-db + den / 2) / den);
+    if (db < MIC_DSP_DB_FLOOR_X100) db = MIC_DSP_DB_FLOOR_X100;
+    return (int32_t)db;
+}
+
+/* ---------------------------------------------------------------- biquads / energy ---- */
+
+#if MIC_FIXED_POINT
+
+static int32_t to_q(float v, int frac)
+{
+    float s = v * (float)(1ul << frac);
+    return (int32_t)((s >= 0.0f) ? (s + 0.5f) : (s - 0.5f));
+}
+
+void MIC_DSP_BiquadInit(mic_biquad_t *s, const mic_biquad_coef_t *c)
+{
+    if (s == 0 || c == 0) return;
+    s->b0 = to_q(c->b0, MIC_BIQUAD_FRAC);
+    s->b1 = to_q(c->b1, MIC_BIQUAD_FRAC);
+    s->b2 = to_q(c->b2, MIC_BIQUAD_FRAC);
+    s->a1 = to_q(c->a1, MIC_BIQUAD_FRAC);
+    s->a2 = to_q(c->a2, MIC_BIQUAD_FRAC);
+    MIC_DSP_BiquadReset(s);
+}
+
+void MIC_DSP_BiquadReset(mic_biquad_t *s)
+{
+    if (s == 0) return;
+    s->x1 = s->x2 = 0;
+    s->y1 = s->y2 = 0;
+}
+
+void MIC_DSP_BiquadBlock(mic_biquad_t *s, mic_sample_t *buf, uint32_t n)
+{
+    if (s == 0 || buf == 0) return;
+
+    const int32_t b0 = s->b0, b1 = s->b1, b2 = s->b2, a1 = s->a1, a2 = s->a2;
+    int32_t x1 = s->x1, x2 = s->x2, y1 = s->y1, y2 = s->y2;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t x = buf[i];
+        int64_t acc = (int64_t)b0 * x + (int64_t)b1 * x1 + (int64_t)b2 * x2
+                    - (int64_t)a1 * y1 - (int64_t)a2 * y2;
+        int32_t y = (int32_t)((acc + ((int64_t)1 << (MIC_BIQUAD_FRAC - 1))) >> MIC_BIQUAD_FRAC);
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+        buf[i] = y;
+    }
+    s->x1 = x1;
+    s->x2 = x2;
+    s->y1 = y1;
+    s->y2 = y2;
+}
+
+void MIC_DSP_EnergyBlock(mic_energy_t *e, const mic_sample_t *buf, uint32_t n)
+{
+    if (e == 0 || buf == 0) return;
+
+    uint64_t sum = e->sum_sq;
+    uint32_t peak = e->peak;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t v = (buf[i] + (1 << 7)) >> 8;
+        uint32_t a = (uint32_t)((v < 0) ? -v : v);
+        if (a > 0xFFFFu) a = 0xFFFFu;
+        sum += a * a;
+        if (a > peak) peak = a;
+    }
+    e->sum_sq = sum;
+    e->peak = peak;
+    e->n += n;
+}
+
+int32_t MIC_DSP_EnergyDbX100(const mic_energy_t *e)
+{
+    if (e == 0) return MIC_DSP_DB_FLOOR_X100;
+    return MIC_DSP_PowerDbX100(e->sum_sq, e->n, 30);
+}
+
+float MIC_DSP_EnergyRms(const mic_energy_t *e)
+{
+    if (e == 0 || e->n == 0u) return 0.0f;
+    return (float)MIC_DSP_ISqrt64(e->sum_sq / e->n) * (1.0f / 32768.0f);
+}
+
+float MIC_DSP_EnergyPeak(const mic_energy_t *e)
+{
+    return (e != 0) ? (float)e->peak * (1.0f / 32768.0f) : 0.0f;
+}
+
+uint8_t MIC_DSP_EnergySaturated(const mic_energy_t *e)
+{
+    if (e == 0 || e->n == 0u) return 0u;
+    /* 0.98 full scale: peak 32112/32768, mean square 0.9604 * 2^30. */
+    if (e->peak > 32112u) return 1u;
+    return (e->sum_sq > (uint64_t)e->n * 1031221002u) ? 1u : 0u;
+}
+
+#else /* float reference */
+
+void MIC_DSP_BiquadInit(mic_biquad_t *s, const mic_biquad_coef_t *c)
+{
+    if (s == 0 || c == 0) return;
+    s->b0 = c->b0;
+    s->b1 = c->b1;
+    s->b2 = c->b2;
+    s->a1 = c->a1;
+    s->a2 = c->a2;
+    MIC_DSP_BiquadReset(s);
+}
+
+void MIC_DSP_BiquadReset(mic_biquad_t *s)
+{
+    if (s == 0) return;
+    s->z1 = 0.0f;
+    s->z2 = 0.0f;
+}
+
+void MIC_DSP_BiquadBlock(mic_biquad_t *s, mic_sample_t *buf, uint32_t n)
+{
+    if (s == 0 || buf == 0) return;
+
+    const float b0 = s->b0, b1 = s->b1, b2 = s->b2, a1 = s->a1, a2 = s->a2;
+    float z1 = s->z1, z2 = s->z2;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        float x = buf[i];
+        float y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        buf[i] = y;
+    }
+    s->z1 = z1;
+    s->z2 = z2;
+}
+
+void MIC_DSP_EnergyBlock(mic_energy_t *e, const mic_sample_t *buf, uint32_t n)
+{
+    if (e == 0 || buf == 0) return;
+
+    double sum = e->sum_sq;
+    double peak = e->peak;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        double d = (double)buf[i];
+        sum += d * d;
+        double a = (d >= 0.0) ? d : -d;
+        if (a > peak) peak = a;
+    }
+    e->sum_sq = sum;
+    e->peak = peak;
+    e->n += n;
+}
+
+int32_t MIC_DSP_EnergyDbX100(const mic_energy_t *e)
+{
+    float rms = MIC_DSP_EnergyRms(e);
+    /* Avoid log(0). */
+    if (rms < 1e-6f) return MIC_DSP_DB_FLOOR_X100;
+    float x = 2000.0f * log10f(rms);
+    int32_t v = (x >= 0.0f) ? (int32_t)(x + 0.5f) : (int32_t)(x - 0.5f);
+    return (v < MIC_DSP_DB_FLOOR_X100) ? MIC_DSP_DB_FLOOR_X100 : v;
+}
+
+float MIC_DSP_EnergyRms(const mic_energy_t *e)
+{
+    if (e == 0 || e->n == 0u) return 0.0f;
+    return (float)sqrt(e->sum_sq / (double)e->n);
+}
+
+float MIC_DSP_EnergyPeak(const mic_energy_t *e)
+{
+    return (e != 0) ? (float)e->peak : 0.0f;
+}
+
+uint8_t MIC_DSP_EnergySaturated(const mic_energy_t *e)
+{
+    if (e == 0 || e->n == 0u) return 0u;
+    return (MIC_DSP_EnergyRms(e) > 0.98f || e->peak > 0.98) ? 1u : 0u;
+}
+
+#endif /* MIC_FIXED_POINT */
+
+/* ---------------------------------------------------------------- block kernels ---- */
+
+#if MIC_PDM_LUT
+
+/* sinc^3 over 16 bits: three cascaded 16-bit boxcars, 46 taps summing to 4096, padded
+ * with a zero tap at each end to 6 bytes. Row j holds, for each byte value, the sum of
+ * taps 8j..8j+7 weighted +1/-1 by the bits (MSB first, as SPI shifts them in). */
+#define PDM_LUT_BYTES   6u
+#define PDM_LUT_GAIN    4096u
+
+static int16_t s_pdm_lut[PDM_LUT_BYTES][256];
+static uint8_t s_pdm_lut_ready;
+
+static void pdm_lut_build(void)
+{
+    int16_t h[PDM_LUT_BYTES * 8u] = {0};
+
+    /* box16 * box16 is a triangle of 31 taps; one more boxcar gives 46. */
+    for (uint32_t k = 0; k < 46u; k++)
+    {
+        int32_t acc = 0;
+        for (uint32_t j = 0; j < 16u; j++)
+        {
+            if (j > k || k - j > 30u) continue;
+            uint32_t t = k - j;
+            acc += (int32_t)((t <= 15u) ? (t + 1u) : (31u - t));
+        }
+        h[k + 1u] = (int16_t)acc;
+    }
+
+    for (uint32_t row = 0; row < PDM_LUT_BYTES; row++)
+    {
+        for (uint32_t v = 0; v < 256u; v++)
+        {
+            int32_t acc = 0;
+            for (uint32_t b = 0; b < 8u; b++)
+            {
+                int32_t tap = h[row * 8u + b];
+                acc += ((v >> (7u - b)) & 1u) ? tap : -tap;
+            }
+            s_pdm_lut[row][v] = (int16_t)acc;
+        }
+    }
+    s_pdm_lut_ready = 1u;
+}
+
+#define PDM_STAGE1_GAIN     PDM_LUT_GAIN
+
+#else
+
+#define PDM_STAGE1_GAIN     16u
+
+static inline uint32_t popcount16(uint32_t x)
+{
+    uint32_t c = 0;
+    while (x)
+    {
+        x &= x - 1u;
+        c++;
+    }
+    return c;
+}
+
+#endif /* MIC_PDM_LUT */
+
+void MIC_DSP_CicInit(mic_cic_t *c, uint32_t decim, uint32_t fir_taps)
+{
+    if (c == 0) return;
+    if (decim == 0u) decim = 1u;
+    c->decim = decim;
+#if MIC_PDM_LUT
+    (void)fir_taps;
+    uint32_t taps = 1u;
+    if (!s_pdm_lut_ready) pdm_lut_build();
+#else
+    if (fir_taps == 0u) fir_taps = 1u;
+    if (fir_taps > MIC_DSP_FIR_MAX) fir_taps = MIC_DSP_FIR_MAX;
+    c->fir_taps = fir_taps;
+    uint32_t taps = fir_taps;
+#endif
+
+    /* The largest output (all ones or all zeros) maps to full scale. */
+    uint32_t full = taps * PDM_STAGE1_GAIN * decim * decim * decim;
+#if MIC_FIXED_POINT
+    /* mul = 2^(23+shift) / full, with the shift that puts mul in [2^29, 2^30]: the gain is
+     * exact to 2^-29 for any decim (a fixed 2^30/full kept only 3 bits at decim 32). */
+    uint32_t shift = 1u;
+    while ((((uint64_t)1 << (24u + shift)) / full) < ((uint64_t)1 << 30)) shift++;
+    c->shift = shift;
+    c->mul = (int32_t)((((uint64_t)1 << (23u + shift)) + full / 2u) / full);
+#else
+    c->scale = 1.0f / (float)full;
+#endif
+    MIC_DSP_CicReset(c);
+}
+
+void MIC_DSP_CicReset(mic_cic_t *c)
+{
+    if (c == 0) return;
+    c->i1 = c->i2 = c->i3 = 0u;
+    c->d1 = c->d2 = c->d3 = 0u;
+    c->phase = 0u;
+#if MIC_PDM_LUT
+    /* Alternating bits: the PDM idle pattern, about zero output. */
+    c->w1 = c->w2 = 0xAAAAu;
+#else
+    c->fir_pos = 0u;
+    c->fir_sum = 0;
+    for (uint32_t i = 0; i < MIC_DSP_FIR_MAX; i++)
+        c->fir_hist[i] = 0;
+#endif
+}
+
+/* Combs (+ moving average) + scaling for one decimated output. */
+static mic_sample_t cic_output(mic_cic_t *c, uint32_t i3)
+{
+    uint32_t c1 = i3 - c->d1; c->d1 = i3;
+    uint32_t c2 = c1 - c->d2; c->d2 = c1;
+    uint32_t c3 = c2 - c->d3; c->d3 = c2;
+    int32_t sum = (int32_t)c3;      /* two's complement on every supported target */
+
+#if !MIC_PDM_LUT
+    c->fir_sum += sum - c->fir_hist[c->fir_pos];
+    c->fir_hist[c->fir_pos] = sum;
+    if (++c->fir_pos >= c->fir_taps) c->fir_pos = 0u;
+    sum = c->fir_sum;
+#endif
+
+    /* Normalize to [-1..1] (not calibrated) and clamp for stability. */
+#if MIC_FIXED_POINT
+    int32_t y = (int32_t)(((int64_t)sum * c->mul + ((int64_t)1 << (c->shift - 1u))) >> c->shift);
+#else
+    float y = (float)sum * c->scale;
+#endif
+    if (y > MIC_SAMPLE_ONE) y = MIC_SAMPLE_ONE;
+    if (y < -MIC_SAMPLE_ONE) y = -MIC_SAMPLE_ONE;
+    return y;
+}
+
+static inline void word_stats_begin(mic_word_stats_t *st, uint32_t n)
+{
+    st->n = n;
+    st->cnt_0000 = 0u;
+    st->cnt_ffff = 0u;
+    st->transitions = 0u;
+    st->minw = 0xFFFFu;
+    st->maxw = 0x0000u;
+}
+
+/* One word; prev is the previous word of the block (the first word is its own). */
+#define WORD_STATS_ADD(w, prev, c0, cf, tr, lo, hi)     \
+    do {                                                \
+        if ((w) == 0x0000u) (c0)++;                     \
+        else if ((w) == 0xFFFFu) (cf)++;                \
+        if ((w) < (lo)) (lo) = (w);                     \
+        if ((w) > (hi)) (hi) = (w);                     \
+        (tr) += ((w) != (prev));                        \
+    } while (0)
+
+void MIC_DSP_WordStats(mic_word_stats_t *st, const uint16_t *words, uint32_t n)
+{
+    if (st == 0) return;
+    word_stats_begin(st, n);
+    if (words == 0 || n == 0u) return;
+
+    uint32_t c0 = 0u, cf = 0u, tr = 0u, lo = 0xFFFFu, hi = 0u;
+    uint32_t prev = words[0];
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint32_t w = words[k];
+        WORD_STATS_ADD(w, prev, c0, cf, tr, lo, hi);
+        prev = w;
+    }
+    st->cnt_0000 = c0;
+    st->cnt_ffff = cf;
+    st->transitions = tr;
+    st->minw = (uint16_t)lo;
+    st->maxw = (uint16_t)hi;
+}
+
+uint32_t MIC_DSP_CicBlock(mic_cic_t *c, const uint16_t *words, uint32_t n, mic_sample_t *out,
+                          mic_word_stats_t *st)
+{
+    mic_word_stats_t dummy;
+    if (st == 0) st = &dummy;
+    word_stats_begin(st, n);
+    if (c == 0 || words == 0 || out == 0 || c->decim == 0u || n == 0u) return 0u;
+
+    uint32_t i1 = c->i1, i2 = c->i2, i3 = c->i3;
+    uint32_t phase = c->phase;
+    const uint32_t decim = c->decim;
+    uint32_t m = 0u;
+    uint32_t c0 = 0u, cf = 0u, tr = 0u, lo = 0xFFFFu, hi = 0u;
+    uint32_t prev = words[0];
+#if MIC_PDM_LUT
+    /* FIR window, oldest first: w2, w1, words[k]. */
+    uint32_t w2 = c->w2, w1 = c->w1;
+#endif
+
+    for (uint32_t k = 0; k < n; k++)
+    {
+        uint32_t w = words[k];
+        WORD_STATS_ADD(w, prev, c0, cf, tr, lo, hi);
+        prev = w;
+#if MIC_PDM_LUT
+        int32_t x = s_pdm_lut[0][w2 >> 8] + s_pdm_lut[1][w2 & 0xFFu]
+                  + s_pdm_lut[2][w1 >> 8] + s_pdm_lut[3][w1 & 0xFFu]
+                  + s_pdm_lut[4][w >> 8]  + s_pdm_lut[5][w & 0xFFu];
+        w2 = w1;
+        w1 = w;
+        i1 += (uint32_t)x;
+#else
+        i1 += 2u * popcount16(w) - 16u;
+#endif
+        i2 += i1;
+        i3 += i2;
+        if (++phase < decim) continue;
+        phase = 0u;
+        out[m++] = cic_output(c, i3);
+    }
+
+    c->i1 = i1;
+    c->i2 = i2;
+    c->i3 = i3;
+    c->phase = phase;
+#if MIC_PDM_LUT
+    c->w1 = (uint16_t)w1;
+    c->w2 = (uint16_t)w2;
+#endif
+    st->cnt_0000 = c0;
+    st->cnt_ffff = cf;
+    st->transitions = tr;
+    st->minw = (uint16_t)lo;
+    st->maxw = (uint16_t)hi;
+    return m;
+}
+
+/* ---------------------------------------------------------------- spectrum ---- */
+
+#define FFT_QUARTER     (MIC_DSP_FFT_MAX / 4u)
+
+static int16_t  s_fft_sin[FFT_QUARTER + 1u];        /* sin(2*pi*k/MAX), Q15, first quadrant */
+static int16_t  s_fft_hann[MIC_DSP_FFT_MAX / 2u + 1u];  /* first half of the periodic Hann */
+static uint32_t s_fft_size;
+
+/* W = cos - j*sin of 2*pi*k/MIC_DSP_FFT_MAX, k = 0..MAX/2. */
+static inline void fft_twiddle(uint32_t k, int32_t *c, int32_t *s)
+{
+    if (k <= FFT_QUARTER)
+    {
+        *c = s_fft_sin[FFT_QUARTER - k];
+        *s = s_fft_sin[k];
+    }
+    else
+    {
+        *c = -s_fft_sin[k - FFT_QUARTER];
+        *s = s_fft_sin[2u * FFT_QUARTER - k];
+    }
+}
+
+uint8_t MIC_DSP_FftInit(uint32_t n)
+{
+    if (n < 16u || n > MIC_DSP_FFT_MAX || (n & (n - 1u)) != 0u) return 0u;
+
+    if (s_fft_sin[FFT_QUARTER] == 0)
+    {
+        for (uint32_t k = 0; k <= FFT_QUARTER; k++)
+        {
+            float v = sinf(6.28318530718f * (float)k / (float)MIC_DSP_FFT_MAX) * 32767.0f;
+            s_fft_sin[k] = (int16_t)(v + 0.5f);
+        }
+    }
+    for (uint32_t i = 0; i <= n / 2u; i++)
+    {
+        int32_t c, s;
+        fft_twiddle(i * (MIC_DSP_FFT_MAX / n), &c, &s);
+        s_fft_hann[i] = (int16_t)((32767 - c) >> 1);
+    }
+    s_fft_size = n;
+    return 1u;
+}
+
+uint32_t MIC_DSP_FftSize(void)
+{
+    return s_fft_size;
+}
+
+/* In-place complex FFT of m interleaved (re, im) points, scaled by 1/m. */
+static void fft_complex(int16_t *z, uint32_t m)
+{
+    for (uint32_t i = 1, j = 0; i < m; i++)
+    {
+        uint32_t bit = m >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j)
+        {
+            int16_t t;
+            t = z[2u * i];      z[2u * i] = z[2u * j];           z[2u * j] = t;
+            t = z[2u * i + 1u]; z[2u * i + 1u] = z[2u * j + 1u]; z[2u * j + 1u] = t;
+        }
+    }
+
+    for (uint32_t len = 2u; len <= m; len <<= 1)
+    {
+        uint32_t half = len >> 1;
+        uint32_t step = MIC_DSP_FFT_MAX / len;
+        for (uint32_t k = 0; k < half; k++)
+        {
+            int32_t c, s;
+            fft_twiddle(k * step, &c, &s);
+            for (uint32_t i = k; i < m; i += len)
+            {
+                int16_t *a = &z[2u * i];
+                int16_t *b = &z[2u * (i + half)];
+                /* |c| + |s| <= sqrt(2), so the products stay within int32. */
+                int32_t tr = ((int32_t)b[0] * c + (int32_t)b[1] * s) >> 15;
+                int32_t ti = ((int32_t)b[1] * c - (int32_t)b[0] * s) >> 15;
+                int32_t ar = a[0], ai = a[1];
+                a[0] = (int16_t)((ar + tr) >> 1);
+                a[1] = (int16_t)((ai + ti) >> 1);
+                b[0] = (int16_t)((ar - tr) >> 1);
+                b[1] = (int16_t)((ai - ti) >> 1);
+            }
+        }
+    }
+}
+
+int32_t MIC_DSP_RealFftPower(int16_t *x, uint32_t *power)
+{
+    const uint32_t n = s_fft_size;
+    if (x == 0 || power == 0 || n == 0u) return 0;
+
+    /* Window and find the peak. */
+    uint32_t peak = 0u;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t w = s_fft_hann[(i <= n / 2u) ? i : (n - i)];
+        int32_t v = ((int32_t)x[i] * w) >> 15;
+        x[i] = (int16_t)v;
+        uint32_t a = (uint32_t)((v < 0) ? -v : v);
+        if (a > peak) peak = a;
+    }
+
+    /* Normalize to |x| < 2^14: the butterflies then never overflow int16. */
+    int32_t shift = 0;
+    if (peak >= (1u << 14))
+    {
+        shift = -1;
+        for (uint32_t i = 0; i < n; i++) x[i] = (int16_t)(x[i] >> 1);
+    }
+    else if (peak != 0u)
+    {
+        while (shift < MIC_DSP_FFT_SHIFT_MAX && (peak << (shift + 1)) < (1u << 14)) shift++;
+        for (uint32_t i = 0; i < n && shift > 0; i++) x[i] = (int16_t)(x[i] * (1 << shift));
+    }
+
+    const uint32_t m = n / 2u;
+    fft_complex(x, m);
+
+    /* Split Z (n/2 points) into X: X[k] = E - j*W^k*O with
+     * E = (Z[k] + conj Z[m-k]) / 2, O = (Z[k] - conj Z[m-k]) / 2; one more /2 gives 1/n. */
+    for (uint32_t k = 0; k < m; k++)
+    {
+        uint32_t r = (k == 0u) ? 0u : (m - k);
+        int32_t a = x[2u * k], b = x[2u * k + 1u];
+        int32_t p = x[2u * r], q = x[2u * r + 1u];
+        int32_t er = (a + p) >> 1, ei = (b - q) >> 1;
+        int32_t or_ = (a - p) >> 1, oi = (b + q) >> 1;
+        int32_t c, s;
+        fft_twiddle(k * (MIC_DSP_FFT_MAX / n), &c, &s);
+        int32_t xr = (er + ((c * oi - s * or_) >> 15)) >> 1;
+        int32_t xi = (ei - ((c * or_ + s * oi) >> 15)) >> 1;
+        power[k] = (uint32_t)(xr * xr) + (uint32_t)(xi * xi);
+    }
+    return shift;
+}
+
+void MIC_DSP_BandsAccumulate(uint64_t *acc, const uint16_t *edges, uint32_t nb,
+                             const uint32_t *power, int32_t shift)
+{
+    if (acc == 0 || edges == 0 || power == 0) return;
+
+    /* Common scale for all frames: 4^(MIC_DSP_FFT_SHIFT_MAX - shift). */
+    uint32_t up = (uint32_t)(2 * (MIC_DSP_FFT_SHIFT_MAX - shift));
+    for (uint32_t b = 0; b < nb; b++)
+    {
+        uint64_t sum = 0u;
+        for (uint32_t k = edges[b]; k < edges[b + 1u]; k++)
+            sum += power[k];
+        acc[b] += sum << up;
+    }
+}
+
+int32_t MIC_DSP_BandDbX100(uint64_t acc, uint32_t frames)
+{
+    /* One-sided bins count twice, and the Hann window keeps 3/8 of the power:
+     * mean square = 16/3 * sum |X|^2, +7.27 dB. */
+    int32_t db = MIC_DSP_PowerDbX100(acc, frames, 30 + 2 * MIC_DSP_FFT_SHIFT_MAX);
+    if (db <= MIC_DSP_DB_FLOOR_X100) return MIC_DSP_DB_FLOOR_X100;
+    return db + 727;
+}
+
+/* ---------------------------------------------------------------- beat tracking ---- */
+
+void MIC_DSP_BeatReset(mic_beat_det_t *d, uint32_t frame_q16)
+{
+    if (d == 0) return;
+
+    uint32_t onsets = d->onsets, beats = d->beats;
+    memset(d, 0, sizeof(*d));
+    d->onsets = onsets;
+    d->beats = beats;
+    d->frame_q16 = frame_q16;
+    /* Fill the level history first, then let the flux statistics settle. */
+    d->warm = (uint8_t)(MIC_BEAT_LAG + 8u);
+    for (uint32_t i = 0; i < MIC_BEAT_LAG; i++)
+        for (uint32_t b = 0; b < MIC_BEAT_BANDS; b++)
+            d->lvl[i][b] = (int16_t)MIC_BEAT_FLOOR_X100;
+}
+
+/* Vote the intervals ending at onset t into the period histogram; returns the refined
+ * period of its peak, or 0 while the peak is too weak. */
+static uint32_t beat_vote(mic_beat_det_t *d, uint32_t t)
+{
+    for (uint32_t i = 0; i < MIC_BEAT_BINS; i++)
+        d->hist[i] = (uint16_t)(d->hist[i] - (d->hist[i] >> 3));
+
+    for (uint32_t i = 0; i < d->onset_n; i++)
+    {
+        uint32_t dt = t - d->onset_ms[i];
+        if (dt > 4u * MIC_BEAT_PERIOD_MAX_MS) continue;
+        for (uint32_t k = 1u; k <= 4u; k++)
+        {
+            /* dt/k without a divider: 21846/65536 ~ 1/3. */
+            uint32_t p = (k == 3u) ? ((dt * 21846u) >> 16) : (dt >> (k >> 1));
+            if (p < MIC_BEAT_PERIOD_MIN_MS || p > MIC_BEAT_PERIOD_MAX_MS) continue;
+            d->hist[(p - MIC_BEAT_PERIOD_MIN_MS) / MIC_BEAT_BIN_MS] += (k == 1u) ? 4u : (k == 2u) ? 2u : 1u;
+        }
+    }
+
+    uint32_t best = 0u, bi = 0u;
+    for (uint32_t i = 0; i < MIC_BEAT_BINS; i++)
+    {
+        uint32_t s = 2u * d->hist[i] + ((i > 0u) ? d->hist[i - 1u] : 0u)
+                   + ((i + 1u < MIC_BEAT_BINS) ? d->hist[i + 1u] : 0u);
+        if (s > best) { best = s; bi = i; }
+    }
+    if (best < MIC_BEAT_MIN_SCORE)
+        return 0u;
+
+    /* Centroid of the peak and its neighbours. */
+    int32_t lo = (bi > 0u) ? d->hist[bi - 1u] : 0;
+    int32_t hi = (bi + 1u < MIC_BEAT_BINS) ? d->hist[bi + 1u] : 0;
+    int32_t off = ((hi - lo) * (int32_t)MIC_BEAT_BIN_MS) / (lo + (int32_t)d->hist[bi] + hi);
+    return (uint32_t)((int32_t)(MIC_BEAT_PERIOD_MIN_MS + bi * MIC_BEAT_BIN_MS + MIC_BEAT_BIN_MS / 2u) + off);
+}
+
+static void beat_onset(mic_beat_det_t *d, uint32_t t, uint32_t *flags)
+{
+    d->onsets++;
+    *flags |= MIC_BEAT_ONSET;
+
+    uint32_t p = beat_vote(d, t);
+    d->onset_ms[d->onset_pos] = t;
+    d->onset_pos = (uint8_t)((d->onset_pos + 1u) % MIC_BEAT_ONSETS);
+    if (d->onset_n < MIC_BEAT_ONSETS) d->onset_n++;
+    d->onset_last_ms = t;
+
+    if (p != 0u)
+    {
+        int32_t dp = (int32_t)(p - d->period_ms);
+        if (d->period_ms != 0u && (uint32_t)((dp < 0) ? -dp : dp) <= d->period_ms / 8u)
+        {
+            d->period_ms = (uint32_t)((int32_t)d->period_ms + dp / 4);
+        }
+        else
+        {
+            /* New tempo: this onset is its first beat. */
+            d->period_ms = p;
+            memset(d->phase, 0, sizeof(d->phase));
+            d->beats++;
+            *flags |= MIC_BEAT_BEAT;
+            d->beat_ms = t;
+            d->next_ms = t + p;
+            return;
+        }
+    }
+
+    if (d->period_ms == 0u)
+    {
+        d->beats++;
+        *flags |= MIC_BEAT_BEAT;
+        d->beat_ms = t;
+        return;
+    }
+
+    const uint32_t per = d->period_ms;
+    uint32_t ph = (((t - d->beat_ms) * MIC_BEAT_PHASES + per / 2u) / per) % MIC_BEAT_PHASES;
+    for (uint32_t i = 0; i < MIC_BEAT_PHASES; i++)
+        d->phase[i] = (uint16_t)(d->phase[i] - (d->phase[i] >> 3));
+    uint32_t w = (uint32_t)d->flux >> 6;
+    d->phase[ph] = (uint16_t)(d->phase[ph] + ((w > 1000u) ? 1000u : w));
+
+    if (ph != 0u && d->phase[ph] > d->phase[0] + d->phase[0] / 2u)
+    {
+        /* Onsets gather off the beat: move the beat here. */
+        uint16_t rot[MIC_BEAT_PHASES];
+        for (uint32_t i = 0; i < MIC_BEAT_PHASES; i++)
+            rot[i] = d->phase[(i + ph) % MIC_BEAT_PHASES];
+        memcpy(d->phase, rot, sizeof(rot));
+        d->beats++;
+        *flags |= MIC_BEAT_BEAT;
+        d->beat_ms = t;
+        d->next_ms = t + per;
+        return;
+    }
+
+    const int32_t q = (int32_t)(per / 4u);
+    int32_t late = (int32_t)(t - d->beat_ms);
+    int32_t early = (int32_t)(d->next_ms - t);
+    if (late <= q)
+    {
+        d->next_ms += (uint32_t)(late / 4);
+    }
+    else if (early > 0 && early <= q)
+    {
+        d->beats++;
+        *flags |= MIC_BEAT_BEAT;
+        d->beat_ms = t;
+        d->next_ms += per - (uint32_t)(early / 4);
+    }
+}
+
+uint32_t MIC_DSP_BeatFrame(mic_beat_det_t *d, const int32_t *lvl_x100)
+{
+    if (d == 0 || lvl_x100 == 0) return 0u;
+
+    d->t_frac += d->frame_q16;
+    d->t_ms += d->t_frac >> 16;
+    d->t_frac &= 0xFFFFu;
+    const uint32_t t = d->t_ms;
+
+    /* Rectified flux against the oldest level slot, which this frame then replaces. */
+    int16_t *old = d->lvl[d->lvl_pos];
+    int32_t flux = 0;
+    for (uint32_t b = 0; b < MIC_BEAT_BANDS; b++)
+    {
+        int32_t v = lvl_x100[b];
+        if (v < MIC_BEAT_FLOOR_X100) v = MIC_BEAT_FLOOR_X100;
+        if (v > 0) v = 0;
+        if (v > old[b]) flux += v - old[b];
+        old[b] = (int16_t)v;
+    }
+    d->lvl_pos = (uint8_t)((d->lvl_pos + 1u) % MIC_BEAT_LAG);
+    d->flux = flux;
+
+    /* Threshold from the frames before this one; onsets enter the statistics capped
+     * at it so a dense passage does not blind the detector. */
+    int32_t mean = d->mean_x16 >> 4;
+    int32_t thr = mean + 3 * (d->dev_x16 >> 4) + MIC_BEAT_MIN_FLUX_X100;
+    int32_t f = (flux < thr) ? flux : thr;
+    int32_t dev = (f >= mean) ? (f - mean) : (mean - f);
+    d->mean_x16 += f - mean;
+    d->dev_x16 += dev - (d->dev_x16 >> 4);
+
+    uint32_t flags = 0u;
+    if (d->warm)
+    {
+        d->warm--;
+        return 0u;
+    }
+
+    if (d->onset_n != 0u && (t - d->onset_last_ms) > MIC_BEAT_LOST_MS)
+    {
+        d->period_ms = 0u;
+        d->onset_n = 0u;
+        memset(d->hist, 0, sizeof(d->hist));
+    }
+
+    /* Flywheel. */
+    if (d->period_ms != 0u && (int32_t)(t - d->next_ms) >= 0)
+    {
+        d->beats++;
+        flags |= MIC_BEAT_BEAT;
+        d->beat_ms = t;
+        d->next_ms += d->period_ms;
+        if ((int32_t)(t - d->next_ms) >= 0)
+            d->next_ms = t + d->period_ms;
+    }
+
+    if (flux > thr && (d->onset_n == 0u || (t - d->onset_last_ms) >= MIC_BEAT_REFRACT_MS))
+        beat_onset(d, t, &flags);
+    return flags;
+}
@@ -0,0 +1,344 @@
+/*
+ * mic_dsp.h - DSP primitives of the PDM microphone path (mic.c).
+ *
+ * No HAL dependencies, so the same code builds on the host for checks against the
+ * float reference.
+ *
+ * Every stage has a block kernel (MIC_DSP_*Block) that loads its state into locals once
+ * per call and runs over a whole DMA chunk; mic.c strings them together block by block.
+ * The per-sample inline helpers remain for code that only has single samples.
+ *
+ * MIC_FIXED_POINT selects the number format (the STM32U0 has no FPU):
+ *   1: samples are int32 Q23 (full scale +-1.0 = +-2^23, leaving headroom for filter gain),
+ *      biquads are DF1 with Q29 coefficients and a 64-bit accumulator, energy is summed
+ *      as Q30 squares in uint64 and converted to dB with a log2 table.
+ *   0: float samples, DF2T float biquads, double accumulators (reference implementation).
+ * Filter design runs in float in both cases; it only happens on (re)configuration.
+ */
+
+#ifndef PROJECT_DRV_MIC_DSP_H_
+#define PROJECT_DRV_MIC_DSP_H_
+
+#include <stdint.h>
+
+#ifndef MIC_FIXED_POINT
+#define MIC_FIXED_POINT 1
+#endif
+
+/* Floor reported for silence, dBFS*100. */
+#define MIC_DSP_DB_FLOOR_X100   (-12000)
+
+/* Normalized biquad (a0 = 1) as produced by the designers. */
+typedef struct
+{
+    float b0, b1, b2;
+    float a1, a2;
+} mic_biquad_coef_t;
+
+void MIC_DSP_DesignLP(mic_biquad_coef_t *c, uint32_t fc_hz, uint32_t fs_hz, float q);
+void MIC_DSP_DesignHP(mic_biquad_coef_t *c, uint32_t fc_hz, uint32_t fs_hz, float q);
+
+#if MIC_FIXED_POINT
+
+typedef int32_t mic_sample_t;
+#define MIC_SAMPLE_FRAC     23
+#define MIC_SAMPLE_ONE      ((mic_sample_t)1 << MIC_SAMPLE_FRAC)
+#define MIC_BIQUAD_FRAC     29
+
+typedef struct
+{
+    int32_t b0, b1, b2, a1, a2;     /* Q29 */
+    int32_t x1, x2, y1, y2;         /* Q23 */
+} mic_biquad_t;
+
+/* Window energy: sum of Q15 squares (Q30), peak |x| in Q15. */
+typedef struct
+{
+    uint64_t sum_sq;
+    uint32_t peak;
+    uint32_t n;
+} mic_energy_t;
+
+static inline mic_sample_t mic_biquad_step(mic_biquad_t *s, mic_sample_t x)
+{
+    /* Direct Form I: the state holds plain samples, so rounding never feeds back
+     * through the recursion at more than Q23 precision. */
+    int64_t acc = (int64_t)s->b0 * x + (int64_t)s->b1 * s->x1 + (int64_t)s->b2 * s->x2
+                - (int64_t)s->a1 * s->y1 - (int64_t)s->a2 * s->y2;
+    int32_t y = (int32_t)((acc + ((int64_t)1 << (MIC_BIQUAD_FRAC - 1))) >> MIC_BIQUAD_FRAC);
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+    return y;
+}
+
+static inline void mic_energy_add(mic_energy_t *e, mic_sample_t x)
+{
+    /* Q23 -> Q15 (rounded); |x| <= 2 full scale keeps the square in 32 bits. */
+    int32_t v = (x + (1 << 7)) >> 8;
+    uint32_t a = (uint32_t)((v < 0) ? -v : v);
+    if (a > 0xFFFFu) a = 0xFFFFu;
+    e->sum_sq += a * a;
+    if (a > e->peak) e->peak = a;
+    e->n++;
+}
+
+#else /* float reference */
+
+typedef float mic_sample_t;
+#define MIC_SAMPLE_ONE      1.0f
+
+typedef struct
+{
+    float b0, b1, b2, a1, a2;
+    float z1, z2;                   /* DF2T state */
+} mic_biquad_t;
+
+typedef struct
+{
+    double   sum_sq;
+    double   peak;
+    uint32_t n;
+} mic_energy_t;
+
+static inline mic_sample_t mic_biquad_step(mic_biquad_t *s, mic_sample_t x)
+{
+    /* Direct Form II Transposed */
+    float y = s->b0 * x + s->z1;
+    s->z1 = s->b1 * x - s->a1 * y + s->z2;
+    s->z2 = s->b2 * x - s->a2 * y;
+    return y;
+}
+
+static inline void mic_energy_add(mic_energy_t *e, mic_sample_t x)
+{
+    double d = (double)x;
+    e->sum_sq += d * d;
+    double a = (d >= 0.0) ? d : -d;
+    if (a > e->peak) e->peak = a;
+    e->n++;
+}
+
+#endif /* MIC_FIXED_POINT */
+
+void MIC_DSP_BiquadInit(mic_biquad_t *s, const mic_biquad_coef_t *c);
+void MIC_DSP_BiquadReset(mic_biquad_t *s);
+
+static inline void mic_energy_reset(mic_energy_t *e)
+{
+    e->sum_sq = 0;
+    e->peak = 0;
+    e->n = 0u;
+}
+
+/* ---------------------------------------------------------------- block kernels ---- */
+
+/*
+ * MIC_PDM_LUT selects the first decimation stage (16 PDM bits -> one word-rate sample):
+ *   1: a 48-bit sinc^3 FIR evaluated with per-byte lookup tables (6 lookups per word).
+ *      Its alias rejection around multiples of the word rate is three times that of
+ *      the popcount (in dB), so the moving average after the CIC is dropped.
+ *      Needs decim <= 64 so the CIC output stays within int32.
+ *   0: popcount of each word (a 16-bit boxcar), CIC, then the MIC_FIR_TAPS moving average.
+ */
+#ifndef MIC_PDM_LUT
+#define MIC_PDM_LUT         1
+#endif
+
+#ifndef MIC_DSP_FIR_MAX
+#define MIC_DSP_FIR_MAX     8u
+#endif
+
+/*
+ * PDM decimator: the first stage above, then a 3rd-order CIC decimating by `decim`.
+ * Integrators wrap modulo 2^32 on purpose; the combs undo the wrap.
+ */
+typedef struct
+{
+    uint32_t i1, i2, i3;                /* integrators */
+    uint32_t d1, d2, d3;                /* comb delays (at decimated rate) */
+    uint32_t phase;
+    uint32_t decim;
+#if MIC_PDM_LUT
+    uint16_t w1, w2;                    /* previous two words (FIR window) */
+#else
+    uint32_t fir_taps;
+    uint32_t fir_pos;
+    int32_t  fir_sum;
+    int32_t  fir_hist[MIC_DSP_FIR_MAX];
+#endif
+#if MIC_FIXED_POINT
+    int32_t  mul;                       /* fir_sum -> Q23: (fir_sum * mul) >> shift, 64-bit */
+    uint32_t shift;
+#else
+    float    scale;
+#endif
+} mic_cic_t;
+
+/*
+ * Raw PDM word statistics of one block, for the stuck-DATA / activity checks and the
+ * MICDIAG dump. Transitions count words that differ from their predecessor in the block.
+ */
+typedef struct
+{
+    uint32_t n;
+    uint32_t cnt_0000;
+    uint32_t cnt_ffff;
+    uint32_t transitions;
+    uint16_t minw, maxw;
+} mic_word_stats_t;
+
+/* Statistics only (no decimation), for blocks that are not processed. */
+void MIC_DSP_WordStats(mic_word_stats_t *st, const uint16_t *words, uint32_t n);
+
+/* Set decimation/taps (taps clamped to 1..MIC_DSP_FIR_MAX, unused with MIC_PDM_LUT) and
+ * reset the state. The first call builds the lookup tables. */
+void MIC_DSP_CicInit(mic_cic_t *c, uint32_t decim, uint32_t fir_taps);
+void MIC_DSP_CicReset(mic_cic_t *c);
+
+/* Decimate n words into out[]; returns the number of samples written (<= n/decim + 1).
+ * The word statistics are gathered in the same pass (st may be NULL). */
+uint32_t MIC_DSP_CicBlock(mic_cic_t *c, const uint16_t *words, uint32_t n, mic_sample_t *out,
+                          mic_word_stats_t *st);
+
+/* Filter buf[0..n) in place. */
+void MIC_DSP_BiquadBlock(mic_biquad_t *s, mic_sample_t *buf, uint32_t n);
+
+/* Add buf[0..n) to the window energy. */
+void MIC_DSP_EnergyBlock(mic_energy_t *e, const mic_sample_t *buf, uint32_t n);
+
+/* ---------------------------------------------------------------- spectrum ---- */
+
+/*
+ * Fixed-point real FFT (Q15, both number formats): the n real samples are packed as n/2
+ * complex points, transformed by a radix-2 FFT that halves every stage (no overflow),
+ * then split into the n/2 bins of the real spectrum. One transform size is active at a
+ * time (MIC_DSP_FftInit); the tables cover MIC_DSP_FFT_MAX.
+ */
+#ifndef MIC_DSP_FFT_MAX
+#define MIC_DSP_FFT_MAX         256u
+#endif
+
+/* Max input normalization (see MIC_DSP_RealFftPower), 6 dB per step. */
+#define MIC_DSP_FFT_SHIFT_MAX   8
+
+/* Select the transform size (power of two, 16..MIC_DSP_FFT_MAX); 0 if unsupported. */
+uint8_t MIC_DSP_FftInit(uint32_t n);
+uint32_t MIC_DSP_FftSize(void);
+
+/*
+ * Hann-window x[0..n) (Q15, overwritten) and compute power[k] = |X[k]|^2 (Q30) for
+ * k = 0..n/2-1, X scaled by 1/n. Quiet input is first shifted up by up to
+ * MIC_DSP_FFT_SHIFT_MAX bits to keep precision; the return value is that shift (-1 if
+ * the input had to be halved), i.e. power is 4^shift times the true value.
+ */
+int32_t MIC_DSP_RealFftPower(int16_t *x, uint32_t *power);
+
+/* Add the bins [edges[b], edges[b+1]) of one frame to acc[b], b = 0..nb-1. */
+void MIC_DSP_BandsAccumulate(uint64_t *acc, const uint16_t *edges, uint32_t nb,
+                             const uint32_t *power, int32_t shift);
+
+/* Mean-square level of an accumulated band over `frames` frames, dBFS*100. */
+int32_t MIC_DSP_BandDbX100(uint64_t acc, uint32_t frames);
+
+/* ---------------------------------------------------------------- beat tracking ---- */
+
+/*
+ * Onset and tempo tracker, fed once per spectrum frame with that frame's band levels.
+ *
+ * Onset function: the level rise (dB) against the frame MIC_BEAT_LAG back, summed over
+ * the bands (rectified log flux). A frame is an onset when its flux exceeds the running
+ * mean plus three mean deviations plus MIC_BEAT_MIN_FLUX_X100, at most one per
+ * MIC_BEAT_REFRACT_MS.
+ *
+ * Tempo: every onset votes with its intervals to the previous MIC_BEAT_ONSETS onsets
+ * (and their halves, thirds and quarters) into a period histogram that decays by 1/8
+ * per onset. Its peak sets the period of a flywheel that ticks the beats; an onset
+ * within a quarter period of a beat pulls the flywheel toward it, and one that comes
+ * early fires the beat at once. The flux of each onset also goes into a histogram of
+ * where onsets fall within the beat: when another phase clearly outweighs the beat
+ * (the tracker sits on the off-beats), the flywheel moves there. Until there is a tempo
+ * every onset counts as a beat.
+ */
+#define MIC_BEAT_BANDS          3u
+#define MIC_BEAT_LAG            2u      /* frames: the first one without overlap at 50% */
+#define MIC_BEAT_ONSETS         8u
+#define MIC_BEAT_BPM_MIN        60u
+#define MIC_BEAT_BPM_MAX        180u
+#define MIC_BEAT_BIN_MS         8u
+#define MIC_BEAT_PERIOD_MIN_MS  (60000u / MIC_BEAT_BPM_MAX)
+#define MIC_BEAT_PERIOD_MAX_MS  (60000u / MIC_BEAT_BPM_MIN)
+#define MIC_BEAT_BINS           ((MIC_BEAT_PERIOD_MAX_MS - MIC_BEAT_PERIOD_MIN_MS) / MIC_BEAT_BIN_MS + 1u)
+#define MIC_BEAT_PHASES         8u
+
+#ifndef MIC_BEAT_REFRACT_MS
+#define MIC_BEAT_REFRACT_MS     100u
+#endif
+#ifndef MIC_BEAT_MIN_FLUX_X100
+#define MIC_BEAT_MIN_FLUX_X100  500
+#endif
+/* Band levels are clamped here, so changes in the noise below do not count. */
+#ifndef MIC_BEAT_FLOOR_X100
+#define MIC_BEAT_FLOOR_X100     (-7000)
+#endif
+/* Histogram score (peak bin twice plus its neighbours) needed to set a tempo. */
+#ifndef MIC_BEAT_MIN_SCORE
+#define MIC_BEAT_MIN_SCORE      16u
+#endif
+/* No onset for this long: tempo and histogram are dropped. */
+#ifndef MIC_BEAT_LOST_MS
+#define MIC_BEAT_LOST_MS        4000u
+#endif
+
+typedef struct
+{
+    uint32_t t_ms;                      /* stream time of the last frame */
+    uint32_t t_frac;                    /* its fraction, Q16 */
+    uint32_t frame_q16;                 /* frame step, ms Q16 */
+    int16_t  lvl[MIC_BEAT_LAG][MIC_BEAT_BANDS];     /* levels of the last frames, dB*100 */
+    uint8_t  lvl_pos;
+    uint8_t  warm;                      /* frames left before onsets are reported */
+    uint8_t  onset_n, onset_pos;
+    int32_t  flux;                      /* onset function of the last frame, dB*100 */
+    int32_t  mean_x16, dev_x16;         /* its running mean and mean deviation, x16 */
+    uint32_t onset_ms[MIC_BEAT_ONSETS];
+    uint32_t onset_last_ms;
+    uint16_t hist[MIC_BEAT_BINS];
+    uint16_t phase[MIC_BEAT_PHASES];    /* onset flux by phase, bin 0 centred on the beat */
+    uint32_t period_ms;                 /* 0 = no tempo */
+    uint32_t beat_ms;                   /* last beat */
+    uint32_t next_ms;                   /* next flywheel beat */
+    uint32_t onsets, beats;             /* counters, kept across MIC_DSP_BeatReset */
+} mic_beat_det_t;
+
+/* MIC_DSP_BeatFrame result flags. */
+#define MIC_BEAT_ONSET          0x01u
+#define MIC_BEAT_BEAT           0x02u
+
+/* Start on a new stream of frames, frame_q16 ms (Q16) apart. */
+void MIC_DSP_BeatReset(mic_beat_det_t *d, uint32_t frame_q16);
+
+/* One frame of MIC_BEAT_BANDS levels in dB*100; returns MIC_BEAT_ONSET | MIC_BEAT_BEAT. */
+uint32_t MIC_DSP_BeatFrame(mic_beat_det_t *d, const int32_t *lvl_x100);
+
+/* 10*log10(sum / n / 2^frac_bits) in dB*100, floor MIC_DSP_DB_FLOOR_X100. */
+int32_t MIC_DSP_PowerDbX100(uint64_t sum, uint32_t n, int32_t frac_bits);
+
+/* Window level in dBFS*100 (floor MIC_DSP_DB_FLOOR_X100), uncalibrated. */
+int32_t MIC_DSP_EnergyDbX100(const mic_energy_t *e);
+
+/* Window RMS (0..1, full scale = 1) and peak, for diagnostics and calibration. */
+float MIC_DSP_EnergyRms(const mic_energy_t *e);
+float MIC_DSP_EnergyPeak(const mic_energy_t *e);
+
+/* RMS or peak >= 0.98 full scale: DATA stuck or wrong clock/polarity. */
+uint8_t MIC_DSP_EnergySaturated(const mic_energy_t *e);
+
+/* log2(v) in Q16 (v > 0), error < 0.0001. */
+int32_t MIC_DSP_Log2Q16(uint64_t v);
+
+/* floor(sqrt(v)). */
+uint32_t MIC_DSP_ISqrt64(uint64_t v);
+
+#endif /* PROJECT_DRV_MIC_DSP_H_ */
@@ -1,7 +1,11 @@
 /*
- * mp_buttons.c - Simple debounced button events (short/long press).
+ * mp_buttons.c - Debounced button events (clicks, multi-clicks, hold repeat, long press).
  *
- * Reads B1/B2/BL GPIOs (active-high) and exposes short/long press events.
+ * Two single-producer/single-consumer rings:
+ *   edges:  EXTI callback -> MP_Buttons_Tick (SysTick)
+ *   events: MP_Buttons_Tick -> MP_Buttons_Pop (main loop)
+ * B1 and B2 share EXTI priority, so their callbacks never preempt each other and act as
+ * one producer. Buttons are active-high.
  * This module does not start programs or interact with MiniPascal state.
  */
 
@@ -9,116 +13,262 @@
 #include "main.h"
 #include "stm32u0xx_hal.h"
 
-#define EVT_B1 (1u << 0)
-#define EVT_B2 (1u << 1)
-#define EVT_BL (1u << 2)
+#define BTN_COUNT           3u
+#define EDGE_MASK           (MP_BTN_EDGE_QLEN - 1u)
+#define EVENT_MASK          (MP_BTN_EVENT_QLEN - 1u)
+
+#define BTN_F_HELD          0x01u   /* hold repeat fired during this press */
+#define BTN_F_SUPPRESS      0x02u   /* press consumed elsewhere: report nothing for it */
+
+typedef struct
+{
+    uint32_t t_ms;
+    uint8_t  id;
+    uint8_t  level;
+} mp_btn_edge_t;
 
 typedef struct
 {
-    uint8_t raw;
-    uint8_t stable;
-    uint32_t change_ms;
+    uint8_t  raw;
+    uint8_t  stable;
+    uint8_t  clicks;        /* completed clicks waiting for the gap to close */
+    uint8_t  flags;
+    uint32_t change_ms;     /* last raw edge */
     uint32_t press_ms;
+    uint32_t release_ms;
+    uint32_t repeat_ms;     /* next hold repeat due */
 } mp_btn_t;
 
-static mp_btn_t s_b1;
-static mp_btn_t s_b2;
-static mp_btn_t s_bl;
+static mp_btn_t s_btn[BTN_COUNT];
+static volatile uint8_t s_ready;    /* SysTick and EXTI run before MP_Buttons_Init() */
 
-static uint8_t s_short_events;
-static uint8_t s_long_events;
+static mp_btn_edge_t s_edge_q[MP_BTN_EDGE_QLEN];
+static volatile uint8_t s_edge_head;
+static volatile uint8_t s_edge_tail;
+static volatile uint8_t s_edge_lost;
+static uint8_t s_edge_lost_seen;
 
-static uint8_t btn_update(mp_btn_t *b, uint8_t raw, uint32_t now_ms)
+static mp_btn_event_t s_event_q[MP_BTN_EVENT_QLEN];
+static volatile uint8_t s_event_head;
+static volatile uint8_t s_event_tail;
+static volatile uint32_t s_event_dropped;
+
+static uint8_t pin_level(mp_btn_id_t id)
 {
-    if (!b) return 0u;
-    if (raw != b->raw)
+    switch (id)
     {
-        b->raw = raw;
-        b->change_ms = now_ms;
+        case MP_BTN_B1: return (uint8_t)(HAL_GPIO_ReadPin(B1_GPIO_Port, B1_Pin) == GPIO_PIN_SET);
+        case MP_BTN_B2: return (uint8_t)(HAL_GPIO_ReadPin(B2_GPIO_Port, B2_Pin) == GPIO_PIN_SET);
+        case MP_BTN_BL: return (uint8_t)(HAL_GPIO_ReadPin(BL_GPIO_Port, BL_Pin) == GPIO_PIN_SET);
+        default: return 0u;
     }
+}
 
-    if (((uint32_t)(now_ms - b->change_ms) >= MP_BTN_DEBOUNCE_MS) && (b->stable != b->raw))
+void MP_Buttons_Init(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t now = HAL_GetTick();
+    for (uint8_t i = 0; i < BTN_COUNT; i++)
     {
-        b->stable = b->raw;
-        if (b->stable)
-            b->press_ms = now_ms;
-        return 1u;
+        s_btn[i] = (mp_btn_t){0};
+        /* A button held through reset is not a press. */
+        s_btn[i].raw = pin_level((mp_btn_id_t)(i + 1u));
+        s_btn[i].stable = s_btn[i].raw;
+        s_btn[i].change_ms = now;
+        if (s_btn[i].stable) s_btn[i].flags = BTN_F_SUPPRESS;
     }
-    return 0u;
+    s_edge_head = s_edge_tail = 0u;
+    s_edge_lost = s_edge_lost_seen = 0u;
+    s_event_head = s_event_tail = 0u;
+    s_event_dropped = 0u;
+    s_ready = 1u;
+    __set_PRIMASK(primask);
 }
 
-void MP_Buttons_Init(void)
+void MP_Buttons_OnEdge(uint16_t gpio_pin)
 {
-    s_b1 = (mp_btn_t){0};
-    s_b2 = (mp_btn_t){0};
-    s_bl = (mp_btn_t){0};
-    s_short_events = 0u;
-    s_long_events = 0u;
+    mp_btn_id_t id;
+    if (!s_ready) return;
+    if (gpio_pin == B1_Pin) id = MP_BTN_B1;
+    else if (gpio_pin == B2_Pin) id = MP_BTN_B2;
+    else return;
+
+    uint8_t head = s_edge_head;
+    if ((uint8_t)(head - s_edge_tail) >= MP_BTN_EDGE_QLEN)
+    {
+        s_edge_lost++;
+        return;
+    }
+
+    /* Level read here rather than taken from the edge type: if both edges are pending
+     * in one IRQ the HAL reports rising first, which may not be the real order. */
+    mp_btn_edge_t *e = &s_edge_q[head & EDGE_MASK];
+    e->t_ms = HAL_GetTick();
+    e->id = (uint8_t)id;
+    e->level = pin_level(id);
+    __DMB();
+    s_edge_head = (uint8_t)(head + 1u);
 }
 
-static void push_short(mp_btn_id_t id)
+static void push_event(uint8_t id, uint8_t kind, uint32_t t_ms)
 {
-    switch (id)
+    uint8_t head = s_event_head;
+    if ((uint8_t)(head - s_event_tail) >= MP_BTN_EVENT_QLEN)
     {
-        case MP_BTN_B1: s_short_events |= EVT_B1; break;
-        case MP_BTN_B2: s_short_events |= EVT_B2; break;
-        case MP_BTN_BL: s_short_events |= EVT_BL; break;
-        default: break;
+        s_event_dropped++;
+        return;
     }
+    mp_btn_event_t *ev = &s_event_q[head & EVENT_MASK];
+    ev->t_ms = t_ms;
+    ev->id = id;
+    ev->kind = kind;
+    __DMB();
+    s_event_head = (uint8_t)(head + 1u);
 }
 
-static void push_long(mp_btn_id_t id)
+/* Report the open click sequence (1..2 clicks; the third is reported immediately). */
+static void flush_clicks(uint8_t id, mp_btn_t *b)
 {
-    switch (id)
+    if (b->clicks == 0u) return;
+    push_event(id, (uint8_t)(MP_BTN_EV_SHORT + b->clicks - 1u), b->release_ms);
+    b->clicks = 0u;
+}
+
+static void on_press(uint8_t id, mp_btn_t *b, uint32_t t_ms)
+{
+    if (b->clicks && (uint32_t)(t_ms - b->release_ms) > MP_BTN_CLICK_GAP_MS)
+        flush_clicks(id, b);
+    b->press_ms = t_ms;
+    b->repeat_ms = t_ms + MP_BTN_REPEAT_START_MS;
+    b->flags &= BTN_F_SUPPRESS;
+}
+
+static void on_release(uint8_t id, mp_btn_t *b, uint32_t t_ms)
+{
+    uint8_t flags = b->flags;
+    b->flags = 0u;
+    if (flags & BTN_F_SUPPRESS) return;
+
+    if ((uint32_t)(t_ms - b->press_ms) >= MP_BTN_LONG_MS)
     {
-        case MP_BTN_B1: s_long_events |= EVT_B1; break;
-        case MP_BTN_B2: s_long_events |= EVT_B2; break;
-        case MP_BTN_BL: s_long_events |= EVT_BL; break;
-        default: break;
+        flush_clicks(id, b);
+        push_event(id, MP_BTN_EV_LONG, t_ms);
+        return;
     }
+    if (flags & BTN_F_HELD) return;
+
+    b->clicks++;
+    b->release_ms = t_ms;
+    if (b->clicks >= 3u || MP_BTN_CLICK_GAP_MS == 0u)
+        flush_clicks(id, b);
 }
 
-static void handle_release(mp_btn_id_t id, mp_btn_t *b, uint32_t now_ms)
+static void btn_service(uint8_t id, mp_btn_t *b, uint32_t now_ms)
 {
-    if (!b || b->press_ms == 0u) return;
-
-    uint32_t dur = (uint32_t)(now_ms - b->press_ms);
-    if (dur >= MP_BTN_LONG_MS) push_long(id);
-    else push_short(id);
+    /* Debounced edges are timestamped with the raw edge, not with the end of the debounce. */
+    if (b->stable != b->raw && (uint32_t)(now_ms - b->change_ms) >= MP_BTN_DEBOUNCE_MS)
+    {
+        b->stable = b->raw;
+        if (b->stable) on_press(id, b, b->change_ms);
+        else on_release(id, b, b->change_ms);
+    }
 
-    b->press_ms = 0u;
+    if (b->stable)
+    {
+        if ((b->flags & BTN_F_SUPPRESS) == 0u && (int32_t)(now_ms - b->repeat_ms) >= 0)
+        {
+            flush_clicks(id, b);
+            push_event(id, MP_BTN_EV_REPEAT, now_ms);
+            b->repeat_ms += MP_BTN_REPEAT_MS;
+            b->flags |= BTN_F_HELD;
+        }
+    }
+    else if (b->clicks && !b->raw && (uint32_t)(now_ms - b->release_ms) >= MP_BTN_CLICK_GAP_MS)
+    {
+        flush_clicks(id, b);
+    }
 }
 
-void MP_Buttons_Poll(uint32_t now_ms)
+void MP_Buttons_Tick(uint32_t now_ms)
 {
-    uint8_t raw_b1 = (uint8_t)(HAL_GPIO_ReadPin(B1_GPIO_Port, B1_Pin) == GPIO_PIN_SET);
-    uint8_t raw_b2 = (uint8_t)(HAL_GPIO_ReadPin(B2_GPIO_Port, B2_Pin) == GPIO_PIN_SET);
-    uint8_t raw_bl = (uint8_t)(HAL_GPIO_ReadPin(BL_GPIO_Port, BL_Pin) == GPIO_PIN_SET);
+    if (!s_ready) return;
+    uint8_t tail = s_edge_tail;
+    while (tail != s_edge_head)
+    {
+        const mp_btn_edge_t *e = &s_edge_q[tail & EDGE_MASK];
+        mp_btn_t *b = &s_btn[e->id - 1u];
+        b->raw = e->level;
+        b->change_ms = e->t_ms;
+        tail++;
+    }
+    s_edge_tail = tail;
 
-    (void)btn_update(&s_b1, raw_b1, now_ms);
-    (void)btn_update(&s_b2, raw_b2, now_ms);
-    (void)btn_update(&s_bl, raw_bl, now_ms);
+    if (s_edge_lost != s_edge_lost_seen)
+    {
+        /* Edges were dropped: trust the pins. */
+        s_edge_lost_seen = s_edge_lost;
+        for (uint8_t i = 0; i < 2u; i++)
+        {
+            uint8_t lvl = pin_level((mp_btn_id_t)(i + 1u));
+            if (lvl != s_btn[i].raw)
+            {
+                s_btn[i].raw = lvl;
+                s_btn[i].change_ms = now_ms;
+            }
+        }
+    }
 
-    if (!s_b1.stable) handle_release(MP_BTN_B1, &s_b1, now_ms);
-    if (!s_b2.stable) handle_release(MP_BTN_B2, &s_b2, now_ms);
-    if (!s_bl.stable) handle_release(MP_BTN_BL, &s_bl, now_ms);
+    mp_btn_t *bl = &s_btn[MP_BTN_BL - 1u];
+    uint8_t lvl = pin_level(MP_BTN_BL);
+    if (lvl != bl->raw)
+    {
+        bl->raw = lvl;
+        bl->change_ms = now_ms;
+    }
+
+    for (uint8_t i = 0; i < BTN_COUNT; i++)
+        btn_service((uint8_t)(i + 1u), &s_btn[i], now_ms);
+}
+
+uint8_t MP_Buttons_Pop(mp_btn_event_t *ev)
+{
+    uint8_t tail = s_event_tail;
+    if (tail == s_event_head) return 0u;
+    if (ev) *ev = s_event_q[tail & EVENT_MASK];
+    __DMB();
+    s_event_tail = (uint8_t)(tail + 1u);
+    return 1u;
 }
 
-mp_btn_id_t MP_Buttons_PopShort(void)
+uint8_t MP_Buttons_Busy(void)
 {
-    uint8_t e = s_short_events;
-    if (e & EVT_B1) { s_short_events = (uint8_t)(e & (uint8_t)~EVT_B1); return MP_BTN_B1; }
-    if (e & EVT_B2) { s_short_events = (uint8_t)(e & (uint8_t)~EVT_B2); return MP_BTN_B2; }
-    if (e & EVT_BL) { s_short_events = (uint8_t)(e & (uint8_t)~EVT_BL); return MP_BTN_BL; }
-    return MP_BTN_NONE;
+    if (s_edge_head != s_edge_tail) return 1u;
+    for (uint8_t i = 0; i < BTN_COUNT; i++)
+    {
+        const mp_btn_t *b = &s_btn[i];
+        if (b->raw || b->stable || b->clicks) return 1u;
+    }
+    return 0u;
 }
 
-mp_btn_id_t MP_Buttons_PopLong(void)
+void MP_Buttons_Discard(void)
 {
-    uint8_t e = s_long_events;
-    if (e & EVT_B1) { s_long_events = (uint8_t)(e & (uint8_t)~EVT_B1); return MP_BTN_B1; }
-    if (e & EVT_B2) { s_long_events = (uint8_t)(e & (uint8_t)~EVT_B2); return MP_BTN_B2; }
-    if (e & EVT_BL) { s_long_events = (uint8_t)(e & (uint8_t)~EVT_BL); return MP_BTN_BL; }
-    return MP_BTN_NONE;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    s_event_tail = s_event_head;
+    /* Edges stay queued so the debouncer keeps tracking the pins; a press whose edge
+     * has not been drained yet is caught by reading the pin. */
+    for (uint8_t i = 0; i < BTN_COUNT; i++)
+    {
+        mp_btn_t *b = &s_btn[i];
+        b->clicks = 0u;
+        if (b->raw || b->stable || pin_level((mp_btn_id_t)(i + 1u))) b->flags |= BTN_F_SUPPRESS;
+    }
+    __set_PRIMASK(primask);
 }
 
+uint32_t MP_Buttons_Dropped(void)
+{
+    return s_event_dropped;
+}
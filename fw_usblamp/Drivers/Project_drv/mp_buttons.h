@@ -1,9 +1,15 @@
 /*
- * mp_buttons.h - Simple debounced button events (short/long press).
+ * mp_buttons.h - Debounced button events (clicks, multi-clicks, hold repeat, long press).
  *
- * Produces release-based events:
- * - Short press event on release if held < long_ms.
- * - Long press event on release if held >= long_ms.
+ * B1/B2 are captured by EXTI on both edges (MP_Buttons_OnEdge from the EXTI callback)
+ * into a lock-free ring together with the HAL tick. MP_Buttons_Tick (SysTick, 1 ms)
+ * drains that ring, samples BL (PF3 shares EXTI line 3 with USB detect, so it has no
+ * interrupt of its own), debounces and classifies:
+ * - SHORT/DOUBLE/TRIPLE after the release, once MP_BTN_CLICK_GAP_MS passes without
+ *   another press (a third click is reported at once).
+ * - REPEAT every MP_BTN_REPEAT_MS while held past MP_BTN_REPEAT_START_MS.
+ * - LONG on release if held >= MP_BTN_LONG_MS.
+ * Events come out of MP_Buttons_Pop in the order they happened.
  */
 
 #pragma once
@@ -13,6 +19,27 @@
 #define MP_BTN_DEBOUNCE_MS 30u
 #define MP_BTN_LONG_MS     2000u
 
+/* Max gap between the release of one click and the next press of a multi-click (0 = off). */
+#ifndef MP_BTN_CLICK_GAP_MS
+#define MP_BTN_CLICK_GAP_MS     250u
+#endif
+
+/* Hold repeat: first REPEAT after this hold time, then every MP_BTN_REPEAT_MS. */
+#ifndef MP_BTN_REPEAT_START_MS
+#define MP_BTN_REPEAT_START_MS  600u
+#endif
+#ifndef MP_BTN_REPEAT_MS
+#define MP_BTN_REPEAT_MS        200u
+#endif
+
+/* Ring sizes (powers of two). */
+#ifndef MP_BTN_EDGE_QLEN
+#define MP_BTN_EDGE_QLEN        16u
+#endif
+#ifndef MP_BTN_EVENT_QLEN
+#define MP_BTN_EVENT_QLEN       16u
+#endif
+
 typedef enum
 {
     MP_BTN_NONE = 0,
@@ -21,8 +48,41 @@ typedef enum
     MP_BTN_BL   = 3,
 } mp_btn_id_t;
 
+typedef enum
+{
+    MP_BTN_EV_SHORT  = 0,
+    MP_BTN_EV_DOUBLE = 1,
+    MP_BTN_EV_TRIPLE = 2,
+    MP_BTN_EV_REPEAT = 3,
+    MP_BTN_EV_LONG   = 4,
+} mp_btn_kind_t;
+
+typedef struct
+{
+    uint32_t t_ms;      /* HAL tick of the edge that completed the event */
+    uint8_t  id;        /* mp_btn_id_t */
+    uint8_t  kind;      /* mp_btn_kind_t */
+} mp_btn_event_t;
+
 void MP_Buttons_Init(void);
-void MP_Buttons_Poll(uint32_t now_ms);
-mp_btn_id_t MP_Buttons_PopShort(void);
-mp_btn_id_t MP_Buttons_PopLong(void);
 
+/* EXTI context: GPIO_Pin of a B1/B2 edge (other pins are ignored). */
+void MP_Buttons_OnEdge(uint16_t gpio_pin);
+
+/* SysTick context, once per ms. */
+void MP_Buttons_Tick(uint32_t now_ms);
+
+/* Main loop: next event in order; 0 when the queue is empty. */
+uint8_t MP_Buttons_Pop(mp_btn_event_t *ev);
+
+/*
+ * Nonzero while a press is in progress (held, bouncing or a multi-click still open).
+ * Low-power waits must keep SysTick running (no STOP2) until it clears.
+ */
+uint8_t MP_Buttons_Busy(void);
+
+/* Drop queued events and report nothing for presses in progress right now. */
+void MP_Buttons_Discard(void);
+
+/* Events lost because the event queue was full (diagnostics). */
+uint32_t MP_Buttons_Dropped(void);
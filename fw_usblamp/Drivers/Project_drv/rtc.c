@@ -5,6 +5,8 @@
 
 #include "rtc.h"
 #include "main.h"
+#include "settings.h"
+#include "fmt.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -53,7 +55,7 @@ HAL_StatusTypeDef RTC_ReadClock(char *datetime_str)
     }
     
     /* Format: "HH:MM:SS_YY.MM.DD". */
-    snprintf(datetime_str, RTC_DATETIME_STRING_SIZE,
+    FMT_SNPrintf(datetime_str, RTC_DATETIME_STRING_SIZE,
              "%02d:%02d:%02d_%02d.%02d.%02d",
              sTime.Hours,
              sTime.Minutes,
@@ -147,7 +149,7 @@ void RTC_WriteTimeYMDHM(rtc_write_fn_t write)
     }
 
     char buf[32];
-    snprintf(buf, sizeof(buf), "%02d,%02d,%02d,%02d,%02d\r\n", yy, mo, dd, hh, mm);
+    FMT_SNPrintf(buf, sizeof(buf), "%02d,%02d,%02d,%02d,%02d\r\n", yy, mo, dd, hh, mm);
     write(buf);
 }
 
@@ -225,7 +227,12 @@ HAL_StatusTypeDef RTC_SetDailyAlarm(uint8_t hh, uint8_t mm, uint8_t duration_sec
 {
     if (duration_sec == 0)
     {
-        return RTC_SetAlarm("0", 0, 0);
+        HAL_StatusTypeDef off = RTC_SetAlarm("0", 0, 0);
+        if (off == HAL_OK)
+        {
+            (void)SETTINGS_Set(SET_ALARM, 0);
+        }
+        return off;
     }
 
     if (hh > 23 || mm > 59 || duration_sec > 255)
@@ -276,7 +283,7 @@ HAL_StatusTypeDef RTC_SetDailyAlarm(uint8_t hh, uint8_t mm, uint8_t duration_sec
     }
 
     char buf[RTC_ALARM_STRING_SIZE];
-    snprintf(buf, sizeof(buf), "%02u:%02u:%02u", ah, am, as);
+    FMT_SNPrintf(buf, sizeof(buf), "%02u:%02u:%02u", ah, am, as);
     HAL_StatusTypeDef st = RTC_SetAlarm(buf, duration_sec, 1); /* callback_interval ignored */
     if (st != HAL_OK)
     {
@@ -284,9 +291,23 @@ HAL_StatusTypeDef RTC_SetDailyAlarm(uint8_t hh, uint8_t mm, uint8_t duration_sec
         alarm_cfg_valid = 0;
         alarm_cfg_duration = 0;
     }
+    else
+    {
+        (void)SETTINGS_Set(SET_ALARM, ((int32_t)duration_sec << 16) | ((int32_t)hh << 8) | (int32_t)mm);
+    }
     return st;
 }
 
+HAL_StatusTypeDef RTC_RestoreDailyAlarm(void)
+{
+    int32_t v = 0;
+    if (!SETTINGS_Get(SET_ALARM, &v) || v == 0)
+    {
+        return HAL_OK;
+    }
+    return RTC_SetDailyAlarm((uint8_t)((v >> 8) & 0xFF), (uint8_t)(v & 0xFF), (uint8_t)((v >> 16) & 0xFF));
+}
+
 HAL_StatusTypeDef RTC_GetDailyAlarm(uint8_t *hh, uint8_t *mm, uint8_t *duration_sec)
 {
     if (hh == NULL || mm == NULL || duration_sec == NULL)
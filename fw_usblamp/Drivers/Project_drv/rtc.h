@@ -34,6 +34,9 @@ HAL_StatusTypeDef RTC_SetAlarm(const char *alarm_str, uint8_t duration_sec, uint
 HAL_StatusTypeDef RTC_SetDailyAlarm(uint8_t hh, uint8_t mm, uint8_t duration_sec);
 HAL_StatusTypeDef RTC_GetDailyAlarm(uint8_t *hh, uint8_t *mm, uint8_t *duration_sec);
 
+/* Re-arm the daily alarm stored in the settings store (call once at boot, after SETTINGS_Init()). */
+HAL_StatusTypeDef RTC_RestoreDailyAlarm(void);
+
 /* Alarm active flag (1 when alarm beeping/running, 0 otherwise) */
 extern volatile uint8_t RTC_AlarmTrigger;
 
@@ -0,0 +1,306 @@
+/*
+ * settings.c - persistent key/value settings (append-only log in flash).
+ *
+ * Page layout (SETTINGS_PAGE_SIZE):
+ *   DW0     header {magic, seq}  - programmed last when a page is (re)built
+ *   DW1..   records {key, ~key, crc16, value}, appended in order, newest wins
+ *   0xFF..  free space
+ * The valid page with the highest seq is active. A torn record (power loss while
+ * programming) fails its crc and is skipped.
+ */
+
+#include "settings.h"
+#include "crc32.h"
+#include "fmt.h"
+#include "MiniPascal.h"
+
+#include <string.h>
+
+#include "stm32u0xx_hal.h"
+
+extern const uint32_t __settings_start__;
+extern const uint32_t __settings_end__;
+
+#define SETTINGS_MAGIC      0x31544553u /* 'SET1' */
+#define SETTINGS_REC_SIZE   8u
+#define SETTINGS_RECS       ((SETTINGS_PAGE_SIZE / SETTINGS_REC_SIZE) - 1u)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+} settings_hdr_t;
+
+typedef struct
+{
+    uint8_t  key;
+    uint8_t  key_inv;
+    uint16_t crc;
+    int32_t  value;
+} settings_rec_t;
+
+static const char *const s_key_names[SET_COUNT] = {
+    "",
+    "miccal",
+    "alarm",
+    "bright",
+    "slot",
+};
+
+/* RAM index: newest value of every key. */
+static int32_t  s_val[SET_COUNT];
+static uint32_t s_have;             /* bit per key */
+static uint8_t  s_page;             /* active page 0..SETTINGS_PAGES-1 */
+static uint32_t s_seq;
+static uint16_t s_next;             /* next free record index on the active page */
+static uint8_t  s_ready;
+
+uint32_t SETTINGS_AreaStart(void)
+{
+    return (uint32_t)&__settings_start__;
+}
+
+static uint32_t page_addr(uint8_t page)
+{
+    return SETTINGS_AreaStart() + (uint32_t)page * SETTINGS_PAGE_SIZE;
+}
+
+static uint32_t rec_addr(uint8_t page, uint16_t idx)
+{
+    return page_addr(page) + SETTINGS_REC_SIZE * (1u + (uint32_t)idx);
+}
+
+static uint16_t rec_crc(uint8_t key, int32_t value)
+{
+    uint8_t b[5] = { key, (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    return (uint16_t)CRC32_Calc(b, sizeof(b));
+}
+
+static bool dw_is_blank(uint32_t addr)
+{
+    const uint32_t *w = (const uint32_t *)addr;
+    return (w[0] == 0xFFFFFFFFu) && (w[1] == 0xFFFFFFFFu);
+}
+
+static bool page_header(uint32_t page_base, uint32_t *seq_out)
+{
+    const settings_hdr_t *h = (const settings_hdr_t *)page_base;
+    if (h->magic != SETTINGS_MAGIC) return false;
+    if (seq_out) *seq_out = h->seq;
+    return true;
+}
+
+/* Active page: valid header, highest seq. */
+static bool find_active(uint8_t *page_out, uint32_t *seq_out)
+{
+    bool found = false;
+    for (uint8_t p = 0; p < SETTINGS_PAGES; p++)
+    {
+        uint32_t seq = 0;
+        if (!page_header(page_addr(p), &seq)) continue;
+        if (!found || seq > *seq_out)
+        {
+            found = true;
+            *page_out = p;
+            *seq_out = seq;
+        }
+    }
+    return found;
+}
+
+/* One pass over a page: newest record of each key wins. Returns the first free index. */
+static uint16_t page_load(uint32_t page_base)
+{
+    uint16_t i = 0;
+    for (; i < SETTINGS_RECS; i++)
+    {
+        uint32_t a = page_base + SETTINGS_REC_SIZE * (1u + (uint32_t)i);
+        if (dw_is_blank(a)) break;
+        const settings_rec_t *r = (const settings_rec_t *)a;
+        if (r->key == 0u || r->key >= SET_COUNT) continue;
+        if (r->key_inv != (uint8_t)~r->key) continue;
+        if (r->crc != rec_crc(r->key, r->value)) continue;
+        s_val[r->key] = r->value;
+        s_have |= (1u << r->key);
+    }
+    return i;
+}
+
+static bool flash_write_dw(uint32_t addr, const void *src)
+{
+    uint64_t dw;
+    memcpy(&dw, src, sizeof(dw));
+    return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, dw) == HAL_OK);
+}
+
+static bool flash_erase_settings_page(uint8_t page)
+{
+    uint32_t addr = page_addr(page);
+    bool blank = true;
+    for (uint32_t off = 0; off < SETTINGS_PAGE_SIZE && blank; off += 8u)
+        blank = dw_is_blank(addr + off);
+    if (blank) return true;
+
+    FLASH_EraseInitTypeDef ei;
+    memset(&ei, 0, sizeof(ei));
+    uint32_t page_error = 0;
+    ei.TypeErase = FLASH_TYPEERASE_PAGES;
+    ei.Page = (addr - FLASH_BASE) / SETTINGS_PAGE_SIZE;
+    ei.NbPages = 1;
+    return (HAL_FLASHEx_Erase(&ei, &page_error) == HAL_OK);
+}
+
+static bool write_rec(uint8_t page, uint16_t idx, uint8_t key, int32_t value)
+{
+    settings_rec_t r;
+    r.key = key;
+    r.key_inv = (uint8_t)~key;
+    r.crc = rec_crc(key, value);
+    r.value = value;
+    return flash_write_dw(rec_addr(page, idx), &r);
+}
+
+/*
+ * Rebuild the store on the next page in rotation: erase it, copy the RAM index,
+ * then program the header. Until the header lands the old page stays active.
+ */
+static bool settings_compact(void)
+{
+    uint8_t page = (uint8_t)((s_page + 1u) % SETTINGS_PAGES);
+    if (!s_ready) page = 0u;
+
+    mp_flash_clear_errors();
+    if (HAL_FLASH_Unlock() != HAL_OK) return false;
+
+    bool ok = flash_erase_settings_page(page);
+    uint16_t n = 0;
+    for (uint8_t k = 1; k < SET_COUNT && ok; k++)
+    {
+        if ((s_have & (1u << k)) == 0u) continue;
+        ok = write_rec(page, n++, k, s_val[k]);
+    }
+
+    settings_hdr_t h;
+    h.magic = SETTINGS_MAGIC;
+    h.seq = s_seq + 1u;
+    if (ok) ok = flash_write_dw(page_addr(page), &h);
+    (void)HAL_FLASH_Lock();
+
+    if (!ok) return false;
+    s_page = page;
+    s_seq = h.seq;
+    s_next = n;
+    s_ready = 1u;
+    return true;
+}
+
+void SETTINGS_Init(void)
+{
+    memset(s_val, 0, sizeof(s_val));
+    s_have = 0u;
+    s_ready = 0u;
+    s_seq = 0u;
+    s_next = 0u;
+
+    /* A linker script without the full SETTINGS region: run from RAM defaults only. */
+    if (((uint32_t)&__settings_end__ - SETTINGS_AreaStart()) < SETTINGS_AREA_SIZE)
+        return;
+
+    if (!find_active(&s_page, &s_seq))
+    {
+        /* First boot: the region only ever holds the store, so formatting it loses nothing. */
+        (void)settings_compact();   /* formats page 0 */
+        return;
+    }
+
+    s_next = page_load(page_addr(s_page));
+    s_ready = 1u;
+}
+
+bool SETTINGS_Get(settings_key_t key, int32_t *out)
+{
+    if (key <= SET_NONE || key >= SET_COUNT) return false;
+    if ((s_have & (1u << key)) == 0u) return false;
+    if (out) *out = s_val[key];
+    return true;
+}
+
+int32_t SETTINGS_GetOr(settings_key_t key, int32_t def)
+{
+    int32_t v = def;
+    (void)SETTINGS_Get(key, &v);
+    return v;
+}
+
+bool SETTINGS_Set(settings_key_t key, int32_t value)
+{
+    if (key <= SET_NONE || key >= SET_COUNT) return false;
+    if ((s_have & (1u << key)) != 0u && s_val[key] == value) return true;
+
+    s_val[key] = value;
+    s_have |= (1u << key);
+
+    if (!s_ready || s_next >= SETTINGS_RECS)
+        return settings_compact();
+
+    mp_flash_clear_errors();
+    if (HAL_FLASH_Unlock() != HAL_OK) return false;
+    bool ok = write_rec(s_page, s_next, (uint8_t)key, value);
+    (void)HAL_FLASH_Lock();
+
+    /* Skip the slot even on failure: a half-programmed double word cannot be reused. */
+    s_next++;
+    return ok;
+}
+
+bool SETTINGS_Erase(void)
+{
+    s_have = 0u;
+    memset(s_val, 0, sizeof(s_val));
+    return settings_compact();
+}
+
+const char *SETTINGS_KeyName(settings_key_t key)
+{
+    if (key <= SET_NONE || key >= SET_COUNT) return "?";
+    return s_key_names[key];
+}
+
+settings_key_t SETTINGS_KeyByName(const char *name)
+{
+    if (name == NULL) return SET_NONE;
+    for (uint8_t k = 1; k < SET_COUNT; k++)
+    {
+        if (strcmp(name, s_key_names[k]) == 0) return (settings_key_t)k;
+    }
+    return SET_NONE;
+}
+
+void SETTINGS_WriteAll(settings_write_fn_t write)
+{
+    if (write == NULL) return;
+
+    char buf[64];
+    FMT_SNPrintf(buf, sizeof(buf), "CONFIG page=%u seq=%lu used=%u/%u\r\n",
+             (unsigned)s_page, (unsigned long)s_seq, (unsigned)s_next, (unsigned)SETTINGS_RECS);
+    write(buf);
+
+    for (uint8_t k = 1; k < SET_COUNT; k++)
+    {
+        int32_t v = 0;
+        if (!SETTINGS_Get((settings_key_t)k, &v))
+        {
+            FMT_SNPrintf(buf, sizeof(buf), "%s=(default)\r\n", s_key_names[k]);
+        }
+        else if (k == SET_ALARM)
+        {
+            FMT_SNPrintf(buf, sizeof(buf), "%s=%02u:%02u dur=%us\r\n", s_key_names[k],
+                     (unsigned)((v >> 8) & 0xFF), (unsigned)(v & 0xFF), (unsigned)((v >> 16) & 0xFF));
+        }
+        else
+        {
+            FMT_SNPrintf(buf, sizeof(buf), "%s=%ld\r\n", s_key_names[k], (long)v);
+        }
+        write(buf);
+    }
+}
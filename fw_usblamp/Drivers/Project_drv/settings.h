@@ -0,0 +1,62 @@
+/*
+ * settings.h - persistent key/value settings (append-only log in flash).
+ *
+ * The linker SETTINGS region (top of flash, above FLASH_DATA, so no program slot covers it) holds
+ * SETTINGS_PAGES pages with a small log of 8-byte records {key, ~key, crc16, int32 value}. SETTINGS_Init() scans the active page
+ * once at boot and keeps the newest value of every key in RAM; SETTINGS_Get() never
+ * touches flash. SETTINGS_Set() appends one record (only if the value changed); a full
+ * page is compacted into the next page in rotation (header written last).
+ */
+
+#ifndef PROJECT_DRV_SETTINGS_H_
+#define PROJECT_DRV_SETTINGS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Pages of the SETTINGS region in use (>= 2, rotated for wear leveling). */
+#ifndef SETTINGS_PAGES
+#define SETTINGS_PAGES      2u
+#endif
+
+#ifndef SETTINGS_PAGE_SIZE
+#define SETTINGS_PAGE_SIZE  2048u
+#endif
+
+#define SETTINGS_AREA_SIZE  (SETTINGS_PAGES * SETTINGS_PAGE_SIZE)
+
+typedef enum
+{
+    SET_NONE = 0,
+    SET_MIC_CAL_X100,   /* mic dB offset, centi-dB (MIC_CalSave/Load) */
+    SET_ALARM,          /* daily alarm: (duration_s << 16) | (hh << 8) | mm, 0 = off */
+    SET_BRIGHTNESS,     /* LED brightness scale 1..255 (255 = full) */
+    SET_DEFAULT_SLOT,   /* program slot used at boot/autorun, 0 = first non-empty */
+    SET_COUNT
+} settings_key_t;
+
+/* Scan flash and build the RAM index (call once, before drivers read their settings). */
+void SETTINGS_Init(void);
+
+/* Returns true and the stored value if the key has been set. */
+bool SETTINGS_Get(settings_key_t key, int32_t *out);
+int32_t SETTINGS_GetOr(settings_key_t key, int32_t def);
+
+/* Store a value (no flash write if unchanged). Blocking: one double word, or a page erase on compaction. */
+bool SETTINGS_Set(settings_key_t key, int32_t value);
+
+/* Forget all values (formats the active page). */
+bool SETTINGS_Erase(void);
+
+/* First byte of the settings area. */
+uint32_t SETTINGS_AreaStart(void);
+
+/* Key names used by the CONFIG command ("miccal", "alarm", "bright", "slot"). */
+const char *SETTINGS_KeyName(settings_key_t key);
+settings_key_t SETTINGS_KeyByName(const char *name);
+
+/* USB CLI helper: print store status and all keys. */
+typedef void (*settings_write_fn_t)(const char *s);
+void SETTINGS_WriteAll(settings_write_fn_t write);
+
+#endif /* PROJECT_DRV_SETTINGS_H_ */
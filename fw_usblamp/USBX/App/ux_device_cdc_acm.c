@@ -28,7 +28,12 @@
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-
+typedef struct
+{
+  const uint8_t        *buf;
+  uint32_t              len;
+  usbd_cdc_acm_tx_cb_t  done;
+} cdc_tx_desc_t;
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
@@ -44,6 +49,10 @@
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN PV */
 UX_SLAVE_CLASS_CDC_ACM  *cdc_acm=NULL;
+
+static cdc_tx_desc_t cdc_tx_q[USBD_CDC_ACM_TX_QUEUE];
+static uint8_t cdc_tx_head;
+static uint8_t cdc_tx_count;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -53,7 +62,25 @@ UX_SLAVE_CLASS_CDC_ACM  *cdc_acm=NULL;
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+static void cdc_tx_pop(uint32_t len, uint32_t status)
+{
+  cdc_tx_desc_t d = cdc_tx_q[cdc_tx_head];
+  cdc_tx_head = (uint8_t)((cdc_tx_head + 1U) % USBD_CDC_ACM_TX_QUEUE);
+  cdc_tx_count--;
+  if (d.done != NULL)
+  {
+    d.done(d.buf, (status == 0U) ? len : d.len, status);
+  }
+}
 
+/* Host gone: release every queued buffer to its owner. */
+static void cdc_tx_abort(void)
+{
+  while (cdc_tx_count != 0U)
+  {
+    cdc_tx_pop(0U, 1U);
+  }
+}
 /* USER CODE END 0 */
 
 /**
@@ -104,37 +131,64 @@ VOID USBD_CDC_ACM_ParameterChange(VOID *cdc_acm_instance)
 }
 
 /* USER CODE BEGIN 1 */
+uint32_t USBD_CDC_ACM_TxSubmit(const uint8_t* buffer, uint32_t size, usbd_cdc_acm_tx_cb_t done)
+{
+  if (cdc_acm == NULL)
+  {
+    cdc_tx_abort();
+    return 1; /* not connected */
+  }
+  if (cdc_tx_count >= USBD_CDC_ACM_TX_QUEUE)
+  {
+    return 2; /* queue full */
+  }
+
+  cdc_tx_desc_t *d = &cdc_tx_q[(cdc_tx_head + cdc_tx_count) % USBD_CDC_ACM_TX_QUEUE];
+  d->buf = buffer;
+  d->len = size;
+  d->done = done;
+  cdc_tx_count++;
+  return 0;
+}
+
+/*
+ * One step of the head transfer. The class keeps its own state between calls
+ * (copy to the endpoint buffer, wait for the IN token, next chunk), so WAIT/LOCK
+ * just means "call again on the next loop pass".
+ */
+void USBD_CDC_ACM_TxTask(void)
+{
+  if (cdc_tx_count == 0U)
+  {
+    return;
+  }
+  if (cdc_acm == NULL)
+  {
+    cdc_tx_abort();
+    return;
+  }
+
+  cdc_tx_desc_t *d = &cdc_tx_q[cdc_tx_head];
+  ULONG sent = 0;
+  UINT st = ux_device_class_cdc_acm_write_run(cdc_acm, (UCHAR *)d->buf, d->len, &sent);
+  if (st == UX_STATE_WAIT || st == UX_STATE_LOCK)
+  {
+    return;
+  }
+  cdc_tx_pop((uint32_t)sent, (st == UX_STATE_NEXT) ? 0U : 2U);
+}
+
+uint32_t USBD_CDC_ACM_TxPending(void)
+{
+  return cdc_tx_count;
+}
+
 uint32_t USBD_CDC_ACM_Transmit(uint8_t* buffer, uint32_t size, uint32_t* sent)
 {
-    if (sent) *sent = 0;
-    if (cdc_acm == NULL)
-    {
-        return 1; /* not connected */
-    }
-
-    /* Non-blocking with timeout: never hang the firmware if host isn't reading. */
-    ULONG start = _ux_utility_time_get();
-    UINT retVal;
-
-    do
-    {
-        retVal = ux_device_class_cdc_acm_write_run(cdc_acm, buffer, size, sent);
-
-        if (retVal == UX_STATE_NEXT)
-        {
-            return 0; /* sent OK */
-        }
-
-        /* If class wants us to try again later, don't spin forever. */
-        if ((_ux_utility_time_get() - start) > 20U)
-        {
-            return 2; /* busy/timeout */
-        }
-
-    } while (retVal == UX_STATE_WAIT || retVal == UX_STATE_LOCK);
-
-    /* Any other code is treated as an error / not ready. */
-    return 2;
+  if (sent) *sent = 0;
+  uint32_t ret = USBD_CDC_ACM_TxSubmit(buffer, size, NULL);
+  if ((ret == 0U) && sent) *sent = size;
+  return ret;
 }
 
 uint32_t USBD_CDC_ACM_Receive(uint8_t* buffer, uint32_t size, uint32_t* received)
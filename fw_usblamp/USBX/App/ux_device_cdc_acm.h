@@ -36,12 +36,16 @@ extern "C" {
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
-
+/* Called once per queued buffer: status 0 = sent, else dropped (error or detach). */
+typedef void (*usbd_cdc_acm_tx_cb_t)(const uint8_t *buf, uint32_t len, uint32_t status);
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
 /* USER CODE BEGIN EC */
-
+/* TX descriptor queue depth (buffers handed to USBD_CDC_ACM_TxSubmit). */
+#ifndef USBD_CDC_ACM_TX_QUEUE
+#define USBD_CDC_ACM_TX_QUEUE 8U
+#endif
 /* USER CODE END EC */
 
 /* Exported macro ------------------------------------------------------------*/
@@ -55,6 +59,17 @@ VOID USBD_CDC_ACM_Deactivate(VOID *cdc_acm_instance);
 VOID USBD_CDC_ACM_ParameterChange(VOID *cdc_acm_instance);
 
 /* USER CODE BEGIN EFP */
+/*
+ * Non-blocking transmit. Buffers are queued by reference (not copied) and must stay
+ * untouched until their callback runs. USBD_CDC_ACM_TxTask() advances the transfer
+ * by one class step per call; nothing here waits for the host.
+ * Returns 0 = queued, 1 = not connected, 2 = queue full.
+ */
+uint32_t USBD_CDC_ACM_TxSubmit(const uint8_t* buffer, uint32_t size, usbd_cdc_acm_tx_cb_t done);
+void     USBD_CDC_ACM_TxTask(void);
+uint32_t USBD_CDC_ACM_TxPending(void);
+
+/* Queue one buffer without a callback (same rules as TxSubmit; *sent = size when queued). */
 uint32_t USBD_CDC_ACM_Transmit(uint8_t* buffer, uint32_t size, uint32_t* sent);
 uint32_t USBD_CDC_ACM_Receive(uint8_t* buffer, uint32_t size, uint32_t* received);
 /* USER CODE END EFP */
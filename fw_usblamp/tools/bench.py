@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+bench.py - run the lamp's BENCH TX / RX / ECHO commands and check them from the host.
+
+Protocol (usb_cli.h): TX sends n raw bytes, byte i = i & 0xFF; RX takes n such bytes
+after "ready"; ECHO sends frames {0xEC, seq, seq+2, ...} that the host writes back.
+Each run prints the device's result line next to the host's own measurement, so both
+ends of the link can be compared across firmware versions.
+
+  python3 bench.py /dev/ttyACM0 --tx 65536 --rx 65536 --echo 200 --size 16
+"""
+
+import argparse
+import time
+
+import lampcli
+
+ECHO_SYNC = 0xEC
+
+
+def result_line(ser, mode: str) -> str:
+    """Read up to the prompt and return the "BENCH <mode> ..." result line."""
+    out = lampcli.read_until(ser, lampcli.PROMPT, timeout=10.0).decode("ascii", "replace")
+    for ln in out.split("\r\n"):
+        if ln.startswith("BENCH " + mode):
+            return ln
+    raise SystemExit(f"no BENCH {mode} result in {out!r}")
+
+
+def read_line(ser, timeout: float = 2.0) -> bytes:
+    """One line, byte by byte, so none of the raw run data after it is consumed."""
+    buf = bytearray()
+    deadline = time.monotonic() + timeout
+    while not buf.endswith(b"\r\n"):
+        if time.monotonic() > deadline:
+            raise TimeoutError(f"no line end after {bytes(buf[-80:])!r}")
+        buf += ser.read(1)
+    return bytes(buf)
+
+
+def start(ser, line: str) -> str:
+    """Send a BENCH command; return the device's header line (the run starts after it)."""
+    ser.write(line.encode("ascii") + b"\r")
+    read_line(ser)     # echo of the typed line
+    head = read_line(ser).decode("ascii", "replace").strip()
+    if not head.startswith("BENCH"):
+        raise SystemExit(head)
+    return head
+
+
+def bench_tx(ser, n: int) -> None:
+    start(ser, f"BENCH TX {n}")
+    buf = bytearray()
+    t0 = None
+    deadline = time.monotonic() + 10.0
+    while len(buf) < n and time.monotonic() < deadline:
+        chunk = ser.read(min(n - len(buf), max(1, ser.in_waiting)))
+        if chunk and t0 is None:
+            t0 = time.perf_counter()
+        buf += chunk
+    dt = time.perf_counter() - t0 if t0 is not None else 0.0
+    errors = sum(1 for i, b in enumerate(buf) if b != (i & 0xFF))
+    print(result_line(ser, "TX"))
+    rate = len(buf) / dt if dt > 0 else 0.0
+    print(f"host TX bytes={len(buf)}/{n} ms={dt * 1000:.0f} rate={rate:.0f}B/s errors={errors}")
+
+
+def bench_rx(ser, n: int) -> None:
+    start(ser, f"BENCH RX {n}")
+    data = bytes(i & 0xFF for i in range(n))
+    t0 = time.perf_counter()
+    ser.write(data)
+    ser.flush()
+    dt = time.perf_counter() - t0
+    print(result_line(ser, "RX"))
+    print(f"host RX write ms={dt * 1000:.0f} rate={n / dt:.0f}B/s")
+
+
+def bench_echo(ser, count: int, size: int) -> None:
+    start(ser, f"BENCH ECHO {count} {size}")
+    buf = bytearray()
+    frames = 0
+    gaps = []
+    t_last = None
+    deadline = time.monotonic() + 5.0 + count * 0.1
+    while time.monotonic() < deadline:
+        buf += ser.read(max(1, ser.in_waiting))
+        while buf and buf[0] == ECHO_SYNC and len(buf) >= size:
+            ser.write(bytes(buf[:size]))
+            del buf[:size]
+            now = time.perf_counter()
+            if t_last is not None:
+                gaps.append((now - t_last) * 1e6)
+            t_last = now
+            frames += 1
+        if buf and buf[0] != ECHO_SYNC:
+            break   # the result line
+    rest = bytes(buf) + lampcli.read_until(ser, lampcli.PROMPT, timeout=10.0)
+    line = [ln for ln in rest.decode("ascii", "replace").split("\r\n") if ln.startswith("BENCH ECHO")]
+    print(line[0] if line else f"no BENCH ECHO result in {rest!r}")
+    gaps.sort()
+    if gaps:
+        pct = {p: gaps[min(len(gaps) - 1, len(gaps) * p // 100)] for p in (50, 90, 99)}
+        print(f"host ECHO frames={frames} frame-to-frame p50={pct[50]:.0f}us "
+              f"p90={pct[90]:.0f}us p99={pct[99]:.0f}us max={gaps[-1]:.0f}us")
+    else:
+        print(f"host ECHO frames={frames}")
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    lampcli.add_port_arg(ap)
+    ap.add_argument("--tx", type=int, default=65536, help="BENCH TX bytes (0 = skip)")
+    ap.add_argument("--rx", type=int, default=65536, help="BENCH RX bytes (0 = skip)")
+    ap.add_argument("--echo", type=int, default=100, help="BENCH ECHO frames (0 = skip)")
+    ap.add_argument("--size", type=int, default=16, help="BENCH ECHO frame size 2-64")
+    args = ap.parse_args()
+
+    ser = lampcli.open_port(args.port, timeout=0.05)
+    lampcli.sync(ser)
+    if args.tx:
+        bench_tx(ser, args.tx)
+    if args.rx:
+        bench_rx(ser, args.rx)
+    if args.echo:
+        bench_echo(ser, args.echo, args.size)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""
+cps_test.py - console output throughput (characters per second) and loss check.
+
+Runs a text-heavy CLI command (HELP by default) N times, times the bytes that come
+back and compares every reply with the first one, so bytes dropped by the device
+show up as short replies. Run it on the old and the new firmware to compare.
+TXSTAT counters are printed afterwards when the firmware has them.
+
+  python3 cps_test.py /dev/ttyACM0 -n 50
+"""
+
+import argparse
+import time
+
+import lampcli
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    lampcli.add_port_arg(ap)
+    ap.add_argument("-n", type=int, default=20, help="repetitions (default 20)")
+    ap.add_argument("--cmd", default="HELP", help="command to repeat (default HELP)")
+    args = ap.parse_args()
+
+    ser = lampcli.open_port(args.port)
+    lampcli.sync(ser)
+    has_txstat = not lampcli.command(ser, "TXSTAT RESET").startswith(b"ERR")
+
+    ref = None
+    total = 0
+    short = 0
+    t0 = time.perf_counter()
+    for _ in range(args.n):
+        out = lampcli.command(ser, args.cmd)
+        total += len(out)
+        if ref is None:
+            ref = out
+        elif out != ref:
+            short += 1
+    dt = time.perf_counter() - t0
+
+    print(f"{args.n} x {args.cmd}: {total} bytes in {dt:.3f} s = {total / dt:.0f} chars/s")
+    print(f"reply size {len(ref)} bytes, {short} of {args.n - 1} later replies differ")
+    if has_txstat:
+        print(lampcli.command(ser, "TXSTAT").decode("ascii", "replace").strip())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,56 @@
+"""
+lampcli.py - small helpers for host scripts that talk to the lamp's USB CLI.
+
+Needs pyserial (pip install pyserial). The CDC port ignores the baud rate.
+"""
+
+import argparse
+import time
+
+import serial
+
+PROMPT = b"\r\n> "
+
+
+def add_port_arg(ap: argparse.ArgumentParser) -> None:
+    ap.add_argument("port", help="CDC port, e.g. /dev/ttyACM0 or COM5")
+
+
+def open_port(port: str, timeout: float = 0.2) -> serial.Serial:
+    ser = serial.Serial(port, 115200, timeout=timeout)
+    ser.reset_input_buffer()
+    return ser
+
+
+def read_until(ser: serial.Serial, marker: bytes, timeout: float = 5.0) -> bytes:
+    """Read until `marker` arrives; raise TimeoutError with what came so far."""
+    buf = bytearray()
+    deadline = time.monotonic() + timeout
+    while not buf.endswith(marker):
+        chunk = ser.read(max(1, ser.in_waiting))
+        if chunk:
+            buf += chunk
+            deadline = time.monotonic() + timeout
+        elif time.monotonic() > deadline:
+            raise TimeoutError(f"no {marker!r} after {bytes(buf[-80:])!r}")
+    return bytes(buf)
+
+
+def sync(ser: serial.Serial) -> None:
+    """Get back to an idle CLI prompt (ends STREAM/BENCH, leaves PASCAL)."""
+    ser.write(b"\r")
+    time.sleep(0.2)
+    ser.write(b"QUIT\r")
+    time.sleep(0.2)
+    ser.reset_input_buffer()
+    ser.write(b"\r")
+    read_until(ser, PROMPT)
+
+
+def command(ser: serial.Serial, line: str, timeout: float = 5.0) -> bytes:
+    """Run one CLI command; return its output without the echo and the prompt."""
+    ser.write(line.encode("ascii") + b"\r")
+    out = read_until(ser, PROMPT, timeout)
+    out = out[: -len(PROMPT)]
+    echo = line.encode("ascii") + b"\r\n"
+    return out[len(echo):] if out.startswith(echo) else out
@@ -0,0 +1,190 @@
+/*
+ * mic_dsp_bench.c - host timing of the mic_dsp.c stages, per sample.
+ *
+ * Runs each block kernel over MIC_BENCH_BLOCK-sample blocks of realistic data (a PDM
+ * tone from a sigma-delta, and the PCM it decimates to) and prints the best of
+ * MIC_BENCH_REPS passes; MIC_DSP_RealFftPower is timed per frame for every supported
+ * size up to MIC_DSP_FFT_MAX. On x86 the unit is TSC ticks, elsewhere nanoseconds.
+ *
+ * Host numbers only rank the stages and compare versions: on the Cortex-M0+ every
+ * 64-bit multiply of the DF1 biquads is a library call, so build this with
+ * MIC_FIXED_POINT=0 as well (tools/Makefile does) and compare the ratio, not the
+ * absolute values.
+ */
+
+#include "mic_dsp.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT      "ticks"
+static uint64_t bench_now(void) { return __rdtsc(); }
+#else
+#define BENCH_UNIT      "ns"
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define MIC_BENCH_BLOCK     256u
+#define MIC_BENCH_REPS      2000u
+#define MIC_BENCH_DECIM     10u
+#define MIC_BENCH_FS_HZ     (3000000u / 16u / MIC_BENCH_DECIM)
+
+static uint16_t s_words[MIC_BENCH_BLOCK];
+static mic_sample_t s_pcm[MIC_BENCH_BLOCK];
+static mic_sample_t s_work[MIC_BENCH_BLOCK];
+
+/* Keeps the compiler from dropping the benchmarked work. */
+static volatile uint32_t s_sink;
+
+static void make_input(void)
+{
+    /* 2nd-order sigma-delta, 1 kHz at -20 dBFS; enough words for one PCM block. */
+    static uint16_t words[MIC_BENCH_BLOCK * MIC_BENCH_DECIM];
+    double i1 = 0.0, i2 = 0.0;
+    int y = 1;
+    uint64_t bit = 0;
+    for (uint32_t k = 0; k < MIC_BENCH_BLOCK * MIC_BENCH_DECIM; k++)
+    {
+        uint32_t w = 0;
+        for (uint32_t b = 0; b < 16u; b++, bit++)
+        {
+            double x = 0.1414 * sin(2.0 * M_PI * 1000.0 * (double)bit / 3000000.0);
+            i1 += x - y;
+            i2 += i1 - y;
+            y = (i2 >= 0.0) ? 1 : -1;
+            w = (w << 1) | (y > 0 ? 1u : 0u);
+        }
+        words[k] = (uint16_t)w;
+    }
+    memcpy(s_words, words, sizeof(s_words));
+
+    mic_cic_t cic;
+    MIC_DSP_CicInit(&cic, MIC_BENCH_DECIM, 2u);
+    uint32_t n = MIC_DSP_CicBlock(&cic, words, MIC_BENCH_BLOCK * MIC_BENCH_DECIM, s_pcm, NULL);
+    (void)n;
+}
+
+static void report(const char *stage, uint64_t best, const char *per)
+{
+    printf("  %-24s %8.2f %s/%s\n", stage, (double)best / MIC_BENCH_BLOCK, BENCH_UNIT, per);
+}
+
+static void bench_cic(void)
+{
+    mic_cic_t cic;
+    MIC_DSP_CicInit(&cic, MIC_BENCH_DECIM, 2u);
+    mic_word_stats_t st;
+    uint64_t best = UINT64_MAX;
+    for (uint32_t r = 0; r < MIC_BENCH_REPS; r++)
+    {
+        uint64_t t0 = bench_now();
+        s_sink += MIC_DSP_CicBlock(&cic, s_words, MIC_BENCH_BLOCK, s_work, &st);
+        uint64_t dt = bench_now() - t0;
+        if (dt < best) best = dt;
+    }
+    report("CicBlock (+stats)", best, "word");
+    printf("  %-24s %8.2f %s/sample (decim %u)\n", "", (double)best * MIC_BENCH_DECIM / MIC_BENCH_BLOCK,
+           BENCH_UNIT, (unsigned)MIC_BENCH_DECIM);
+}
+
+static void bench_biquads(void)
+{
+    mic_biquad_coef_t c;
+    mic_biquad_t q[4];
+    MIC_DSP_DesignHP(&c, 100u, MIC_BENCH_FS_HZ, 0.54119610f);
+    MIC_DSP_BiquadInit(&q[0], &c);
+    MIC_DSP_DesignHP(&c, 100u, MIC_BENCH_FS_HZ, 1.30656296f);
+    MIC_DSP_BiquadInit(&q[1], &c);
+    MIC_DSP_DesignLP(&c, 8000u, MIC_BENCH_FS_HZ, 0.54119610f);
+    MIC_DSP_BiquadInit(&q[2], &c);
+    MIC_DSP_DesignLP(&c, 8000u, MIC_BENCH_FS_HZ, 1.30656296f);
+    MIC_DSP_BiquadInit(&q[3], &c);
+
+    uint64_t best1 = UINT64_MAX, best4 = UINT64_MAX;
+    for (uint32_t r = 0; r < MIC_BENCH_REPS; r++)
+    {
+        memcpy(s_work, s_pcm, sizeof(s_work));
+        uint64_t t0 = bench_now();
+        MIC_DSP_BiquadBlock(&q[0], s_work, MIC_BENCH_BLOCK);
+        uint64_t dt = bench_now() - t0;
+        if (dt < best1) best1 = dt;
+
+        memcpy(s_work, s_pcm, sizeof(s_work));
+        t0 = bench_now();
+        for (uint32_t k = 0; k < 4u; k++) MIC_DSP_BiquadBlock(&q[k], s_work, MIC_BENCH_BLOCK);
+        dt = bench_now() - t0;
+        if (dt < best4) best4 = dt;
+    }
+    report("BiquadBlock (one)", best1, "sample");
+    report("band filter (4 biquads)", best4, "sample");
+}
+
+static void bench_energy(void)
+{
+    mic_energy_t e;
+    mic_energy_reset(&e);
+    uint64_t best = UINT64_MAX;
+    for (uint32_t r = 0; r < MIC_BENCH_REPS; r++)
+    {
+        uint64_t t0 = bench_now();
+        MIC_DSP_EnergyBlock(&e, s_pcm, MIC_BENCH_BLOCK);
+        uint64_t dt = bench_now() - t0;
+        if (dt < best) best = dt;
+    }
+    s_sink += e.n;
+    report("EnergyBlock", best, "sample");
+}
+
+static void bench_fft(void)
+{
+    static int16_t src[MIC_DSP_FFT_MAX];
+    static int16_t x[MIC_DSP_FFT_MAX];
+    static uint32_t power[MIC_DSP_FFT_MAX / 2u];
+
+    /* Q15 frames of the decimated tone, as mic.c hands them over. */
+    for (uint32_t i = 0; i < MIC_DSP_FFT_MAX; i++)
+    {
+        double v = (double)s_pcm[i % MIC_BENCH_BLOCK] / (double)MIC_SAMPLE_ONE;
+        src[i] = (int16_t)lrint(v * 32767.0);
+    }
+
+    for (uint32_t n = 64u; n <= MIC_DSP_FFT_MAX; n *= 2u)
+    {
+        if (!MIC_DSP_FftInit(n)) continue;
+        uint64_t best = UINT64_MAX;
+        for (uint32_t r = 0; r < MIC_BENCH_REPS; r++)
+        {
+            memcpy(x, src, n * sizeof(x[0]));
+            uint64_t t0 = bench_now();
+            s_sink += (uint32_t)MIC_DSP_RealFftPower(x, power);
+            uint64_t dt = bench_now() - t0;
+            if (dt < best) best = dt;
+        }
+        s_sink += power[1];
+        char stage[32];
+        snprintf(stage, sizeof(stage), "RealFftPower N=%u", (unsigned)n);
+        printf("  %-24s %8.0f %s/frame (%.2f /sample)\n", stage, (double)best, BENCH_UNIT,
+               (double)best / n);
+    }
+}
+
+int main(void)
+{
+    make_input();
+    printf("mic_dsp %s, block %u, best of %u:\n", MIC_FIXED_POINT ? "fixed point" : "float reference",
+           (unsigned)MIC_BENCH_BLOCK, (unsigned)MIC_BENCH_REPS);
+    bench_cic();
+    bench_biquads();
+    bench_energy();
+    bench_fft();
+    return 0;
+}
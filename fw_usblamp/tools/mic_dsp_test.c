@@ -0,0 +1,396 @@
+/*
+ * mic_dsp_test.c - host check of the mic_dsp.c fixed-point path against the float reference.
+ *
+ * Built twice by tools/Makefile: with MIC_FIXED_POINT=0 it prints one "<case> <dBFS*100>"
+ * line per test case (the reference); with MIC_FIXED_POINT=1 it runs the same cases,
+ * reads the reference file given on the command line and fails when any level differs by
+ * more than MIC_TEST_TOL_X100.
+ *
+ * Cases run the chain of mic.c: PCM tones through the 4th-order band filters into the
+ * window energy, and PDM tones (2nd-order sigma-delta at the SPI bit rate) through
+ * MIC_DSP_CicBlock first.
+ *
+ * Both builds also check MIC_DSP_CicBlock (and the tables of pdm_lut_build) sample by
+ * sample against a direct evaluation: the 46-tap sinc^3 FIR over the bit stream and a
+ * CIC in 64-bit integers, scaled by 1/full. Stimuli are sigma-delta tones, random words
+ * and full-scale runs.
+ */
+
+#include "mic_dsp.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIC_TEST_TOL_X100   10          /* 0.1 dB */
+#define MIC_TEST_BIT_HZ     3000000u    /* PDM bit clock (SPI SCK) */
+#define MIC_TEST_BAND_HP_HZ 100u        /* mic.h MIC_BAND_HP_HZ / MIC_BAND_LP_HZ */
+#define MIC_TEST_BAND_LP_HZ 8000u
+#define MIC_TEST_SETTLE_MS  200u
+#define MIC_TEST_WINDOW_MS  50u
+#define MIC_TEST_WORDS      256u
+#define MIC_TEST_CASES      64u
+
+typedef struct
+{
+    char    name[32];
+    int32_t db_x100;
+} test_result_t;
+
+static test_result_t s_res[MIC_TEST_CASES];
+static uint32_t s_res_n;
+
+typedef struct
+{
+    mic_biquad_t hp[2];
+    mic_biquad_t lp[2];
+} band_t;
+
+static void band_init(band_t *b, uint32_t fs_hz)
+{
+    /* mic_update_rates(): 4th-order Butterworth as two biquads, LP capped below Nyquist. */
+    const float q1 = 0.54119610f;
+    const float q2 = 1.30656296f;
+    uint32_t lp_hz = MIC_TEST_BAND_LP_HZ;
+    if (lp_hz > fs_hz * 45u / 100u) lp_hz = fs_hz * 45u / 100u;
+
+    mic_biquad_coef_t c;
+    MIC_DSP_DesignHP(&c, MIC_TEST_BAND_HP_HZ, fs_hz, q1);
+    MIC_DSP_BiquadInit(&b->hp[0], &c);
+    MIC_DSP_DesignHP(&c, MIC_TEST_BAND_HP_HZ, fs_hz, q2);
+    MIC_DSP_BiquadInit(&b->hp[1], &c);
+    MIC_DSP_DesignLP(&c, lp_hz, fs_hz, q1);
+    MIC_DSP_BiquadInit(&b->lp[0], &c);
+    MIC_DSP_DesignLP(&c, lp_hz, fs_hz, q2);
+    MIC_DSP_BiquadInit(&b->lp[1], &c);
+}
+
+static void band_block(band_t *b, mic_sample_t *buf, uint32_t n)
+{
+    MIC_DSP_BiquadBlock(&b->hp[0], buf, n);
+    MIC_DSP_BiquadBlock(&b->hp[1], buf, n);
+    MIC_DSP_BiquadBlock(&b->lp[0], buf, n);
+    MIC_DSP_BiquadBlock(&b->lp[1], buf, n);
+}
+
+static mic_sample_t to_sample(double v)
+{
+#if MIC_FIXED_POINT
+    return (mic_sample_t)lrint(v * (double)MIC_SAMPLE_ONE);
+#else
+    return (mic_sample_t)v;
+#endif
+}
+
+static void result(const char *name, int32_t db_x100)
+{
+    if (s_res_n >= MIC_TEST_CASES) return;
+    snprintf(s_res[s_res_n].name, sizeof(s_res[0].name), "%s", name);
+    s_res[s_res_n].db_x100 = db_x100;
+    s_res_n++;
+}
+
+/* Band-filtered level of a PCM tone, measured over one window after the filters settle. */
+static void pcm_tone(uint32_t fs_hz, double f_hz, double dbfs)
+{
+    band_t band;
+    band_init(&band, fs_hz);
+    mic_energy_t e;
+    mic_energy_reset(&e);
+
+    double amp = pow(10.0, dbfs / 20.0) * sqrt(2.0);
+    uint32_t settle = fs_hz * MIC_TEST_SETTLE_MS / 1000u;
+    uint32_t total = settle + fs_hz * MIC_TEST_WINDOW_MS / 1000u;
+    mic_sample_t buf[MIC_TEST_WORDS];
+    for (uint32_t t = 0; t < total; t += MIC_TEST_WORDS)
+    {
+        uint32_t n = total - t;
+        if (n > MIC_TEST_WORDS) n = MIC_TEST_WORDS;
+        for (uint32_t i = 0; i < n; i++)
+            buf[i] = to_sample(amp * sin(2.0 * M_PI * f_hz * (double)(t + i) / fs_hz + 0.3));
+        band_block(&band, buf, n);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (t + i >= settle) MIC_DSP_EnergyBlock(&e, &buf[i], 1u);
+        }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "pcm_%u_%.0f_%.0f", (unsigned)fs_hz, f_hz, dbfs);
+    result(name, MIC_DSP_EnergyDbX100(&e));
+}
+
+/* 2nd-order sigma-delta modulator, MSB first, 1 = positive. */
+typedef struct
+{
+    double i1, i2;
+    int    y;
+    uint64_t bit;
+} sdm_t;
+
+static uint16_t sdm_word(sdm_t *m, double amp, double f_hz)
+{
+    uint32_t w = 0;
+    for (uint32_t b = 0; b < 16u; b++, m->bit++)
+    {
+        double x = amp * sin(2.0 * M_PI * f_hz * (double)m->bit / MIC_TEST_BIT_HZ);
+        m->i1 += x - m->y;
+        m->i2 += m->i1 - m->y;
+        m->y = (m->i2 >= 0.0) ? 1 : -1;
+        w = (w << 1) | (m->y > 0 ? 1u : 0u);
+    }
+    return (uint16_t)w;
+}
+
+/* Level of a PDM tone after CIC, band filters and window energy (the MIC() path). */
+static void pdm_tone(uint32_t decim, double f_hz, double dbfs)
+{
+    uint32_t fs_hz = MIC_TEST_BIT_HZ / 16u / decim;
+    mic_cic_t cic;
+    MIC_DSP_CicInit(&cic, decim, 2u);
+    band_t band;
+    band_init(&band, fs_hz);
+    mic_energy_t e;
+    mic_energy_reset(&e);
+    sdm_t m;
+    memset(&m, 0, sizeof(m));
+    m.y = 1;
+
+    double amp = pow(10.0, dbfs / 20.0) * sqrt(2.0);
+    uint32_t settle = fs_hz * MIC_TEST_SETTLE_MS / 1000u;
+    uint32_t total = settle + fs_hz * MIC_TEST_WINDOW_MS / 1000u;
+    uint32_t done = 0;
+    uint16_t words[MIC_TEST_WORDS];
+    mic_sample_t pcm[MIC_TEST_WORDS];
+    while (done < total)
+    {
+        for (uint32_t i = 0; i < MIC_TEST_WORDS; i++) words[i] = sdm_word(&m, amp, f_hz);
+        uint32_t n = MIC_DSP_CicBlock(&cic, words, MIC_TEST_WORDS, pcm, NULL);
+        band_block(&band, pcm, n);
+        for (uint32_t i = 0; i < n && done < total; i++, done++)
+        {
+            if (done >= settle) MIC_DSP_EnergyBlock(&e, &pcm[i], 1u);
+        }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "pdm_d%u_%.0f_%.0f", (unsigned)decim, f_hz, dbfs);
+    result(name, MIC_DSP_EnergyDbX100(&e));
+}
+
+#if MIC_PDM_LUT
+
+#define CIC_REF_TAPS    46u
+#define CIC_REF_WORDS   4096u
+
+/* box16 * box16 * box16, built by convolution (pdm_lut_build uses a closed form). */
+static void cic_ref_kernel(int32_t *h)
+{
+    int32_t a[CIC_REF_TAPS] = {0};
+    int32_t b[CIC_REF_TAPS] = {0};
+    for (uint32_t i = 0; i < 16u; i++) a[i] = 1;
+    for (uint32_t pass = 0; pass < 2u; pass++)
+    {
+        memset(b, 0, sizeof(b));
+        for (uint32_t i = 0; i < CIC_REF_TAPS; i++)
+        {
+            for (uint32_t j = 0; j < 16u && j <= i; j++) b[i] += a[i - j];
+        }
+        memcpy(a, b, sizeof(a));
+    }
+    memcpy(h, a, sizeof(a));
+}
+
+/* Largest |y - ref| of one stimulus, in units of the sample LSB (2^-23 of full scale). */
+static double cic_ref_check(const uint16_t *words, uint32_t n, uint32_t decim)
+{
+    static mic_sample_t out[CIC_REF_WORDS];
+    mic_cic_t cic;
+    MIC_DSP_CicInit(&cic, decim, 2u);
+    /* Feed in uneven blocks so state carried across calls is covered too. */
+    uint32_t m = 0;
+    for (uint32_t k = 0, step = 1u; k < n; step = step * 3u % 97u + 1u)
+    {
+        uint32_t len = (n - k < step) ? n - k : step;
+        m += MIC_DSP_CicBlock(&cic, &words[k], len, &out[m], NULL);
+        k += len;
+    }
+
+    int32_t h[CIC_REF_TAPS];
+    cic_ref_kernel(h);
+    const double full = 4096.0 * decim * decim * decim;
+    int64_t i1 = 0, i2 = 0, i3 = 0, d1 = 0, d2 = 0, d3 = 0;
+    uint32_t j = 0;
+    double worst = 0.0;
+    for (uint32_t k = 0; k < n; k++)
+    {
+        /* 48-bit window ending with word k, oldest bit first; words before 0 are the
+         * 0xAAAA idle pattern MIC_DSP_CicReset starts from.
+         * Window bit p carries tap p-1 (taps 1..46 of the 48). */
+        int64_t x = 0;
+        for (uint32_t p = 1; p <= CIC_REF_TAPS; p++)
+        {
+            int32_t wi = (int32_t)k - 2 + (int32_t)(p / 16u);
+            uint32_t w = (wi < 0) ? 0xAAAAu : words[wi];
+            int32_t bit = ((w >> (15u - p % 16u)) & 1u) ? 1 : -1;
+            x += (int64_t)bit * h[p - 1u];
+        }
+        i1 += x;
+        i2 += i1;
+        i3 += i2;
+        if ((k + 1u) % decim != 0u) continue;
+        int64_t c1 = i3 - d1; d1 = i3;
+        int64_t c2 = c1 - d2; d2 = c1;
+        int64_t c3 = c2 - d3; d3 = c2;
+
+        double ref = (double)c3 / full;
+        if (ref > 1.0) ref = 1.0;
+        if (ref < -1.0) ref = -1.0;
+        double got = (double)out[j++] / (double)MIC_SAMPLE_ONE;
+        double d = fabs(got - ref) * 8388608.0;
+        if (d > worst) worst = d;
+    }
+    if (j != m) return 1e30;
+    return worst;
+}
+
+/* Returns the number of failed stimuli. */
+static uint32_t cic_check(void)
+{
+    static uint16_t words[CIC_REF_WORDS];
+    uint32_t bad = 0;
+    for (uint32_t decim = 4u; decim <= 32u; decim++)
+    {
+        const double tol = 2.0;
+        for (uint32_t kind = 0; kind < 3u; kind++)
+        {
+            sdm_t m;
+            memset(&m, 0, sizeof(m));
+            m.y = 1;
+            uint32_t seed = 12345u + decim;
+            for (uint32_t k = 0; k < CIC_REF_WORDS; k++)
+            {
+                if (kind == 0u)
+                {
+                    words[k] = sdm_word(&m, 0.5, 1000.0 + 300.0 * decim);
+                }
+                else if (kind == 1u)
+                {
+                    seed = seed * 1103515245u + 12345u;
+                    words[k] = (uint16_t)(seed >> 12);
+                }
+                else
+                {
+                    words[k] = ((k / 300u) & 1u) ? 0xFFFFu : 0x0000u;
+                }
+            }
+            double worst = cic_ref_check(words, CIC_REF_WORDS, decim);
+            if (worst > tol)
+            {
+                fprintf(stderr, "FAIL cic decim %u stimulus %u: off by %.1f LSB (limit %.1f)\n",
+                        (unsigned)decim, (unsigned)kind, worst, tol);
+                bad++;
+            }
+        }
+    }
+    return bad;
+}
+
+#else
+
+static uint32_t cic_check(void)
+{
+    return 0u;  /* the reference covers the lookup-table front end only */
+}
+
+#endif /* MIC_PDM_LUT */
+
+static void run_cases(void)
+{
+    static const double freqs[] = { 200.0, 1000.0, 4000.0 };
+    static const double levels[] = { -3.0, -20.0, -40.0, -60.0 };
+    for (uint32_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++)
+    {
+        for (uint32_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+            pcm_tone(18750u, freqs[f], levels[l]);
+    }
+
+    static const double pdm_levels[] = { -6.0, -20.0, -40.0 };
+    for (uint32_t l = 0; l < sizeof(pdm_levels) / sizeof(pdm_levels[0]); l++)
+        pdm_tone(10u, 1000.0, pdm_levels[l]);
+    /* MIC_Configure accepts any decim in MIC_DECIM_MIN..MIC_DECIM_MAX. */
+    for (uint32_t decim = 4u; decim <= 32u; decim++)
+    {
+        if (decim != 10u) pdm_tone(decim, 1000.0, -20.0);
+    }
+}
+
+#if MIC_FIXED_POINT
+
+static int compare(const char *ref_path)
+{
+    FILE *f = fopen(ref_path, "r");
+    if (f == NULL)
+    {
+        perror(ref_path);
+        return 2;
+    }
+
+    char name[32];
+    long ref;
+    uint32_t checked = 0, bad = 0;
+    int32_t worst = 0;
+    while (fscanf(f, "%31s %ld", name, &ref) == 2)
+    {
+        for (uint32_t i = 0; i < s_res_n; i++)
+        {
+            if (strcmp(name, s_res[i].name) != 0) continue;
+            int32_t d = s_res[i].db_x100 - (int32_t)ref;
+            int32_t a = (d < 0) ? -d : d;
+            if (a > worst) worst = a;
+            if (a > MIC_TEST_TOL_X100)
+            {
+                printf("FAIL %-20s float %7.2f fixed %7.2f dB\n", name, ref / 100.0, s_res[i].db_x100 / 100.0);
+                bad++;
+            }
+            checked++;
+        }
+    }
+    fclose(f);
+
+    if (checked != s_res_n)
+    {
+        printf("FAIL reference has %u of %u cases\n", (unsigned)checked, (unsigned)s_res_n);
+        return 1;
+    }
+    printf("%s: %u cases, worst fixed-float difference %.2f dB (limit %.2f)\n",
+           bad ? "FAIL" : "PASS", (unsigned)checked, worst / 100.0, MIC_TEST_TOL_X100 / 100.0);
+    return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "use: %s <reference output>\n", argv[0]);
+        return 2;
+    }
+    run_cases();
+    int rc = compare(argv[1]);
+    uint32_t bad = cic_check();
+    printf("%s: CicBlock against the direct sinc^3 FIR + CIC, %u failures\n", bad ? "FAIL" : "PASS", (unsigned)bad);
+    return (rc != 0) ? rc : (bad ? 1 : 0);
+}
+
+#else
+
+int main(void)
+{
+    if (cic_check() != 0u) return 1;
+    run_cases();
+    for (uint32_t i = 0; i < s_res_n; i++) printf("%s %ld\n", s_res[i].name, (long)s_res[i].db_x100);
+    return 0;
+}
+
+#endif
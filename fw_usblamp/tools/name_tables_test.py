@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+name_tables_test.py - check the hand-written name hash tables in the firmware sources.
+
+s_cmds[] (usb_cli.c) and g_builtins[] (MiniPascal.c) are searched by binary search on
+mp_name_hash(name), so every row must carry the right hash and the rows must be sorted
+by it; a wrong hash or a misplaced row makes that name silently unreachable. Run by
+`make test`; prints the rows to fix and exits 1 on any error.
+
+  python3 name_tables_test.py
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+TABLES = [  # (file, start of the table definition)
+    ("Core/Src/usb_cli.c", "static const cli_cmd_t s_cmds[] ="),
+    ("Drivers/Project_drv/MiniPascal.c", "static const mp_builtin_t g_builtins[] ="),
+]
+ROW = re.compile(r'^\s*\{\s*"([^"]*)",\s*0x([0-9A-Fa-f]{1,4})u,')
+
+
+def name_hash(name: str) -> int:
+    """mp_name_hash(): case-insensitive FNV-1a 32, folded to 16 bits (MiniPascal.c)."""
+    h = 2166136261
+    for c in name.lower().encode("ascii"):
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return (h ^ (h >> 16)) & 0xFFFF
+
+
+def table_rows(path: str, start: str):
+    """(line number, text) of every row between the definition and its closing "};"."""
+    with open(os.path.join(ROOT, path), encoding="utf-8", errors="replace") as f:
+        lines = f.read().split("\n")
+    first = next((i for i, ln in enumerate(lines) if ln.startswith(start)), None)
+    if first is None:
+        return None
+    rows = []
+    for i in range(first + 1, len(lines)):
+        if lines[i].startswith("};"):
+            return rows
+        if lines[i].lstrip().startswith("{ "):
+            rows.append((i + 1, lines[i]))
+    return None
+
+
+def check(path: str, start: str) -> int:
+    rows = table_rows(path, start)
+    if not rows:
+        print(f"FAIL {path}: no rows found after '{start}'")
+        return 1
+    bad = 0
+    names = set()
+    prev = -1
+    for line_no, text in rows:
+        m = ROW.match(text)
+        where = f"{path}:{line_no}"
+        if not m:
+            print(f"FAIL {where}: row not in the {{ \"name\", 0xHHHHu, ... }} form")
+            bad += 1
+            continue
+        name, stored = m.group(1), int(m.group(2), 16)
+        want = name_hash(name)
+        if stored != want:
+            print(f"FAIL {where}: \"{name}\" has hash 0x{stored:04X}u, mp_name_hash gives 0x{want:04X}u")
+            bad += 1
+        if name != name.lower():
+            print(f"FAIL {where}: \"{name}\" is not lower case")
+            bad += 1
+        if name in names:
+            print(f"FAIL {where}: \"{name}\" appears twice")
+            bad += 1
+        names.add(name)
+        if stored < prev:
+            print(f"FAIL {where}: \"{name}\" (0x{stored:04X}u) is out of hash order")
+            bad += 1
+        prev = stored
+    print(f"{'FAIL' if bad else 'PASS'}: {path} {len(rows)} rows, {bad} errors")
+    return bad
+
+
+def main() -> None:
+    bad = sum(check(path, start) for path, start in TABLES)
+    sys.exit(1 if bad else 0)
+
+
+if __name__ == "__main__":
+    main()
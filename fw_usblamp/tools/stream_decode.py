@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""
+stream_decode.py - start STREAM on the lamp and decode its binary telemetry frames.
+
+Frame layout (usb_cli.h), little-endian:
+  0xA5 0x5A | len u8 | mask u8 | seq u16 | t_ms u32 | fields | crc u16
+crc = low 16 bits of zlib CRC-32 over len..last field. Fields in mask bit order:
+  MIC dBFS*100 i16 | FFT LF, MF, HF dBFS*100 i16 x3 | LIGHT lux u16 | BAT mV u16, VCC mV u16
+-32768 means "no data yet". A gap in seq is a frame the device could not send.
+
+Prints one CSV row per frame (stdout or --csv file) and a summary at the end; stop with
+Ctrl+C or --seconds.
+
+  python3 stream_decode.py /dev/ttyACM0 --mask 15 --hz 50 --seconds 10 --csv log.csv
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import lampcli
+
+SYNC = b"\xA5\x5A"
+NO_DATA = -32768
+FIELDS = [  # (mask bit, struct format, column names, scale)
+    (0x01, "<h", ["mic_dbfs"], 0.01),
+    (0x02, "<hhh", ["lf_dbfs", "mf_dbfs", "hf_dbfs"], 0.01),
+    (0x04, "<H", ["lux"], 1.0),
+    (0x08, "<HH", ["bat_v", "vcc_v"], 0.001),
+]
+
+
+def columns(mask: int) -> list[str]:
+    cols = ["seq", "t_ms"]
+    for bit, _, names, _ in FIELDS:
+        if mask & bit:
+            cols += names
+    return cols
+
+
+def decode_payload(payload: bytes):
+    """payload = mask..last field. Returns (mask, seq, t_ms, values) or None if malformed."""
+    if len(payload) < 7:
+        return None
+    mask, seq, t_ms = struct.unpack_from("<BHI", payload, 0)
+    off = 7
+    values = []
+    for bit, fmt, _, scale in FIELDS:
+        if not mask & bit:
+            continue
+        if off + struct.calcsize(fmt) > len(payload):
+            return None
+        for v in struct.unpack_from(fmt, payload, off):
+            values.append(None if (fmt[1] == "h" and v == NO_DATA) else v * scale)
+        off += struct.calcsize(fmt)
+    if off != len(payload):
+        return None
+    return mask, seq, t_ms, values
+
+
+class Decoder:
+    """Finds frames in a byte stream, checks CRC and counts sequence gaps."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.frames = 0
+        self.lost = 0
+        self.crc_errors = 0
+        self.last_seq = None
+
+    def feed(self, data: bytes):
+        self.buf += data
+        while True:
+            i = self.buf.find(SYNC)
+            if i < 0:
+                del self.buf[:-1]
+                return
+            del self.buf[:i]
+            if len(self.buf) < 3:
+                return
+            n = self.buf[2]
+            total = 3 + n + 2
+            if len(self.buf) < total:
+                return
+            body = bytes(self.buf[2:3 + n])
+            (crc,) = struct.unpack_from("<H", self.buf, 3 + n)
+            frame = decode_payload(body[1:]) if (zlib.crc32(body) & 0xFFFF) == crc else None
+            if frame is None:
+                self.crc_errors += 1
+                del self.buf[:2]  # resync on the next marker
+                continue
+            del self.buf[:total]
+            seq = frame[1]
+            if self.last_seq is not None:
+                self.lost += (seq - self.last_seq - 1) & 0xFFFF
+            self.last_seq = seq
+            self.frames += 1
+            yield frame
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    lampcli.add_port_arg(ap)
+    ap.add_argument("--mask", type=lambda s: int(s, 0), default=0x0F, help="1=MIC 2=FFT 4=LIGHT 8=BAT (default 15)")
+    ap.add_argument("--hz", type=int, default=20, help="frame rate 1-50 (default 20)")
+    ap.add_argument("--seconds", type=float, default=0.0, help="stop after this long (default: Ctrl+C)")
+    ap.add_argument("--csv", help="write rows here instead of stdout")
+    args = ap.parse_args()
+
+    out = open(args.csv, "w", encoding="ascii") if args.csv else sys.stdout
+    ser = lampcli.open_port(args.port, timeout=0.05)
+    lampcli.sync(ser)
+    ser.write(f"STREAM {args.mask} {args.hz}\r".encode("ascii"))
+    head = bytearray()
+    deadline = time.monotonic() + 2.0
+    while b"stops)\r\n" not in head:
+        head += ser.read(max(1, ser.in_waiting))
+        if b"ERR" in head or time.monotonic() > deadline:
+            raise SystemExit(bytes(head).decode("ascii", "replace").strip() or "no reply")
+    first = bytes(head[head.index(b"stops)\r\n") + 8:])  # frames may follow at once
+
+    dec = Decoder()
+    print(",".join(columns(args.mask)), file=out)
+    t_end = time.monotonic() + args.seconds if args.seconds > 0 else None
+    try:
+        while t_end is None or time.monotonic() < t_end:
+            data, first = first + ser.read(max(1, ser.in_waiting)), b""
+            for mask, seq, t_ms, values in dec.feed(data):
+                cells = [str(seq), str(t_ms)] + ["" if v is None else f"{v:g}" for v in values]
+                print(",".join(cells), file=out)
+    except KeyboardInterrupt:
+        pass
+
+    ser.write(b"\r")
+    tail = lampcli.read_until(ser, lampcli.PROMPT, timeout=2.0)
+    for frame in dec.feed(tail):  # frames that were still in flight
+        pass
+    i = tail.find(b"STREAM OFF")
+    device = tail[i:].split(b"\r\n")[0].decode("ascii", "replace") if i >= 0 else "no STREAM OFF line"
+    if out is not sys.stdout:
+        out.close()
+    print(f"host: frames={dec.frames} lost={dec.lost} crc_errors={dec.crc_errors}", file=sys.stderr)
+    print(f"device: {device}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
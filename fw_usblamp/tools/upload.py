@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+upload.py - push a MiniPascal program with UPLOAD and compare it with a line-by-line paste.
+
+The program file holds "<no> <text>" lines; unnumbered files are numbered 10, 20, ...
+Without a file a 70-line demo program is sent. The whole program goes out in one write
+after the device answers READY; the device reports its own time and rate, the script
+checks the result with LIST. --paste also types the same program line by line (each
+line waits for its echo and prompt, like a careful terminal paste) for comparison.
+
+  python3 upload.py /dev/ttyACM0 prog.pas --slot 2 --paste
+"""
+
+import argparse
+import re
+import time
+import zlib
+
+import lampcli
+
+
+def demo_program() -> list[str]:
+    lines = [f"{10 * (i + 1)} led({i % 12 + 1},{(i * 37) % 256},{(i * 91) % 256},{(i * 53) % 256},0)"
+             for i in range(69)]
+    return lines + ["700 end"]
+
+
+def load_program(path: str) -> list[str]:
+    with open(path, encoding="ascii") as f:
+        lines = [ln.rstrip() for ln in f if ln.strip()]
+    if all(re.match(r"\d+\s", ln) for ln in lines):
+        return lines
+    return [f"{10 * (i + 1)} {ln.strip()}" for i, ln in enumerate(lines)]
+
+
+def normalize(lines: list[str]) -> list[str]:
+    return [re.sub(r"^(\d+)\s+", r"\1 ", ln) for ln in lines]
+
+
+def upload(ser, lines: list[str], slot: int) -> float:
+    data = ("\n".join(lines) + "\n").encode("ascii")
+    crc = zlib.crc32(data) & 0xFFFFFFFF
+    ser.write(f"UPLOAD {slot} {len(data)} {crc:08X}\r".encode("ascii"))
+    lampcli.read_until(ser, b"READY\r\n")
+    t0 = time.perf_counter()
+    ser.write(data)
+    out = lampcli.read_until(ser, lampcli.PROMPT, timeout=10.0)
+    dt = time.perf_counter() - t0
+    text = out.decode("ascii", "replace")
+    print(text[: -len(lampcli.PROMPT)].strip())
+    if "UPLOAD OK" not in text:
+        raise SystemExit("upload failed")
+    return dt
+
+
+def paste(ser, lines: list[str]) -> float:
+    lampcli.command(ser, "NEW")
+    t0 = time.perf_counter()
+    for ln in lines:
+        lampcli.command(ser, ln)
+    return time.perf_counter() - t0
+
+
+def listing(ser) -> list[str]:
+    out = lampcli.command(ser, "LIST", timeout=10.0).decode("ascii", "replace")
+    return [ln for ln in out.split("\r\n") if ln]
+
+
+def main() -> None:
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    lampcli.add_port_arg(ap)
+    ap.add_argument("file", nargs="?", help="program text (default: 70-line demo)")
+    ap.add_argument("--slot", type=int, default=0, help="0 = editor only, 1-6 = also compile + SAVE")
+    ap.add_argument("--paste", action="store_true", help="also time a line-by-line paste")
+    args = ap.parse_args()
+
+    lines = load_program(args.file) if args.file else demo_program()
+    size = sum(len(ln) + 1 for ln in lines)
+
+    ser = lampcli.open_port(args.port)
+    lampcli.sync(ser)
+    ser.write(b"PASCAL\r")
+    lampcli.read_until(ser, lampcli.PROMPT)
+
+    try:
+        results = []
+        if args.paste:
+            dt = paste(ser, lines)
+            ok = listing(ser) == normalize(lines)
+            results.append(("paste", dt, ok))
+        dt = upload(ser, lines, args.slot)
+        ok = listing(ser) == normalize(lines)
+        results.append(("UPLOAD", dt, ok))
+    finally:
+        ser.write(b"QUIT\r")
+
+    print(f"{len(lines)} lines, {size} bytes")
+    for name, dt, ok in results:
+        print(f"{name:7s} {dt * 1000:8.1f} ms  {size / dt:8.0f} B/s  LIST {'matches' if ok else 'DIFFERS'}")
+    if len(results) == 2:
+        print(f"UPLOAD is {results[0][1] / results[1][1]:.1f}x faster than paste")
+
+
+if __name__ == "__main__":
+    main()